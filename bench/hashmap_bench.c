@@ -0,0 +1,114 @@
+#include "microbench.h"
+#include <dht/hash.h>
+#include <dht/random.h>
+#include <lcthw/hashmap.h>
+
+/* Keys of random ids, as in the maps of the routing table and the
+ * peer store, set again in a new map every BENCH_KEYS operations. */
+#define BENCH_KEYS 4096
+
+struct Maps {
+    Hash keys[BENCH_KEYS];
+    Hashmap *map;               /* Of all the keys */
+};
+
+Hashmap *CreateMap()
+{
+    return Hashmap_create((Hashmap_compare)Distance_Compare,
+                          (Hashmap_hash)Hash_Hash);
+}
+
+int Bench_Set(struct Maps *maps, long n)
+{
+    Hashmap *map = NULL;
+
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (i % BENCH_KEYS == 0)
+        {
+            Hashmap_destroy(map);
+            map = CreateMap();
+            check(map != NULL, "Hashmap_create failed");
+        }
+
+        Hash *key = &maps->keys[i % BENCH_KEYS];
+
+        int rc = Hashmap_set(map, key, key);
+        check(rc == 0, "Hashmap_set failed");
+    }
+
+    Hashmap_destroy(map);
+
+    return 0;
+error:
+    Hashmap_destroy(map);
+    return -1;
+}
+
+int Bench_Get(struct Maps *maps, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        Hash *key = &maps->keys[i % BENCH_KEYS];
+        check(Hashmap_get(maps->map, key) == key, "Hashmap_get failed");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Bench_GetMissing(struct Maps *maps, long n)
+{
+    Hash missing = { "missing" };
+
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        missing.value[0] = i;
+        check(Hashmap_get(maps->map, &missing) == NULL, "Hashmap_get found it");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+char *all_benches()
+{
+    bench_start();
+
+    RandomState *random = RandomState_Create(1);
+    check(random != NULL, "RandomState_Create failed");
+
+    struct Maps *maps = calloc(1, sizeof(struct Maps));
+    check_mem(maps);
+
+    maps->map = CreateMap();
+    check(maps->map != NULL, "Hashmap_create failed");
+
+    int i = 0;
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        Random_Fill(random, maps->keys[i].value, HASH_BYTES);
+
+        int rc = Hashmap_set(maps->map, &maps->keys[i], &maps->keys[i]);
+        check(rc == 0, "Hashmap_set failed");
+    }
+
+    bench_run("Hashmap_set", (Bench_fp)Bench_Set, maps);
+    bench_run("Hashmap_get", (Bench_fp)Bench_Get, maps);
+    bench_run("Hashmap_get/missing", (Bench_fp)Bench_GetMissing, maps);
+
+    Hashmap_destroy(maps->map);
+    free(maps);
+    RandomState_Destroy(random);
+
+    return NULL;
+error:
+    return "Setup failed";
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,136 @@
+#undef NDEBUG
+#ifndef _microbench_h
+#define _microbench_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <lcthw/dbg.h>
+
+/* Nanoseconds of CPU time a measured round takes at least. The
+ * iterations per round are doubled until one does, which also warms
+ * up. CPU time leaves out the time other processes run. */
+#define BENCH_ROUND_NS 50000000LL
+/* Measured rounds. ns/op is of the fastest, the least disturbed by
+ * the rest of the machine, which repeats best from run to run. */
+#define BENCH_ROUNDS 7
+
+/* Runs n operations on context.
+ * Returns 0 on success, -1 on failure. */
+typedef int (*Bench_fp)(void *context, long n);
+
+/* Each benchmark prints a line of tab separated fields to stdout:
+ * name, ns/op, allocs/op, bytes allocated/op, iterations measured.
+ * The spread of the rounds goes to stderr. */
+
+#define bench_start() char *message = NULL
+
+#define bench_run(name, fun, context) \
+    message = Bench_Measure((name), (fun), (context)); \
+    benches_run++; if (message) return message;
+
+#define RUN_BENCHES(name) int main(int argc, char *argv[]) {\
+    (void)(argc);\
+    printf("# %s\n", argv[0]);\
+    char *result = name();\
+    if (result != 0) {\
+        fprintf(stderr, "FAILED: %s\n", result);\
+    }\
+    exit(result != 0);\
+}
+
+int benches_run;
+
+unsigned long bench_allocs;
+unsigned long long bench_bytes;
+
+/* Linked with --wrap for each, so that the calls of the library are
+ * counted too */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    bench_allocs++;
+    bench_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    bench_allocs++;
+    bench_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    bench_allocs++;
+    bench_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+int64_t Bench_Ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int Bench_CompareNs(const void *a, const void *b)
+{
+    double x = *(double *)a, y = *(double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+char *Bench_Measure(const char *name, Bench_fp fun, void *context)
+{
+    long n = 1;
+    int64_t start = 0;
+    int64_t elapsed = 0;
+
+    do
+    {
+        n *= 2;
+        start = Bench_Ns();
+        check(fun(context, n) == 0, "%s failed", name);
+        elapsed = Bench_Ns() - start;
+    } while (elapsed < BENCH_ROUND_NS);
+
+    unsigned long allocs = bench_allocs;
+    unsigned long long bytes = bench_bytes;
+    double ns[BENCH_ROUNDS];
+
+    int i = 0;
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        start = Bench_Ns();
+        check(fun(context, n) == 0, "%s failed", name);
+        ns[i] = (double)(Bench_Ns() - start) / n;
+    }
+
+    double ops = (double)n * BENCH_ROUNDS;
+
+    qsort(ns, BENCH_ROUNDS, sizeof(double), Bench_CompareNs);
+
+    printf("%s\t%.1f\t%.2f\t%.1f\t%.0f\n",
+           name,
+           ns[0],
+           (bench_allocs - allocs) / ops,
+           (bench_bytes - bytes) / ops,
+           ops);
+    fflush(stdout);
+
+    fprintf(stderr, "%s: %.1f to %.1f ns/op, median %.1f\n",
+            name, ns[0], ns[BENCH_ROUNDS - 1], ns[BENCH_ROUNDS / 2]);
+
+    return NULL;
+error:
+    return "Benchmark failed";
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "microbench.h"
+#include <dht/peers.h>
+
+/* Distinct peers, each added twice to a Peers, new and then as an
+ * update, before starting over with a new one. */
+#define BENCH_PEERS 4096
+
+struct PeersContext {
+    Hash info_hash;
+    Peer peers[BENCH_PEERS];
+};
+
+int Bench_AddPeer(struct PeersContext *context, long n)
+{
+    Peers *peers = NULL;
+
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (i % (2 * BENCH_PEERS) == 0)
+        {
+            Peers_Destroy(peers);
+            peers = Peers_Create(&context->info_hash);
+            check(peers != NULL, "Peers_Create failed");
+        }
+
+        int rc = Peers_AddPeer(peers, &context->peers[i % BENCH_PEERS]);
+        check(rc == 0, "Peers_AddPeer failed");
+    }
+
+    Peers_Destroy(peers);
+
+    return 0;
+error:
+    Peers_Destroy(peers);
+    return -1;
+}
+
+char *all_benches()
+{
+    bench_start();
+
+    struct PeersContext *context = calloc(1, sizeof(struct PeersContext));
+    check_mem(context);
+
+    context->info_hash = (Hash){ "info_hash" };
+
+    int i = 0;
+    for (i = 0; i < BENCH_PEERS; i++)
+        context->peers[i] = (Peer){ .addr = 0x0A000000 + i * 7919, .port = 6881 + i };
+
+    bench_run("Peers_AddPeer", (Bench_fp)Bench_AddPeer, context);
+
+    free(context);
+
+    return NULL;
+error:
+    return "Setup failed";
+}
+
+RUN_BENCHES(all_benches);
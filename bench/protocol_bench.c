@@ -0,0 +1,173 @@
+#include "microbench.h"
+#include <dht/bencode.h>
+#include <dht/client.h>
+#include <dht/message_create.h>
+#include <dht/network.h>
+#include <dht/protocol.h>
+
+/* A find_node reply with a full bucket of nodes, and a get_peers
+ * query, as sent and as received. */
+struct Wire {
+    Message *query;
+    Message *reply;
+    char query_data[UDPBUFLEN];
+    int query_len;
+    char reply_data[UDPBUFLEN];
+    int reply_len;
+    char buf[UDPBUFLEN];
+};
+
+struct ReplyResponses {
+    GetPendingResponse_fp getPendingResponse;
+    AddPendingResponse_fp addPendingResponse;
+};
+
+PendingResponse GetRFindNode(void *responses, char *tid, int *rc)
+{
+    (void)responses;
+    *rc = 0;
+
+    return (PendingResponse){ .type = RFindNode, .tid = *(tid_t *)tid, .is_new = 1 };
+}
+
+struct ReplyResponses responses = { .getPendingResponse = GetRFindNode };
+
+int Bench_BDecode(struct Wire *wire, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        BNode *node = BDecode(wire->reply_data, wire->reply_len);
+        check(node != NULL, "BDecode failed");
+        BNode_Destroy(node);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Bench_DecodeQuery(struct Wire *wire, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        Message *message = Message_Decode(wire->query_data, wire->query_len, NULL);
+        check(message != NULL && message->errors == 0, "Message_Decode failed");
+        Message_Destroy(message);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Bench_DecodeReply(struct Wire *wire, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        Message *message = Message_Decode(wire->reply_data,
+                                          wire->reply_len,
+                                          (struct PendingResponses *)&responses);
+        check(message != NULL && message->errors == 0, "Message_Decode failed");
+        Message_Destroy(message);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Bench_EncodeQuery(struct Wire *wire, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        int len = Message_Encode(wire->query, wire->buf, UDPBUFLEN);
+        check(len > 0, "Message_Encode failed");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Bench_EncodeReply(struct Wire *wire, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        int len = Message_Encode(wire->reply, wire->buf, UDPBUFLEN);
+        check(len > 0, "Message_Encode failed");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+char *all_benches()
+{
+    bench_start();
+
+    Hash id = { "client id" };
+    Hash target = { "target" };
+    Client *client = Client_Create(id, 0, 0, 0);
+    check(client != NULL, "Client_Create failed");
+
+    struct Wire *wire = calloc(1, sizeof(struct Wire));
+    check_mem(wire);
+
+    DArray *found = DArray_create(sizeof(Node *), BUCKET_K);
+    check(found != NULL, "DArray_create failed");
+
+    Node to = { .addr.s_addr = 1, .port = 1 };
+
+    int i = 0;
+    for (i = 0; i < BUCKET_K; i++)
+    {
+        Hash node_id = target;
+        node_id.value[HASH_BYTES - 1] ^= i + 1;
+
+        Node *node = Node_Create(&node_id);
+        check(node != NULL, "Node_Create failed");
+
+        node->addr.s_addr = 0x0A000000 + i;
+        node->port = 6881;
+        DArray_push(found, node);
+    }
+
+    wire->query = Message_CreateQGetPeers(client, &to, &target);
+    check(wire->query != NULL, "Message_CreateQGetPeers failed");
+
+    wire->reply = Message_CreateRFindNode(client, wire->query, found);
+    check(wire->reply != NULL, "Message_CreateRFindNode failed");
+
+    wire->query_len = Message_Encode(wire->query, wire->query_data, UDPBUFLEN);
+    check(wire->query_len > 0, "Message_Encode failed");
+
+    wire->reply_len = Message_Encode(wire->reply, wire->reply_data, UDPBUFLEN);
+    check(wire->reply_len > 0, "Message_Encode failed");
+
+    bench_run("BDecode/find_node_reply", (Bench_fp)Bench_BDecode, wire);
+    bench_run("Message_Decode/get_peers_query", (Bench_fp)Bench_DecodeQuery, wire);
+    bench_run("Message_Decode/find_node_reply", (Bench_fp)Bench_DecodeReply, wire);
+    bench_run("Message_Encode/get_peers_query", (Bench_fp)Bench_EncodeQuery, wire);
+    bench_run("Message_Encode/find_node_reply", (Bench_fp)Bench_EncodeReply, wire);
+
+    while (DArray_count(found) > 0)
+        Node_Destroy(DArray_pop(found));
+
+    DArray_destroy(found);
+    Message_Destroy(wire->query);
+    Message_Destroy(wire->reply);
+    free(wire);
+    Client_Destroy(client);
+
+    return NULL;
+error:
+    return "Setup failed";
+}
+
+RUN_BENCHES(all_benches);
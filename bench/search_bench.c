@@ -0,0 +1,108 @@
+#include "microbench.h"
+#include "../tests/fixtures.h"
+#include <time.h>
+#include <dht/client.h>
+#include <dht/search.h>
+#include <dht/work.h>
+
+/* Searches set up on a client with a full routing table, one at a time
+ * or in bulk, and destroyed again every BENCH_SEARCHES. */
+#define BENCH_SEARCHES 1024
+
+struct Searches {
+    Client *client;
+    SearchRequest requests[BENCH_SEARCHES];
+};
+
+void ClearSearches(Client *client)
+{
+    while (DArray_count(client->searches) > 0)
+    {
+        Search *search = DArray_pop(client->searches);
+        Hashmap_delete(client->serials, &search->serial);
+        Search_Destroy(search);
+    }
+}
+
+int Bench_AddSearch(struct Searches *searches, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (i % BENCH_SEARCHES == 0)
+            ClearSearches(searches->client);
+
+        Search *search = Client_AddSearch(searches->client,
+                                          &searches->requests[i % BENCH_SEARCHES].info_hash);
+        check(search != NULL, "Client_AddSearch failed");
+    }
+
+    ClearSearches(searches->client);
+
+    return 0;
+error:
+    return -1;
+}
+
+int Bench_AddSearches(struct Searches *searches, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i += BENCH_SEARCHES)
+    {
+        size_t count = n - i < BENCH_SEARCHES ? n - i : BENCH_SEARCHES;
+
+        int rc = Client_AddSearches(searches->client, searches->requests, count);
+        check(rc == 0, "Client_AddSearches failed");
+
+        rc = Client_StartSearches(searches->client);
+        check(rc == 0, "Client_StartSearches failed");
+
+        ClearSearches(searches->client);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+char *all_benches()
+{
+    bench_start();
+
+    Hash id = { "search bench" };
+
+    RandomState *random = RandomState_Create(1);
+    check(random != NULL, "RandomState_Create failed");
+
+    struct Searches *searches = calloc(1, sizeof(struct Searches));
+    check_mem(searches);
+
+    searches->client = Client_Create(id, 0, 0, 0);
+    check(searches->client != NULL, "Client_Create failed");
+
+    /* Every search is started at once, as by Client_AddSearch */
+    searches->client->max_searches = BENCH_SEARCHES;
+
+    int rc = FillTable(searches->client->table, random);
+    check(rc == 0, "FillTable failed");
+
+    int i = 0;
+    for (i = 0; i < BENCH_SEARCHES; i++)
+    {
+        Random_Fill(random, searches->requests[i].info_hash.value, HASH_BYTES);
+        searches->requests[i].flags = SearchAnnounce;
+    }
+
+    bench_run("Client_AddSearch", (Bench_fp)Bench_AddSearch, searches);
+    bench_run("Client_AddSearches", (Bench_fp)Bench_AddSearches, searches);
+
+    Client_Destroy(searches->client);
+    free(searches);
+    RandomState_Destroy(random);
+
+    return NULL;
+error:
+    return "Setup failed";
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,107 @@
+#include "microbench.h"
+#include <dht/random.h>
+#include <dht/table.h>
+
+/* Nodes of random ids, inserted again into a new table every
+ * BENCH_NODES operations. */
+#define BENCH_NODES 1024
+
+struct Tables {
+    Hash id;
+    Node *nodes[BENCH_NODES];
+    Table *table;               /* Of all the nodes */
+    Hash targets[BENCH_NODES];
+};
+
+int Bench_InsertNode(struct Tables *tables, long n)
+{
+    Table *table = NULL;
+
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (i % BENCH_NODES == 0)
+        {
+            Table_Destroy(table);
+            table = Table_Create(&tables->id);
+            check(table != NULL, "Table_Create failed");
+        }
+
+        Table_InsertNodeResult result = Table_InsertNode(table,
+                                                         tables->nodes[i % BENCH_NODES]);
+        check(result.rc != ERROR, "Table_InsertNode failed");
+    }
+
+    Table_Destroy(table);
+
+    return 0;
+error:
+    Table_Destroy(table);
+    return -1;
+}
+
+int Bench_GatherClosest(struct Tables *tables, long n)
+{
+    long i = 0;
+    for (i = 0; i < n; i++)
+    {
+        DArray *found = Table_GatherClosest(tables->table,
+                                            &tables->targets[i % BENCH_NODES]);
+        check(found != NULL && DArray_count(found) == BUCKET_K,
+              "Table_GatherClosest failed");
+        DArray_destroy(found);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+char *all_benches()
+{
+    bench_start();
+
+    RandomState *random = RandomState_Create(1);
+    check(random != NULL, "RandomState_Create failed");
+
+    struct Tables *tables = calloc(1, sizeof(struct Tables));
+    check_mem(tables);
+
+    Random_Fill(random, tables->id.value, HASH_BYTES);
+
+    tables->table = Table_Create(&tables->id);
+    check(tables->table != NULL, "Table_Create failed");
+
+    int i = 0;
+    for (i = 0; i < BENCH_NODES; i++)
+    {
+        Hash id;
+        Random_Fill(random, id.value, HASH_BYTES);
+        Random_Fill(random, tables->targets[i].value, HASH_BYTES);
+
+        tables->nodes[i] = Node_Create(&id);
+        check(tables->nodes[i] != NULL, "Node_Create failed");
+
+        tables->nodes[i]->addr.s_addr = 0x0A000000 + i;
+        tables->nodes[i]->port = 6881;
+
+        Table_InsertNode(tables->table, tables->nodes[i]);
+    }
+
+    bench_run("Table_InsertNode", (Bench_fp)Bench_InsertNode, tables);
+    bench_run("Table_GatherClosest", (Bench_fp)Bench_GatherClosest, tables);
+
+    Table_Destroy(tables->table);
+
+    for (i = 0; i < BENCH_NODES; i++)
+        Node_Destroy(tables->nodes[i]);
+
+    free(tables);
+    RandomState_Destroy(random);
+
+    return NULL;
+error:
+    return "Setup failed";
+}
+
+RUN_BENCHES(all_benches);
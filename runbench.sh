@@ -0,0 +1,55 @@
+BENCH_LOG=bench.log
+BASELINE=$1
+# Slowdown of ns/op over the baseline taken as a regression
+TOLERANCE=${BENCH_TOLERANCE:-0.10}
+
+echo "Running benchmarks:"
+
+echo -n > ${BENCH_LOG}
+
+for i in bin/bench/*_bench
+do
+    if test -f $i
+    then
+	if ./$i >> ${BENCH_LOG} 2> /dev/null
+	then
+	    echo $i done
+	else
+	    echo "ERROR in benchmark $i"
+	    ./$i > /dev/null
+	    exit 1
+	fi
+    fi
+done
+
+echo ""
+echo "# name	ns/op	allocs/op	bytes/op	iterations"
+grep -v '^#' ${BENCH_LOG}
+
+if test -z "${BASELINE}"
+then
+    echo ""
+    echo "Save ${BENCH_LOG} and compare with: make bench BASELINE=<saved>"
+    exit 0
+fi
+
+echo ""
+echo "Compared with ${BASELINE}:"
+
+# A regression is slower by more than the tolerance, or allocating more
+awk -F '\t' -v tolerance=${TOLERANCE} '
+    /^#/ { next }
+    NR == FNR { ns[$1] = $2; allocs[$1] = $3; next }
+    !($1 in ns) { printf "%-40s new\n", $1; next }
+    {
+        change = ns[$1] > 0 ? ($2 - ns[$1]) / ns[$1] : 0
+        status = "ok"
+        if (change > tolerance || $3 > allocs[$1] + 0.005) {
+            status = "REGRESSION"
+            regressions++
+        }
+        printf "%-40s %10.1f -> %10.1f ns/op %+6.1f%%  %6.2f -> %6.2f allocs/op  %s\n",
+               $1, ns[$1], $2, change * 100, allocs[$1], $3, status
+    }
+    END { exit regressions > 0 }
+' ${BASELINE} ${BENCH_LOG}
@@ -0,0 +1,579 @@
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dht/client.h>
+#include <dht/hooks.h>
+#include <dht/message_create.h>
+#include <dht/network.h>
+#include <dht/table.h>
+#include <lcthw/dbg.h>
+
+/* Sends a mix of queries to a node over loopback from many sources,
+ * each with its own id and port, printing the sustained rate, the
+ * percentiles of the reply latency and the CPU time per query. The mix
+ * weighs ping:find_node:get_peers:announce_peer. A qps of 0 sends as
+ * fast as replies come back. Without a port, the target is a node run
+ * by a thread of this process, with a full table and peers to give
+ * out, and its CPU time is measured too.
+ * Usage: bin/dht_load [seconds] [qps] [mix] [sources] [port] */
+
+#define LOAD_SECONDS 10
+#define LOAD_QPS 0
+#define LOAD_MIX "1:4:4:1"
+#define LOAD_SOURCES 64
+#define LOAD_TARGET_PORT 21900
+#define LOAD_WINDOW 8               /* Queries in flight per source */
+#define LOAD_SLOTS 256              /* Of queries in flight, by tid */
+#define LOAD_TIMEOUT_NS 1000000000LL
+#define LOAD_INFO_HASHES 256
+#define LOAD_PEERS 8                /* Per info_hash, on the target */
+#define LOAD_TABLE_NODES 8192       /* Offered to the target's table */
+
+enum { MixPing, MixFindNode, MixGetPeers, MixAnnouncePeer, MixMax };
+
+typedef struct Slot {
+    tid_t tid;
+    MessageType type;           /* Of the reply */
+    int64_t sent_ns;            /* 0 when free */
+} Slot;
+
+/* A client sending queries, and decoding the replies with its own
+ * table of queries in flight. */
+typedef struct Source {
+    struct PendingResponses pending;
+    Client *client;
+    Slot slots[LOAD_SLOTS];
+    int in_flight;
+    char token[HASH_BYTES];     /* From the last get_peers reply */
+    size_t token_len;
+} Source;
+
+typedef struct Totals {
+    unsigned long sent;
+    unsigned long send_errors;
+    unsigned long replies;
+    unsigned long errors;       /* Error replies */
+    unsigned long invalid;      /* Replies that did not decode */
+    unsigned long timeouts;
+    unsigned long by_type[MixMax];
+    int64_t *latency_ns;        /* Of every reply */
+    size_t latency_max;
+} Totals;
+
+typedef struct Target {
+    Client *client;
+    atomic_int running;         /* Cleared to stop its thread */
+    unsigned long queries;      /* Received */
+    int64_t cpu_ns;             /* Of its thread, once stopped */
+} Target;
+
+char buf[UDPBUFLEN];
+Hash info_hashes[LOAD_INFO_HASHES];
+Totals totals = { 0 };
+Target target = { 0 };
+
+int64_t NowNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+uint32_t Pick(RandomState *random, uint32_t count)
+{
+    uint32_t value = 0;
+    Random_Fill(random, (char *)&value, sizeof(value));
+
+    return value % count;
+}
+
+Hash RandomHash(RandomState *random)
+{
+    Hash hash;
+    Random_Fill(random, hash.value, HASH_BYTES);
+
+    return hash;
+}
+
+PendingResponse Source_GetPendingResponse(Source *source, char *transaction_id, int *rc)
+{
+    tid_t tid = *(tid_t *)transaction_id;
+    Slot *slot = &source->slots[tid % LOAD_SLOTS];
+
+    if (slot->sent_ns == 0 || slot->tid != tid)
+    {
+        *rc = -1;
+        return (PendingResponse){ 0 };
+    }
+
+    *rc = 0;
+
+    return (PendingResponse){ .type = slot->type, .tid = tid, .is_new = 1 };
+}
+
+int Source_AddPendingResponse(Source *source, PendingResponse entry)
+{
+    (void)source;
+    (void)entry;
+
+    return 0;
+}
+
+int Source_Init(Source *source, Hash *id)
+{
+    source->pending.getPendingResponse = (GetPendingResponse_fp)Source_GetPendingResponse;
+    source->pending.addPendingResponse = (AddPendingResponse_fp)Source_AddPendingResponse;
+
+    /* Bound to any free port */
+    source->client = Client_Create(*id, htonl(INADDR_LOOPBACK), 0, htons(6881));
+    check(source->client != NULL, "Client_Create failed");
+
+    int rc = NetworkUp(source->client);
+    check(rc == 0, "NetworkUp failed");
+
+    return 0;
+error:
+    return -1;
+}
+
+/* Frees the slots of queries sent before cutoff_ns. */
+void Source_Expire(Source *source, int64_t cutoff_ns)
+{
+    int i = 0;
+    for (i = 0; i < LOAD_SLOTS; i++)
+    {
+        Slot *slot = &source->slots[i];
+
+        if (slot->sent_ns != 0 && slot->sent_ns < cutoff_ns)
+        {
+            slot->sent_ns = 0;
+            source->in_flight--;
+            totals.timeouts++;
+        }
+    }
+}
+
+Message *CreateQuery(Source *source, Node *target, int kind, RandomState *random)
+{
+    Hash hash = RandomHash(random);
+    Hash *info_hash = &info_hashes[Pick(random, LOAD_INFO_HASHES)];
+
+    if (kind == MixAnnouncePeer && source->token_len == 0)
+        kind = MixGetPeers;
+
+    totals.by_type[kind]++;
+
+    switch (kind)
+    {
+    case MixPing:
+        return Message_CreateQPing(source->client, target);
+    case MixFindNode:
+        return Message_CreateQFindNode(source->client, target, &hash);
+    case MixGetPeers:
+        return Message_CreateQGetPeers(source->client, target, info_hash);
+    default:
+        return Message_CreateQAnnouncePeer(source->client,
+                                           target,
+                                           info_hash,
+                                           source->token,
+                                           source->token_len);
+    }
+}
+
+int SendQuery(Source *source, Node *target, int kind, RandomState *random)
+{
+    Message *query = CreateQuery(source, target, kind, random);
+    check(query != NULL, "CreateQuery failed");
+
+    tid_t tid = *(tid_t *)query->t;
+    Slot *slot = &source->slots[tid % LOAD_SLOTS];
+
+    /* Its reply never came */
+    if (slot->sent_ns != 0)
+    {
+        source->in_flight--;
+        totals.timeouts++;
+    }
+
+    int len = Message_Encode(query, buf, UDPBUFLEN);
+    check(len > 0, "Message_Encode failed");
+
+    slot->tid = tid;
+    slot->type = MessageType_AsReply(query->type);
+    slot->sent_ns = NowNs(CLOCK_MONOTONIC);
+
+    Message_Destroy(query);
+    query = NULL;
+
+    totals.sent++;
+
+    if (Send(source->client, target, buf, len) != 0)
+    {
+        slot->sent_ns = 0;
+        totals.send_errors++;
+        return 0;
+    }
+
+    source->in_flight++;
+
+    return 0;
+error:
+    Message_Destroy(query);
+    return -1;
+}
+
+int AddLatency(int64_t latency_ns)
+{
+    if (totals.replies == totals.latency_max)
+    {
+        size_t max = totals.latency_max > 0 ? totals.latency_max * 2 : 1 << 16;
+
+        int64_t *latency_ns = realloc(totals.latency_ns, max * sizeof(int64_t));
+        check_mem(latency_ns);
+
+        totals.latency_ns = latency_ns;
+        totals.latency_max = max;
+    }
+
+    totals.latency_ns[totals.replies++] = latency_ns;
+
+    return 0;
+error:
+    return -1;
+}
+
+int ReceiveReplies(Source *source)
+{
+    for (;;)
+    {
+        Node from = {{{ 0 }}};
+
+        int len = Receive(source->client, &from, buf, UDPBUFLEN);
+        check(len >= 0, "Receive failed");
+
+        if (len == 0)
+            return 0;
+
+        int64_t now_ns = NowNs(CLOCK_MONOTONIC);
+
+        Message *reply = Message_Decode(buf, len, &source->pending);
+
+        if (reply == NULL || reply->t_len != sizeof(tid_t))
+        {
+            totals.invalid++;
+            Message_Destroy(reply);
+            continue;
+        }
+
+        tid_t tid = *(tid_t *)reply->t;
+        Slot *slot = &source->slots[tid % LOAD_SLOTS];
+
+        if (slot->sent_ns != 0 && slot->tid == tid)
+        {
+            int rc = AddLatency(now_ns - slot->sent_ns);
+            check(rc == 0, "AddLatency failed");
+
+            slot->sent_ns = 0;
+            source->in_flight--;
+
+            if (reply->type == RError)
+                totals.errors++;
+        }
+
+        if (reply->type == RGetPeers
+            && reply->data.rgetpeers.token.len == HASH_BYTES)
+        {
+            memcpy(source->token, reply->data.rgetpeers.token.data, HASH_BYTES);
+            source->token_len = HASH_BYTES;
+        }
+
+        Message_Destroy(reply);
+    }
+error:
+    return -1;
+}
+
+void CountQuery(void *client, void *message)
+{
+    (void)client;
+    (void)message;
+    target.queries++;
+}
+
+void *RunTarget(void *arg)
+{
+    (void)arg;
+    struct pollfd pollfd = { .fd = target.client->socket, .events = POLLIN };
+
+    while (atomic_load(&target.running))
+    {
+        if (Dht_Process(target.client) != 0)
+            log_err("Dht_Process failed");
+
+        int64_t wait = Dht_NextDeadline(target.client);
+        poll(&pollfd, 1, wait < 10 ? wait : 10);
+    }
+
+    target.cpu_ns = NowNs(CLOCK_THREAD_CPUTIME_ID);
+
+    return NULL;
+}
+
+/* A node on loopback with a table as full as it gets and peers on
+ * every info_hash. */
+Client *CreateTarget(RandomState *random)
+{
+    Client *client = Client_Create(RandomHash(random),
+                                   htonl(INADDR_LOOPBACK),
+                                   htons(LOAD_TARGET_PORT),
+                                   htons(6881));
+    check(client != NULL, "Client_Create failed");
+
+    int rc = Dht_Start(client);
+    check(rc == 0, "Dht_Start failed");
+
+    int i = 0;
+    for (i = 0; i < LOAD_TABLE_NODES; i++)
+    {
+        Node node = { .id = RandomHash(random),
+                      .addr.s_addr = htonl(0x0A000000 + i),
+                      .port = htons(6881),
+                      .reply_time = Clock_Time(&client->clock) };
+
+        rc = Table_CopyAndAddNode(client->table, &node);
+        check(rc == 0, "Table_CopyAndAddNode failed");
+    }
+
+    for (i = 0; i < LOAD_INFO_HASHES * LOAD_PEERS; i++)
+    {
+        Peer peer = { .addr = htonl(0x0B000000 + i), .port = htons(6881) };
+
+        rc = Client_AddPeer(client, &info_hashes[i % LOAD_INFO_HASHES], &peer, 0);
+        check(rc == 0, "Client_AddPeer failed");
+    }
+
+    return client;
+error:
+    Client_Destroy(client);
+    return NULL;
+}
+
+int64_t Percentile(double p)
+{
+    if (totals.replies == 0)
+        return 0;
+
+    return totals.latency_ns[(size_t)(p * (totals.replies - 1))];
+}
+
+int CompareNs(const void *a, const void *b)
+{
+    int64_t x = *(int64_t *)a, y = *(int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : LOAD_SECONDS;
+    long qps = argc > 2 ? atol(argv[2]) : LOAD_QPS;
+    const char *mix_arg = argc > 3 ? argv[3] : LOAD_MIX;
+    int count = argc > 4 ? atoi(argv[4]) : LOAD_SOURCES;
+    int port = argc > 5 ? atoi(argv[5]) : 0;
+
+    unsigned int mix[MixMax] = { 0 };
+    int fields = sscanf(mix_arg, "%u:%u:%u:%u", &mix[0], &mix[1], &mix[2], &mix[3]);
+    unsigned int mix_total = mix[0] + mix[1] + mix[2] + mix[3];
+
+    check(seconds > 0 && qps >= 0 && fields == MixMax && mix_total > 0
+          && count > 0 && port >= 0 && port < 65536,
+          "Usage: %s [seconds] [qps] [ping:find_node:get_peers:announce_peer] [sources] [port]",
+          argv[0]);
+
+    RandomState *random = RandomState_Create(1);
+    check(random != NULL, "RandomState_Create failed");
+
+    int i = 0;
+    for (i = 0; i < LOAD_INFO_HASHES; i++)
+        info_hashes[i] = RandomHash(random);
+
+    Hook *hook = NULL;
+    pthread_t thread;
+
+    if (port == 0)
+    {
+        target.client = CreateTarget(random);
+        check(target.client != NULL, "CreateTarget failed");
+
+        hook = Hook_Create(HookReceiveMessage, CountQuery);
+        check(hook != NULL, "Hook_Create failed");
+
+        Hook_SetMessageTypes(hook,
+                             HOOK_MESSAGE_BIT(QPing)
+                             | HOOK_MESSAGE_BIT(QFindNode)
+                             | HOOK_MESSAGE_BIT(QGetPeers)
+                             | HOOK_MESSAGE_BIT(QAnnouncePeer));
+
+        int rc = Dht_AddHook(target.client, hook);
+        check(rc == 0, "Dht_AddHook failed");
+
+        atomic_store(&target.running, 1);
+
+        rc = pthread_create(&thread, NULL, RunTarget, NULL);
+        check(rc == 0, "pthread_create failed");
+    }
+
+    Node node = { .addr.s_addr = htonl(INADDR_LOOPBACK),
+                  .port = htons(port > 0 ? port : LOAD_TARGET_PORT) };
+
+    Source *sources = calloc(count, sizeof(Source));
+    check_mem(sources);
+
+    struct pollfd *pollfds = calloc(count, sizeof(struct pollfd));
+    check_mem(pollfds);
+
+    for (i = 0; i < count; i++)
+    {
+        Hash id = RandomHash(random);
+
+        int rc = Source_Init(&sources[i], &id);
+        check(rc == 0, "Source_Init failed");
+
+        pollfds[i] = (struct pollfd){ .fd = sources[i].client->socket, .events = POLLIN };
+    }
+
+    int64_t cpu_ns = NowNs(CLOCK_THREAD_CPUTIME_ID);
+    int64_t start_ns = NowNs(CLOCK_MONOTONIC);
+    int64_t end_ns = start_ns + seconds * 1000000000LL;
+    int64_t now_ns = start_ns;
+    int next = 0;
+
+    while ((now_ns = NowNs(CLOCK_MONOTONIC)) < end_ns)
+    {
+        unsigned long due = qps > 0
+            ? (unsigned long)((now_ns - start_ns) * qps / 1000000000LL)
+            : (unsigned long)-1;
+        int blocked = 0;
+
+        while (totals.sent < due && blocked < count)
+        {
+            Source *source = &sources[next++ % count];
+
+            if (source->in_flight >= LOAD_WINDOW)
+                Source_Expire(source, now_ns - LOAD_TIMEOUT_NS);
+
+            if (source->in_flight >= LOAD_WINDOW)
+            {
+                blocked++;
+                continue;
+            }
+
+            blocked = 0;
+
+            uint32_t pick = Pick(random, mix_total);
+            int kind = 0;
+
+            while (pick >= mix[kind])
+                pick -= mix[kind++];
+
+            int rc = SendQuery(source, &node, kind, random);
+            check(rc == 0, "SendQuery failed");
+
+            /* Replies are read at least every window */
+            if (qps == 0 && totals.sent % (count * LOAD_WINDOW) == 0)
+                break;
+        }
+
+        int ready = poll(pollfds, count, totals.sent < due ? 0 : 1);
+
+        for (i = 0; i < count && ready > 0; i++)
+        {
+            if (pollfds[i].revents & POLLIN)
+            {
+                int rc = ReceiveReplies(&sources[i]);
+                check(rc == 0, "ReceiveReplies failed");
+            }
+        }
+    }
+
+    int64_t elapsed_ns = now_ns - start_ns;
+
+    /* The replies still on their way */
+    while (NowNs(CLOCK_MONOTONIC) < end_ns + LOAD_TIMEOUT_NS)
+    {
+        int in_flight = 0;
+
+        for (i = 0; i < count; i++)
+            in_flight += sources[i].in_flight;
+
+        if (in_flight == 0)
+            break;
+
+        if (poll(pollfds, count, 10) <= 0)
+            continue;
+
+        for (i = 0; i < count; i++)
+        {
+            int rc = ReceiveReplies(&sources[i]);
+            check(rc == 0, "ReceiveReplies failed");
+        }
+    }
+
+    cpu_ns = NowNs(CLOCK_THREAD_CPUTIME_ID) - cpu_ns;
+
+    for (i = 0; i < count; i++)
+        Source_Expire(&sources[i], INT64_MAX);
+
+    if (port == 0)
+    {
+        atomic_store(&target.running, 0);
+        pthread_join(thread, NULL);
+    }
+
+    qsort(totals.latency_ns, totals.replies, sizeof(int64_t), CompareNs);
+
+    double elapsed = elapsed_ns / 1e9;
+
+    printf("sent     %lu in %.1f s, %.0f/s (ping %lu, find_node %lu, get_peers %lu, announce_peer %lu)\n",
+           totals.sent, elapsed, totals.sent / elapsed,
+           totals.by_type[MixPing], totals.by_type[MixFindNode],
+           totals.by_type[MixGetPeers], totals.by_type[MixAnnouncePeer]);
+    printf("replies  %lu, %.0f/s; %lu errors, %lu invalid, %lu timeouts, %lu not sent\n",
+           totals.replies, totals.replies / elapsed,
+           totals.errors, totals.invalid, totals.timeouts, totals.send_errors);
+    printf("latency  p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n",
+           Percentile(0.5) / 1e3, Percentile(0.99) / 1e3,
+           Percentile(0.999) / 1e3, Percentile(1) / 1e3);
+    printf("cpu      %.2f us per query sent",
+           totals.sent > 0 ? cpu_ns / 1e3 / totals.sent : 0);
+
+    if (port == 0)
+    {
+        printf(", target %.2f us per query received (%lu)",
+               target.queries > 0 ? target.cpu_ns / 1e3 / target.queries : 0,
+               target.queries);
+    }
+
+    printf("\n");
+
+    for (i = 0; i < count; i++)
+        Client_Destroy(sources[i].client);
+
+    free(sources);
+    free(pollfds);
+    free(totals.latency_ns);
+
+    Client_Destroy(target.client);
+    Hook_Destroy(hook);
+
+    RandomState_Destroy(random);
+
+    return 0;
+error:
+    return 1;
+}
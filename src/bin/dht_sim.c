@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <dht/clock.h>
+#include <dht/hooks.h>
+#include <dht/simnet.h>
+#include <lcthw/dbg.h>
+
+/* Bootstraps a simulated network of clients, each from a few of those
+ * created before it, then runs lookups of random clients' ids from
+ * random clients, printing the time to converge and the hops, packets
+ * and time per lookup. Runs are repeatable for the same arguments.
+ * Usage: bin/dht_sim [clients] [lookups] [latency_ms] [loss] [nat] [seed] */
+
+#define SIM_CLIENTS 10000
+#define SIM_LOOKUPS 1000
+#define SIM_SEEDS 8
+#define SIM_NAT_TIMEOUT_MS (60 * 1000)
+#define SIM_BOOTSTRAP_MS (60 * 1000)
+#define SIM_LOOKUPS_MS (60 * 1000)
+
+typedef struct LookupTotals {
+    unsigned long done;
+    unsigned long queries;
+    unsigned long replies;
+    unsigned long hops;
+    int64_t duration_ms;
+} LookupTotals;
+
+LookupTotals totals = { 0 };
+
+void LookupDone(void *client, void *search)
+{
+    (void)client;
+
+    SearchStats stats;
+    Dht_GetSearchStats(search, &stats);
+
+    totals.done++;
+    totals.queries += stats.queries;
+    totals.replies += stats.replies;
+    totals.hops += stats.hops;
+    totals.duration_ms += stats.duration_ms;
+}
+
+int CompareMs(const void *a, const void *b)
+{
+    int64_t x = *(int64_t *)a, y = *(int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+uint32_t Pick(RandomState *random, size_t count)
+{
+    uint32_t value = 0;
+    Random_Fill(random, (char *)&value, sizeof(value));
+
+    return value % count;
+}
+
+Client *GetClient(SimNet *net, size_t index)
+{
+    return ((SimEndpoint *)DArray_get(net->endpoints, index))->client;
+}
+
+/* Prints the times to a ready table, of the clients with seeds. */
+int PrintConvergence(SimNet *net, size_t count)
+{
+    int64_t *ready = calloc(count, sizeof(int64_t));
+    check_mem(ready);
+
+    size_t i = 0, n = 0, never = 0;
+    for (i = 1; i < count; i++)
+    {
+        BootstrapStats stats;
+        Dht_GetBootstrapStats(GetClient(net, i), &stats);
+
+        if (stats.ready_ms < 0)
+            never++;
+        else
+            ready[n++] = stats.ready_ms;
+    }
+
+    qsort(ready, n, sizeof(int64_t), CompareMs);
+
+    if (n > 0)
+    {
+        printf("converged  %zu ready, %zu not; p50 %lld ms, p99 %lld ms, max %lld ms\n",
+               n, never,
+               (long long)ready[n / 2],
+               (long long)ready[n * 99 / 100],
+               (long long)ready[n - 1]);
+    }
+    else
+    {
+        printf("converged  none\n");
+    }
+
+    free(ready);
+
+    return 0;
+error:
+    return -1;
+}
+
+void PrintTraffic(SimNet *net, const char *phase, size_t count)
+{
+    printf("%-10s %lu sent, %lu lost, %lu nat dropped, %.1f packets per client\n",
+           phase,
+           net->stats.sent,
+           net->stats.lost,
+           net->stats.nat_dropped,
+           (double)net->stats.sent / count);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? (size_t)atol(argv[1]) : SIM_CLIENTS;
+    long lookups = argc > 2 ? atol(argv[2]) : SIM_LOOKUPS;
+
+    SimNetConfig config = {
+        .latency_ms = argc > 3 ? atol(argv[3]) : 50,
+        .jitter_ms = 50,
+        .loss = argc > 4 ? atof(argv[4]) : 0,
+        .nat = argc > 5 ? atof(argv[5]) : 0,
+        .nat_timeout_ms = SIM_NAT_TIMEOUT_MS,
+        .seed = argc > 6 ? atoi(argv[6]) : 1
+    };
+
+    check(count > 1 && lookups >= 0,
+          "Usage: %s [clients] [lookups] [latency_ms] [loss] [nat] [seed]",
+          argv[0]);
+
+    RandomState *random = RandomState_Create(config.seed);
+    check(random != NULL, "RandomState_Create failed");
+
+    SimNet *net = SimNet_Create(&config);
+    check(net != NULL, "SimNet_Create failed");
+
+    Hook *hook = Hook_Create(HookSearchDone, LookupDone);
+    check(hook != NULL, "Hook_Create failed");
+
+    int64_t wall_ms = Clock_Ms();
+    int rc = 0;
+
+    size_t i = 0;
+    for (i = 0; i < count; i++)
+    {
+        Hash id;
+        Random_Fill(random, id.value, HASH_BYTES);
+
+        Client *client = SimNet_AddClient(net, &id);
+        check(client != NULL, "SimNet_AddClient failed");
+
+        Seed seeds[SIM_SEEDS];
+        size_t j = 0;
+        for (j = 0; j < SIM_SEEDS && j < i; j++)
+            seeds[j] = SimNet_Seed(net, Pick(random, i));
+
+        if (j > 0)
+        {
+            rc = Dht_AddSeeds(client, seeds, j);
+            check(rc == 0, "Dht_AddSeeds failed");
+        }
+
+        rc = Dht_AddHook(client, hook);
+        check(rc == 0, "Dht_AddHook failed");
+    }
+
+    int64_t start_ms = net->now_ms;
+
+    rc = SimNet_Run(net, start_ms + SIM_BOOTSTRAP_MS);
+    check(rc == 0, "SimNet_Run failed");
+
+    rc = PrintConvergence(net, count);
+    check(rc == 0, "PrintConvergence failed");
+
+    PrintTraffic(net, "bootstrap", count);
+
+    /* Refreshes and pings of the tables go on meanwhile */
+    SimNetStats before = net->stats;
+
+    long n = 0;
+    for (n = 0; n < lookups; n++)
+    {
+        size_t from = Pick(random, count);
+        Client *target = GetClient(net, Pick(random, count));
+
+        void *search = Dht_AddSearch(GetClient(net, from), target->node.id);
+        check(search != NULL, "Dht_AddSearch failed");
+
+        rc = SimNet_Wake(net, from);
+        check(rc == 0, "SimNet_Wake failed");
+    }
+
+    rc = SimNet_Run(net, net->now_ms + SIM_LOOKUPS_MS);
+    check(rc == 0, "SimNet_Run failed");
+
+    if (totals.done > 0)
+    {
+        printf("lookups    %lu of %ld done; %.2f hops, %.1f queries, %.1f replies, %.0f ms per lookup\n",
+               totals.done, lookups,
+               (double)totals.hops / totals.done,
+               (double)totals.queries / totals.done,
+               (double)totals.replies / totals.done,
+               (double)totals.duration_ms / totals.done);
+    }
+
+    printf("%-10s %lu sent in all, %lu while looking up\n",
+           "traffic", net->stats.sent, net->stats.sent - before.sent);
+    struct rusage usage = { 0 };
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%-10s %lu Dht_Process calls, %lld ms of wall time, %ld KB max RSS\n",
+           "cost",
+           net->stats.processed,
+           (long long)(Clock_Ms() - wall_ms),
+           usage.ru_maxrss);
+
+    SimNet_Destroy(net);
+    Hook_Destroy(hook);
+    RandomState_Destroy(random);
+
+    return 0;
+error:
+    return 1;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <dht/clock.h>
+#include <dht/token.h>
+#include <lcthw/dbg.h>
+
+/* Issues and validates tokens for a spread of addresses under each
+ * scheme, printing the rates.
+ * Usage: bin/token_bench [count] */
+
+#define BENCH_COUNT 1000000
+#define BENCH_ADDRS 1024
+
+volatile int sink = 0;
+
+double PerSecond(long count, int64_t start_ms)
+{
+    int64_t elapsed = Clock_Ms() - start_ms;
+
+    return count * 1000.0 / (elapsed > 0 ? elapsed : 1);
+}
+
+int Bench(TokenSecrets *secrets, const char *name, long count)
+{
+    Token *tokens = NULL;
+    Node *nodes = calloc(BENCH_ADDRS, sizeof(Node));
+    check_mem(nodes);
+
+    tokens = calloc(BENCH_ADDRS, sizeof(Token));
+    check_mem(tokens);
+
+    int i = 0;
+    for (i = 0; i < BENCH_ADDRS; i++)
+        nodes[i].addr.s_addr = 0x0A000000 + i * 7919;
+
+    int64_t start = Clock_Ms();
+
+    long n = 0;
+    for (n = 0; n < count; n++)
+    {
+        tokens[n % BENCH_ADDRS] = Token_Make(secrets, &nodes[n % BENCH_ADDRS]);
+    }
+
+    double issued = PerSecond(count, start);
+
+    start = Clock_Ms();
+
+    for (n = 0; n < count; n++)
+    {
+        sink += Token_IsValid(secrets,
+                              &nodes[n % BENCH_ADDRS],
+                              tokens[n % BENCH_ADDRS].value,
+                              HASH_BYTES);
+    }
+
+    double validated = PerSecond(count, start);
+
+    printf("%-8s issued %12.0f/s  validated %12.0f/s\n", name, issued, validated);
+
+    free(nodes);
+    free(tokens);
+
+    return 0;
+error:
+    free(nodes);
+    free(tokens);
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    long count = argc > 1 ? atol(argv[1]) : BENCH_COUNT;
+    check(count > 0, "Usage: %s [count]", argv[0]);
+
+    RandomState *random = RandomState_Create(time(NULL));
+    check(random != NULL, "RandomState_Create failed");
+
+    TokenSecrets secrets = { 0 };
+    int rc = TokenSecrets_Init(&secrets, random, time(NULL));
+    check(rc == 0, "TokenSecrets_Init failed");
+
+    secrets.scheme = TokenSipHash;
+    rc = Bench(&secrets, "siphash", count);
+    check(rc == 0, "Bench failed");
+
+    secrets.scheme = TokenSha1;
+    rc = Bench(&secrets, "sha1", count);
+    check(rc == 0, "Bench failed");
+
+    RandomState_Destroy(random);
+
+    return 0;
+error:
+    return 1;
+}
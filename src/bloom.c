@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <math.h>
+#include <openssl/sha.h>
+
+#include <dht/bloom.h>
+
+/* Two bits per address, from the first four bytes of its SHA1 */
+#define BLOOM_K 2
+
+void Bloom_SetBit(Bloom *bloom, unsigned int index)
+{
+    index %= BLOOM_BITS;
+    bloom->bits[index / 8] |= 1 << (index % 8);
+}
+
+void Bloom_Add(Bloom *bloom, const void *addr, size_t len)
+{
+    assert(bloom != NULL && "NULL Bloom pointer");
+    assert(addr != NULL && "NULL addr pointer");
+
+    unsigned char hash[SHA_DIGEST_LENGTH];
+
+    SHA1(addr, len, hash);
+
+    Bloom_SetBit(bloom, hash[0] | hash[1] << 8);
+    Bloom_SetBit(bloom, hash[2] | hash[3] << 8);
+}
+
+void Bloom_AddAddr(Bloom *bloom, uint32_t addr)
+{
+    unsigned char bytes[] = { addr >> 24, addr >> 16, addr >> 8, addr };
+
+    Bloom_Add(bloom, bytes, sizeof(bytes));
+}
+
+void Bloom_Merge(Bloom *dest, Bloom *src)
+{
+    assert(dest != NULL && "NULL Bloom dest pointer");
+    assert(src != NULL && "NULL Bloom src pointer");
+
+    int i = 0;
+    for (i = 0; i < BLOOM_BYTES; i++)
+        dest->bits[i] |= src->bits[i];
+}
+
+double Bloom_Estimate(Bloom *bloom)
+{
+    assert(bloom != NULL && "NULL Bloom pointer");
+
+    int zeros = 0;
+
+    int i = 0;
+    for (i = 0; i < BLOOM_BYTES; i++)
+        zeros += 8 - __builtin_popcount(bloom->bits[i]);
+
+    /* A full filter estimates as one with a single bit unset */
+    if (zeros == 0)
+        zeros = 1;
+
+    return log((double)zeros / BLOOM_BITS)
+        / (BLOOM_K * log1p(-1.0 / BLOOM_BITS));
+}
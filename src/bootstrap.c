@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dht/bootstrap.h>
+#include <lcthw/dbg.h>
+
+void Bootstrap_Init(Bootstrap *bootstrap)
+{
+    assert(bootstrap != NULL && "NULL Bootstrap pointer");
+
+    memset(bootstrap, 0, sizeof(Bootstrap));
+    bootstrap->stats.start_ms = -1;
+    bootstrap->stats.ready_ms = -1;
+}
+
+void Bootstrap_Clear(Bootstrap *bootstrap)
+{
+    if (bootstrap == NULL)
+        return;
+
+    free(bootstrap->seeds);
+    Bootstrap_Init(bootstrap);
+}
+
+int Bootstrap_AddSeeds(Bootstrap *bootstrap, Seed *seeds, size_t count)
+{
+    assert(bootstrap != NULL && "NULL Bootstrap pointer");
+    assert(seeds != NULL && "NULL Seed pointer");
+
+    size_t total = bootstrap->stats.seeds + count;
+
+    Seed *more = realloc(bootstrap->seeds, total * sizeof(Seed));
+    check_mem(more);
+
+    memcpy(more + bootstrap->stats.seeds, seeds, count * sizeof(Seed));
+
+    bootstrap->seeds = more;
+    bootstrap->stats.seeds = total;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Bootstrap_IsTableReady(Table *table)
+{
+    assert(table != NULL && "NULL Table pointer");
+
+    int count = 0;
+
+    int i = 0;
+    for (i = 0; i < table->end; i++)
+    {
+        if (table->buckets[i]->count == 0)
+            return 0;
+
+        count += table->buckets[i]->count;
+    }
+
+    return count >= BUCKET_K;
+}
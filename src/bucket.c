@@ -1,17 +1,19 @@
 #include <assert.h>
+#include <string.h>
 #include <time.h>
 
 #include <dht/dht.h>
 #include <dht/bucket.h>
+#include <dht/hash.h>
 #include <dht/node.h>
 #include <lcthw/dbg.h>
 
-Bucket *Bucket_Create()
+Bucket *Bucket_Create(time_t now)
 {
     Bucket *bucket = calloc(1, sizeof(Bucket));
     check_mem(bucket);
 
-    bucket->change_time = time(NULL);
+    bucket->change_time = now;
 
     return bucket;
 error:
@@ -20,6 +22,13 @@ error:
 
 void Bucket_Destroy(Bucket *bucket)
 {
+    if (bucket == NULL)
+        return;
+
+    int i = 0;
+    for (i = 0; i < bucket->replacement_count; i++)
+        Node_Destroy(bucket->replacements[i]);
+
     free(bucket);
 }
 
@@ -44,13 +53,11 @@ int Bucket_ContainsNode(Bucket *bucket, Node *node)
     return 0;
 }
 
-Node *Bucket_ReplaceBad(Bucket *bucket, Node *node)
+Node *Bucket_ReplaceBad(Bucket *bucket, Node *node, time_t now)
 {
     assert(bucket != NULL && "NULL Bucket pointer");
     assert(node != NULL && "NULL Node pointer");
 
-    time_t now = time(NULL);
-
     int i = 0;
     for (i = 0; i < BUCKET_K; i++)
     {
@@ -70,38 +77,44 @@ Node *Bucket_ReplaceBad(Bucket *bucket, Node *node)
     return NULL;
 }
 
-Node *Bucket_ReplaceQuestionable(Bucket *bucket, Node *node)
+Node *Bucket_ReplaceQuestionable(Bucket *bucket, Node *node, time_t now)
 {
     assert(bucket != NULL && "NULL Bucket pointer");
     assert(node != NULL && "NULL Node pointer");
 
-    time_t now = time(NULL), oldest_time = now;
-    int oldest_i = -1, i = 0;
+    time_t worst_time = now;
+    int worst_i = -1, worst_score = 0, i = 0;
 
+    /* The lowest scoring node goes, the least recently seen of those. */
     for (i = 0; i < BUCKET_K; i++)
     {
-        if (bucket->nodes[i] == NULL)
+        Node *candidate = bucket->nodes[i];
+
+        if (candidate == NULL)
             continue;
 
-	if (Node_Status(bucket->nodes[i], now) == Questionable)
-	{
-	    if (bucket->nodes[i]->reply_time < oldest_time) {
-		oldest_time = bucket->nodes[i]->reply_time;
-		oldest_i = i;
-	    }
-
-	    if (bucket->nodes[i]->query_time < oldest_time) {
-		oldest_time = bucket->nodes[i]->query_time;
-		oldest_i = i;
-	    }
-	}
+        if (Node_Status(candidate, now) != Questionable)
+            continue;
+
+        int score = Node_Score(candidate);
+        time_t seen = candidate->reply_time > candidate->query_time
+            ? candidate->reply_time
+            : candidate->query_time;
+
+        if (worst_i == -1
+            || score < worst_score
+            || (score == worst_score && seen < worst_time))
+        {
+            worst_i = i;
+            worst_score = score;
+            worst_time = seen;
+        }
     }
 
-    if (oldest_i > -1)
+    if (worst_i > -1)
     {
-	// TODO: ping before replacing
-	Node *replaced = bucket->nodes[oldest_i];
-	bucket->nodes[oldest_i] = node;
+	Node *replaced = bucket->nodes[worst_i];
+	bucket->nodes[worst_i] = node;
 	bucket->change_time = now;
 
 	return replaced;
@@ -119,7 +132,7 @@ int Bucket_IsFull(Bucket *bucket)
     return BUCKET_K == bucket->count;
 }
 
-int Bucket_AddNode(Bucket *bucket, Node *node)
+int Bucket_AddNode(Bucket *bucket, Node *node, time_t now)
 {
     assert(bucket != NULL && "NULL Bucket pointer");
     assert(node != NULL && "NULL Node pointer");
@@ -135,7 +148,7 @@ int Bucket_AddNode(Bucket *bucket, Node *node)
         {
             bucket->nodes[i] = node;
             bucket->count++;
-            bucket->change_time = time(NULL);
+            bucket->change_time = now;
 
             assert(bucket->count <= BUCKET_K && "Too large Bucket count");
 
@@ -147,3 +160,53 @@ int Bucket_AddNode(Bucket *bucket, Node *node)
 error:
     return -1;
 }
+
+Node *RemoveReplacement(Bucket *bucket, int i)
+{
+    assert(0 <= i && i < bucket->replacement_count && "Bad replacement index");
+
+    Node *removed = bucket->replacements[i];
+
+    bucket->replacement_count--;
+
+    memmove(&bucket->replacements[i],
+            &bucket->replacements[i + 1],
+            (bucket->replacement_count - i) * sizeof(Node *));
+
+    return removed;
+}
+
+Node *Bucket_AddReplacement(Bucket *bucket, Node *node)
+{
+    assert(bucket != NULL && "NULL Bucket pointer");
+    assert(node != NULL && "NULL Node pointer");
+
+    Node *dropped = NULL;
+
+    int i = 0;
+    for (i = 0; i < bucket->replacement_count; i++)
+    {
+        if (Hash_Equals(&node->id, &bucket->replacements[i]->id))
+        {
+            dropped = RemoveReplacement(bucket, i);
+            break;
+        }
+    }
+
+    if (dropped == NULL && bucket->replacement_count == BUCKET_REPLACEMENTS)
+        dropped = RemoveReplacement(bucket, 0);
+
+    bucket->replacements[bucket->replacement_count++] = node;
+
+    return dropped;
+}
+
+Node *Bucket_PopReplacement(Bucket *bucket)
+{
+    assert(bucket != NULL && "NULL Bucket pointer");
+
+    if (bucket->replacement_count == 0)
+        return NULL;
+
+    return RemoveReplacement(bucket, bucket->replacement_count - 1);
+}
@@ -1,24 +1,27 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <openssl/sha.h>
 
 #include <lcthw/dbg.h>
 #include <dht/client.h>
+#include <dht/clock.h>
+#include <dht/crawl.h>
 #include <dht/hooks.h>
 #include <dht/network.h>
 #include <dht/peers.h>
 #include <dht/pendingresponses.h>
 #include <dht/random.h>
+#include <dht/searchcache.h>
 
 int CreateSocket();
+int Serial_Compare(uint32_t *a, uint32_t *b);
+uint32_t Serial_Hash(uint32_t *serial);
 
 Client *Client_Create(Hash id,
                       uint32_t addr,
                       uint16_t port,
                       uint16_t peer_port)
 {
-    RandomState *rs = NULL;
     Client *client = calloc(1, sizeof(Client));
     check_mem(client);
 
@@ -28,17 +31,30 @@ Client *Client_Create(Hash id,
 
     client->peer_port = peer_port;
 
+    Clock_Init(&client->clock, NULL, NULL);
+
     client->table = Table_Create(&client->node.id);
     check_mem(client->table);
 
+    client->table->clock = &client->clock;
+
+    client->table->has_replacements = 1;
+
+    int rc = Table_IndexAddrs(client->table);
+    check(rc == 0, "Table_IndexAddrs failed");
+
+    Bootstrap_Init(&client->bootstrap);
+
     client->pending = (struct PendingResponses *)HashmapPendingResponses_Create();
     check(client->pending != NULL, "HashmapPendingResponses_Create failed");
 
     client->buf = calloc(1, UDPBUFLEN);
     check_mem(client->buf);
 
-    client->peers = PeersHashmap_Create();
-    check(client->peers != NULL, "PeersHashmap_Create failed");
+    client->peers = PeerStore_Create(PEERSTORE_MAX_SIZE);
+    check(client->peers != NULL, "PeerStore_Create failed");
+    client->peers->clock = &client->clock;
+    client->values_budget = CLIENT_VALUES_BUDGET;
 
     client->incoming = MessageQueue_Create();
     check(client->incoming != NULL, "MessageQueue_Create failed");
@@ -47,26 +63,43 @@ Client *Client_Create(Hash id,
     client->replies = MessageQueue_Create();
     check(client->replies != NULL, "MessageQueue_Create failed");
 
+    client->incoming->clock = &client->clock;
+    client->queries->clock = &client->clock;
+    client->replies->clock = &client->clock;
+
     client->searches = DArray_create(sizeof(Search *), 128);
     check(client->searches != NULL, "DArray_create failed");
 
+    client->serials = Hashmap_create((Hashmap_compare)Serial_Compare,
+                                     (Hashmap_hash)Serial_Hash);
+    check(client->serials != NULL, "Hashmap_create failed");
+
+    client->queued_searches = List_create();
+    check_mem(client->queued_searches);
+    client->max_searches = CLIENT_ACTIVE_SEARCHES;
+
     client->hooks = Hooks_Create();
     check(client->hooks != NULL, "Hooks_Create failed");
 
-    rs = RandomState_Create(time(NULL));
-    check(rs != NULL, "RandomState_Create failed");
+    RttStats_Init(&client->rtt);
+    Pacer_Init(&client->pacer, 0, 0, Clock_Now(&client->clock));
 
-    int rc = Random_Fill(rs, (char *)client->secrets, SECRETS_LEN * sizeof(Hash));
-    check(rc == 0, "Random_Fill failed");
+    client->cache = SearchCache_Create(SEARCHCACHE_TTL, SEARCHCACHE_MAX_SIZE);
+    check(client->cache != NULL, "SearchCache_Create failed");
+
+    client->random = RandomState_Create(time(NULL));
+    check(client->random != NULL, "RandomState_Create failed");
+
+    rc = TokenSecrets_Init(&client->tokens,
+                           client->random,
+                           Clock_Time(&client->clock));
+    check(rc == 0, "TokenSecrets_Init failed");
 
     client->socket = CreateSocket();
     check(client->socket != -1, "CreateSocket failed");
 
-    RandomState_Destroy(rs);
-
     return client;
 error:
-    RandomState_Destroy(rs);
     Client_Destroy(client);
 
     return NULL;
@@ -81,7 +114,8 @@ void Client_Destroy(Client *client)
     Table_Destroy(client->table);
     HashmapPendingResponses_Destroy((HashmapPendingResponses *)client->pending);
     free(client->buf);
-    PeersHashmap_Destroy(client->peers);
+    PeerStore_Destroy(client->peers);
+    Crawl_Destroy(client->crawl);
 
     MessageQueue_Destroy(client->incoming);
     MessageQueue_Destroy(client->queries);
@@ -94,7 +128,21 @@ void Client_Destroy(Client *client)
     }
 
     DArray_destroy(client->searches);
+    Hashmap_destroy(client->serials);
+
+    if (client->queued_searches != NULL)
+    {
+        while (List_count(client->queued_searches) > 0)
+            Search_Destroy(List_pop(client->queued_searches));
+
+        List_destroy(client->queued_searches);
+    }
+
     Hooks_Destroy(client->hooks);
+    AsyncHooks_Destroy(client->async_hooks);
+    SearchCache_Destroy(client->cache);
+    RandomState_Destroy(client->random);
+    Bootstrap_Clear(&client->bootstrap);
   
     if (client->socket != -1)
         close(client->socket);
@@ -102,146 +150,245 @@ void Client_Destroy(Client *client)
     free(client);
 }
 
-#define TOKEN_DATA_LEN (sizeof(Hash) + sizeof(in_addr_t))
+Token Client_MakeToken(Client *client, Node *from)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(from != NULL && "NULL Node pointer");
+
+    return Token_Make(&client->tokens, from);
+}
 
-Token MakeToken(Client *client, Node *from, int secret)
+int Client_IsValidToken(Client *client, Node *from, char *token, size_t token_len)
 {
     assert(client != NULL && "NULL Client pointer");
     assert(from != NULL && "NULL Node pointer");
-    assert(0 <= secret && secret < SECRETS_LEN && "Bad secret");
+    assert(token != NULL && "NULL token data pointer");
 
-    unsigned char data[TOKEN_DATA_LEN];
-    memcpy(data, &client->secrets[secret], sizeof(Hash));
-    memcpy(data + sizeof(Hash), &from->addr.s_addr, sizeof(in_addr_t));
+    return Token_IsValid(&client->tokens, from, token, token_len);
+}
 
-    Token token;
+int Client_NewSecret(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
 
-    SHA1(data, TOKEN_DATA_LEN, (unsigned char *)token.value);
+    return TokenSecrets_Rotate(&client->tokens,
+                               client->random,
+                               Clock_Time(&client->clock));
+}
 
-    return token;
+int CreateSocket()
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    check(sock != -1, "Create socket failed");
+
+    return sock;
+error:
+    return -1;
 }
 
-Token Client_MakeToken(Client *client, Node *from)
+int Client_AddPeer(Client *client, Hash *info_hash, Peer *peer, int seed)
 {
     assert(client != NULL && "NULL Client pointer");
-    assert(from != NULL && "NULL Node pointer");
+    assert(info_hash != NULL && "NULL Hash pointer");
+    assert(peer != NULL && "NULL Peer pointer");
+
+    int rc = PeerStore_AddPeer(client->peers, info_hash, peer, seed);
+    check(rc == 0, "PeerStore_AddPeer failed");
+
+    struct HookPeerData hook_data = { .info_hash = info_hash, .peers = peer, .count = 1 };
+    Client_RunHook(client, HookAddPeer, &hook_data);
 
-    return MakeToken(client, from, 0);
+    return 0;
+error:
+    return -1;
 }
 
-int Client_IsValidToken(Client *client, Node *from, char *token, size_t token_len)
+int Client_GetPeers(Client *client, Hash *info_hash, Peer *peers, size_t max)
 {
     assert(client != NULL && "NULL Client pointer");
-    assert(from != NULL && "NULL Node pointer");
-    assert(token != NULL && "NULL token data pointer");
+    assert(info_hash != NULL && "NULL Hash pointer");
+    assert(peers != NULL && "NULL Peer pointer");
 
-    if (token_len != HASH_BYTES)
-        return 0;
+    return PeerStore_GetPeers(client->peers,
+                              info_hash,
+                              peers,
+                              max,
+                              client->random);
+}
 
-    int i = 0;
-    for (i = 0; i < SECRETS_LEN; i++)
-    {
-        Token valid = MakeToken(client, from, i);
+Search *Client_AddSearch(Client *client, Hash *target)
+{
+    Search *search = Search_Create(target);
+    check(search != NULL, "Search_Create failed");
 
-        if (Hash_Equals((Hash *)token, (Hash *)&valid))
-            return 1;
+    search->table->clock = &client->clock;
+    search->flags = SearchAnnounce;
+
+    int rc = Client_SeedSearch(client, search);
+    check(rc != -1, "Client_SeedSearch failed");
+
+    if (rc == 0)
+    {
+        rc = Search_CopyTable(search, client->table);
+        check(rc == 0, "Search_CopyTable failed");
     }
 
-    return 0;
+    rc = Client_RunSearch(client, search);
+    check(rc == 0, "Client_RunSearch failed");
+
+    return search;
+error:
+    Search_Destroy(search);
+    return NULL;
 }
 
-int Client_NewSecret(Client *client)
+int Client_SeedSearch(Client *client, Search *search)
 {
     assert(client != NULL && "NULL Client pointer");
-    assert(client->buf != NULL && "NULL Client buf pointer");
-    assert(HASH_BYTES == SHA_DIGEST_LENGTH && "Size confusion");
+    assert(search != NULL && "NULL Search pointer");
 
-    SHA_CTX ctx;
+    /* Cached results have no bloom filters to scrape */
+    if (search->flags & SearchScrape)
+        return 0;
 
-    int rc = SHA1_Init(&ctx);
-    check(rc == 1, "SHA1_Init failed");
+    SearchResult *result = SearchCache_Get(client->cache,
+                                           &search->table->id,
+                                           search->max_peers,
+                                           Clock_Time(&client->clock));
 
-    rc = SHA1_Update(&ctx, client->table->id.value, HASH_BYTES);
-    check(rc == 1, "SHA1_Update failed");
+    if (result == NULL)
+        return 0;
 
-    rc = SHA1_Update(&ctx, client->buf, UDPBUFLEN);
-    check(rc == 1, "SHA1_Update failed");
+    int rc = Search_UseResult(search, result);
+    check(rc == 0, "Search_UseResult failed");
 
-    rc = SHA1_Update(&ctx, client->secrets, sizeof(Hash) * SECRETS_LEN);
-    check(rc == 1, "SHA1_Update failed");
+    search->is_cached = 1;
 
-    int i;
-    for (i = SECRETS_LEN - 1; i > 0; i--)
-        client->secrets[i] = client->secrets[i - 1];
+    if (result->peers_count > 0)
+    {
+        Peer *fresh = Search_FreshPeers(search, result->peers_count);
+        check(fresh != NULL, "Search_FreshPeers failed");
+
+        int count = Search_AddPeers(search,
+                                    result->peers,
+                                    result->peers_count,
+                                    fresh);
+        check(count >= 0, "Search_AddPeers failed");
+
+        if (count > 0)
+        {
+            struct HookPeerData data = { .info_hash = &search->table->id,
+                                         .peers = fresh,
+                                         .count = count };
+            Client_RunHook(client, HookNewPeer, &data);
+        }
+    }
 
-    rc = SHA1_Final((unsigned char *)&client->secrets[0].value, &ctx);
-    check(rc == 1, "SHA1_Final failed");
+    /* A lookup is answered by the cached peers alone. An announce
+     * only needs the cached nodes and their tokens. */
+    if (!(search->flags & SearchAnnounce))
+        search->is_done = 1;
 
-    return 0;
+    return search->is_done || result->nodes_count > 0;
 error:
     return -1;
 }
 
-int CreateSocket()
+int Serial_Compare(uint32_t *a, uint32_t *b)
 {
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    check(sock != -1, "Create socket failed");
+    return (*a > *b) - (*a < *b);
+}
 
-    return sock;
-error:
-    return -1;
+uint32_t Serial_Hash(uint32_t *serial)
+{
+    /* Knuth's multiplicative hash spreads consecutive serials */
+    return *serial * 2654435761u;
 }
 
-int Client_AddPeer(Client *client, Hash *info_hash, Peer *peer)
+int Client_RunSearch(Client *client, Search *search)
 {
     assert(client != NULL && "NULL Client pointer");
-    assert(info_hash != NULL && "NULL Hash pointer");
-    assert(peer != NULL && "NULL Peer pointer");
+    assert(search != NULL && "NULL Search pointer");
 
-    int rc = PeersHashmap_AddPeer(client->peers, info_hash, peer);
-    check(rc == 0, "PeersHashmap_AddPeer failed");
+    /* A reply to a query of an ended search must never find a new
+     * search, as it could by the address of the old one */
+    do
+    {
+        search->serial = ++client->next_serial;
+    } while (search->serial == 0
+             || Hashmap_get(client->serials, &search->serial) != NULL);
 
-    struct HookPeerData hook_data = { .info_hash = info_hash, .peers = peer, .count = 1 };
-    Client_RunHook(client, HookAddPeer, &hook_data);
+    int rc = Hashmap_set(client->serials, &search->serial, search);
+    check(rc == 0, "Hashmap_set failed");
+
+    rc = DArray_push(client->searches, search);
+    check(rc == 0, "DArray_push failed");
 
     return 0;
 error:
+    Hashmap_delete(client->serials, &search->serial);
     return -1;
 }
 
-int Client_GetPeers(Client *client, Hash *info_hash, DArray **peers)
+Search *Client_GetSearch(Client *client, uint32_t serial)
 {
     assert(client != NULL && "NULL Client pointer");
-    assert(info_hash != NULL && "NULL Hash pointer");
-    assert(peers != NULL && "NULL pointer to DArray pointer");
 
-    *peers = DArray_create(sizeof(Peer *), 128);
-    check(*peers != NULL, "DArray_create failed");
+    if (serial == 0)
+        return NULL;
 
-    int rc = PeersHashmap_GetPeers(client->peers, info_hash, *peers);
-    check(rc == 0, "PeersHashmap_GetPeers failed");
+    return Hashmap_get(client->serials, &serial);
+}
 
-    return 0;
-error:
-    DArray_destroy(*peers);
-    return -1;
+int SearchRequest_Compare(const void *a, const void *b)
+{
+    SearchRequest *ra = *(SearchRequest **)a;
+    SearchRequest *rb = *(SearchRequest **)b;
+
+    return memcmp(ra->info_hash.value, rb->info_hash.value, HASH_BYTES);
 }
 
-Search *Client_AddSearch(Client *client, Hash *target)
+int Client_AddSearches(Client *client, SearchRequest *requests, size_t count)
 {
-    Search *search = Search_Create(target);
-    check(search != NULL, "Search_Create failed");
+    assert(client != NULL && "NULL Client pointer");
+    assert(requests != NULL && "NULL SearchRequest pointer");
 
-    int rc = Search_CopyTable(search, client->table);
-    check(rc == 0, "Search_CopyTable failed");
+    SearchRequest **sorted = malloc(count * sizeof(SearchRequest *));
+    check_mem(sorted);
 
-    rc = DArray_push(client->searches, search);
-    check(rc == 0, "DArray_push failed");
+    size_t i = 0;
+    for (i = 0; i < count; i++)
+        sorted[i] = &requests[i];
 
-    return search;
+    /* Neighbours in keyspace are started after each other, so each
+     * search can be seeded with the nodes found by the previous. */
+    qsort(sorted, count, sizeof(SearchRequest *), SearchRequest_Compare);
+
+    for (i = 0; i < count; i++)
+    {
+        Search *search = Search_Create(&sorted[i]->info_hash);
+        check(search != NULL, "Search_Create failed");
+
+        search->table->clock = &client->clock;
+        search->flags = sorted[i]->flags;
+        search->max_peers = sorted[i]->max_peers;
+        sorted[i]->search = search;
+
+        List_push(client->queued_searches, search);
+    }
+
+    free(sorted);
+    return 0;
 error:
-    Search_Destroy(search);
-    return NULL;
+    /* None of the batch is left queued */
+    while (sorted != NULL && i-- > 0)
+    {
+        Search_Destroy(List_pop(client->queued_searches));
+        sorted[i]->search = NULL;
+    }
+
+    free(sorted);
+    return -1;
 }
 
 int Client_MarkInvalidMessage(Client *client, Node *from)
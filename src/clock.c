@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <dht/clock.h>
+#include <lcthw/dbg.h>
+
+static pthread_once_t offset_once = PTHREAD_ONCE_INIT;
+static int64_t offset_ms = 0;
+
+int64_t ClockIdMs(clockid_t id)
+{
+    struct timespec now;
+
+    int rc = clock_gettime(id, &now);
+    check(rc == 0, "clock_gettime failed");
+
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+error:
+    return -1;
+}
+
+void InitOffset()
+{
+    offset_ms = ClockIdMs(CLOCK_REALTIME) - ClockIdMs(CLOCK_MONOTONIC);
+}
+
+int64_t Clock_Ms()
+{
+    pthread_once(&offset_once, InitOffset);
+
+    return ClockIdMs(CLOCK_MONOTONIC) + offset_ms;
+}
+
+int64_t Clock_CoarseMs(void *context)
+{
+    (void)context;
+
+    pthread_once(&offset_once, InitOffset);
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    return ClockIdMs(CLOCK_MONOTONIC_COARSE) + offset_ms;
+#else
+    return ClockIdMs(CLOCK_MONOTONIC) + offset_ms;
+#endif
+}
+
+void Clock_Init(Clock *clock, ClockSource source, void *context)
+{
+    assert(clock != NULL && "NULL Clock pointer");
+
+    clock->source = source != NULL ? source : Clock_CoarseMs;
+    clock->context = context;
+
+    Clock_Update(clock);
+}
+
+int64_t Clock_Update(Clock *clock)
+{
+    assert(clock != NULL && "NULL Clock pointer");
+
+    clock->now_ms = clock->source(clock->context);
+
+    return clock->now_ms;
+}
@@ -8,6 +8,8 @@ struct CloseNode
 {
     Node *node;
     Distance distance;
+    int prefix;                 /* Bits shared with the id */
+    int score;
 };
 
 CloseNodes *CloseNodes_Create(Hash *id)
@@ -64,7 +66,7 @@ error:
     return NULL;
 }
 
-int FindIndex(DArray *close, Distance *distance);
+int FindIndex(DArray *close, struct CloseNode *close_node);
 void ShiftFrom(DArray *close, int i);
 
 int CloseNodes_Add(CloseNodes *close, Node *node)
@@ -72,8 +74,14 @@ int CloseNodes_Add(CloseNodes *close, Node *node)
     assert(close != NULL && "NULL CloseNodes pointer");
     assert(node != NULL && "NULL Node pointer");
 
-    Distance distance = Hash_Distance(&close->id, &node->id);
-    int i = FindIndex(close->close_nodes, &distance);
+    struct CloseNode candidate = {
+        .node = node,
+        .distance = Hash_Distance(&close->id, &node->id),
+        .prefix = Hash_SharedPrefix(&close->id, &node->id),
+        .score = Node_Score(node)
+    };
+
+    int i = FindIndex(close->close_nodes, &candidate);
 
     if (i < 0)
         return 0;
@@ -81,8 +89,7 @@ int CloseNodes_Add(CloseNodes *close, Node *node)
     struct CloseNode *close_node = malloc(sizeof(struct CloseNode));
     check_mem(close_node);
 
-    close_node->node = node;
-    close_node->distance = distance;
+    *close_node = candidate;
 
     if (DArray_count(close->close_nodes) < BUCKET_K)
         DArray_push(close->close_nodes, NULL);
@@ -95,10 +102,23 @@ error:
     return -1;
 }
 
-int FindIndex(DArray *close, Distance *distance)
+/* Nodes sharing as many bits with the id are equally close, and
+ * ordered by score before distance. */
+int CloseNode_Compare(struct CloseNode *a, struct CloseNode *b)
+{
+    if (a->prefix != b->prefix)
+        return b->prefix - a->prefix;
+
+    if (a->score != b->score)
+        return b->score - a->score;
+
+    return Distance_Compare(&a->distance, &b->distance);
+}
+
+int FindIndex(DArray *close, struct CloseNode *close_node)
 {
     assert(close != NULL && "NULL DArray pointer");
-    assert(distance != NULL && "NULL Distance pointer");
+    assert(close_node != NULL && "NULL CloseNode pointer");
 
     int i = 0;
     while (i < BUCKET_K)
@@ -108,7 +128,7 @@ int FindIndex(DArray *close, Distance *distance)
 
         struct CloseNode *other = DArray_get(close, i);
 
-        if (Distance_Compare(distance, &other->distance) <= 0)
+        if (CloseNode_Compare(close_node, other) <= 0)
             return i;
 
         i++;
@@ -0,0 +1,196 @@
+#include <assert.h>
+
+#include <dht/clock.h>
+#include <dht/crawl.h>
+#include <dht/hash.h>
+#include <dht/hooks.h>
+#include <dht/message_create.h>
+#include <dht/node.h>
+#include <lcthw/dbg.h>
+
+Crawl *Crawl_Create(int qps, size_t filter_bytes)
+{
+    Crawl *crawl = calloc(1, sizeof(Crawl));
+    check_mem(crawl);
+
+    crawl->queue = List_create();
+    check_mem(crawl->queue);
+
+    crawl->queried = HashFilter_Create(filter_bytes);
+    check(crawl->queried != NULL, "HashFilter_Create failed");
+
+    crawl->samples = HashFilter_Create(filter_bytes);
+    check(crawl->samples != NULL, "HashFilter_Create failed");
+
+    crawl->qps = qps > 0 ? qps : CRAWL_QPS;
+
+    return crawl;
+error:
+    Crawl_Destroy(crawl);
+    return NULL;
+}
+
+void Crawl_Destroy(Crawl *crawl)
+{
+    if (crawl == NULL)
+        return;
+
+    if (crawl->queue != NULL)
+    {
+        while (List_count(crawl->queue) > 0)
+            Node_Destroy(List_unshift(crawl->queue));
+
+        List_destroy(crawl->queue);
+    }
+
+    HashFilter_Destroy(crawl->queried);
+    HashFilter_Destroy(crawl->samples);
+    free(crawl);
+}
+
+/* Moves the target to the next region and queues the closest nodes
+ * we know of there. */
+int Crawl_NextRegion(Client *client, Crawl *crawl)
+{
+    Node *copy = NULL;
+    DArray *nodes = NULL;
+    unsigned char *region = (unsigned char *)crawl->target.value;
+
+    Hash target;
+    int rc = Hash_Random(client->random, &target);
+    check(rc == 0, "Hash_Random failed");
+
+    if (++region[1] == 0 && ++region[0] == 0)
+        crawl->stats.sweeps++;
+
+    memcpy(target.value, region, 2);
+    crawl->target = target;
+
+    nodes = Table_GatherClosest(client->table, &crawl->target);
+    check(nodes != NULL, "Table_GatherClosest failed");
+
+    int i = 0;
+    for (i = 0; i < DArray_count(nodes); i++)
+    {
+        copy = Node_Copy(DArray_get(nodes, i));
+        check_mem(copy);
+
+        List_push(crawl->queue, copy);
+        copy = NULL;
+    }
+
+    DArray_destroy(nodes);
+
+    return 0;
+error:
+    Node_Destroy(copy);
+    DArray_destroy(nodes);
+    return -1;
+}
+
+int Crawl_DoWork(Client *client, Crawl *crawl)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(crawl != NULL && "NULL Crawl pointer");
+
+    Node *node = NULL;
+    int64_t now = Clock_Now(&client->clock);
+    int64_t gap = crawl->qps < 1000 ? 1000 / crawl->qps : 1;
+
+    /* At most a second worth of queries after a pause */
+    if (crawl->next_ms < now - 1000)
+        crawl->next_ms = now - 1000;
+
+    int moved = 0;
+
+    while (crawl->next_ms <= now
+           && !MessageQueue_IsFull(client->queries, LaneMaintenance))
+    {
+        if (List_count(crawl->queue) == 0)
+        {
+            /* One region per call, when all its nodes were queried */
+            if (moved)
+                break;
+
+            int rc = Crawl_NextRegion(client, crawl);
+            check(rc == 0, "Crawl_NextRegion failed");
+
+            moved = 1;
+            continue;
+        }
+
+        node = List_unshift(crawl->queue);
+
+        if (HashFilter_Add(crawl->queried, &node->id))
+        {
+            Message *query = Message_CreateQSampleInfohashes(client,
+                                                             node,
+                                                             &crawl->target);
+            check(query != NULL, "Message_CreateQSampleInfohashes failed");
+
+            int rc = MessageQueue_Push(client->queries, query);
+            check(rc == 0, "MessageQueue_Push failed");
+
+            crawl->stats.queries++;
+            crawl->next_ms += gap;
+        }
+
+        Node_Destroy(node);
+        node = NULL;
+    }
+
+    return 0;
+error:
+    Node_Destroy(node);
+    return -1;
+}
+
+int Crawl_HandleReply(Client *client, Crawl *crawl, Message *reply)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(crawl != NULL && "NULL Crawl pointer");
+    assert(reply != NULL && "NULL Message pointer");
+    assert(reply->type == RSampleInfohashes && "Wrong message type");
+
+    RSampleInfohashesData *data = &reply->data.rsampleinfohashes;
+
+    crawl->stats.replies++;
+    crawl->stats.samples += data->samples_count;
+
+    /* Compacts the new samples to the front of the array */
+    size_t fresh = 0;
+
+    size_t i = 0;
+    for (i = 0; i < data->samples_count; i++)
+    {
+        if (HashFilter_Add(crawl->samples, &data->samples[i]))
+            data->samples[fresh++] = data->samples[i];
+    }
+
+    if (fresh > 0)
+    {
+        struct HookInfoHashData hook_data = { .info_hashes = data->samples,
+                                              .count = fresh };
+        Client_RunHook(client, HookNewInfoHash, &hook_data);
+
+        crawl->stats.new_samples += fresh;
+    }
+
+    for (i = 0; i < data->count; i++)
+    {
+        if (List_count(crawl->queue) >= CRAWL_QUEUE_MAX)
+            break;
+
+        Node *node = data->nodes[i];
+
+        if (node == NULL
+            || Hash_Equals(&node->id, &client->node.id)
+            || HashFilter_Contains(crawl->queried, &node->id))
+            continue;
+
+        List_push(crawl->queue, node);
+        data->nodes[i] = NULL;
+    }
+
+    return 0;
+}
@@ -5,9 +5,15 @@
 #include <lcthw/dbg.h>
 #include <dht/dht.h>
 #include <dht/client.h>
+#include <dht/clock.h>
+#include <dht/crawl.h>
 #include <dht/hooks.h>
 #include <dht/message_create.h>
 #include <dht/network.h>
+#include <dht/peers.h>
+#include <dht/search.h>
+#include <dht/searchcache.h>
+#include <dht/snapshot.h>
 #include <dht/work.h>
 
 void *Dht_CreateClient(Hash id, uint32_t addr, uint16_t port, uint16_t peer_port)
@@ -41,13 +47,27 @@ error:
     return -1;
 }
 
+int Dht_AddSeeds(void *client_, Seed *seeds, size_t count)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(seeds != NULL, "NULL Seed pointer");
+
+    return Bootstrap_AddSeeds(&client->bootstrap, seeds, count);
+error:
+    return -1;
+}
+
 int Dht_Start(void *client_)
 {
     Client *client = (Client *)client_;
     check(client != NULL, "NULL client pointer");
 
-    Search *search = Client_AddSearch(client, &client->table->id);
-    check(search != NULL, "Client_AddSearch failed");
+    int64_t now = Clock_Update(&client->clock);
+
+    /* The first wave of seeds is due at once */
+    client->bootstrap.stats.start_ms = now;
+    client->bootstrap.wave_ms = now - BOOTSTRAP_WAVE_MS;
 
     int rc = NetworkUp(client);
     check(rc == 0, "NetworkUp failed");
@@ -71,11 +91,44 @@ int Dht_Process(void *client_)
     Client *client = (Client *)client_;
     check(client != NULL, "NULL client pointer");
 
-    int rc = Client_HandleSearches(client);
+    Clock_Update(&client->clock);
+
+    int rc = Client_ExpireQueries(client);
+    check(rc == 0, "Client_ExpireQueries failed");
+
+    rc = Client_PingQuestionable(client);
+    check(rc == 0, "Client_PingQuestionable failed");
+
+    rc = Client_Bootstrap(client);
+    check(rc == 0, "Client_Bootstrap failed");
+
+    rc = Client_PingLoaded(client);
+    check(rc == 0, "Client_PingLoaded failed");
+
+    rc = Client_RefreshBuckets(client);
+    check(rc == 0, "Client_RefreshBuckets failed");
+
+    rc = Client_HandleSearches(client);
     check(rc == 0, "Client_HandleSearches failed");
 
     Client_CleanSearches(client);
 
+    rc = Client_CleanPeers(client);
+    check(rc == 0, "Client_CleanPeers failed");
+
+    rc = Client_RotateSecrets(client);
+    check(rc == 0, "Client_RotateSecrets failed");
+
+    if (client->crawl != NULL)
+    {
+        rc = Crawl_DoWork(client, client->crawl);
+        check(rc == 0, "Crawl_DoWork failed");
+    }
+
+    /* Replies held back by the send rate go first */
+    rc = Client_Send(client, client->replies);
+    check(rc == 0, "Client_Send failed");
+
     rc = Client_Send(client, client->queries);
     check(rc == 0, "Client_Send failed");
 
@@ -88,11 +141,52 @@ int Dht_Process(void *client_)
     rc = Client_Send(client, client->replies);
     check(rc == 0, "Client_Send failed");
 
+    Client_FlushHooks(client);
+
     return 0;
 error:
     return -1;
 }
 
+int64_t Dht_NextDeadline(void *client_)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    int64_t now = Clock_Update(&client->clock);
+    int64_t wait = DHT_MAX_WAIT_MS;
+
+    if (MessageQueue_Count(client->incoming) > 0)
+        return 0;
+
+    if (MessageQueue_Count(client->queries) > 0
+        || MessageQueue_Count(client->replies) > 0)
+    {
+        int64_t paced = Pacer_Wait(&client->pacer, now);
+        wait = paced < wait ? paced : wait;
+    }
+
+    Bootstrap *bootstrap = &client->bootstrap;
+
+    if (bootstrap->stats.start_ms >= 0
+        && bootstrap->stats.ready_ms < 0
+        && bootstrap->next < bootstrap->stats.seeds)
+    {
+        int64_t wave = bootstrap->wave_ms + BOOTSTRAP_WAVE_MS - now;
+        wait = wave < wait ? wave : wait;
+    }
+
+    if (client->crawl != NULL)
+    {
+        int64_t crawl = client->crawl->next_ms - now;
+        wait = crawl < wait ? crawl : wait;
+    }
+
+    return wait > 0 ? wait : 0;
+error:
+    return -1;
+}
+
 int Dht_AddHook(void *client, Hook *hook)
 {
     check(client != NULL, "NULL client pointer");
@@ -111,6 +205,68 @@ error:
     return -1;
 }
 
+int Dht_SetAsyncHooks(void *client_, size_t size, HookOverflow overflow)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    int idle = AsyncIdle;
+    int rc = atomic_compare_exchange_strong(&client->async_state,
+                                            &idle,
+                                            AsyncReplacing);
+    check(rc, "Hooks being drained");
+
+    AsyncHooks_Destroy(client->async_hooks);
+    client->async_hooks = NULL;
+
+    if (size > 0)
+    {
+        client->async_hooks = AsyncHooks_Create(size, overflow);
+        check(client->async_hooks != NULL, "AsyncHooks_Create failed");
+    }
+
+    atomic_store(&client->async_state, AsyncIdle);
+
+    return 0;
+error:
+    if (client != NULL && idle == AsyncIdle)
+        atomic_store(&client->async_state, AsyncIdle);
+
+    return -1;
+}
+
+int Dht_DrainHooks(void *client, size_t max)
+{
+    check(client != NULL, "NULL client pointer");
+
+    return Client_DrainHooks((Client *)client, max);
+error:
+    return -1;
+}
+
+int Dht_GetHookStats(void *client_, HookStats *stats)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL HookStats pointer");
+
+    AsyncHooks *async = client->async_hooks;
+
+    *stats = (HookStats){ 0 };
+
+    if (async != NULL)
+    {
+        stats->queued = atomic_load(&async->queued);
+        stats->delivered = atomic_load(&async->delivered);
+        stats->dropped = atomic_load(&async->dropped);
+        stats->synced = atomic_load(&async->synced);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
 /* bstring */
 
 bstring HexStr(char *data, size_t len)
@@ -192,10 +348,12 @@ bstring Dht_MessageTypeStr(MessageType type)
     case QFindNode:     return bfromcstr("QFindNode");
     case QGetPeers:     return bfromcstr("QGetPeers");
     case QAnnouncePeer: return bfromcstr("QAnnouncePeer");
+    case QSampleInfohashes: return bfromcstr("QSampleInfohashes");
     case RPing:         return bfromcstr("RPing");
     case RFindNode:     return bfromcstr("RFindNode");
     case RGetPeers:     return bfromcstr("RGetPeers");
     case RAnnouncePeer: return bfromcstr("RAnnouncePeer");
+    case RSampleInfohashes: return bfromcstr("RSampleInfohashes");
     case RError:        return bfromcstr("RError");
     default:            return bfromcstr("(Invalid MessageType");
     }
@@ -275,6 +433,8 @@ bstring DataQGetPeersStr(Message *message);
 bstring DataQAnnouncePeerStr(Message *message);
 bstring DataRFindNodeStr(Message *message);
 bstring DataRGetPeersStr(Message *message);
+bstring DataQSampleInfohashesStr(Message *message);
+bstring DataRSampleInfohashesStr(Message *message);
 bstring DataRErrorStr(Message *message);
 
 bstring DataStr(Message *message)
@@ -294,6 +454,8 @@ bstring DataStr(Message *message)
     case QAnnouncePeer: return DataQAnnouncePeerStr(message);
     case RFindNode: return DataRFindNodeStr(message);
     case RGetPeers: return DataRGetPeersStr(message);
+    case QSampleInfohashes: return DataQSampleInfohashesStr(message);
+    case RSampleInfohashes: return DataRSampleInfohashesStr(message);
     case RError: return DataRErrorStr(message);
     default: return bfromcstr("(Invalid MessageType)");
     }
@@ -339,6 +501,48 @@ bstring DataQAnnouncePeerStr(Message *message)
     return str;
 }
 
+bstring DataQSampleInfohashesStr(Message *message)
+{
+    bstring target = Dht_HashStr(message->data.qsampleinfohashes.target);
+
+    bstring str = bformat("QSampleInfohashes target: %s", target->data);
+
+    bdestroy(target);
+
+    return str;
+}
+
+bstring DataRSampleInfohashesStr(Message *message)
+{
+    RSampleInfohashesData *data = &message->data.rsampleinfohashes;
+
+    bstring str = bformat("Interval: %d Num: %zd Samples: %zd",
+                          data->interval,
+                          data->num,
+                          data->samples_count);
+
+    size_t i = 0;
+    for (i = 0; i < data->samples_count; i++)
+    {
+        bstring sample = Dht_HashStr(&data->samples[i]);
+
+        bformata(str, "\nSample %02zd: %s", i, sample->data);
+
+        bdestroy(sample);
+    }
+
+    if (data->nodes != NULL && data->count > 0)
+    {
+        bstring nodes = DataRFindNodeStr(message);
+
+        bconchar(str, '\n');
+        bconcat(str, nodes);
+        bdestroy(nodes);
+    }
+
+    return str;
+}
+
 bstring DataRFindNodeStr(Message *message)
 {
     if (message->data.rfindnode.nodes == NULL)
@@ -422,3 +626,330 @@ void *Dht_AddSearch(void *client, Hash info_hash)
 error:
     return NULL;
 }
+
+int Dht_AddSearches(void *client, SearchRequest *requests, size_t count)
+{
+    check(client != NULL, "NULL client pointer");
+    check(requests != NULL || count == 0, "NULL requests pointer");
+
+    if (count == 0)
+        return 0;
+
+    return Client_AddSearches((Client *)client, requests, count);
+error:
+    return -1;
+}
+
+int Dht_SetSearchCache(void *client_, time_t ttl, size_t max_size)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    client->cache->ttl = ttl;
+    client->cache->max_size = max_size;
+
+    SearchCache_Clean(client->cache, Clock_Time(&client->clock));
+
+    while (client->cache->size > max_size)
+        SearchCache_Remove(client->cache, List_first(client->cache->order));
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetSearchCacheStats(void *client_, SearchCacheStats *stats)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL SearchCacheStats pointer");
+
+    stats->hits = client->cache->hits;
+    stats->misses = client->cache->misses;
+    stats->count = List_count(client->cache->order);
+    stats->size = client->cache->size;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_SaveTable(void *client_, const char *path)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(path != NULL, "NULL path pointer");
+
+    return Snapshot_Write(client->table, path);
+error:
+    return -1;
+}
+
+int Dht_LoadTable(void *client_, const char *path)
+{
+    Table *table = NULL;
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(path != NULL, "NULL path pointer");
+
+    table = Snapshot_Read(path);
+    check(table != NULL, "Snapshot_Read failed");
+    check(Hash_Equals(&table->id, &client->table->id), "Snapshot of another id");
+
+    table->has_replacements = client->table->has_replacements;
+
+    int rc = Table_IndexAddrs(table);
+    check(rc == 0, "Table_IndexAddrs failed");
+
+    Table_DestroyNodes(client->table);
+    Table_Destroy(client->table);
+
+    table->clock = &client->clock;
+
+    client->table = table;
+    client->load_time = Clock_Time(&client->clock);
+    client->load_ping_time = 0;
+
+    return 0;
+error:
+    if (table != NULL)
+        Table_DestroyNodes(table);
+
+    Table_Destroy(table);
+    return -1;
+}
+
+int Dht_SetPeerStore(void *client_, size_t max_size)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    client->peers->max_size = max_size;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetPeerStoreStats(void *client_, PeerStoreStats *stats)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL PeerStoreStats pointer");
+
+    stats->info_hashes = List_count(client->peers->order);
+    stats->peers = client->peers->count;
+    stats->size = client->peers->size;
+    stats->max_size = client->peers->max_size;
+    stats->evictions = client->peers->evictions;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetRefreshStats(void *client_, RefreshStats *stats)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL RefreshStats pointer");
+
+    *stats = client->refresh;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetQueueStats(void *client_, QueueLaneStats stats[QueueLaneMax])
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL QueueLaneStats pointer");
+
+    int i = 0;
+    for (i = 0; i < QueueLaneMax; i++)
+    {
+        MessageQueue *queue = i == LaneReply ? client->replies : client->queries;
+        MessageLane *lane = &queue->lanes[i];
+
+        stats[i] = lane->stats;
+        stats[i].count = lane->tail - lane->head;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_SetClock(void *client_, ClockSource source, void *context)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    Clock_Init(&client->clock, source, context);
+
+    /* Restamps what Client_Create stamped with the system clock */
+    time_t now = Clock_Time(&client->clock);
+
+    client->tokens.rotate_time = now;
+
+    Pacer_Init(&client->pacer,
+               client->pacer.packets_rate,
+               client->pacer.bytes_rate,
+               Clock_Now(&client->clock));
+
+    int i = 0;
+    for (i = 0; i < client->table->end; i++)
+        client->table->buckets[i]->change_time = now;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_SetTransport(void *client_, Transport *transport)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(transport != NULL, "NULL Transport pointer");
+
+    if (client->transport == NULL)
+    {
+        int rc = NetworkDown(client);
+        check(rc == 0, "NetworkDown failed");
+
+        client->socket = -1;
+    }
+
+    client->transport = transport;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_SetSendRate(void *client_, uint32_t packets_rate, uint32_t bytes_rate)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    Pacer_Init(&client->pacer,
+               packets_rate,
+               bytes_rate,
+               Clock_Now(&client->clock));
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetPacerStats(void *client_, PacerStats *stats)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL PacerStats pointer");
+
+    *stats = client->pacer.stats;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetBootstrapStats(void *client_, BootstrapStats *stats)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL BootstrapStats pointer");
+
+    *stats = client->bootstrap.stats;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetScrapeStats(void *search, ScrapeStats *stats)
+{
+    check(search != NULL, "NULL search pointer");
+    check(stats != NULL, "NULL ScrapeStats pointer");
+
+    Search_GetScrapeStats((Search *)search, stats);
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_SetTokenScheme(void *client_, TokenScheme scheme)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(scheme == TokenSipHash || scheme == TokenSha1, "Bad TokenScheme");
+
+    client->tokens.scheme = scheme;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_StartCrawl(void *client_, int qps)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    if (client->crawl == NULL)
+    {
+        client->crawl = Crawl_Create(qps, CRAWL_FILTER_BYTES);
+        check(client->crawl != NULL, "Crawl_Create failed");
+    }
+    else
+    {
+        client->crawl->qps = qps > 0 ? qps : CRAWL_QPS;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_StopCrawl(void *client_)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+
+    Crawl_Destroy(client->crawl);
+    client->crawl = NULL;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetCrawlStats(void *client_, CrawlStats *stats)
+{
+    Client *client = (Client *)client_;
+    check(client != NULL, "NULL client pointer");
+    check(stats != NULL, "NULL CrawlStats pointer");
+    check(client->crawl != NULL, "No crawl running");
+
+    *stats = client->crawl->stats;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Dht_GetSearchStats(void *search, SearchStats *stats)
+{
+    check(search != NULL, "NULL search pointer");
+    check(stats != NULL, "NULL SearchStats pointer");
+
+    *stats = ((Search *)search)->stats;
+
+    return 0;
+error:
+    return -1;
+}
@@ -0,0 +1,15 @@
+#ifndef _dht_bloom_h
+#define _dht_bloom_h
+
+#include <dht/dht.h>
+
+/* Adds the address bytes, 4 for IPv4 and 16 for IPv6, to the filter. */
+void Bloom_Add(Bloom *bloom, const void *addr, size_t len);
+/* Adds the IPv4 address, in host byte order, to the filter. */
+void Bloom_AddAddr(Bloom *bloom, uint32_t addr);
+/* Adds every address of src to dest. */
+void Bloom_Merge(Bloom *dest, Bloom *src);
+/* Returns the estimated number of addresses added to the filter. */
+double Bloom_Estimate(Bloom *bloom);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _dht_bootstrap_h
+#define _dht_bootstrap_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dht/dht.h>
+#include <dht/table.h>
+
+/* Seeds pinged at once, and milliseconds between the waves. */
+#define BOOTSTRAP_WAVE 16
+#define BOOTSTRAP_WAVE_MS 200
+/* Rounds of lookups after which the table is ready even if some
+ * buckets are still empty, as in a small network. */
+#define BOOTSTRAP_MAX_ROUNDS 4
+
+/* Fills the routing table from seeds. Each round of lookups looks
+ * for our own id and for a random id in every bucket that is not
+ * full, until the table is ready. */
+typedef struct Bootstrap {
+    Seed *seeds;
+    size_t next;                /* Next seed to ping */
+    int64_t wave_ms;            /* Of the last wave, see Clock_Ms */
+    int lookups;                /* Running */
+    BootstrapStats stats;
+} Bootstrap;
+
+void Bootstrap_Init(Bootstrap *bootstrap);
+void Bootstrap_Clear(Bootstrap *bootstrap);
+
+/* Returns 0 on success, -1 on failure. */
+int Bootstrap_AddSeeds(Bootstrap *bootstrap, Seed *seeds, size_t count);
+
+/* Returns 1 when every bucket of the table has nodes, and there are
+ * at least BUCKET_K of them, 0 otherwise. */
+int Bootstrap_IsTableReady(Table *table);
+
+#endif
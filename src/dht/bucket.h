@@ -7,30 +7,45 @@
 #include <dht/node.h>
 
 #define BUCKET_K 8
+/* Candidates kept for a full bucket. */
+#define BUCKET_REPLACEMENTS 8
 /* The last bits worth of hash ids will all fit in the same bucket. */
 #define BUCKET_LAST_BITS 3
 
 /* A Bucket holds up to BUCKET_K Nodes.
  * The Nodes of a Bucket share at least index bits of id prefix.
- * The nodes array may be sparse. */
+ * The nodes array may be sparse. The replacements array is not, and
+ * holds the most recent candidate last. */
 typedef struct Bucket {
     int index;
     int count;
     time_t change_time;
     Node *nodes[BUCKET_K];
+    Node *replacements[BUCKET_REPLACEMENTS];
+    int replacement_count;
 } Bucket;
 
-Bucket *Bucket_Create();
+/* Bucket functions take the time now, which is their change_time when
+ * they change it. */
+Bucket *Bucket_Create(time_t now);
 void Bucket_Destroy(Bucket *bucket);
 
 int Bucket_ContainsNode(Bucket *bucket, Node *node);
 int Bucket_IsFull(Bucket *bucket);
 
 /* Returns the replaced node, or NULL when no Bad was found */
-Node *Bucket_ReplaceBad(Bucket *bucket, Node *node);
-/* Returns the replaced node, or NULL when no Questionable was found */
-Node *Bucket_ReplaceQuestionable(Bucket *bucket, Node *node);
-
-int Bucket_AddNode(Bucket *bucket, Node *node);
+Node *Bucket_ReplaceBad(Bucket *bucket, Node *node, time_t now);
+/* Replaces the Questionable node of lowest Node_Score.
+ * Returns the replaced node, or NULL when no Questionable was found */
+Node *Bucket_ReplaceQuestionable(Bucket *bucket, Node *node, time_t now);
+
+int Bucket_AddNode(Bucket *bucket, Node *node, time_t now);
+
+/* Adds node as a replacement candidate. A candidate of the same id,
+ * or else the oldest when there are too many, is dropped.
+ * Returns the dropped candidate, or NULL. */
+Node *Bucket_AddReplacement(Bucket *bucket, Node *node);
+/* Removes and returns the most recent candidate, or NULL. */
+Node *Bucket_PopReplacement(Bucket *bucket);
 
 #endif
@@ -1,33 +1,84 @@
 #ifndef _dht_client_h
 #define _dht_client_h
 
+#include <stdatomic.h>
+
+#include <dht/bootstrap.h>
+#include <dht/clock.h>
 #include <dht/messagequeue.h>
+#include <dht/pacer.h>
 #include <dht/table.h>
 #include <dht/protocol.h>
+#include <dht/random.h>
+#include <dht/rtt.h>
+#include <dht/token.h>
 #include <lcthw/hashmap.h>
+#include <lcthw/list.h>
+
+/* Searches queued by Dht_AddSearches are started while fewer than
+ * max_searches are running. This is the default. */
+#define CLIENT_ACTIVE_SEARCHES 16
+/* Nodes of the routing table next to its target in keyspace order
+ * that a search queued by Dht_AddSearches is seeded with. */
+#define CLIENT_SEARCH_SEEDS (2 * BUCKET_K)
+
+/* Buckets unchanged for this many seconds are refreshed. */
+#define CLIENT_REFRESH_AGE (15 * 60)
+/* Seconds between starting bucket refreshes. */
+#define CLIENT_REFRESH_GAP 5
+
+/* Bytes of peers in a get_peers reply, to stay within a datagram.
+ * This is the default. */
+#define CLIENT_VALUES_BUDGET 1024
 
-/* Past secrets are kept to give a grace period for slow announcers */
-#define SECRETS_LEN 2
+/* Nodes of a loaded table pinged per second. */
+#define CLIENT_LOAD_PINGS 32
 
-/* Our own tokens have a known fixed length. See also FToken. */
-typedef Hash Token;
+/* Info_hashes in a sample_infohashes reply, to stay within a datagram
+ * along with the closest nodes. */
+#define CLIENT_SAMPLES_MAX 20
+/* Seconds the same sample of our info_hashes is served (BEP 51). */
+#define CLIENT_SAMPLES_INTERVAL (5 * 60)
 
 typedef struct Client {
     Node node;                  /* Client's own Node */
+    Clock clock;                /* Updated once per Dht_Process */
     Table *table;               /* DHT routing table of Nodes */
     int socket;
+    Transport *transport;       /* In place of the socket, or NULL */
     uint16_t peer_port;         /* Port of the Client's Node's Peer */
     /* tid and message type of queries for which we're expecting replies */
     struct PendingResponses *pending;
     char *buf;                  /* Used for sending and receiving */
     int next_t;                 /* Next transaction id */
-    Hash secrets[SECRETS_LEN];  /* Current and past secrets */
-    Hashmap *peers;             /* All the Peers announced to us, by info_hash */
+    TokenSecrets tokens;        /* Rotated by Client_RotateSecrets */
+    struct PeerStore *peers;    /* All the Peers announced to us */
+    size_t values_budget;       /* Bytes of peers per get_peers reply */
     MessageQueue *incoming;
     MessageQueue *queries;
     MessageQueue *replies;
+    Pacer pacer;                /* Of all outgoing datagrams */
     DArray *searches;
+    Hashmap *serials;           /* The searches, by serial */
+    uint32_t next_serial;
+    List *queued_searches;      /* Not yet started, in keyspace order */
+    int max_searches;           /* Running searches before queueing */
     DArray *hooks;
+    struct AsyncHooks *async_hooks; /* NULL when hooks run at once */
+    atomic_int async_state;     /* Of async_hooks, an AsyncState */
+    struct SearchCache *cache;  /* Results of recently finished searches */
+    RttStats rtt;               /* Of replies to search queries */
+    RandomState *random;
+    time_t refresh_time;        /* When the last refresh started */
+    int refreshing;             /* Refresh searches running */
+    RefreshStats refresh;
+    time_t load_time;           /* Of the table, 0 when all were pinged */
+    time_t load_ping_time;      /* Of the last batch of pings */
+    Bootstrap bootstrap;
+    Hash samples[CLIENT_SAMPLES_MAX]; /* Of our info_hashes, served */
+    size_t samples_count;
+    time_t samples_time;        /* When they were sampled */
+    struct Crawl *crawl;        /* NULL unless crawling */
 } Client;
 
 Client *Client_Create(Hash id,
@@ -46,18 +97,34 @@ int Client_IsValidToken(Client *client,
 /* Create a new secret and shift the past ones */
 int Client_NewSecret(Client *client);
 
-/* Sets *peers to a new DArray of all Peers announced to client for info_hash.
+/* Copies a random sample of up to max Peers announced to client for
+ * info_hash to peers. Returns the number copied, -1 on failure. */
+int Client_GetPeers(Client *client, Hash *info_hash, Peer *peers, size_t max);
+/* Adds peer as announced on info_hash to client, a seed or not, or
+ * updates the entry when already present.
  * Returns 0 on success, -1 on failure. */
-int Client_GetPeers(Client *client, Hash *info_hash, DArray **peers);
-/* Adds peer as announced on info_hash to client or updates the entry time
- * when already present.
- * Returns 0 on success, -1 on failure. */
-int Client_AddPeer(Client *client, Hash *info_hash, Peer *peer);
+int Client_AddPeer(Client *client, Hash *info_hash, Peer *peer, int seed);
 
 typedef struct Search Search;
 
 /* Adds a new Search for target to client. */
 Search *Client_AddSearch(Client *client, Hash *target);
+/* Queues new Searches for the requests, sorted by info_hash, and sets
+ * their search members. Returns 0 on success, -1 on failure, when
+ * none of them is queued. */
+int Client_AddSearches(Client *client, SearchRequest *requests, size_t count);
+
+/* Seeds a new search from the cached result for its target, if any,
+ * delivering the cached peers. Returns 1 when the search needs no
+ * nodes from the routing table, 0 when it does, -1 on failure. */
+int Client_SeedSearch(Client *client, Search *search);
+
+/* Gives search a serial and adds it to the running searches.
+ * Returns 0 on success, -1 on failure. */
+int Client_RunSearch(Client *client, Search *search);
+/* Returns the running search of the serial, or NULL when it has ended
+ * or the serial is 0. */
+Search *Client_GetSearch(Client *client, uint32_t serial);
 
 /* Notes an invalid message from the node. For blacklisting. */
 int Client_MarkInvalidMessage(Client *client, Node *from);
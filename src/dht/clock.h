@@ -0,0 +1,34 @@
+#ifndef _dht_clock_h
+#define _dht_clock_h
+
+#include <stdint.h>
+#include <time.h>
+
+#include <dht/dht.h>
+
+/* A time source read once per tick. The system source reads
+ * CLOCK_MONOTONIC_COARSE. Simulations give their own, such as a
+ * virtual time moved forward by the test. */
+typedef struct Clock {
+    ClockSource source;
+    void *context;
+    int64_t now_ms;             /* As of the last Clock_Update */
+} Clock;
+
+/* A NULL source is the system clock. Reads the time once. */
+void Clock_Init(Clock *clock, ClockSource source, void *context);
+/* Reads the source. Returns the new time in milliseconds. */
+int64_t Clock_Update(Clock *clock);
+
+/* The cached time, in milliseconds and in seconds. */
+#define Clock_Now(C) ((C)->now_ms)
+#define Clock_Time(C) ((time_t)((C)->now_ms / 1000))
+
+/* Milliseconds of a monotonic clock, for timing outside of a Client.
+ * Both system clocks start at the wall clock time of the first read,
+ * so their times compare with each other and with saved tables. */
+int64_t Clock_Ms();
+/* The system ClockSource, of a coarse monotonic clock. */
+int64_t Clock_CoarseMs(void *context);
+
+#endif
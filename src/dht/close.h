@@ -5,7 +5,9 @@
 #include <dht/hash.h>
 #include <dht/node.h>
 
-/* Holds the up to BUCKET_K closet nodes to id. */
+/* Holds the up to BUCKET_K closet nodes to id. Of the nodes sharing
+ * the same number of prefix bits with id, the ones of higher
+ * Node_Score are held first. */
 typedef struct CloseNodes
 {
     Hash id;
@@ -0,0 +1,43 @@
+#ifndef _dht_crawl_h
+#define _dht_crawl_h
+
+#include <dht/client.h>
+#include <dht/hashfilter.h>
+#include <lcthw/list.h>
+
+/* Queries per second of a crawl. This is the default. */
+#define CRAWL_QPS 10
+/* Nodes from replies waiting to be queried. */
+#define CRAWL_QUEUE_MAX 512
+/* Bytes of each filter generation, for the samples and the queried
+ * nodes. */
+#define CRAWL_FILTER_BYTES (1 << 20)
+
+/* A walk of the keyspace with sample_infohashes queries (BEP 51). The
+ * target steps through 2^16 regions, each seeded with the closest
+ * nodes of our table. The nodes of the replies are queried in turn.
+ * Nodes and samples are deduplicated by HashFilters, so memory stays
+ * bounded however long the crawl runs. */
+typedef struct Crawl {
+    Hash target;                /* In the region being walked */
+    List *queue;                /* Of Nodes to query next */
+    HashFilter *queried;        /* Ids of the nodes queried */
+    HashFilter *samples;        /* Info_hashes sampled */
+    int qps;
+    int64_t next_ms;            /* Earliest time of the next query */
+    CrawlStats stats;
+} Crawl;
+
+Crawl *Crawl_Create(int qps, size_t filter_bytes);
+void Crawl_Destroy(Crawl *crawl);
+
+/* Queues the sample_infohashes queries the rate allows. When no nodes
+ * are waiting, moves on to the next region.
+ * Returns 0 on success, -1 on failure. */
+int Crawl_DoWork(Client *client, Crawl *crawl);
+/* Delivers the new samples of the reply to the HookNewInfoHash hooks,
+ * and queues the nodes not queried before, taking them from the reply.
+ * Returns 0 on success, -1 on failure. */
+int Crawl_HandleReply(Client *client, Crawl *crawl, Message *reply);
+
+#endif
@@ -29,6 +29,13 @@ typedef struct Node {
     unsigned int rfindnode_count;
     unsigned int rgetpeers_count;
     unsigned int rannounce_count;
+    int64_t sent_ms;            /* Our last query to it or its last timeout,
+                                 * see Clock_Ms */
+    unsigned int hops;          /* Replies leading to it in a search */
+    int rtt_ms;                 /* Smoothed round trip time, 0 if unknown */
+    unsigned int replies;       /* Replies to our queries */
+    unsigned int timeouts;      /* Our queries it never replied to */
+    unsigned int failures;      /* Timeouts since its last reply */
 } Node;
 
 bstring Dht_NodeStr(Node *node);
@@ -44,6 +51,16 @@ typedef struct Peer {
 
 bstring Dht_PeerStr(Peer *peer);
 
+/* Bloom */
+
+#define BLOOM_BYTES 256
+#define BLOOM_BITS (BLOOM_BYTES * 8)
+
+/* A BEP 33 bloom filter of peer addresses, as sent in BFsd and BFpe. */
+typedef struct Bloom {
+    unsigned char bits[BLOOM_BYTES];
+} Bloom;
+
 /* Hooks */
 
 typedef enum HookType {         /* HookOp args: */
@@ -55,14 +72,41 @@ typedef enum HookType {         /* HookOp args: */
     HookSendMessage,            /* Message */
     HookReceiveMessage,         /* Message */
     HookSearchDone,             /* Search */
+    HookNewPeer,                /* struct HookPeerData, once per Search */
+    HookTableReady,             /* BootstrapStats */
+    HookNewInfoHash,            /* struct HookInfoHashData, once per crawl */
     HookTypeMax
 } HookType;
 
 typedef void (*HookOp)(void *client, void *args);
 
+/* Returns the time in milliseconds. Must not go backwards. */
+typedef int64_t (*ClockSource)(void *context);
+
+/* Carries the datagrams of a client in place of its UDP socket, such
+ * as a simulated network. Implementations start with this struct. send
+ * returns 0 on success; receive returns the length of a datagram from
+ * the node, 0 when there is none; both -1 on failure. */
+typedef struct Transport {
+    int (*send)(struct Transport *transport, Node *to, char *buf, size_t len);
+    int (*receive)(struct Transport *transport, Node *from, char *buf, size_t len);
+} Transport;
+
+/* A hook may be filtered to the message types in a mask of
+ * HOOK_MESSAGE_BITs, and to a set of info_hashes. The mask applies to
+ * the Message hooks, the set to the Message hooks and to those of
+ * struct HookPeerData and struct HookAnnounceData; events without an
+ * info_hash are then skipped. A batched hook gets the events of a
+ * Message hook as struct HookBatchData, once per Dht_Process. */
 typedef struct Hook {
     HookType type;
     HookOp fun;
+    uint64_t message_types;     /* Mask of HOOK_MESSAGE_BITs, 0 for all */
+    void *info_hashes;          /* Hashmap used as a set, NULL for all */
+    int batched;
+    struct HookEvent *events;   /* Batched since the last delivery */
+    size_t events_count;
+    size_t events_max;
 } Hook;
 
 struct HookPeerData {
@@ -71,11 +115,44 @@ struct HookPeerData {
     size_t count;
 };
 
+struct HookInfoHashData {
+    Hash *info_hashes;
+    size_t count;
+};
+
 struct HookAnnounceData {
     void *search;
     Node *node;
 };
 
+/* A Message seen by a hook, copied for batched delivery. */
+typedef struct HookEvent {
+    int message_type;           /* MessageType */
+    Node node;                  /* The other end */
+    int has_info_hash;
+    Hash info_hash;             /* Of the query, or of the search replied */
+} HookEvent;
+
+struct HookBatchData {
+    HookEvent *events;
+    size_t count;
+};
+
+/* What becomes of a hook event when the ring of asynchronous hooks is
+ * full. */
+typedef enum HookOverflow {
+    HookOverflowDrop,           /* Counted and lost */
+    HookOverflowSync            /* Run at once, as without the ring */
+} HookOverflow;
+
+/* Counters of the asynchronous hooks. */
+typedef struct HookStats {
+    unsigned long queued;       /* Events put in the ring */
+    unsigned long delivered;    /* Taken from it by Dht_DrainHooks */
+    unsigned long dropped;
+    unsigned long synced;       /* Run at once, the ring being full */
+} HookStats;
+
 /* Message */
 
 /* Foreign tokens are of unknown length. */
@@ -89,12 +166,18 @@ bstring Dht_FTokenStr(struct FToken ftoken);
 typedef enum MessageType {
     MUnknown = 0,
     QPing = 0100, QFindNode = 0101, QGetPeers = 0102, QAnnouncePeer = 0104,
+    QSampleInfohashes = 0120,
     RPing = 0200, RFindNode = 0201, RGetPeers = 0202, RAnnouncePeer = 0204,
     RError = 0210,
+    RSampleInfohashes = 0220,
 } MessageType;
 
 bstring Dht_MessageTypeStr(MessageType type);
 
+/* Bits for the message_types mask of a Hook, none shared */
+#define HOOK_MESSAGE_BIT(T) ((T) == MUnknown ? 1ULL << 63 \
+                             : 1ULL << (((T) & 037) + ((T) & 0200 ? 32 : 0)))
+
 #define MessageType_IsQuery(T) ((T) & 0100)
 #define MessageType_IsReply(T) ((T) & 0200)
 #define MessageType_AsReply(T) ((T) ^ 0300)
@@ -108,14 +191,21 @@ typedef struct QFindNodeData {
 
 typedef struct QGetPeersData {
     Hash *info_hash;
+    int scrape;                 /* Ask for BFsd and BFpe (BEP 33) */
 } QGetPeersData;
 
 typedef struct QAnnouncePeerData {
     Hash *info_hash;
     uint16_t port;
+    int implied_port;           /* Use the source port instead of port */
+    int seed;                   /* The peer is a seed (BEP 33) */
     struct FToken token;
 } QAnnouncePeerData;
 
+typedef struct QSampleInfohashesData {
+    Hash *target;
+} QSampleInfohashesData;
+
 typedef struct RPingData {
 } RPingData;
 
@@ -130,11 +220,23 @@ typedef struct RGetPeersData {
     size_t count;
     struct FToken token;
     Peer *values;
+    Bloom *seeds;               /* BFsd of a scrape, one block with peers */
+    Bloom *peers;               /* BFpe of a scrape */
 } RGetPeersData;
 
 typedef struct RAnnouncePeerData {
 } RAnnouncePeerData;
 
+/* May be cast as RFindNodeData (BEP 51) */
+typedef struct RSampleInfohashesData {
+    Node **nodes;
+    size_t count;
+    int interval;               /* Seconds the samples are kept */
+    size_t num;                 /* Info_hashes stored */
+    Hash *samples;
+    size_t samples_count;
+} RSampleInfohashesData;
+
 typedef struct RErrorData {
     int code;
     bstring message;
@@ -149,16 +251,22 @@ typedef struct Message {
     char *t;
     size_t t_len;
     Hash id;
-    void *context;
+    void *context;              /* The Search of a reply, when handled */
+    uint32_t search;            /* Serial of the Search of a query, or of
+                                 * the query of a reply. 0 for none */
+    int64_t sent_ms;            /* Of the query of a reply, see Clock_Ms.
+                                 * 0 when unknown */
     union {
 	QPingData qping;
 	QFindNodeData qfindnode;
 	QGetPeersData qgetpeers;
 	QAnnouncePeerData qannouncepeer;
+	QSampleInfohashesData qsampleinfohashes;
 	RPingData rping;
 	RFindNodeData rfindnode;
 	RGetPeersData rgetpeers;
 	RAnnouncePeerData rannouncepeer;
+	RSampleInfohashesData rsampleinfohashes;
 	RErrorData rerror;
     } data;
 } Message;
@@ -181,20 +289,219 @@ bstring Dht_MERROR_Str(merror_t errors);
 
 bstring Dht_RERROR_Str(int code);
 
+/* Search */
+
+typedef enum SearchFlag {
+    SearchLookup = 0,           /* Only look for peers */
+    SearchAnnounce = 01,        /* Also announce our peer_port */
+    SearchImpliedPort = 02,     /* Announce with implied_port set */
+    SearchRefresh = 04,         /* Only find the nodes closest to the target */
+    SearchBootstrap = 010,      /* A SearchRefresh of the bootstrap */
+    SearchScrape = 020,         /* Also estimate the swarm size (BEP 33) */
+    SearchSeed = 040            /* Announce as a seed */
+} SearchFlag;
+
+/* One item of a bulk Dht_AddSearches call. */
+typedef struct SearchRequest {
+    Hash info_hash;
+    int flags;                  /* SearchFlag bits */
+    size_t max_peers;           /* Done after this many peers, 0 for no limit */
+    void *search;               /* Set to the queued Search */
+} SearchRequest;
+
+/* Progress of a search, final once it is done. */
+typedef struct SearchStats {
+    unsigned int queries;       /* Queries sent */
+    unsigned int replies;       /* Replies to them */
+    unsigned int hops;          /* Most replies leading to a replying node */
+    int64_t start_ms;           /* First query sent, see Clock_Ms */
+    int64_t duration_ms;        /* From the first query until done */
+} SearchStats;
+
+/* Swarm size estimated from the bloom filters of the replies to a
+ * SearchScrape, merged. */
+typedef struct ScrapeStats {
+    unsigned int replies;       /* With bloom filters */
+    double seeds;
+    double peers;               /* Not seeding */
+} ScrapeStats;
+
+/* Progress of a crawl of the info_hashes of the DHT (BEP 51). */
+typedef struct CrawlStats {
+    unsigned long queries;
+    unsigned long replies;
+    unsigned long samples;      /* Received */
+    unsigned long new_samples;  /* Not seen before, as far as we know */
+    unsigned long sweeps;       /* Full walks of the keyspace */
+} CrawlStats;
+
+/* How the tokens of our get_peers replies are made. */
+typedef enum TokenScheme {
+    TokenSipHash,               /* Keyed SipHash MAC, the default */
+    TokenSha1                   /* SHA1 of a secret and the address */
+} TokenScheme;
+
+/* Lanes of the message queues, in order of priority. */
+typedef enum QueueLane {
+    LaneReply,                  /* Replies to queries of other nodes */
+    LaneSearch,                 /* Queries of searches */
+    LaneMaintenance,            /* Pings, bootstrap and crawl queries */
+    QueueLaneMax
+} QueueLane;
+
+/* Traffic and queueing delay of a lane. */
+typedef struct QueueLaneStats {
+    size_t count;               /* Messages waiting */
+    size_t capacity;
+    unsigned long pushed;
+    unsigned long rejected;     /* When full */
+    int64_t delay_ms;           /* Total of the popped messages */
+    int64_t max_delay_ms;
+} QueueLaneStats;
+
+/* Outgoing traffic, and how often the send rate held queries back. */
+typedef struct PacerStats {
+    unsigned long packets;
+    unsigned long long bytes;
+    unsigned long deferred;     /* Sends stopped with messages waiting */
+} PacerStats;
+
+/* Traffic of the background bucket refreshes. */
+typedef struct RefreshStats {
+    unsigned long refreshes;    /* Buckets refreshed */
+    unsigned long queries;
+    unsigned long replies;
+} RefreshStats;
+
+/* The address of a node to bootstrap from. */
+typedef struct Seed {
+    uint32_t addr;              /* network byte order */
+    uint16_t port;              /* network byte order */
+} Seed;
+
+/* Progress of the bootstrap, final once the table is ready. */
+typedef struct BootstrapStats {
+    size_t seeds;               /* Added */
+    size_t pinged;              /* Seeds pinged so far */
+    unsigned int rounds;        /* Of lookups */
+    unsigned long queries;      /* Sent by the lookups */
+    unsigned long replies;
+    int64_t start_ms;           /* See Clock_Ms, -1 until Dht_Start */
+    int64_t ready_ms;           /* Time to ready, -1 until then */
+} BootstrapStats;
+
+/* Usage of the store of peers announced to us. */
+typedef struct PeerStoreStats {
+    size_t info_hashes;
+    size_t peers;
+    size_t size;                /* Bytes held */
+    size_t max_size;
+    unsigned long evictions;    /* Of info_hashes, to stay in max_size */
+} PeerStoreStats;
+
+/* Counters of the cache of finished search results. */
+typedef struct SearchCacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    size_t count;               /* Cached results */
+    size_t size;                /* Bytes held by them */
+} SearchCacheStats;
+
+/* Longest wait returned by Dht_NextDeadline. Expired queries and the
+ * periodic work are checked at least this often. */
+#define DHT_MAX_WAIT_MS 250
+
 /* API */
 
 void *Dht_CreateClient(Hash id, uint32_t addr, uint16_t port, uint16_t peer_port);
 void Dht_DestroyClient(void *client);
 int Dht_AddNode(void *client, uint32_t addr, uint16_t port);
+/* Adds nodes to bootstrap from. Once started, the client pings them in
+ * waves and looks up its own id until the routing table is ready,
+ * then runs the HookTableReady hooks. */
+int Dht_AddSeeds(void *client, Seed *seeds, size_t count);
 void *Dht_AddSearch(void *client, Hash info_hash);
+/* Queues searches for many info_hashes. They are started in keyspace
+ * order, a few at a time. Returns 0 on success, -1 on failure, when
+ * none of them is queued. */
+int Dht_AddSearches(void *client, SearchRequest *requests, size_t count);
+/* Saves the routing table of the client to path. */
+int Dht_SaveTable(void *client, const char *path);
+/* Replaces the routing table of the client with the one saved at
+ * path, which must have the same id. The saved nodes are pinged a few
+ * at a time. */
+int Dht_LoadTable(void *client, const char *path);
+
+/* Results of finished searches are reused by new searches for ttl
+ * seconds, within max_size bytes. A max_size of 0 disables the cache. */
+int Dht_SetSearchCache(void *client, time_t ttl, size_t max_size);
+int Dht_GetSearchCacheStats(void *client, SearchCacheStats *stats);
+/* Announced peers are kept within max_size bytes, evicting the least
+ * recently announced info_hashes. */
+int Dht_SetPeerStore(void *client, size_t max_size);
+int Dht_GetPeerStoreStats(void *client, PeerStoreStats *stats);
+int Dht_GetRefreshStats(void *client, RefreshStats *stats);
+/* Of the outgoing lanes: replies, then search and maintenance queries. */
+int Dht_GetQueueStats(void *client, QueueLaneStats stats[QueueLaneMax]);
+/* Limits the datagrams sent to packets_rate per second and bytes_rate
+ * bytes per second, with bursts of 100 ms. A rate of 0 is not limited,
+ * which is the default. Messages wait in their queues for the budget,
+ * replies first. */
+int Dht_SetSendRate(void *client, uint32_t packets_rate, uint32_t bytes_rate);
+int Dht_GetPacerStats(void *client, PacerStats *stats);
+int Dht_GetBootstrapStats(void *client, BootstrapStats *stats);
+/* For a running search, or one passed to a HookSearchDone hook. */
+int Dht_GetSearchStats(void *search, SearchStats *stats);
+/* For a SearchScrape, running or passed to a HookSearchDone hook. */
+int Dht_GetScrapeStats(void *search, ScrapeStats *stats);
+
+/* Tokens given out before a change of scheme are no longer valid. */
+int Dht_SetTokenScheme(void *client, TokenScheme scheme);
+
+/* Walks the keyspace with sample_infohashes queries, at most qps per
+ * second, running the HookNewInfoHash hooks for the info_hashes not
+ * seen before. Returns 0 on success, -1 on failure. */
+int Dht_StartCrawl(void *client, int qps);
+int Dht_StopCrawl(void *client);
+int Dht_GetCrawlStats(void *client, CrawlStats *stats);
 
 bstring Dht_ClientStr(void *client);
 
 int Dht_Start(void *client);
 int Dht_Stop(void *client);
 int Dht_Process(void *client);
+/* Replaces the time source of the client, read once at the start of
+ * each Dht_Process and by Dht_Start. A NULL source is the system clock,
+ * the default. Restamps the token rotation, the send rate budget and
+ * the bucket changes with the new time. Set before Dht_Start, as other
+ * times already taken are kept. */
+int Dht_SetClock(void *client, ClockSource source, void *context);
+/* Returns the milliseconds until Dht_Process has timed work to do,
+ * such as queries waiting for the send rate, for an event loop to
+ * wait on the socket. At most DHT_MAX_WAIT_MS, -1 on failure. */
+int64_t Dht_NextDeadline(void *client);
+/* Closes the socket of the client and sends and receives through
+ * transport instead, which must outlive it. Dht_Start and Dht_Stop
+ * then leave the network alone. */
+int Dht_SetTransport(void *client, Transport *transport);
 
 int Dht_AddHook(void *client, Hook *hook);
 int Dht_RemoveHook(void *client, Hook *hook);
 
+/* Queues the events of HookAddPeer, HookFoundPeer, HookNewPeer,
+ * HookNewInfoHash, HookInvalidMessage and HookTableReady as copies in
+ * a ring of size bytes, instead of running their hooks inside
+ * Dht_Process. The other hooks still run at once, as their args do
+ * not outlive the call. A size of 0 runs all hooks at once again; any
+ * events still queued are lost. Hooks must be added beforehand.
+ * Call it from the thread of Dht_Process. Fails while Dht_DrainHooks
+ * runs, which in turn drains nothing while the ring is replaced. */
+int Dht_SetAsyncHooks(void *client, size_t size, HookOverflow overflow);
+/* Runs the hooks of up to max queued events, oldest first. Meant for
+ * a single application thread, concurrently with Dht_Process. The
+ * hooks get the client pointer only to tell clients apart, and must
+ * not call into it. Returns the number of events, -1 on failure. */
+int Dht_DrainHooks(void *client, size_t max);
+int Dht_GetHookStats(void *client, HookStats *stats);
+
 #endif
@@ -31,6 +31,10 @@ int HandleRFindNode(Client *client, Message *reply);
 int HandleRGetPeers(Client *client, Message *reply);
 /* Runs the HookAnnouncedPeer */
 int HandleRAnnouncePeer(Client *client, Message *reply);
+/* Hands the samples and nodes to a running crawl. */
+int HandleRSampleInfohashes(Client *client, Message *reply);
+/* Notes that the node replied to a query for a Search that is gone. */
+int HandleOrphanReply(Client *client, Message *reply);
 
 /* Gathers the closest nodes. */
 Message *HandleQFindNode(Client *client, Message *query);
@@ -40,6 +44,9 @@ Message *HandleQPing(Client *client, Message *query);
 Message *HandleQAnnouncePeer(Client *client, Message *query);
 /* Finds announced peers or closer nodes. */
 Message *HandleQGetPeers(Client *client, Message *query);
+/* Samples the stored info_hashes, at most once per interval, and
+ * gathers the closest nodes. */
+Message *HandleQSampleInfohashes(Client *client, Message *query);
 
 /* Notes the invalid query and makes a suitable RError */
 Message *HandleInvalidQuery(Client *client, Message *query);
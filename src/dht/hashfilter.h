@@ -0,0 +1,32 @@
+#ifndef _dht_hashfilter_h
+#define _dht_hashfilter_h
+
+#include <dht/dht.h>
+
+/* Bits set per hash. */
+#define HASHFILTER_K 7
+
+/* A set of hashes in bounded memory: two bloom filters of the same
+ * size, each holding up to capacity hashes. When the current one is
+ * full, the older is cleared and takes its place, forgetting the
+ * hashes seen only before then. The filter positions come from the
+ * bits of the hashes themselves, mixed. */
+typedef struct HashFilter {
+    unsigned char *bits[2];     /* Current, then older */
+    size_t bytes;               /* Of each, a power of 2 */
+    size_t count;               /* Added to the current one */
+    size_t capacity;
+    unsigned long rotations;
+} HashFilter;
+
+/* Creates a filter taking 2 * bytes, rounded up to a power of 2. */
+HashFilter *HashFilter_Create(size_t bytes);
+void HashFilter_Destroy(HashFilter *filter);
+
+/* Returns 1 if the hash may have been added, 0 if it surely was not. */
+int HashFilter_Contains(HashFilter *filter, Hash *hash);
+/* Adds the hash. Returns 1 if it was new, 0 if it may have been
+ * added already. */
+int HashFilter_Add(HashFilter *filter, Hash *hash);
+
+#endif
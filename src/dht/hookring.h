@@ -0,0 +1,45 @@
+#ifndef _dht_hookring_h
+#define _dht_hookring_h
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bytes of a ring of hook events. This is the default. */
+#define HOOKRING_SIZE (1 << 20)
+
+/* The header of a record in a HookRing. The payload follows. */
+typedef struct HookRecord {
+    uint32_t type;              /* HookType, HookTypeMax for padding */
+    uint32_t size;              /* Bytes of the record, a multiple of 8 */
+} HookRecord;
+
+/* A bounded ring of variable size records, for a single producer and
+ * a single consumer on another thread, without locks. Positions only
+ * grow; each side publishes its own with release ordering and reads
+ * the other's with acquire ordering. A record never wraps around the
+ * end of the buffer: the space left there is taken by padding. */
+typedef struct HookRing {
+    unsigned char *buf;
+    size_t size;                /* A power of 2 */
+    _Atomic size_t head;        /* Written by the producer */
+    _Atomic size_t tail;        /* Written by the consumer */
+    size_t reserved;            /* Head after the reserved record */
+} HookRing;
+
+/* Creates a ring of size bytes, rounded up to a power of 2. */
+HookRing *HookRing_Create(size_t size);
+void HookRing_Destroy(HookRing *ring);
+
+/* Producer side. Reserves a record with len bytes of payload, or
+ * returns NULL when the ring is full. The record is seen by the
+ * consumer once committed. */
+HookRecord *HookRing_Reserve(HookRing *ring, uint32_t type, size_t len);
+void HookRing_Commit(HookRing *ring);
+
+/* Consumer side. Returns the oldest committed record, or NULL when
+ * the ring is empty. The record stays valid until released. */
+HookRecord *HookRing_Peek(HookRing *ring);
+void HookRing_Release(HookRing *ring, HookRecord *record);
+
+#endif
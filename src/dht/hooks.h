@@ -3,16 +3,62 @@
 
 #include <dht/dht.h>
 #include <dht/client.h>
+#include <dht/hookring.h>
 #include <lcthw/darray.h>
 
+/* Hook events queued for an application thread. The counters are
+ * read from either thread. */
+typedef struct AsyncHooks {
+    HookRing *ring;
+    HookOverflow overflow;
+    atomic_ulong queued;
+    atomic_ulong delivered;
+    atomic_ulong dropped;
+    atomic_ulong synced;
+} AsyncHooks;
+
+/* Of client->async_state. Client_DrainHooks only reads the ring while
+ * draining, and Dht_SetAsyncHooks only replaces it while replacing;
+ * each takes the state from AsyncIdle with a compare and swap. */
+typedef enum AsyncState {
+    AsyncIdle = 0,
+    AsyncDraining,
+    AsyncReplacing
+} AsyncState;
+
 DArray *Hooks_Create();
 void Hooks_Destroy(DArray *array);
 
+/* Events of a batched hook delivered at once when this many pile up
+ * before the end of the tick. */
+#define HOOK_BATCH_MAX 4096
+
 Hook *Hook_Create(HookType type, HookOp fun);
+/* A hook of HookReceiveMessage, HookSendMessage or HookHandleMessage
+ * getting struct HookBatchData. */
+Hook *Hook_CreateBatched(HookType type, HookOp fun);
 void Hook_Destroy(Hook *hook);
 
+/* Limits the hook to the message types of the mask. */
+void Hook_SetMessageTypes(Hook *hook, uint64_t mask);
+/* Adds info_hash to the set the hook is limited to.
+ * Returns 0 on success, -1 on failure. */
+int Hook_AddInfoHash(Hook *hook, Hash *info_hash);
+
 int Client_AddHook(Client *client, Hook *hook);
 int Client_RemoveHook(Client *client, Hook *hook);
+/* Runs the hooks of type with args, or queues a copy of args when
+ * hooks are asynchronous. Returns the number of hooks run. */
 int Client_RunHook(Client *client, HookType type, void *args);
+/* Delivers the events of the batched hooks. Run once per tick. */
+void Client_FlushHooks(Client *client);
+
+AsyncHooks *AsyncHooks_Create(size_t size, HookOverflow overflow);
+void AsyncHooks_Destroy(AsyncHooks *async);
+/* Returns 1 if events of type can be queued. */
+int AsyncHooks_IsQueued(HookType type);
+/* Runs the hooks of up to max queued events, oldest first.
+ * Returns the number of events. */
+int Client_DrainHooks(Client *client, size_t max);
 
 #endif
@@ -12,6 +12,7 @@ Message *Message_CreateQAnnouncePeer(Client *client,
                                      Hash *info_hash,
                                      char *token,
                                      size_t token_len);
+Message *Message_CreateQSampleInfohashes(Client *client, Node *to, Hash *target);
 
 Message *Message_CreateRFindNode(Client *client, Message *query, DArray *found);
 Message *Message_CreateRPing(Client *client, Message *query);
@@ -21,6 +22,21 @@ Message *Message_CreateRGetPeers(Client *client,
                                  DArray *peers,
                                  DArray *nodes,
                                  Token *token);
+/* The reply takes the values array, which must be malloc'd. It is
+ * freed on failure as well. */
+Message *Message_CreateRGetPeersValues(Client *client,
+                                       Message *query,
+                                       Peer *values,
+                                       size_t count,
+                                       Token *token);
+/* Copies the samples. Like Message_CreateRFindNode, does not copy the
+ * found nodes. */
+Message *Message_CreateRSampleInfohashes(Client *client,
+                                         Message *query,
+                                         DArray *found,
+                                         Hash *samples,
+                                         size_t count,
+                                         size_t num);
 
 Message *Message_CreateRErrorBadToken(Client *client, Message *query);
 Message *Message_CreateRError(Client *client, Message *query);
@@ -1,19 +1,49 @@
 #ifndef _dht_messagequeue_h
 #define _dht_messagequeue_h
 
+#include <dht/clock.h>
+#include <dht/dht.h>
 #include <dht/message.h>
-#include <lcthw/darray.h>
 
-/* LIFO but whatever */
-typedef DArray MessageQueue;
+/* Messages per lane of a queue. This is the default. */
+#define MESSAGEQUEUE_CAPACITY 256
 
-#define MessageQueue_Create() DArray_create(sizeof(Message *), 0x100)
-#define MessageQueue_Destroy DArray_destroy
+/* A fixed ring of messages, oldest first. */
+typedef struct MessageLane {
+    Message **messages;
+    int64_t *push_ms;           /* When each message was pushed */
+    size_t capacity;            /* A power of 2 */
+    size_t head;                /* Next to pop */
+    size_t tail;                /* Next free */
+    QueueLaneStats stats;
+} MessageLane;
 
-#define MessageQueue_Push DArray_push
-#define MessageQueue_Pop DArray_pop
-#define MessageQueue_Count DArray_count
+/* A FIFO queue in lanes of fixed capacity. Replies are popped first,
+ * then the queries of searches, then the other queries. A full lane
+ * rejects messages instead of growing, so producers check
+ * MessageQueue_IsFull before making theirs. The queue owns the
+ * messages it holds. */
+typedef struct MessageQueue {
+    MessageLane lanes[QueueLaneMax];
+    Clock *clock;               /* Of the client, NULL for the system's */
+} MessageQueue;
 
-#define MessageQueue_Clear(MQ) while (DArray_count((MQ)) > 0) Message_Destroy(DArray_pop((MQ)));
+#define MessageQueue_Create() MessageQueue_CreateSized(MESSAGEQUEUE_CAPACITY)
+/* Creates a queue of lanes of capacity messages, rounded up to a
+ * power of 2. */
+MessageQueue *MessageQueue_CreateSized(size_t capacity);
+/* Destroys the queue and the messages left in it. */
+void MessageQueue_Destroy(MessageQueue *queue);
+
+/* The lane a message goes to. */
+QueueLane MessageQueue_Lane(Message *message);
+/* Returns 0 when queued, -1 when its lane is full. The caller still
+ * owns a rejected message. */
+int MessageQueue_Push(MessageQueue *queue, Message *message);
+/* Returns the oldest message of the first lane not empty, or NULL. */
+Message *MessageQueue_Pop(MessageQueue *queue);
+int MessageQueue_Count(MessageQueue *queue);
+int MessageQueue_IsFull(MessageQueue *queue, QueueLane lane);
+void MessageQueue_Clear(MessageQueue *queue);
 
 #endif
@@ -25,6 +25,25 @@ typedef enum NodeStatus { Unknown, Good, Questionable, Bad } NodeStatus;
 
 NodeStatus Node_Status(Node *node, time_t time);
 
+/* Round trip time assumed for nodes we haven't timed yet, in ms. */
+#define NODE_RTT_UNKNOWN 1000
+/* After a timeout the node is not queried for this many ms, doubling
+ * with each further timeout up to NODE_BACKOFF_MAX_SHIFT times. */
+#define NODE_BACKOFF_MS 2000
+#define NODE_BACKOFF_MAX_SHIFT 9
+
+/* Records a reply to our query after rtt ms. */
+void Node_MarkReply(Node *node, int64_t rtt);
+/* Records a query of ours that the node never replied to. */
+void Node_MarkTimeout(Node *node);
+
+/* Returns 1 when the node should not be queried at time now (ms). */
+int Node_IsBackedOff(Node *node, int64_t now);
+
+/* The quality of the node as a query target, from its reply ratio and
+ * round trip time. Higher is better. */
+int Node_Score(Node *node);
+
 typedef int (*NodeOp)(void *context, Node *node);
 
 #endif
@@ -0,0 +1,36 @@
+#ifndef _dht_pacer_h
+#define _dht_pacer_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dht/dht.h>
+
+/* Milliseconds of budget a pacer saves up, and so its largest burst. */
+#define PACER_BURST_MS 100
+
+/* A token bucket over the outgoing datagrams, for a rate of packets
+ * and of bytes per second. A rate of 0 is not limited. The budget is
+ * kept in thousandths so that it refills every millisecond. A send is
+ * allowed while the budget is not spent, and is then charged in full,
+ * so the size of a datagram need not be known beforehand; the debt is
+ * paid back before the next one. */
+typedef struct Pacer {
+    uint32_t packets_rate;
+    uint32_t bytes_rate;
+    int64_t packets;            /* Thousandths of a packet */
+    int64_t bytes;              /* Thousandths of a byte */
+    int64_t update_ms;          /* Of the budget, see Clock_Ms */
+    PacerStats stats;
+} Pacer;
+
+void Pacer_Init(Pacer *pacer, uint32_t packets_rate, uint32_t bytes_rate, int64_t now);
+
+/* Returns 1 when a datagram may be sent at now, 0 when it must wait. */
+int Pacer_IsReady(Pacer *pacer, int64_t now);
+/* Charges a sent datagram of len bytes. */
+void Pacer_Charge(Pacer *pacer, size_t len);
+/* Returns the milliseconds until Pacer_IsReady, 0 when it already is. */
+int64_t Pacer_Wait(Pacer *pacer, int64_t now);
+
+#endif
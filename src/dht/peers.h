@@ -3,40 +3,142 @@
 
 #include <time.h>
 
+#include <dht/clock.h>
 #include <dht/dht.h>
 #include <dht/hash.h>
+#include <dht/random.h>
 #include <lcthw/darray.h>
 #include <lcthw/hashmap.h>
+#include <lcthw/list.h>
 
 #define MAXPEERS 0x1F00
 
-/* Stores announced peers for a single info_hash.  */
+/* Bytes of a peer in compact form: addr and port, big endian. */
+#define PEER_COMPACT_LEN 6
+/* Bytes of a peer in the values of a get_peers reply. */
+#define PEER_VALUE_LEN (PEER_COMPACT_LEN + 2)
+
+/* No entry, in the time links of Peers. */
+#define PEERS_NIL 0xFFFF
+
+/* Stores announced peers for a single info_hash, as a flat array of
+ * compact entries and their times. The slots index the entries by
+ * open addressing, and the entries are linked oldest to newest so
+ * expired ones are found without a scan. */
 typedef struct Peers {
     Hash info_hash;
-    Hashmap *hashmap;
+    char *entries;              /* count compact peers */
+    time_t *times;              /* Added or updated, per entry */
+    char *seeds;                /* 1 for a seed, per entry */
     int count;
-    time_t (*GetTime)();
+    int capacity;               /* Of entries, times and seeds */
+    uint32_t *slots;            /* Entry position + 1, 0 for empty */
+    size_t size;                /* Of slots, 0 or a power of 2 */
+    uint16_t *older;            /* Entry added or updated before, per entry */
+    uint16_t *newer;            /* Entry added or updated after, per entry */
+    int oldest;                 /* PEERS_NIL when empty */
+    int newest;
+    Bloom *blooms;              /* BFsd then BFpe, NULL until scraped */
+    int blooms_stale;           /* Rebuild them before the next scrape */
+    Clock *clock;               /* Of the store, NULL for the system's */
+    ListNode *entry;            /* In PeerStore.order */
+    ListNode *wheel_entry;      /* In PeerStore.wheel, NULL if not in it */
+    int wheel_slot;
 } Peers;
 
 Peers *Peers_Create(Hash *info_hash);
 void Peers_Destroy(Peers *peers);
 
-/* Pushes all peers on the result array. */
-int Peers_GetPeers(Peers *peers, DArray *result);
+/* Copies up to max peers to dest. Returns the number copied. */
+size_t Peers_GetPeers(Peers *peers, Peer *dest, size_t max);
+/* Copies a uniform random sample of up to max peers to dest.
+ * Returns the number copied, -1 on failure. */
+int Peers_Sample(Peers *peers, Peer *dest, size_t max, RandomState *rs);
 /* Add the peer or update the time if already present. */
 int Peers_AddPeer(Peers *peers, Peer *peer);
+/* Peers_AddPeer, telling if the peer is a seed. */
+int Peers_AnnouncePeer(Peers *peers, Peer *peer, int seed);
+/* Copies the bloom filters of the addresses of the seeds and of the
+ * other peers (BEP 33). They are built on the first scrape, updated
+ * as peers are added, and rebuilt once peers are removed.
+ * Returns 0 on success, -1 on failure. */
+int Peers_Scrape(Peers *peers, Bloom *seeds, Bloom *others);
 
-/* Clean out all peers added or updated before the cutoff time. */
+/* Clean out all peers added or updated before the cutoff time,
+ * oldest first. Takes time in the number of peers removed. */
 int Peers_Clean(Peers *peers, time_t cutoff);
+/* Returns the bytes held by peers. */
+size_t Peers_Size(Peers *peers);
+
+/* A compact set of peers, telling new peers from already seen ones.
+ * Open addressing over packed addr and port keys. */
+typedef struct PeerFilter {
+    uint64_t *slots;            /* 0 for empty slots */
+    size_t size;                /* Always a power of 2 */
+    size_t count;
+} PeerFilter;
+
+PeerFilter *PeerFilter_Create(size_t size);
+void PeerFilter_Destroy(PeerFilter *filter);
+
+/* Adds the peer to the filter.
+ * Returns 1 if it was new, 0 if already present, -1 on failure. */
+int PeerFilter_Add(PeerFilter *filter, Peer *peer);
+
+/* Bytes held by a PeerStore before the least recently announced
+ * info_hashes are evicted. This is the default. */
+#define PEERSTORE_MAX_SIZE (16 << 20)
+/* Seconds an announced peer is kept after its last announce. */
+#define PEERSTORE_TTL (30 * 60)
+/* Minutes in the expiry wheel, covering PEERSTORE_TTL and the minutes
+ * being cleaned and filled. */
+#define PEERSTORE_WHEEL_SLOTS (PEERSTORE_TTL / 60 + 2)
+
+/* The Peers announced to us, by info_hash, within max_size bytes.
+ * The wheel holds each Peers in the slot of the minute its oldest
+ * peer was announced, so a clean only visits the Peers with peers
+ * expiring in the minutes passed since the last one. */
+typedef struct PeerStore {
+    Hashmap *hashmap;
+    List *order;                /* Least recently announced first */
+    List *wheel[PEERSTORE_WHEEL_SLOTS];
+    time_t wheel_minute;        /* Next minute of the wheel to expire */
+    size_t count;               /* Of peers */
+    size_t size;
+    size_t max_size;
+    unsigned long evictions;    /* Of info_hashes, to stay in max_size */
+    Clock *clock;               /* Given to its Peers */
+} PeerStore;
 
-Hashmap *PeersHashmap_Create();
-void PeersHashmap_Destroy(Hashmap *hashmap);
+PeerStore *PeerStore_Create(size_t max_size);
+void PeerStore_Destroy(PeerStore *store);
 
-/* From a hashmap of Peers structs by info_hash, push all peers for the
- * given info_hash on the result array. */
-int PeersHashmap_GetPeers(Hashmap *hashmap, Hash *info_hash, DArray *result);
-/* To a hashmap of Peers structs by info_hash, add the peer to the
- * Peers of the info_hash, creating the Peers struct when needed. */
-int PeersHashmap_AddPeer(Hashmap *hashmap, Hash *info_hash, Peer *peer);
+/* Copies a random sample of up to max peers for info_hash to dest,
+ * allocating nothing. Returns the number copied, -1 on failure. */
+int PeerStore_GetPeers(PeerStore *store,
+                       Hash *info_hash,
+                       Peer *dest,
+                       size_t max,
+                       RandomState *rs);
+/* Adds the peer, a seed or not, to the Peers of info_hash, creating
+ * them when needed,
+ * then evicts the least recently announced while over max_size.
+ * Returns 0 on success, -1 on failure. */
+int PeerStore_AddPeer(PeerStore *store, Hash *info_hash, Peer *peer, int seed);
+/* Copies the bloom filters of the seeds and other peers announced for
+ * info_hash. Returns 1 when there are any, 0 when there are none,
+ * -1 on failure. */
+int PeerStore_Scrape(PeerStore *store, Hash *info_hash, Bloom *seeds, Bloom *others);
+/* Cleans out the peers not announced within PEERSTORE_TTL of now, a
+ * minute at a time, and the info_hashes left without peers. */
+int PeerStore_Clean(PeerStore *store, time_t now);
+/* Copies a uniform random sample of up to max of the info_hashes to
+ * dest. Returns the number copied, -1 on failure. */
+int PeerStore_SampleInfoHashes(PeerStore *store,
+                               Hash *dest,
+                               size_t max,
+                               RandomState *rs);
+/* Removes and destroys the peers of one info_hash. */
+void PeerStore_Remove(PeerStore *store, Peers *peers);
 
 #endif
@@ -15,4 +15,13 @@ typedef struct HashmapPendingResponses {
 HashmapPendingResponses *HashmapPendingResponses_Create();
 void HashmapPendingResponses_Destroy(HashmapPendingResponses *pending);
 
+typedef int (*PendingResponseOp)(void *context, PendingResponse *entry);
+
+/* Removes the entries of queries sent before cutoff, calling
+ * op(context, entry) for each. Returns 0 on success, -1 on failure. */
+int HashmapPendingResponses_Expire(HashmapPendingResponses *pending,
+                                   int64_t cutoff,
+                                   void *context,
+                                   PendingResponseOp op);
+
 #endif
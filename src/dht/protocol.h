@@ -16,7 +16,9 @@ typedef struct PendingResponse {
     tid_t tid;
     Hash id;
     void *context;
+    uint32_t search;            /* Serial of the Search of the query, or 0 */
     int is_new;                 /* Don't know their id yet */
+    int64_t sent_ms;            /* See Clock_Ms */
 } PendingResponse;
 
 /* Try to get the entry for the given transaction_id. (By now we
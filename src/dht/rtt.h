@@ -0,0 +1,39 @@
+#ifndef _dht_rtt_h
+#define _dht_rtt_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Recent round trip times kept for the percentile. */
+#define RTT_SAMPLES 64
+/* Samples needed before the timeout follows them. */
+#define RTT_MIN_SAMPLES 8
+/* The timeout is RTT_FACTOR times this percentile of the samples. */
+#define RTT_PERCENTILE 90
+#define RTT_FACTOR 2
+
+/* Query timeouts in milliseconds: used until there are enough
+ * samples, and the bounds of the adaptive timeout. */
+#define RTT_TIMEOUT_DEFAULT 2000
+#define RTT_TIMEOUT_MIN 250
+#define RTT_TIMEOUT_MAX 5000
+
+/* Observed round trip times of queries, in milliseconds. */
+typedef struct RttStats {
+    int64_t samples[RTT_SAMPLES]; /* Ring of the latest samples */
+    size_t count;
+    size_t next;
+    int64_t timeout;            /* Updated by RttStats_Add */
+} RttStats;
+
+void RttStats_Init(RttStats *stats);
+
+void RttStats_Add(RttStats *stats, int64_t rtt);
+
+/* Returns the percentile of the samples, -1 when there are none. */
+int64_t RttStats_Percentile(RttStats *stats, int percent);
+
+/* Returns how long to wait for a reply before giving up on a query. */
+#define RttStats_Timeout(S) ((S)->timeout)
+
+#endif
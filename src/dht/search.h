@@ -16,8 +16,19 @@
 typedef struct Search {
     Table *table;
     Peers *peers;
+    PeerFilter *seen;           /* Every peer delivered so far */
+    Peer *fresh;                /* See Search_FreshPeers */
+    size_t fresh_max;
     Hashmap *tokens;
-    time_t send_time;
+    uint32_t serial;            /* Unique on the client once running */
+    SearchStats stats;
+    int flags;                  /* SearchFlag bits */
+    size_t max_peers;           /* Done after this many peers, 0 for no limit */
+    int is_done;                /* Ended early, send no more queries */
+    int is_cached;              /* Seeded from a cached SearchResult */
+    Bloom scrape_seeds;         /* BFsd of the replies to a SearchScrape */
+    Bloom scrape_peers;         /* BFpe of them */
+    unsigned int scrapes;       /* Replies with bloom filters */
 } Search;
 
 Search *Search_Create(Hash *id);
@@ -25,15 +36,45 @@ void Search_Destroy(Search *search);
 
 /* Copy the nodes from source and insert them to the search table. */
 int Search_CopyTable(Search *search, Table *source);
+/* Copy the nodes of the array and insert them to the search table. */
+int Search_CopyNodes(Search *search, DArray *nodes);
 
 /* Create and enqueue find_nodes, get_peers and announce_peer queries. */
 int Search_DoWork(Client *client, Search *search);
 
-/* Checks if the search is done */
-int Search_IsDone(Search *search, time_t now);
+/* Checks if the search is done: each of the closest nodes that has
+ * not timed out replied to every query we had for it. Times are in
+ * ms, see Clock_Ms. */
+int Search_IsDone(Search *search, int64_t now, int64_t timeout);
 
-/* Adds to the collection of found peers by the search. */
-int Search_AddPeers(Search *search, Peer *peers, int count);
+/* sent_ms of a node in a search while its query waits to be sent */
+#define SEARCH_QUEUED_MS INT64_MAX
+
+/* A node timed out when a query sent to it is older than timeout, or
+ * expired since its last reply. A query still queued has not. */
+#define Search_IsTimedOut(N, NOW, TIMEOUT) \
+    ((N)->failures > 0 \
+     || ((N)->pending_queries > 0 \
+         && (N)->sent_ms != SEARCH_QUEUED_MS \
+         && (NOW) - (N)->sent_ms >= (TIMEOUT)))
+
+/* Notes that the query to the node of id was sent at now (ms). */
+void Search_MarkSent(Search *search, Hash *id, int64_t now);
+
+/* Adds to the collection of found peers by the search. The peers not
+ * seen before are copied to fresh, which may be the peers array
+ * itself. When max_peers is reached the rest are ignored and the
+ * search is done. Returns the number of fresh peers, -1 on failure. */
+int Search_AddPeers(Search *search, Peer *peers, int count, Peer *fresh);
+
+/* Returns room in the search for count fresh peers, reused by the
+ * next call. Returns NULL on failure. */
+Peer *Search_FreshPeers(Search *search, size_t count);
+
+/* Merges the bloom filters of a reply to a SearchScrape. */
+void Search_AddScrape(Search *search, Bloom *seeds, Bloom *peers);
+/* Estimates the swarm size from the merged bloom filters. */
+void Search_GetScrapeStats(Search *search, ScrapeStats *stats);
 
 /* Gets the token, if any, for the node id. */
 struct FToken *Search_GetToken(Search *search, Hash *id);
@@ -0,0 +1,74 @@
+#ifndef _dht_searchcache_h
+#define _dht_searchcache_h
+
+#include <time.h>
+
+#include <dht/dht.h>
+#include <dht/search.h>
+#include <lcthw/hashmap.h>
+#include <lcthw/list.h>
+
+/* Seconds a search result is reused. Kept below the usual lifetime of
+ * the tokens it holds. */
+#define SEARCHCACHE_TTL (5 * 60)
+/* Bytes held by all cached results before the oldest are evicted. */
+#define SEARCHCACHE_MAX_SIZE (1 << 20)
+
+/* A close node that replied to get_peers, with its token. */
+typedef struct SearchResultNode {
+    Node node;
+    struct FToken token;
+} SearchResultNode;
+
+/* The outcome of a finished search for info_hash. */
+typedef struct SearchResult {
+    Hash info_hash;
+    time_t time;
+    Peer *peers;
+    size_t peers_count;
+    SearchResultNode *nodes;
+    size_t nodes_count;
+    size_t max_peers;           /* Peers it stopped at, 0 when complete */
+    size_t size;                /* Bytes accounted to the cache */
+    ListNode *entry;            /* In SearchCache.order */
+} SearchResult;
+
+/* Recent search results by info_hash. Results expire after ttl
+ * seconds, and the oldest are evicted while more than max_size
+ * bytes are held. */
+typedef struct SearchCache {
+    Hashmap *results;
+    List *order;                /* Oldest result first */
+    time_t ttl;
+    size_t max_size;
+    size_t size;
+    unsigned long hits;
+    unsigned long misses;
+} SearchCache;
+
+SearchCache *SearchCache_Create(time_t ttl, size_t max_size);
+void SearchCache_Destroy(SearchCache *cache);
+
+/* Stores the peers and the closest replied nodes of the search,
+ * replacing any older result for its target.
+ * Returns 0 on success, -1 on failure. */
+int SearchCache_Put(SearchCache *cache, Search *search, time_t now);
+/* Returns the unexpired result for info_hash, or NULL. A result that
+ * stopped at max_peers only serves searches stopping at as many peers
+ * or fewer; max_peers is that of the search, 0 for no limit. Counts a
+ * hit or a miss. */
+SearchResult *SearchCache_Get(SearchCache *cache,
+                              Hash *info_hash,
+                              size_t max_peers,
+                              time_t now);
+/* Removes the results that expired before now. */
+void SearchCache_Clean(SearchCache *cache, time_t now);
+/* Removes and destroys the cached result. */
+void SearchCache_Remove(SearchCache *cache, SearchResult *result);
+
+/* Seeds the search table with the nodes of the result, marked as
+ * already replied to get_peers, and their tokens.
+ * Returns 0 on success, -1 on failure. */
+int Search_UseResult(Search *search, SearchResult *result);
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef _dht_simnet_h
+#define _dht_simnet_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dht/client.h>
+#include <dht/random.h>
+#include <lcthw/darray.h>
+
+/* Address of the first client of a SimNet, 10.0.0.1, host order. */
+#define SIMNET_BASE_ADDR 0x0A000001
+/* Port of every client of a SimNet, host order. */
+#define SIMNET_PORT 6881
+/* Virtual time of a new SimNet, in 2020 as milliseconds of the epoch,
+ * so that times in seconds are never 0. */
+#define SIMNET_START_MS 1600000000000LL
+/* Peers a client behind a NAT keeps a mapping for. A new mapping
+ * replaces any other in its slot. */
+#define SIMNET_NAT_MAPPINGS 256
+
+/* How the datagrams of a SimNet are carried. */
+typedef struct SimNetConfig {
+    int64_t latency_ms;         /* One way */
+    int64_t jitter_ms;          /* Up to this much more, at random */
+    double loss;                /* Share of the datagrams lost */
+    double nat;                 /* Share of the clients behind a NAT */
+    int64_t nat_timeout_ms;     /* Of a mapping, after the last datagram out */
+    int seed;                   /* Of all random choices */
+} SimNetConfig;
+
+typedef struct SimNetStats {
+    unsigned long sent;
+    unsigned long delivered;
+    unsigned long lost;
+    unsigned long nat_dropped;  /* Unsolicited, to a client behind a NAT */
+    unsigned long long bytes;   /* Sent */
+    unsigned long processed;    /* Calls of Dht_Process */
+} SimNetStats;
+
+/* A datagram in flight, then waiting in the inbox of its client. */
+typedef struct SimDatagram {
+    struct SimDatagram *next;   /* In the inbox */
+    uint32_t from;              /* Index of the sender */
+    size_t len;
+    char data[];
+} SimDatagram;
+
+/* A peer a client behind a NAT sent to, and when. */
+typedef struct SimMapping {
+    uint32_t peer;              /* Index */
+    int64_t sent_ms;            /* 0 when unused */
+} SimMapping;
+
+/* A client of a SimNet and its end of the network. */
+typedef struct SimEndpoint {
+    Transport transport;        /* Of the client */
+    struct SimNet *net;
+    Client *client;
+    uint32_t index;
+    SimDatagram *inbox;         /* Oldest first */
+    SimDatagram *inbox_last;
+    int64_t wake_ms;            /* Of the next Dht_Process */
+    SimMapping *mappings;       /* NULL unless behind a NAT */
+} SimEndpoint;
+
+/* A datagram or a wake up due at ms, ordered by seq when at the same
+ * time. */
+typedef struct SimEvent {
+    int64_t ms;
+    unsigned long seq;
+    uint32_t to;                /* Index */
+    SimDatagram *datagram;      /* NULL for a wake up */
+} SimEvent;
+
+/* Clients in one process, passing datagrams to each other in virtual
+ * time. Each client is processed when a datagram reaches it or when
+ * Dht_NextDeadline says so, and time then jumps to the next event, so
+ * a run depends only on the config and on what the caller does. */
+typedef struct SimNet {
+    SimNetConfig config;
+    int64_t now_ms;             /* The ClockSource of every client */
+    DArray *endpoints;          /* By index */
+    SimEvent *events;           /* A binary heap on ms, then seq */
+    size_t events_count;
+    size_t events_max;
+    unsigned long seq;
+    RandomState *random;
+    SimNetStats stats;
+} SimNet;
+
+SimNet *SimNet_Create(SimNetConfig *config);
+/* Destroys the clients too. */
+void SimNet_Destroy(SimNet *net);
+
+/* Creates a started client with id, at the address of its index,
+ * its random choices seeded from the config.
+ * Returns NULL on failure. */
+Client *SimNet_AddClient(SimNet *net, Hash *id);
+/* Returns the client at addr and port, in network order, or NULL. */
+SimEndpoint *SimNet_GetEndpoint(SimNet *net, uint32_t addr, uint16_t port);
+/* Returns the Seed of the client at index. */
+Seed SimNet_Seed(SimNet *net, size_t index);
+/* Has the client at index processed at the current time, as after
+ * adding seeds or searches to it. Returns 0 on success, -1 on failure. */
+int SimNet_Wake(SimNet *net, size_t index);
+
+/* Runs the clients until virtual time until_ms.
+ * Returns 0 on success, -1 on failure. */
+int SimNet_Run(SimNet *net, int64_t until_ms);
+
+#endif
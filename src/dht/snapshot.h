@@ -0,0 +1,54 @@
+#ifndef _dht_snapshot_h
+#define _dht_snapshot_h
+
+#include <stdint.h>
+
+#include <dht/hash.h>
+#include <dht/table.h>
+
+/* A routing table snapshot is a SnapshotHeader followed by count
+ * SnapshotRecords, in host byte order except where noted. It is only
+ * meant to be read back by the same build on the same machine. */
+
+#define SNAPSHOT_MAGIC "DHTS"
+#define SNAPSHOT_VERSION 2
+
+typedef struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    Hash id;                    /* Of the table */
+    uint32_t count;             /* Of records */
+    uint32_t checksum;          /* FNV-1a of the records */
+    uint32_t reserved;          /* Aligns the records that follow */
+} SnapshotHeader;
+
+typedef struct SnapshotRecord {
+    int64_t reply_time;
+    int64_t query_time;
+    Hash id;
+    uint32_t addr;              /* Network byte order */
+    uint16_t port;              /* Network byte order */
+    uint16_t reserved;
+    int32_t rtt_ms;
+    uint32_t replies;
+    uint32_t timeouts;
+} SnapshotRecord;
+
+/* The records are read in place from the mapped file. */
+_Static_assert(sizeof(SnapshotHeader) % _Alignof(SnapshotRecord) == 0,
+               "SnapshotRecords after the header are misaligned");
+
+/* Returns the FNV-1a checksum of len bytes of data, continuing from
+ * sum. Start with SNAPSHOT_CHECKSUM_INIT. */
+#define SNAPSHOT_CHECKSUM_INIT 2166136261u
+uint32_t Snapshot_Checksum(uint32_t sum, const void *data, size_t len);
+
+/* Writes the nodes of table to path, one record at a time, through a
+ * temporary file that replaces path once complete.
+ * Returns 0 on success, -1 on failure. */
+int Snapshot_Write(Table *table, const char *path);
+/* Maps the snapshot at path and returns a new table with its nodes,
+ * or NULL when it is missing, of another version or corrupt. */
+Table *Snapshot_Read(const char *path);
+
+#endif
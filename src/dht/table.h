@@ -2,9 +2,11 @@
 #define _dht_table_h
 
 #include <dht/bucket.h>
+#include <dht/clock.h>
 #include <dht/hash.h>
 #include <dht/node.h>
 #include <lcthw/bstrlib.h>
+#include <lcthw/hashmap.h>
 
 #define MAX_TABLE_BUCKETS (HASH_BITS + 1 - BUCKET_LAST_BITS)
 
@@ -14,6 +16,13 @@ typedef struct Table {
     Hash id;
     Bucket *buckets[MAX_TABLE_BUCKETS];
     int end;
+    /* Full buckets keep new nodes as replacements, instead of
+     * replacing Questionable nodes that may still be alive. */
+    int has_replacements;
+    /* The nodes by addr and port, when indexed. Only the nodes of the
+     * buckets, not the replacements. */
+    Hashmap *addrs;
+    Clock *clock;               /* Of the client, NULL for the system's */
 } Table;
 
 Table *Table_Create(Hash *id);
@@ -30,17 +39,40 @@ Bucket *Table_FindBucket(Table *table, Hash *id);
 
 Node *Table_FindNode(Table *table, Hash *id);
 
+/* The time of the clock of the table, in seconds and milliseconds. */
+time_t Table_Time(Table *table);
+int64_t Table_Ms(Table *table);
+
+/* Starts indexing the nodes of table by addr and port.
+ * Returns 0 on success, -1 on failure. */
+int Table_IndexAddrs(Table *table);
+/* Returns the node at the addr and port of node, whatever its id, or
+ * NULL. The table must be indexed. */
+Node *Table_FindNodeByAddr(Table *table, Node *node);
+/* Takes node out of its bucket, leaving the caller to destroy it.
+ * Returns node, or NULL when it was not in the table. */
+Node *Table_RemoveNode(Table *table, Node *node);
+
+/* Sets id to a random value that falls in the bucket.
+ * Returns 0 on success, -1 on failure. */
+int Table_RandomId(Table *table, Bucket *bucket, RandomState *rs, Hash *id);
+
 enum Table_InsertNodeResultRc {
     ERROR,                      /* Insert failed. */
     OKAdded,                    /* Added to .bucket */
     OKReplaced,                 /* Replaced .replaced in .bucket */
     OKFull,                     /* Target bucket full. */
-    OKAlreadyAdded              /* Node of same id already added. */
+    OKAlreadyAdded,             /* Node of same id already added. */
+    OKCached                    /* A replacement in .bucket, dropping
+                                 * .replaced when not NULL. */
 };
 
 /* Returns a new array with the BUCKET_K nodes from table that are
  * closest to the id. Returns NULL on error. */
 DArray *Table_GatherClosest(Table *table, Hash *id);
+/* Returns a new array with all nodes from table that are not Bad at
+ * time now. Returns NULL on error. */
+DArray *Table_GatherNodes(Table *table, time_t now);
 
 typedef struct Table_InsertNodeResult {
     enum Table_InsertNodeResultRc rc;
@@ -50,10 +82,18 @@ typedef struct Table_InsertNodeResult {
 } Table_InsertNodeResult;
 
 Table_InsertNodeResult Table_InsertNode(Table *table, Node *node);
-/* If Node is good, copy and add to table (when not already there) */
+/* If Node is not Bad nor backed off, copy and add to table (when not
+ * already there) */
 int Table_CopyAndAddNode(Table *dest, Node *node);
 
-/* Finds or adds the node in the table and updates its reply_time.*/
+/* Puts the most recent replacement of its bucket in place of node.
+ * Returns node, now out of the table, or NULL when there was no
+ * replacement. */
+Node *Table_ReplaceNode(Table *table, Node *node);
+
+/* Finds or adds the node in the table and updates its reply_time.
+ * On an indexed table, a node found at the same addr and port with
+ * another id is replaced. */
 int Table_MarkReply(Table *table, Message *message);
 /* Finds or adds the node in the table and updates its query_time.*/
 int Table_MarkQuery(Table *table, Node *node);
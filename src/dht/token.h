@@ -0,0 +1,52 @@
+#ifndef _dht_token_h
+#define _dht_token_h
+
+#include <stdint.h>
+#include <time.h>
+
+#include <dht/dht.h>
+#include <dht/random.h>
+
+/* Past secrets are kept to give a grace period for slow announcers */
+#define TOKEN_SECRETS 2
+/* Seconds between secret rotations. A token is accepted for up to
+ * TOKEN_SECRETS times as long. */
+#define TOKEN_ROTATE_INTERVAL (5 * 60)
+/* Bytes of the key of SipHash, taken from the front of a secret. */
+#define SIPHASH_KEY_BYTES 16
+
+/* Our own tokens have a known fixed length. See also FToken. */
+typedef Hash Token;
+
+/* The secrets our tokens are made with. Under TokenSipHash a token is
+ * the generation of its secret followed by a MAC of the generation
+ * and the address, so it is checked against that one secret only. */
+typedef struct TokenSecrets {
+    TokenScheme scheme;
+    Hash secrets[TOKEN_SECRETS];  /* Current and past secrets */
+    uint32_t generation;          /* Of secrets[0] */
+    time_t rotate_time;           /* Of the last rotation */
+} TokenSecrets;
+
+/* Picks the first random secrets. Returns 0 on success, -1 on failure. */
+int TokenSecrets_Init(TokenSecrets *secrets, RandomState *random, time_t now);
+/* Creates a new secret and shifts the past ones.
+ * Returns 0 on success, -1 on failure. */
+int TokenSecrets_Rotate(TokenSecrets *secrets, RandomState *random, time_t now);
+/* Rotates once TOKEN_ROTATE_INTERVAL passed since the last rotation.
+ * Returns 1 if rotated, 0 if not, -1 on failure. */
+int TokenSecrets_Update(TokenSecrets *secrets, RandomState *random, time_t now);
+
+/* Makes the Token required for a valid announce by the from Node */
+Token Token_Make(TokenSecrets *secrets, Node *from);
+/* Validates the Node's token against the secrets */
+int Token_IsValid(TokenSecrets *secrets, Node *from, char *token, size_t len);
+
+/* SipHash-2-4 of data with the 16 byte key, 8 or 16 bytes to out. */
+void SipHash(const unsigned char *key,
+             const unsigned char *data,
+             size_t len,
+             unsigned char *out,
+             size_t out_len);
+
+#endif
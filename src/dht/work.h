@@ -5,15 +5,38 @@
 
 /* The following functions returns 0 on success, -1 on failure. */
 
-/* Sends all the messages on queue from client. */
+/* Sends the messages on queue from client, oldest first, as long as
+ * the send rate allows. */
 int Client_Send(Client *client, MessageQueue *queue);
 /* Decodes available messages and queues them as incoming. */
 int Client_Receive(Client *client);
 /* Handles the incoming queue, queuing replies to queries. */
 int Client_HandleMessages(Client *client);
 int Client_RunHooks(Client *client);
+/* Gives up on queries not replied to within the RTT timeout, marking
+ * the timeouts on their nodes. */
+int Client_ExpireQueries(Client *client);
+/* Pings the Questionable nodes of buckets that have replacements.
+ * The ones that time out are replaced. */
+int Client_PingQuestionable(Client *client);
+/* Pings up to CLIENT_LOAD_PINGS of the nodes of a loaded table that
+ * have not been heard of since, once per second. */
+int Client_PingLoaded(Client *client);
+/* Pings the next wave of seeds, and starts a round of lookups when
+ * the last one is done, until the table is ready. */
+int Client_Bootstrap(Client *client);
+/* Starts a find_node search for a random id in the bucket unchanged
+ * for longest, once it is CLIENT_REFRESH_AGE old. Refreshes start
+ * CLIENT_REFRESH_GAP seconds apart and one at a time. */
+int Client_RefreshBuckets(Client *client);
+/* Starts queued searches while there is room for more active ones. */
+int Client_StartSearches(Client *client);
 int Client_HandleSearches(Client *client);
 void Client_CleanSearches(Client *client);
+/* Expires the announced peers of the minutes passed since the last
+ * call. Cheap enough to run on every tick. */
 int Client_CleanPeers(Client *client);
+/* Replaces the token secret every TOKEN_ROTATE_INTERVAL. */
+int Client_RotateSecrets(Client *client);
 
 #endif
@@ -1,6 +1,8 @@
 #include <arpa/inet.h>
 
+#include <dht/clock.h>
 #include <dht/close.h>
+#include <dht/crawl.h>
 #include <dht/handle.h>
 #include <dht/hooks.h>
 #include <dht/message.h>
@@ -18,6 +20,7 @@ ReplyHandler GetReplyHandler(MessageType type)
     case RAnnouncePeer: return HandleRAnnouncePeer;
     case RFindNode: return HandleRFindNode;
     case RGetPeers: return HandleRGetPeers;
+    case RSampleInfohashes: return HandleRSampleInfohashes;
     default:
         log_err("No reply handler for type %d", type);
         return NULL;
@@ -32,6 +35,7 @@ QueryHandler GetQueryHandler(MessageType type)
     case QAnnouncePeer: return HandleQAnnouncePeer;
     case QFindNode: return HandleQFindNode;
     case QGetPeers: return HandleQGetPeers;
+    case QSampleInfohashes: return HandleQSampleInfohashes;
     default:
         log_err("No query handler for type %d", type);
         return NULL;
@@ -74,7 +78,54 @@ int HandleUnknown(Client *client, Message *message)
     return 0;
 }
 
-int AddSearchNodes(Client *client, Search *search, Node **nodes, size_t count);
+int AddSearchNodes(Client *client,
+                   Search *search,
+                   Node **nodes,
+                   size_t count,
+                   unsigned int hops);
+
+/* Returns the ms since the query of the reply was sent, -1 when not
+ * known. Queries can wait in the queue, so not since it was queued. */
+int64_t ReplyRtt(Client *client, Message *message)
+{
+    if (message->sent_ms <= 0)
+        return -1;
+
+    return Clock_Now(&client->clock) - message->sent_ms;
+}
+
+/* Marks the reply in the search table, timing it against our query.
+ * Sets *hops to the number of replies leading to the node. */
+int MarkSearchReply(Client *client,
+                    Search *search,
+                    Message *message,
+                    unsigned int *hops)
+{
+    Node *node = Table_FindNode(search->table, &message->node.id);
+
+    if (node != NULL && node->pending_queries > 0)
+    {
+        int64_t rtt = ReplyRtt(client, message);
+
+        RttStats_Add(&client->rtt, rtt);
+        Node_MarkReply(node, rtt);
+
+        Node *known = Table_FindNode(client->table, &message->node.id);
+
+        if (known != NULL)
+            Node_MarkReply(known, rtt);
+
+        search->stats.replies++;
+
+        if (node->hops > search->stats.hops)
+            search->stats.hops = node->hops;
+    }
+
+    if (hops != NULL)
+        *hops = node != NULL ? node->hops + 1 : 1;
+
+    return Table_MarkReply(search->table, message);
+}
 
 int HandleRPing(Client *client, Message *message)
 {
@@ -85,12 +136,17 @@ int HandleRPing(Client *client, Message *message)
     int rc = HandleReply(client, message);
     check(rc == 0, "HandleReply failed");
 
+    Node *known = Table_FindNode(client->table, &message->node.id);
+
+    if (known != NULL)
+        Node_MarkReply(known, ReplyRtt(client, message));
+
     int i;
     for (i = 0; i < DArray_end(client->searches); i++)
     {
         Search *search = (Search *)DArray_get(client->searches, i);
         /* Only good nodes are copied, so we set the reply_time */
-        message->node.reply_time = time(NULL);
+        message->node.reply_time = Clock_Time(&client->clock);
         rc = Table_CopyAndAddNode(search->table, &message->node);
         check(rc == 0, "Table_CopyAndAddNode failed");
     }
@@ -113,13 +169,16 @@ int HandleRFindNode(Client *client, Message *message)
     int rc = Table_MarkReply(client->table, message);
     check(rc == 0, "Table_MarkReply failed (client->table)");
 
-    rc = Table_MarkReply(search->table, message);
-    check(rc == 0, "Table_MarkReply failed (search->table)");
+    unsigned int hops = 0;
+
+    rc = MarkSearchReply(client, search, message, &hops);
+    check(rc == 0, "MarkSearchReply failed");
 
     rc = AddSearchNodes(client,
                         search,
                         message->data.rfindnode.nodes,
-                        message->data.rfindnode.count);
+                        message->data.rfindnode.count,
+                        hops);
     check(rc == 0, "AddSearchNodes failed");
 
     /* Free nodes not added to search */
@@ -148,15 +207,22 @@ int HandleRGetPeers(Client *client, Message *message)
     int rc = Table_MarkReply(client->table, message);
     check(rc == 0, "Table_MarkReply failed (client->table)");
 
-    rc = Table_MarkReply(search->table, message);
-    check(rc == 0, "Table_MarkReply failed (search->table)");
+    unsigned int hops = 0;
+
+    rc = MarkSearchReply(client, search, message, &hops);
+    check(rc == 0, "MarkSearchReply failed");
 
     rc = Search_SetToken(search, &message->id, data->token);
     check(rc == 0, "Search_SetToken failed");
 
+    if (data->seeds != NULL && (search->flags & SearchScrape))
+    {
+        Search_AddScrape(search, data->seeds, data->peers);
+    }
+
     if (data->nodes != NULL)
     {
-        rc = AddSearchNodes(client, search, data->nodes, data->count);
+        rc = AddSearchNodes(client, search, data->nodes, data->count, hops);
         check(rc == 0, "AddSearchNodes failed");
 
         /* Free nodes not added to search */
@@ -164,9 +230,6 @@ int HandleRGetPeers(Client *client, Message *message)
     }
     else if (data->values != NULL)
     {
-        rc = Search_AddPeers(search, data->values, data->count);
-        check(rc == 0, "Search_AddPeers failed");
-
         struct HookPeerData hook_data = {
             .info_hash = &search->table->id,
             .peers = data->values,
@@ -174,10 +237,24 @@ int HandleRGetPeers(Client *client, Message *message)
         };
 
         Client_RunHook(client, HookFoundPeer, &hook_data);
+
+        /* The values stay as received for the later hooks */
+        Peer *fresh = Search_FreshPeers(search, data->count);
+        check(fresh != NULL, "Search_FreshPeers failed");
+
+        int count = Search_AddPeers(search, data->values, data->count, fresh);
+        check(count >= 0, "Search_AddPeers failed");
+
+        if (count > 0)
+        {
+            hook_data.peers = fresh;
+            hook_data.count = count;
+            Client_RunHook(client, HookNewPeer, &hook_data);
+        }
     }
-    else
+    else if (data->seeds == NULL)
     {
-        sentinel("No peers or nodes in RGetPeers");
+        sentinel("No peers, nodes or bloom filters in RGetPeers");
     }
 
     return 0;
@@ -198,8 +275,8 @@ int HandleRAnnouncePeer(Client *client, Message *message)
     int rc = Table_MarkReply(client->table, message);
     check(rc == 0, "Table_MarkReply failed (client->table)");
 
-    rc = Table_MarkReply(search->table, message);
-    check(rc == 0, "Table_MarkReply failed (search->table)");
+    rc = MarkSearchReply(client, search, message, NULL);
+    check(rc == 0, "MarkSearchReply failed");
 
     struct HookAnnounceData hook_data = {
         .search = search,
@@ -213,8 +290,51 @@ error:
     return -1;
 }
 
+int HandleRSampleInfohashes(Client *client, Message *message)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(message != NULL && "NULL Message pointer");
+    assert(message->type == RSampleInfohashes && "Wrong message type");
+
+    int rc = Table_MarkReply(client->table, message);
+    check(rc == 0, "Table_MarkReply failed");
+
+    if (client->crawl != NULL)
+    {
+        rc = Crawl_HandleReply(client, client->crawl, message);
+        check(rc == 0, "Crawl_HandleReply failed");
+    }
+
+    /* Free nodes not taken by the crawl */
+    Message_DestroyNodes(message);
+
+    return 0;
+error:
+    return -1;
+}
+
+int HandleOrphanReply(Client *client, Message *message)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(message != NULL && "NULL Message pointer");
+    assert(MessageType_IsReply(message->type) && "Not a reply");
+
+    int rc = Table_MarkReply(client->table, message);
+    check(rc == 0, "Table_MarkReply failed");
+
+    Message_DestroyNodes(message);
+
+    return 0;
+error:
+    return -1;
+}
+
 /* AddSearchNodes NULLs the added nodes. */
-int AddSearchNodes(Client *client, Search *search, Node **nodes, size_t count)
+int AddSearchNodes(Client *client,
+                   Search *search,
+                   Node **nodes,
+                   size_t count,
+                   unsigned int hops)
 {
     assert(search != NULL && "NULL Search pointer");
     assert(nodes != NULL && "NULL pointer to Nodes pointer");
@@ -232,6 +352,8 @@ int AddSearchNodes(Client *client, Search *search, Node **nodes, size_t count)
             continue;
         }
 
+        (*node)->hops = hops;
+
         Table_InsertNodeResult result
             = Table_InsertNode(search->table, *node);
         check(result.rc != ERROR, "Table_InsertNode failed");
@@ -315,7 +437,15 @@ Message *HandleQAnnouncePeer(Client *client, Message *query)
     Peer peer = { .addr = query->node.addr.s_addr,
                   .port = query->data.qannouncepeer.port };
 
-    rc = Client_AddPeer(client, query->data.qannouncepeer.info_hash, &peer);
+    if (query->data.qannouncepeer.implied_port)
+    {
+        peer.port = ntohs(query->node.port);
+    }
+
+    rc = Client_AddPeer(client,
+                        query->data.qannouncepeer.info_hash,
+                        &peer,
+                        query->data.qannouncepeer.seed);
     check(rc == 0, "Client_AddPeer failed");
 
     Message *reply = Message_CreateRAnnouncePeer(client, query);
@@ -326,42 +456,136 @@ error:
     return NULL;
 }
 
+Message *HandleQSampleInfohashes(Client *client, Message *query)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(query != NULL && "NULL Message pointer");
+    assert(query->type == QSampleInfohashes && "Wrong message type");
+
+    DArray *found = NULL;
+
+    int rc = Table_MarkQuery(client->table, &query->node);
+    check(rc == 0, "Table_MarkQuery failed");
+
+    /* The same samples are served for the whole interval, so that
+     * crawlers gain nothing by asking again sooner */
+    time_t now = Clock_Time(&client->clock);
+
+    if (now - client->samples_time >= CLIENT_SAMPLES_INTERVAL)
+    {
+        int count = PeerStore_SampleInfoHashes(client->peers,
+                                               client->samples,
+                                               CLIENT_SAMPLES_MAX,
+                                               client->random);
+        check(count >= 0, "PeerStore_SampleInfoHashes failed");
+
+        client->samples_count = count;
+        client->samples_time = now;
+    }
+
+    found = Table_GatherClosest(client->table,
+                                query->data.qsampleinfohashes.target);
+    check(found != NULL, "Table_GatherClosest failed");
+
+    Message *reply = Message_CreateRSampleInfohashes(client,
+                                                     query,
+                                                     found,
+                                                     client->samples,
+                                                     client->samples_count,
+                                                     List_count(client->peers->order));
+    check(reply != NULL, "Message_CreateRSampleInfohashes failed");
+
+    DArray_destroy(found);
+    return reply;
+error:
+    DArray_destroy(found);
+    return NULL;
+}
+
 Message *HandleQGetPeers(Client *client, Message *query)
 {
     assert(client != NULL && "NULL Client pointer");
     assert(query != NULL && "NULL Message pointer");
     assert(query->type == QGetPeers && "Wrong message type");
 
-    DArray *peers = NULL;
+    Peer *values = NULL;
+    Bloom *blooms = NULL;
     DArray *nodes = NULL;
 
     int rc = Table_MarkQuery(client->table, &query->node);
     check(rc == 0, "Table_MarkQuery failed");
 
-    rc = Client_GetPeers(client, query->data.qgetpeers.info_hash, &peers);
-    check(rc == 0, "Client_GetPeers failed");
+    Token token = Client_MakeToken(client, &query->node);
+
+    /* A scrape gets the bloom filters of the peers along with the
+     * closest nodes, instead of the peers themselves */
+    if (query->data.qgetpeers.scrape)
+    {
+        blooms = malloc(2 * sizeof(Bloom));
+        check_mem(blooms);
+
+        rc = PeerStore_Scrape(client->peers,
+                              query->data.qgetpeers.info_hash,
+                              &blooms[0],
+                              &blooms[1]);
+        check(rc != -1, "PeerStore_Scrape failed");
 
-    if (DArray_count(peers) == 0)
+        if (rc == 0)
+        {
+            free(blooms);
+            blooms = NULL;
+        }
+    }
+
+    /* A sample of the peers that fits the budget, in one block the
+     * reply takes over */
+    size_t max = query->data.qgetpeers.scrape
+        ? 0
+        : client->values_budget / PEER_VALUE_LEN;
+
+    if (max > 0)
     {
-        DArray_destroy(peers);
-        peers = NULL;
+        values = malloc(max * sizeof(Peer));
+        check_mem(values);
+
+        int count = Client_GetPeers(client,
+                                    query->data.qgetpeers.info_hash,
+                                    values,
+                                    max);
+        check(count >= 0, "Client_GetPeers failed");
 
-        nodes = Table_GatherClosest(client->table,
-                                    query->data.qgetpeers.info_hash);
-        check(nodes != NULL, "Table_GatherClosest failed");
+        if (count > 0)
+        {
+            return Message_CreateRGetPeersValues(client,
+                                                 query,
+                                                 values,
+                                                 count,
+                                                 &token);
+        }
+
+        free(values);
+        values = NULL;
     }
 
-    Token token = Client_MakeToken(client, &query->node);
+    nodes = Table_GatherClosest(client->table,
+                                query->data.qgetpeers.info_hash);
+    check(nodes != NULL, "Table_GatherClosest failed");
 
-    Message *reply = Message_CreateRGetPeers(client, query, peers, nodes, &token);
+    Message *reply = Message_CreateRGetPeers(client, query, NULL, nodes, &token);
     check(reply != NULL, "Message_CreateRGetPeers failed");
 
-    DArray_destroy(peers);
+    if (blooms != NULL)
+    {
+        reply->data.rgetpeers.seeds = &blooms[0];
+        reply->data.rgetpeers.peers = &blooms[1];
+    }
+
     DArray_destroy(nodes);
 
     return reply;
 error:
-    DArray_destroy(peers);
+    free(values);
+    free(blooms);
     DArray_destroy(nodes);
 
     return NULL;
@@ -0,0 +1,127 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dht/hashfilter.h>
+#include <lcthw/dbg.h>
+
+HashFilter *HashFilter_Create(size_t bytes)
+{
+    HashFilter *filter = calloc(1, sizeof(HashFilter));
+    check_mem(filter);
+
+    filter->bytes = 64;
+
+    while (filter->bytes < bytes)
+        filter->bytes *= 2;
+
+    filter->bits[0] = calloc(1, filter->bytes);
+    check_mem(filter->bits[0]);
+
+    filter->bits[1] = calloc(1, filter->bytes);
+    check_mem(filter->bits[1]);
+
+    /* About 1% false positives when full */
+    filter->capacity = filter->bytes * 8 / 10;
+
+    return filter;
+error:
+    HashFilter_Destroy(filter);
+    return NULL;
+}
+
+void HashFilter_Destroy(HashFilter *filter)
+{
+    if (filter == NULL)
+        return;
+
+    free(filter->bits[0]);
+    free(filter->bits[1]);
+    free(filter);
+}
+
+/* The finalizer of MurmurHash3, so every bit of the word counts */
+static inline uint32_t HashFilter_Mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/* Double hashing over the words of the hash folded in two */
+void HashFilter_Positions(HashFilter *filter, Hash *hash, size_t *positions)
+{
+    uint32_t words[HASH_BYTES / 4];
+    memcpy(words, hash->value, HASH_BYTES);
+
+    uint32_t a = HashFilter_Mix(words[0] ^ words[2] ^ words[4]);
+    uint32_t b = HashFilter_Mix(words[1] ^ words[3]);
+
+    size_t mask = filter->bytes * 8 - 1;
+
+    int i = 0;
+    for (i = 0; i < HASHFILTER_K; i++)
+        positions[i] = (a + (size_t)i * (b | 1)) & mask;
+}
+
+int HashFilter_Test(unsigned char *bits, size_t *positions)
+{
+    int i = 0;
+    for (i = 0; i < HASHFILTER_K; i++)
+    {
+        if (!(bits[positions[i] / 8] & 1 << (positions[i] % 8)))
+            return 0;
+    }
+
+    return 1;
+}
+
+int HashFilter_Contains(HashFilter *filter, Hash *hash)
+{
+    assert(filter != NULL && "NULL HashFilter pointer");
+    assert(hash != NULL && "NULL Hash pointer");
+
+    size_t positions[HASHFILTER_K];
+    HashFilter_Positions(filter, hash, positions);
+
+    return HashFilter_Test(filter->bits[0], positions)
+        || HashFilter_Test(filter->bits[1], positions);
+}
+
+int HashFilter_Add(HashFilter *filter, Hash *hash)
+{
+    assert(filter != NULL && "NULL HashFilter pointer");
+    assert(hash != NULL && "NULL Hash pointer");
+
+    size_t positions[HASHFILTER_K];
+    HashFilter_Positions(filter, hash, positions);
+
+    if (HashFilter_Test(filter->bits[0], positions))
+        return 0;
+
+    int seen = HashFilter_Test(filter->bits[1], positions);
+
+    if (filter->count == filter->capacity)
+    {
+        unsigned char *older = filter->bits[1];
+
+        memset(older, 0, filter->bytes);
+        filter->bits[1] = filter->bits[0];
+        filter->bits[0] = older;
+        filter->count = 0;
+        filter->rotations++;
+    }
+
+    /* Hashes seen in the older filter move on to the current one */
+    int i = 0;
+    for (i = 0; i < HASHFILTER_K; i++)
+        filter->bits[0][positions[i] / 8] |= 1 << (positions[i] % 8);
+
+    filter->count++;
+
+    return !seen;
+}
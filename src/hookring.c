@@ -0,0 +1,113 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <dht/dht.h>
+#include <dht/hookring.h>
+#include <lcthw/dbg.h>
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+HookRing *HookRing_Create(size_t size)
+{
+    HookRing *ring = calloc(1, sizeof(HookRing));
+    check_mem(ring);
+
+    ring->size = 4096;
+
+    while (ring->size < size)
+        ring->size *= 2;
+
+    ring->buf = malloc(ring->size);
+    check_mem(ring->buf);
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    return ring;
+error:
+    HookRing_Destroy(ring);
+    return NULL;
+}
+
+void HookRing_Destroy(HookRing *ring)
+{
+    if (ring == NULL)
+        return;
+
+    free(ring->buf);
+    free(ring);
+}
+
+HookRecord *HookRing_Reserve(HookRing *ring, uint32_t type, size_t len)
+{
+    assert(ring != NULL && "NULL HookRing pointer");
+
+    size_t total = ALIGN8(sizeof(HookRecord) + len);
+
+    /* At most half the ring, so that it fits after any padding */
+    if (total > ring->size / 2)
+        return NULL;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t offset = head & (ring->size - 1);
+    size_t pad = ring->size - offset < total ? ring->size - offset : 0;
+
+    if (head + pad + total - tail > ring->size)
+        return NULL;
+
+    if (pad > 0)
+    {
+        HookRecord *padding = (HookRecord *)(ring->buf + offset);
+        padding->type = HookTypeMax;
+        padding->size = pad;
+        head += pad;
+        offset = 0;
+    }
+
+    HookRecord *record = (HookRecord *)(ring->buf + offset);
+    record->type = type;
+    record->size = total;
+
+    ring->reserved = head + total;
+
+    return record;
+}
+
+void HookRing_Commit(HookRing *ring)
+{
+    assert(ring != NULL && "NULL HookRing pointer");
+
+    atomic_store_explicit(&ring->head, ring->reserved, memory_order_release);
+}
+
+HookRecord *HookRing_Peek(HookRing *ring)
+{
+    assert(ring != NULL && "NULL HookRing pointer");
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    while (tail != head)
+    {
+        HookRecord *record = (HookRecord *)(ring->buf + (tail & (ring->size - 1)));
+
+        if (record->type != HookTypeMax)
+            return record;
+
+        tail += record->size;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    return NULL;
+}
+
+void HookRing_Release(HookRing *ring, HookRecord *record)
+{
+    assert(ring != NULL && "NULL HookRing pointer");
+    assert(record != NULL && "NULL HookRecord pointer");
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&ring->tail, tail + record->size, memory_order_release);
+}
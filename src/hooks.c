@@ -1,7 +1,9 @@
 #include <assert.h>
+#include <string.h>
 
 #include <dht/client.h>
 #include <dht/hooks.h>
+#include <dht/search.h>
 #include <lcthw/darray.h>
 #include <lcthw/dbg.h>
 #include <lcthw/list.h>
@@ -73,7 +75,7 @@ Hook *Hook_Create(HookType type, HookOp fun)
 {
     assert(fun != NULL && "NULL HookOp");
 
-    Hook *hook = malloc(sizeof(Hook));
+    Hook *hook = calloc(1, sizeof(Hook));
     check_mem(hook);
 
     hook->type = type;
@@ -84,16 +86,316 @@ error:
     return NULL;
 }
 
+int IsMessageHook(HookType type)
+{
+    return type == HookReceiveMessage
+        || type == HookSendMessage
+        || type == HookHandleMessage;
+}
+
+Hook *Hook_CreateBatched(HookType type, HookOp fun)
+{
+    check(IsMessageHook(type), "Only Message hooks are batched");
+
+    Hook *hook = Hook_Create(type, fun);
+    check(hook != NULL, "Hook_Create failed");
+
+    hook->batched = 1;
+
+    return hook;
+error:
+    return NULL;
+}
+
 void Hook_Destroy(Hook *hook)
 {
+    if (hook == NULL)
+        return;
+
+    if (hook->info_hashes != NULL)
+    {
+        Hashmap_traverse(hook->info_hashes, NULL, Hashmap_freeNodeData);
+        Hashmap_destroy(hook->info_hashes);
+    }
+
+    free(hook->events);
     free(hook);
 }
 
+void Hook_SetMessageTypes(Hook *hook, uint64_t mask)
+{
+    assert(hook != NULL && "NULL Hook pointer");
 
-int Client_RunHook(Client *client, HookType type, void *args)
+    hook->message_types = mask;
+}
+
+int Hook_AddInfoHash(Hook *hook, Hash *info_hash)
 {
-    assert(client != NULL && "NULL Client pointer");
+    assert(hook != NULL && "NULL Hook pointer");
+    assert(info_hash != NULL && "NULL Hash pointer");
+
+    Hash *copy = NULL;
+
+    if (hook->info_hashes == NULL)
+    {
+        hook->info_hashes = Hashmap_create((Hashmap_compare)Distance_Compare,
+                                           (Hashmap_hash)Hash_Hash);
+        check_mem(hook->info_hashes);
+    }
+
+    if (Hashmap_get(hook->info_hashes, info_hash) != NULL)
+        return 0;
+
+    copy = Hash_Clone(info_hash);
+    check_mem(copy);
+
+    int rc = Hashmap_set(hook->info_hashes, copy, copy);
+    check(rc == 0, "Hashmap_set failed");
+
+    return 0;
+error:
+    free(copy);
+    return -1;
+}
+
+
+AsyncHooks *AsyncHooks_Create(size_t size, HookOverflow overflow)
+{
+    AsyncHooks *async = calloc(1, sizeof(AsyncHooks));
+    check_mem(async);
 
+    async->ring = HookRing_Create(size);
+    check(async->ring != NULL, "HookRing_Create failed");
+
+    async->overflow = overflow;
+
+    return async;
+error:
+    AsyncHooks_Destroy(async);
+    return NULL;
+}
+
+void AsyncHooks_Destroy(AsyncHooks *async)
+{
+    if (async == NULL)
+        return;
+
+    HookRing_Destroy(async->ring);
+    free(async);
+}
+
+int AsyncHooks_IsQueued(HookType type)
+{
+    switch (type)
+    {
+    case HookAddPeer:
+    case HookFoundPeer:
+    case HookNewPeer:
+    case HookNewInfoHash:
+    case HookInvalidMessage:
+    case HookTableReady:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* The payloads of the queued events, rebuilt as args when drained */
+struct QueuedPeerData {
+    Hash info_hash;
+    size_t count;
+    Peer peers[];
+};
+
+struct QueuedInfoHashData {
+    size_t count;
+    Hash info_hashes[];
+};
+
+/* Copies args into the ring. Returns 0 when queued, -1 when full. */
+int AsyncHooks_Push(AsyncHooks *async, HookType type, void *args)
+{
+    HookRecord *record = NULL;
+
+    switch (type)
+    {
+    case HookAddPeer:
+    case HookFoundPeer:
+    case HookNewPeer:
+    {
+        struct HookPeerData *data = args;
+        size_t peers_len = data->count * sizeof(Peer);
+
+        record = HookRing_Reserve(async->ring,
+                                  type,
+                                  sizeof(struct QueuedPeerData) + peers_len);
+        if (record == NULL)
+            return -1;
+
+        struct QueuedPeerData *queued = (struct QueuedPeerData *)(record + 1);
+        queued->info_hash = *data->info_hash;
+        queued->count = data->count;
+        memcpy(queued->peers, data->peers, peers_len);
+        break;
+    }
+    case HookNewInfoHash:
+    {
+        struct HookInfoHashData *data = args;
+        size_t hashes_len = data->count * sizeof(Hash);
+
+        record = HookRing_Reserve(async->ring,
+                                  type,
+                                  sizeof(struct QueuedInfoHashData) + hashes_len);
+        if (record == NULL)
+            return -1;
+
+        struct QueuedInfoHashData *queued = (struct QueuedInfoHashData *)(record + 1);
+        queued->count = data->count;
+        memcpy(queued->info_hashes, data->info_hashes, hashes_len);
+        break;
+    }
+    case HookInvalidMessage:
+        record = HookRing_Reserve(async->ring, type, sizeof(Node));
+        if (record == NULL)
+            return -1;
+
+        memcpy(record + 1, args, sizeof(Node));
+        break;
+    case HookTableReady:
+        record = HookRing_Reserve(async->ring, type, sizeof(BootstrapStats));
+        if (record == NULL)
+            return -1;
+
+        memcpy(record + 1, args, sizeof(BootstrapStats));
+        break;
+    default:
+        assert(0 && "HookType not queued");
+        return -1;
+    }
+
+    HookRing_Commit(async->ring);
+
+    return 0;
+}
+
+/* What the filters of the hooks are checked against, found once per
+ * event and only when a hook is filtered */
+struct HookKey {
+    int found;
+    int is_message;
+    MessageType message_type;
+    Hash *info_hash;
+};
+
+Hash *Message_InfoHash(Client *client, Message *message)
+{
+    Search *search = NULL;
+
+    switch (message->type)
+    {
+    case QGetPeers: return message->data.qgetpeers.info_hash;
+    case QAnnouncePeer: return message->data.qannouncepeer.info_hash;
+    case RGetPeers:
+    case RAnnouncePeer:
+        /* The search of an orphan reply is gone */
+        search = Client_GetSearch(client, message->search);
+        return search != NULL ? &search->table->id : NULL;
+    default:
+        return NULL;
+    }
+}
+
+void HookKey_Find(Client *client, HookType type, void *args, struct HookKey *key)
+{
+    key->found = 1;
+
+    switch (type)
+    {
+    case HookReceiveMessage:
+    case HookSendMessage:
+    case HookHandleMessage:
+        key->is_message = 1;
+        key->message_type = ((Message *)args)->type;
+        key->info_hash = Message_InfoHash(client, args);
+        break;
+    case HookAddPeer:
+    case HookFoundPeer:
+    case HookNewPeer:
+        key->info_hash = ((struct HookPeerData *)args)->info_hash;
+        break;
+    case HookAnnouncedPeer:
+        key->info_hash = &((Search *)((struct HookAnnounceData *)args)->search)->table->id;
+        break;
+    case HookSearchDone:
+        key->info_hash = &((Search *)args)->table->id;
+        break;
+    default:
+        break;
+    }
+}
+
+int Hook_Matches(Hook *hook, struct HookKey *key)
+{
+    if (hook->message_types != 0
+        && key->is_message
+        && !(hook->message_types & HOOK_MESSAGE_BIT(key->message_type)))
+    {
+        return 0;
+    }
+
+    if (hook->info_hashes != NULL)
+    {
+        return key->info_hash != NULL
+            && Hashmap_get(hook->info_hashes, key->info_hash) != NULL;
+    }
+
+    return 1;
+}
+
+void Hook_Deliver(Client *client, Hook *hook)
+{
+    struct HookBatchData data = { .events = hook->events,
+                                  .count = hook->events_count };
+
+    hook->fun(client, &data);
+    hook->events_count = 0;
+}
+
+int Hook_Batch(Client *client, Hook *hook, struct HookKey *key, Message *message)
+{
+    if (hook->events_count == hook->events_max)
+    {
+        if (hook->events_max < HOOK_BATCH_MAX)
+        {
+            size_t max = hook->events_max > 0 ? hook->events_max * 2 : 64;
+            HookEvent *events = realloc(hook->events, max * sizeof(HookEvent));
+            check_mem(events);
+
+            hook->events = events;
+            hook->events_max = max;
+        }
+        else
+        {
+            Hook_Deliver(client, hook);
+        }
+    }
+
+    HookEvent *event = &hook->events[hook->events_count++];
+
+    event->message_type = message->type;
+    event->node = message->node;
+    event->has_info_hash = key->info_hash != NULL;
+
+    if (key->info_hash != NULL)
+        event->info_hash = *key->info_hash;
+
+    return 0;
+error:
+    return -1;
+}
+
+int RunHooks(Client *client, HookType type, void *args)
+{
     if (client->hooks == NULL)
         return 0;
 
@@ -103,12 +405,145 @@ int Client_RunHook(Client *client, HookType type, void *args)
         return 0;
 
     int count = 0;
+    struct HookKey key = { .found = 0 };
 
     LIST_FOREACH(list, first, next, cur)
     {
-        ((Hook *)cur->value)->fun(client, args);
+        Hook *hook = cur->value;
+
+        if (hook->message_types != 0 || hook->info_hashes != NULL || hook->batched)
+        {
+            if (!key.found)
+                HookKey_Find(client, type, args, &key);
+
+            if (!Hook_Matches(hook, &key))
+                continue;
+
+            if (hook->batched)
+            {
+                if (Hook_Batch(client, hook, &key, args) == 0)
+                    count++;
+
+                continue;
+            }
+        }
+
+        hook->fun(client, args);
+        count++;
+    }
+
+    return count;
+}
+
+void Client_FlushHooks(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    if (client->hooks == NULL)
+        return;
+
+    int i = 0;
+    for (i = 0; i < DArray_count(client->hooks); i++)
+    {
+        List *list = DArray_get(client->hooks, i);
+
+        LIST_FOREACH(list, first, next, cur)
+        {
+            Hook *hook = cur->value;
+
+            if (hook->batched && hook->events_count > 0)
+                Hook_Deliver(client, hook);
+        }
+    }
+}
+
+int Client_RunHook(Client *client, HookType type, void *args)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    AsyncHooks *async = client->async_hooks;
+
+    if (async == NULL || !AsyncHooks_IsQueued(type))
+        return RunHooks(client, type, args);
+
+    if (AsyncHooks_Push(async, type, args) == 0)
+    {
+        atomic_fetch_add_explicit(&async->queued, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    if (async->overflow == HookOverflowSync)
+    {
+        atomic_fetch_add_explicit(&async->synced, 1, memory_order_relaxed);
+        return RunHooks(client, type, args);
+    }
+
+    atomic_fetch_add_explicit(&async->dropped, 1, memory_order_relaxed);
+    return 0;
+}
+
+int Client_DrainHooks(Client *client, size_t max)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    int idle = AsyncIdle;
+
+    /* Being replaced by Dht_SetAsyncHooks */
+    if (!atomic_compare_exchange_strong(&client->async_state,
+                                        &idle,
+                                        AsyncDraining))
+    {
+        return 0;
+    }
+
+    AsyncHooks *async = client->async_hooks;
+
+    if (async == NULL)
+    {
+        atomic_store(&client->async_state, AsyncIdle);
+        return 0;
+    }
+
+    size_t count = 0;
+    HookRecord *record = NULL;
+
+    while (count < max && (record = HookRing_Peek(async->ring)) != NULL)
+    {
+        void *payload = record + 1;
+
+        switch (record->type)
+        {
+        case HookAddPeer:
+        case HookFoundPeer:
+        case HookNewPeer:
+        {
+            struct QueuedPeerData *queued = payload;
+            struct HookPeerData data = { .info_hash = &queued->info_hash,
+                                         .peers = queued->peers,
+                                         .count = queued->count };
+            RunHooks(client, record->type, &data);
+            break;
+        }
+        case HookNewInfoHash:
+        {
+            struct QueuedInfoHashData *queued = payload;
+            struct HookInfoHashData data = { .info_hashes = queued->info_hashes,
+                                             .count = queued->count };
+            RunHooks(client, record->type, &data);
+            break;
+        }
+        default:
+            RunHooks(client, record->type, payload);
+            break;
+        }
+
+        HookRing_Release(async->ring, record);
         count++;
     }
 
+    atomic_fetch_add_explicit(&async->delivered, count, memory_order_relaxed);
+
+    atomic_store(&client->async_state, AsyncIdle);
+
     return count;
 }
@@ -12,6 +12,8 @@ void Message_Destroy(Message *message)
 
     free(message->t);
 
+    Message_DestroyNodes(message);
+
     switch (message->type)
     {
     case QPing:
@@ -26,6 +28,9 @@ void Message_Destroy(Message *message)
 	Hash_Destroy(message->data.qannouncepeer.info_hash);
 	free(message->data.qannouncepeer.token.data);
 	break;
+    case QSampleInfohashes:
+	Hash_Destroy(message->data.qsampleinfohashes.target);
+	break;
     case RPing:
 	break;
     case RFindNode:
@@ -35,9 +40,14 @@ void Message_Destroy(Message *message)
 	free(message->data.rgetpeers.token.data);
 	free(message->data.rgetpeers.values); /* TODO: destroy? */
         free(message->data.rgetpeers.nodes);
+        free(message->data.rgetpeers.seeds);
 	break;
     case RAnnouncePeer:
 	break;
+    case RSampleInfohashes:
+        free(message->data.rsampleinfohashes.nodes);
+        free(message->data.rsampleinfohashes.samples);
+	break;
     case RError:
 	bdestroy(message->data.rerror.message);
 	break;
@@ -57,6 +67,7 @@ void Message_DestroyNodes(Message *message)
     {
     case RFindNode:
     case RGetPeers:
+    case RSampleInfohashes:
         if (message->data.rfindnode.nodes != NULL)
         {
             Node_DestroyBlock(message->data.rfindnode.nodes,
@@ -101,6 +101,23 @@ error:
     return NULL;
 }
 
+Message *Message_CreateQSampleInfohashes(Client *client, Node *to, Hash *target)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(target != NULL && "NULL Hash pointer");
+
+    Message *message = Message_CreateQuery(client, to, QSampleInfohashes);
+    check(message != NULL, "Message_Create failed");
+
+    message->data.qsampleinfohashes.target = Hash_Clone(target);
+    check_mem(message->data.qsampleinfohashes.target);
+
+    return message;
+error:
+    Message_Destroy(message);
+    return NULL;
+}
+
 Message *Message_CreateResponse(Client *client, Message *query, MessageType type)
 {
     assert(client != NULL && "NULL Client pointer");
@@ -128,8 +145,31 @@ error:
     return NULL;
 }
 
-/* This does not copy the found nodes, so the message must be sent before
- * they can be destroyed. */
+/* Replies own copies of the found nodes, so they can wait to be sent
+ * while the table changes. */
+Node **CopyNodes(DArray *found)
+{
+    size_t count = DArray_count(found);
+
+    Node **nodes = calloc(count, sizeof(Node *));
+    check_mem(nodes);
+
+    size_t i = 0;
+    for (i = 0; i < count; i++)
+    {
+        nodes[i] = Node_Copy(DArray_get(found, i));
+        check_mem(nodes[i]);
+    }
+
+    return nodes;
+error:
+    if (nodes != NULL)
+        Node_DestroyBlock(nodes, count);
+
+    free(nodes);
+    return NULL;
+}
+
 Message *Message_CreateRFindNode(Client *client, Message *query, DArray *found)
 {
     assert(client != NULL && "NULL Client pointer");
@@ -139,18 +179,14 @@ Message *Message_CreateRFindNode(Client *client, Message *query, DArray *found)
     Message *message = Message_CreateResponse(client, query, RFindNode);
     check(message != NULL, "Message_Create failed");
 
-    RFindNodeData data;
-    data.count = DArray_count(found);
-    data.nodes = malloc(data.count * sizeof(Node *));
+    message->data.rfindnode.nodes = CopyNodes(found);
+    check(message->data.rfindnode.nodes != NULL, "CopyNodes failed");
 
-    unsigned int i = 0;
-    for (i = 0; i < data.count; i++)
-        data.nodes[i] = DArray_get(found, i);
-
-    message->data.rfindnode = data;
+    message->data.rfindnode.count = DArray_count(found);
 
     return message;
 error:
+    Message_Destroy(message);
     return NULL;
 }
 
@@ -164,8 +200,36 @@ Message *Message_CreateRAnnouncePeer(Client *client, Message *query)
     return Message_CreateResponse(client, query, RAnnouncePeer);
 }
 
-/* This does not copy the found nodes, so the message must be sent before
- * they can be destroyed. */
+Message *Message_CreateRGetPeersValues(Client *client,
+                                       Message *query,
+                                       Peer *values,
+                                       size_t count,
+                                       Token *token)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(query != NULL && "NULL Message pointer");
+    assert(values != NULL && "NULL Peer pointer");
+    assert(token != NULL && "NULL Token pointer");
+
+    RGetPeersData data = { .values = values, .count = count };
+
+    Message *message = Message_CreateResponse(client, query, RGetPeers);
+    check(message != NULL, "Message_Create failed");
+
+    data.token.data = malloc(HASH_BYTES);
+    check_mem(data.token.data);
+    memcpy(data.token.data, token->value, HASH_BYTES);
+    data.token.len = HASH_BYTES;
+
+    message->data.rgetpeers = data;
+
+    return message;
+error:
+    free(values);
+    Message_Destroy(message);
+    return NULL;
+}
+
 Message *Message_CreateRGetPeers(Client *client,
                                  Message *query,
                                  DArray *peers,
@@ -204,14 +268,10 @@ Message *Message_CreateRGetPeers(Client *client,
     }
     else
     {
-        data.count = DArray_count(nodes);
-        data.nodes = malloc(data.count * sizeof(Node *));
-        check_mem(data.nodes);
+        data.nodes = CopyNodes(nodes);
+        check(data.nodes != NULL, "CopyNodes failed");
 
-        for (i = 0; i < data.count; i++)
-        {
-            data.nodes[i] = DArray_get(nodes, i);
-        }
+        data.count = DArray_count(nodes);
     }
 
     message->data.rgetpeers = data;
@@ -222,6 +282,46 @@ error:
     return NULL;
 }
 
+Message *Message_CreateRSampleInfohashes(Client *client,
+                                         Message *query,
+                                         DArray *found,
+                                         Hash *samples,
+                                         size_t count,
+                                         size_t num)
+{
+    assert(client != NULL && "NULL Client pointer");
+    assert(query != NULL && "NULL Message pointer");
+    assert(found != NULL && "NULL DArray pointer");
+    assert(samples != NULL || count == 0);
+
+    Message *message = Message_CreateResponse(client, query, RSampleInfohashes);
+    check(message != NULL, "Message_Create failed");
+
+    RSampleInfohashesData *data = &message->data.rsampleinfohashes;
+
+    data->nodes = CopyNodes(found);
+    check(data->nodes != NULL, "CopyNodes failed");
+
+    data->count = DArray_count(found);
+
+    if (count > 0)
+    {
+        data->samples = malloc(count * sizeof(Hash));
+        check_mem(data->samples);
+
+        memcpy(data->samples, samples, count * sizeof(Hash));
+        data->samples_count = count;
+    }
+
+    data->interval = CLIENT_SAMPLES_INTERVAL;
+    data->num = num;
+
+    return message;
+error:
+    Message_Destroy(message);
+    return NULL;
+}
+
 Message *Message_CreateRErrorBadToken(Client *client, Message *query)
 {
     assert(client != NULL && "NULL Client pointer");
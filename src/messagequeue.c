@@ -0,0 +1,157 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <dht/clock.h>
+#include <dht/messagequeue.h>
+#include <lcthw/dbg.h>
+
+int64_t QueueMs(MessageQueue *queue)
+{
+    return queue->clock != NULL ? Clock_Now(queue->clock) : Clock_Ms();
+}
+
+MessageQueue *MessageQueue_CreateSized(size_t capacity)
+{
+    MessageQueue *queue = calloc(1, sizeof(MessageQueue));
+    check_mem(queue);
+
+    size_t size = 1;
+
+    while (size < capacity)
+        size *= 2;
+
+    int i = 0;
+    for (i = 0; i < QueueLaneMax; i++)
+    {
+        MessageLane *lane = &queue->lanes[i];
+
+        lane->messages = calloc(size, sizeof(Message *));
+        check_mem(lane->messages);
+
+        lane->push_ms = calloc(size, sizeof(int64_t));
+        check_mem(lane->push_ms);
+
+        lane->capacity = size;
+        lane->stats.capacity = size;
+    }
+
+    return queue;
+error:
+    MessageQueue_Destroy(queue);
+    return NULL;
+}
+
+void MessageQueue_Destroy(MessageQueue *queue)
+{
+    if (queue == NULL)
+        return;
+
+    int i = 0;
+    for (i = 0; i < QueueLaneMax; i++)
+    {
+        MessageLane *lane = &queue->lanes[i];
+
+        if (lane->messages != NULL)
+        {
+            while (lane->head != lane->tail)
+                Message_Destroy(lane->messages[lane->head++ & (lane->capacity - 1)]);
+        }
+
+        free(lane->messages);
+        free(lane->push_ms);
+    }
+
+    free(queue);
+}
+
+QueueLane MessageQueue_Lane(Message *message)
+{
+    assert(message != NULL && "NULL Message pointer");
+
+    if (!MessageType_IsQuery(message->type))
+        return LaneReply;
+
+    /* Every query of a search has its serial */
+    return message->search != 0 ? LaneSearch : LaneMaintenance;
+}
+
+int MessageQueue_Push(MessageQueue *queue, Message *message)
+{
+    assert(queue != NULL && "NULL MessageQueue pointer");
+    assert(message != NULL && "NULL Message pointer");
+
+    MessageLane *lane = &queue->lanes[MessageQueue_Lane(message)];
+
+    if (lane->tail - lane->head == lane->capacity)
+    {
+        lane->stats.rejected++;
+        return -1;
+    }
+
+    size_t slot = lane->tail++ & (lane->capacity - 1);
+
+    lane->messages[slot] = message;
+    lane->push_ms[slot] = QueueMs(queue);
+    lane->stats.pushed++;
+
+    return 0;
+}
+
+Message *MessageQueue_Pop(MessageQueue *queue)
+{
+    assert(queue != NULL && "NULL MessageQueue pointer");
+
+    int i = 0;
+    for (i = 0; i < QueueLaneMax; i++)
+    {
+        MessageLane *lane = &queue->lanes[i];
+
+        if (lane->head == lane->tail)
+            continue;
+
+        size_t slot = lane->head++ & (lane->capacity - 1);
+        int64_t delay = QueueMs(queue) - lane->push_ms[slot];
+
+        lane->stats.delay_ms += delay;
+
+        if (delay > lane->stats.max_delay_ms)
+            lane->stats.max_delay_ms = delay;
+
+        return lane->messages[slot];
+    }
+
+    return NULL;
+}
+
+int MessageQueue_Count(MessageQueue *queue)
+{
+    assert(queue != NULL && "NULL MessageQueue pointer");
+
+    size_t count = 0;
+
+    int i = 0;
+    for (i = 0; i < QueueLaneMax; i++)
+        count += queue->lanes[i].tail - queue->lanes[i].head;
+
+    return (int)count;
+}
+
+int MessageQueue_IsFull(MessageQueue *queue, QueueLane lane)
+{
+    assert(queue != NULL && "NULL MessageQueue pointer");
+    assert(lane < QueueLaneMax && "Bad QueueLane");
+
+    MessageLane *entry = &queue->lanes[lane];
+
+    return entry->tail - entry->head == entry->capacity;
+}
+
+void MessageQueue_Clear(MessageQueue *queue)
+{
+    assert(queue != NULL && "NULL MessageQueue pointer");
+
+    Message *message = NULL;
+
+    while ((message = MessageQueue_Pop(queue)) != NULL)
+        Message_Destroy(message);
+}
@@ -7,13 +7,19 @@
 #include <unistd.h>
 
 #include <dht/client.h>
+#include <dht/clock.h>
 #include <dht/hooks.h>
 #include <dht/network.h>
+#include <dht/search.h>
 #include <lcthw/dbg.h>
 
 int NetworkUp(Client *client)
 {
     assert(client != NULL && "NULL Client pointer");
+
+    if (client->transport != NULL)
+        return 0;
+
     assert(client->socket != -1 && "Invalid Client socket");
 
     struct sockaddr_in sockaddr = { 0 };
@@ -35,6 +41,10 @@ error:
 int NetworkDown(Client *client)
 {
     assert(client != NULL && "NULL Client pointer");
+
+    if (client->transport != NULL)
+        return 0;
+
     assert(client->socket != -1 && "Invalid Client socket");
 
     int rc;
@@ -60,6 +70,9 @@ int Send(Client *client, Node *node, char *buf, size_t len)
     assert(buf != NULL && "NULL buf pointer");
     assert(len <= UDPBUFLEN && "buf too large for UDP");
 
+    if (client->transport != NULL)
+        return client->transport->send(client->transport, node, buf, len);
+
     struct sockaddr_in addr = { 0 };
 
     addr.sin_family = AF_INET;
@@ -86,6 +99,12 @@ int Receive(Client *client, Node *node, char *buf, size_t len)
     assert(buf != NULL && "NULL buf pointer");
     assert(len >= UDPBUFLEN && "buf too small for UDP");
 
+    if (client->transport != NULL)
+    {
+        *node = (Node){{{ 0 }}};
+        return client->transport->receive(client->transport, node, buf, len);
+    }
+
     struct sockaddr_in srcaddr = { 0 };
     socklen_t addrlen = sizeof(srcaddr);
 
@@ -127,6 +146,8 @@ int SendMessage(Client *client, Message *msg)
     int rc = Send(client, &msg->node, client->buf, len);
     check(rc == 0, "Send failed");
 
+    Pacer_Charge(&client->pacer, len);
+
     if (MessageType_IsQuery(msg->type))
     {
         PendingResponse entry = {
@@ -134,13 +155,21 @@ int SendMessage(Client *client, Message *msg)
             .tid = *(tid_t *)msg->t,
             .id = msg->node.id,
             .context = msg->context,
-            .is_new = msg->node.is_new
+            .search = msg->search,
+            .is_new = msg->node.is_new,
+            .sent_ms = Clock_Now(&client->clock)
         };
 
         if (entry.is_new) debug("Sending first ping");
 
         rc = client->pending->addPendingResponse(client->pending, entry);
         check(rc == 0, "addPendingResponses failed");
+
+        /* Its search times it out from now, not from when queued */
+        Search *search = Client_GetSearch(client, msg->search);
+
+        if (search != NULL)
+            Search_MarkSent(search, &msg->node.id, entry.sent_ms);
     }
 
     Client_RunHook(client, HookSendMessage, msg);
@@ -175,12 +204,12 @@ int ReceiveMessage(Client *client, Message **message)
 
     if (MessageType_IsQuery(decoded->type))
     {
-        decoded->node.query_time = time(NULL);
+        decoded->node.query_time = Clock_Time(&client->clock);
     }
 
     if (MessageType_IsReply(decoded->type))
     {
-        decoded->node.reply_time = time(NULL);
+        decoded->node.reply_time = Clock_Time(&client->clock);
     }
 
     *message = decoded;
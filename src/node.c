@@ -51,6 +51,10 @@ Node *Node_Copy(Node *source)
     copy->addr = source->addr;
     copy->port = source->port;
 
+    copy->rtt_ms = source->rtt_ms;
+    copy->replies = source->replies;
+    copy->timeouts = source->timeouts;
+
     return copy;
 error:
     return NULL;
@@ -91,3 +95,55 @@ int Node_Same(Node *a, Node *b)
         && Hash_Equals(&a->id, &b->id);
 }
 
+
+void Node_MarkReply(Node *node, int64_t rtt)
+{
+    assert(node != NULL && "NULL Node pointer");
+
+    if (rtt >= 0)
+    {
+        /* Exponentially weighted, as TCP does. */
+        node->rtt_ms = node->rtt_ms == 0
+            ? rtt
+            : (7 * (int64_t)node->rtt_ms + rtt) / 8;
+    }
+
+    node->replies++;
+    node->failures = 0;
+}
+
+void Node_MarkTimeout(Node *node)
+{
+    assert(node != NULL && "NULL Node pointer");
+
+    node->timeouts++;
+    node->failures++;
+}
+
+int Node_IsBackedOff(Node *node, int64_t now)
+{
+    assert(node != NULL && "NULL Node pointer");
+
+    if (node->failures == 0)
+        return 0;
+
+    unsigned int shift = node->failures - 1;
+
+    if (shift > NODE_BACKOFF_MAX_SHIFT)
+        shift = NODE_BACKOFF_MAX_SHIFT;
+
+    return now < node->sent_ms + ((int64_t)NODE_BACKOFF_MS << shift);
+}
+
+int Node_Score(Node *node)
+{
+    assert(node != NULL && "NULL Node pointer");
+
+    /* Reply ratio in per mille, starting out at one half. */
+    int64_t score = 1000 * ((int64_t)node->replies + 1)
+        / ((int64_t)node->replies + node->timeouts + 2);
+
+    int64_t rtt = node->rtt_ms > 0 ? node->rtt_ms : NODE_RTT_UNKNOWN;
+
+    return score * NODE_RTT_UNKNOWN / (NODE_RTT_UNKNOWN + rtt);
+}
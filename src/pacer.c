@@ -0,0 +1,87 @@
+#include <assert.h>
+
+#include <dht/pacer.h>
+
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+
+void Pacer_Init(Pacer *pacer, uint32_t packets_rate, uint32_t bytes_rate, int64_t now)
+{
+    assert(pacer != NULL && "NULL Pacer pointer");
+
+    PacerStats stats = pacer->stats;
+
+    *pacer = (Pacer){ .packets_rate = packets_rate,
+                      .bytes_rate = bytes_rate,
+                      .update_ms = now,
+                      .stats = stats };
+
+    /* Starts with a full burst */
+    pacer->packets = MAX((int64_t)packets_rate * PACER_BURST_MS, 1000);
+    pacer->bytes = MAX((int64_t)bytes_rate * PACER_BURST_MS, 1);
+}
+
+void Pacer_Update(Pacer *pacer, int64_t now)
+{
+    int64_t elapsed = now - pacer->update_ms;
+
+    if (elapsed <= 0)
+        return;
+
+    int64_t burst = MAX((int64_t)pacer->packets_rate * PACER_BURST_MS, 1000);
+    pacer->packets = MIN(pacer->packets + elapsed * pacer->packets_rate, burst);
+
+    burst = MAX((int64_t)pacer->bytes_rate * PACER_BURST_MS, 1);
+    pacer->bytes = MIN(pacer->bytes + elapsed * pacer->bytes_rate, burst);
+
+    pacer->update_ms = now;
+}
+
+int Pacer_IsReady(Pacer *pacer, int64_t now)
+{
+    assert(pacer != NULL && "NULL Pacer pointer");
+
+    Pacer_Update(pacer, now);
+
+    if (pacer->packets_rate > 0 && pacer->packets < 1000)
+        return 0;
+
+    if (pacer->bytes_rate > 0 && pacer->bytes <= 0)
+        return 0;
+
+    return 1;
+}
+
+void Pacer_Charge(Pacer *pacer, size_t len)
+{
+    assert(pacer != NULL && "NULL Pacer pointer");
+
+    if (pacer->packets_rate > 0)
+        pacer->packets -= 1000;
+
+    if (pacer->bytes_rate > 0)
+        pacer->bytes -= (int64_t)len * 1000;
+
+    pacer->stats.packets++;
+    pacer->stats.bytes += len;
+}
+
+int64_t Pacer_Wait(Pacer *pacer, int64_t now)
+{
+    assert(pacer != NULL && "NULL Pacer pointer");
+
+    Pacer_Update(pacer, now);
+
+    int64_t wait = 0;
+
+    if (pacer->packets_rate > 0 && pacer->packets < 1000)
+    {
+        int64_t missing = 1000 - pacer->packets;
+        wait = (missing + pacer->packets_rate - 1) / pacer->packets_rate;
+    }
+
+    if (pacer->bytes_rate > 0 && pacer->bytes <= 0)
+        wait = MAX(wait, -pacer->bytes / pacer->bytes_rate + 1);
+
+    return wait;
+}
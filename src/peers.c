@@ -1,53 +1,54 @@
 #include <string.h>
 #include <time.h>
 
+#include <dht/bloom.h>
 #include <dht/hash.h>
 #include <dht/peers.h>
 #include <lcthw/dbg.h>
 
-struct PeerEntry {
-    Peer peer;
-    time_t time;
-};
+#define PEERS_KEY(P) \
+    ((uint64_t)1 << 48 | (uint64_t)(P)->addr << 16 | (P)->port)
+#define PEERS_SLOT(K, SIZE) ((size_t)(((K) * 0x9E3779B97F4A7C15ULL) >> 32) & ((SIZE) - 1))
 
-int Peer_Compare(Peer *a, Peer *b)
+void PeerCompact_Write(char *dest, Peer *peer)
 {
-    assert(a != NULL && "NULL Peer pointer");
-    assert(b != NULL && "NULL Peer pointer");
-
-    return (a->addr + a->port) - (b->addr + b->port);
+    dest[0] = peer->addr >> 24;
+    dest[1] = peer->addr >> 16;
+    dest[2] = peer->addr >> 8;
+    dest[3] = peer->addr;
+    dest[4] = peer->port >> 8;
+    dest[5] = peer->port;
 }
 
-uint32_t Peer_Hash(void *key)
+void PeerCompact_Read(Peer *peer, char *src)
 {
-    assert(key != NULL && "NULL Peer pointer");
+    unsigned char *byte = (unsigned char *)src;
 
-    return ((Peer *)key)->addr;
+    peer->addr = (uint32_t)byte[0] << 24
+        | (uint32_t)byte[1] << 16
+        | (uint32_t)byte[2] << 8
+        | byte[3];
+    peer->port = (uint16_t)(byte[4] << 8 | byte[5]);
 }
 
-time_t GetTime()
+time_t Peers_Time(Peers *peers)
 {
-    return time(NULL);
+    return peers->clock != NULL ? Clock_Time(peers->clock) : Clock_Ms() / 1000;
 }
 
 Peers *Peers_Create(Hash *info_hash)
 {
     assert(info_hash != NULL && "NULL Hash pointer");
 
-    Peers *peers = malloc(sizeof(Peers));
+    Peers *peers = calloc(1, sizeof(Peers));
     check_mem(peers);
 
-    peers->count = 0;
-
-    peers->hashmap = Hashmap_create((Hashmap_compare)Peer_Compare, Peer_Hash);
-    check(peers->hashmap != NULL, "Hashmap_create failed");
-
     peers->info_hash = *info_hash;
-    peers->GetTime = GetTime;
+    peers->oldest = PEERS_NIL;
+    peers->newest = PEERS_NIL;
 
     return peers;
 error:
-    free(peers);
     return NULL;
 }
 
@@ -56,186 +57,723 @@ void Peers_Destroy(Peers *peers)
     if (peers == NULL)
         return;
 
-    Hashmap_traverse(peers->hashmap, NULL, Hashmap_freeNodeData);
-    Hashmap_destroy(peers->hashmap);
+    free(peers->entries);
+    free(peers->times);
+    free(peers->seeds);
+    free(peers->blooms);
+    free(peers->slots);
+    free(peers->older);
+    free(peers->newer);
     free(peers);
 }
 
-int Peers_AddPeer(Peers *peers, Peer *peer)
+/* Returns the slot of the peer's entry, or the empty slot for it. */
+uint32_t *Peers_FindSlot(Peers *peers, Peer *peer)
 {
-    assert(peers != NULL && "NULL Peers pointer");
-    assert(peer != NULL && "NULL Peer pointer");
-    assert(0 <= peers->count && peers->count <= MAXPEERS && "Bad peers count");
+    uint64_t key = PEERS_KEY(peer);
+    size_t mask = peers->size - 1;
+    size_t i = PEERS_SLOT(key, peers->size);
+    char compact[PEER_COMPACT_LEN];
 
-    if (peers->count == MAXPEERS)
-        return -1;
+    PeerCompact_Write(compact, peer);
+
+    while (peers->slots[i] != 0)
+    {
+        char *entry = &peers->entries[(peers->slots[i] - 1) * PEER_COMPACT_LEN];
+
+        if (memcmp(entry, compact, PEER_COMPACT_LEN) == 0)
+            break;
+
+        i = (i + 1) & mask;
+    }
+
+    return &peers->slots[i];
+}
+
+/* Rebuilds the index of the entries in size slots. */
+int Peers_Index(Peers *peers, size_t size)
+{
+    uint32_t *slots = calloc(size, sizeof(uint32_t));
+    check_mem(slots);
+
+    free(peers->slots);
+    peers->slots = slots;
+    peers->size = size;
+
+    int i = 0;
+    for (i = 0; i < peers->count; i++)
+    {
+        Peer peer;
+        PeerCompact_Read(&peer, &peers->entries[i * PEER_COMPACT_LEN]);
+
+        *Peers_FindSlot(peers, &peer) = i + 1;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+/* Makes room for one more entry. */
+int Peers_Reserve(Peers *peers)
+{
+    if (peers->count == peers->capacity)
+    {
+        int capacity = peers->capacity == 0 ? 8 : peers->capacity * 2;
+
+        if (capacity > MAXPEERS)
+            capacity = MAXPEERS;
+
+        char *entries = realloc(peers->entries, capacity * PEER_COMPACT_LEN);
+        check_mem(entries);
+        peers->entries = entries;
+
+        time_t *times = realloc(peers->times, capacity * sizeof(time_t));
+        check_mem(times);
+        peers->times = times;
+
+        char *seeds = realloc(peers->seeds, capacity);
+        check_mem(seeds);
+        peers->seeds = seeds;
 
-    struct PeerEntry *entry = Hashmap_delete(peers->hashmap, peer);
+        uint16_t *older = realloc(peers->older, capacity * sizeof(uint16_t));
+        check_mem(older);
+        peers->older = older;
 
-    if (entry == NULL)
+        uint16_t *newer = realloc(peers->newer, capacity * sizeof(uint16_t));
+        check_mem(newer);
+        peers->newer = newer;
+
+        peers->capacity = capacity;
+    }
+
+    /* Keep the load under a half for short probes */
+    if ((size_t)(peers->count + 1) * 2 > peers->size)
     {
-        entry = malloc(sizeof(struct PeerEntry));
-        check_mem(entry);
-        entry->peer = *peer;
+        int rc = Peers_Index(peers, peers->size == 0 ? 16 : peers->size * 2);
+        check(rc == 0, "Peers_Index failed");
     }
+
+    return 0;
+error:
+    return -1;
+}
+
+void Peers_Unlink(Peers *peers, int i)
+{
+    int older = peers->older[i];
+    int newer = peers->newer[i];
+
+    if (older == PEERS_NIL)
+        peers->oldest = newer;
     else
+        peers->newer[older] = newer;
+
+    if (newer == PEERS_NIL)
+        peers->newest = older;
+    else
+        peers->older[newer] = older;
+}
+
+void Peers_LinkNewest(Peers *peers, int i)
+{
+    peers->older[i] = peers->newest;
+    peers->newer[i] = PEERS_NIL;
+
+    if (peers->newest == PEERS_NIL)
+        peers->oldest = i;
+    else
+        peers->newer[peers->newest] = i;
+
+    peers->newest = i;
+}
+
+/* Empties the slot, shifting back the entries probed past it. */
+void Peers_Unindex(Peers *peers, uint32_t *slot)
+{
+    size_t mask = peers->size - 1;
+    size_t i = slot - peers->slots;
+    size_t j = i;
+
+    peers->slots[i] = 0;
+
+    while (1)
     {
-        peers->count--;
+        j = (j + 1) & mask;
+
+        if (peers->slots[j] == 0)
+            break;
+
+        Peer peer;
+        PeerCompact_Read(&peer, &peers->entries[(peers->slots[j] - 1) * PEER_COMPACT_LEN]);
+
+        size_t home = PEERS_SLOT(PEERS_KEY(&peer), peers->size);
+
+        /* Stays if its probe starts after the hole */
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+
+        peers->slots[i] = peers->slots[j];
+        peers->slots[j] = 0;
+        i = j;
     }
+}
 
-    entry->time = peers->GetTime();
+/* Removes the oldest entry, moving the last one into its place. */
+void Peers_RemoveOldest(Peers *peers)
+{
+    int i = peers->oldest;
+    int last = peers->count - 1;
+    Peer peer;
 
-    int rc = Hashmap_set(peers->hashmap, &entry->peer, entry);
-    check(rc == 0, "Hashmap_set failed");
+    PeerCompact_Read(&peer, &peers->entries[i * PEER_COMPACT_LEN]);
+
+    Peers_Unlink(peers, i);
+    Peers_Unindex(peers, Peers_FindSlot(peers, &peer));
+
+    if (i != last)
+    {
+        memcpy(&peers->entries[i * PEER_COMPACT_LEN],
+               &peers->entries[last * PEER_COMPACT_LEN],
+               PEER_COMPACT_LEN);
+        peers->times[i] = peers->times[last];
+        peers->seeds[i] = peers->seeds[last];
+        peers->older[i] = peers->older[last];
+        peers->newer[i] = peers->newer[last];
+
+        if (peers->older[i] == PEERS_NIL)
+            peers->oldest = i;
+        else
+            peers->newer[peers->older[i]] = i;
+
+        if (peers->newer[i] == PEERS_NIL)
+            peers->newest = i;
+        else
+            peers->older[peers->newer[i]] = i;
+
+        PeerCompact_Read(&peer, &peers->entries[i * PEER_COMPACT_LEN]);
+        *Peers_FindSlot(peers, &peer) = i + 1;
+    }
+
+    peers->count--;
+    peers->blooms_stale = 1;
+}
+
+int Peers_AddPeer(Peers *peers, Peer *peer)
+{
+    return Peers_AnnouncePeer(peers, peer, 0);
+}
+
+int Peers_AnnouncePeer(Peers *peers, Peer *peer, int seed)
+{
+    assert(peers != NULL && "NULL Peers pointer");
+    assert(peer != NULL && "NULL Peer pointer");
+    assert(0 <= peers->count && peers->count <= MAXPEERS && "Bad peers count");
+
+    if (peers->size > 0)
+    {
+        uint32_t *slot = Peers_FindSlot(peers, peer);
+
+        if (*slot != 0)
+        {
+            int i = *slot - 1;
+
+            peers->times[i] = Peers_Time(peers);
+
+            if (peers->seeds[i] != seed)
+            {
+                peers->seeds[i] = seed;
+                peers->blooms_stale = 1;
+            }
+
+            Peers_Unlink(peers, i);
+            Peers_LinkNewest(peers, i);
+
+            return 0;
+        }
+    }
+
+    if (peers->count == MAXPEERS)
+        return -1;
 
+    int rc = Peers_Reserve(peers);
+    check(rc == 0, "Peers_Reserve failed");
+
+    PeerCompact_Write(&peers->entries[peers->count * PEER_COMPACT_LEN], peer);
+    peers->times[peers->count] = Peers_Time(peers);
+    peers->seeds[peers->count] = seed;
+    Peers_LinkNewest(peers, peers->count);
+
+    if (peers->blooms != NULL && !peers->blooms_stale)
+        Bloom_AddAddr(&peers->blooms[seed ? 0 : 1], peer->addr);
+
+    *Peers_FindSlot(peers, peer) = peers->count + 1;
     peers->count++;
 
     return 0;
 error:
-    free(entry);
     return -1;
 }
 
-int TraverseAddPeer(DArray *array, HashmapNode *node)
+size_t Peers_GetPeers(Peers *peers, Peer *dest, size_t max)
 {
-    assert(array != NULL && "NULL DArray pointer");
-    assert(node != NULL && "NULL HashmapNode pointer");
+    assert(peers != NULL && "NULL Peers pointer");
+    assert(dest != NULL || max == 0);
 
-    int rc = DArray_push(array, node->data);
-    check(rc == 0, "DArray_push failed");
+    size_t count = (size_t)peers->count < max ? (size_t)peers->count : max;
 
-    return 0;
+    size_t i = 0;
+    for (i = 0; i < count; i++)
+        PeerCompact_Read(&dest[i], &peers->entries[i * PEER_COMPACT_LEN]);
+
+    return count;
+}
+
+int Peers_Sample(Peers *peers, Peer *dest, size_t max, RandomState *rs)
+{
+    assert(peers != NULL && "NULL Peers pointer");
+    assert(dest != NULL || max == 0);
+    assert(rs != NULL && "NULL RandomState pointer");
+
+    if ((size_t)peers->count <= max)
+        return Peers_GetPeers(peers, dest, max);
+
+    /* Selection sampling: each entry is taken with the probability of
+     * the picks needed over the entries left. */
+    size_t needed = max;
+    size_t left = peers->count;
+
+    int i = 0;
+    for (i = 0; i < peers->count && needed > 0; i++, left--)
+    {
+        uint32_t r = 0;
+        int rc = Random_Fill(rs, (char *)&r, sizeof(r));
+        check(rc == 0, "Random_Fill failed");
+
+        if (r % left >= needed)
+            continue;
+
+        PeerCompact_Read(&dest[max - needed], &peers->entries[i * PEER_COMPACT_LEN]);
+        needed--;
+    }
+
+    return max;
 error:
     return -1;
 }
 
-int Peers_GetPeers(Peers *peers, DArray *result)
+int Peers_Scrape(Peers *peers, Bloom *seeds, Bloom *others)
 {
     assert(peers != NULL && "NULL Peers pointer");
-    assert(result != NULL && "NULL DArray pointer");
+    assert(seeds != NULL && others != NULL && "NULL Bloom pointer");
+
+    if (peers->blooms == NULL)
+    {
+        peers->blooms = malloc(2 * sizeof(Bloom));
+        check_mem(peers->blooms);
+
+        peers->blooms_stale = 1;
+    }
+
+    if (peers->blooms_stale)
+    {
+        memset(peers->blooms, 0, 2 * sizeof(Bloom));
+
+        int i = 0;
+        for (i = 0; i < peers->count; i++)
+        {
+            Peer peer;
+            PeerCompact_Read(&peer, &peers->entries[i * PEER_COMPACT_LEN]);
+
+            Bloom_AddAddr(&peers->blooms[peers->seeds[i] ? 0 : 1], peer.addr);
+        }
+
+        peers->blooms_stale = 0;
+    }
 
-    int rc = Hashmap_traverse(peers->hashmap,
-                              result,
-                              (Hashmap_traverse_cb)TraverseAddPeer);
-    check(rc == 0, "Hashmap_traverse failed");
+    *seeds = peers->blooms[0];
+    *others = peers->blooms[1];
 
     return 0;
 error:
     return -1;
 }
 
-int FreePeersHashmapEntry(void *context, HashmapNode *node)
+size_t Peers_Size(Peers *peers)
 {
-    (void)(context);
-    Peers_Destroy(node->data);
+    assert(peers != NULL && "NULL Peers pointer");
 
-    return 0;
+    return sizeof(Peers)
+        + peers->capacity * (PEER_COMPACT_LEN + sizeof(time_t) + 1 + 2 * sizeof(uint16_t))
+        + peers->size * sizeof(uint32_t)
+        + (peers->blooms != NULL ? 2 * sizeof(Bloom) : 0);
 }
 
-Hashmap *PeersHashmap_Create()
+PeerStore *PeerStore_Create(size_t max_size)
 {
-    Hashmap *hashmap = Hashmap_create(
+    PeerStore *store = calloc(1, sizeof(PeerStore));
+    check_mem(store);
+
+    store->hashmap = Hashmap_create(
         (Hashmap_compare)Distance_Compare,
         (Hashmap_hash)Hash_Hash);
-    check_mem(hashmap);
+    check_mem(store->hashmap);
+
+    store->order = List_create();
+    check_mem(store->order);
 
-    return hashmap;
+    int i = 0;
+    for (i = 0; i < PEERSTORE_WHEEL_SLOTS; i++)
+    {
+        store->wheel[i] = List_create();
+        check_mem(store->wheel[i]);
+    }
+
+    store->max_size = max_size;
+
+    return store;
 error:
+    PeerStore_Destroy(store);
     return NULL;
 }
 
-void PeersHashmap_Destroy(Hashmap *hashmap)
+void PeerStore_Destroy(PeerStore *store)
 {
-    if (hashmap == NULL)
+    if (store == NULL)
         return;
 
-    Hashmap_traverse(hashmap, NULL, FreePeersHashmapEntry);
-    Hashmap_destroy(hashmap);
+    if (store->order != NULL)
+    {
+        while (List_count(store->order) > 0)
+            Peers_Destroy(List_unshift(store->order));
+
+        List_destroy(store->order);
+    }
+
+    int i = 0;
+    for (i = 0; i < PEERSTORE_WHEEL_SLOTS; i++)
+    {
+        if (store->wheel[i] != NULL)
+            List_destroy(store->wheel[i]);
+    }
+
+    Hashmap_destroy(store->hashmap);
+    free(store);
 }
 
-Peers *PeersHashmap_GetSetPeers(Hashmap *hashmap, Hash *info_hash)
+void PeerStore_Remove(PeerStore *store, Peers *peers)
 {
-    assert(hashmap != NULL && "NULL Hashmap pointer");
+    assert(store != NULL && "NULL PeerStore pointer");
+    assert(peers != NULL && "NULL Peers pointer");
+
+    Hashmap_delete(store->hashmap, &peers->info_hash);
+    List_remove(store->order, peers->entry);
+
+    if (peers->wheel_entry != NULL)
+        List_remove(store->wheel[peers->wheel_slot], peers->wheel_entry);
+
+    store->size -= Peers_Size(peers);
+    store->count -= peers->count;
+
+    Peers_Destroy(peers);
+}
+
+int PeerStore_GetPeers(PeerStore *store,
+                       Hash *info_hash,
+                       Peer *dest,
+                       size_t max,
+                       RandomState *rs)
+{
+    assert(store != NULL && "NULL PeerStore pointer");
+    assert(info_hash != NULL && "NULL Hash pointer");
+
+    Peers *peers = Hashmap_get(store->hashmap, info_hash);
+
+    if (peers == NULL)
+        return 0;
+
+    return Peers_Sample(peers, dest, max, rs);
+}
+
+int PeerStore_Scrape(PeerStore *store, Hash *info_hash, Bloom *seeds, Bloom *others)
+{
+    assert(store != NULL && "NULL PeerStore pointer");
     assert(info_hash != NULL && "NULL Hash pointer");
 
-    Peers *peers = Hashmap_get(hashmap, info_hash);
-    Peers *new_peers = NULL;
+    Peers *peers = Hashmap_get(store->hashmap, info_hash);
 
     if (peers == NULL)
+        return 0;
+
+    size_t size = Peers_Size(peers);
+
+    int rc = Peers_Scrape(peers, seeds, others);
+    check(rc == 0, "Peers_Scrape failed");
+
+    store->size += Peers_Size(peers) - size;
+
+    return 1;
+error:
+    return -1;
+}
+
+int PeerStore_SampleInfoHashes(PeerStore *store,
+                               Hash *dest,
+                               size_t max,
+                               RandomState *rs)
+{
+    assert(store != NULL && "NULL PeerStore pointer");
+    assert(dest != NULL || max == 0);
+    assert(rs != NULL && "NULL RandomState pointer");
+
+    /* Selection sampling, as in Peers_Sample */
+    size_t left = List_count(store->order);
+    size_t needed = max < left ? max : left;
+    size_t count = needed;
+
+    LIST_FOREACH(store->order, first, next, cur)
+    {
+        if (needed == 0)
+            break;
+
+        uint32_t r = 0;
+        int rc = Random_Fill(rs, (char *)&r, sizeof(r));
+        check(rc == 0, "Random_Fill failed");
+
+        if (r % left-- >= needed)
+            continue;
+
+        dest[count - needed] = ((Peers *)cur->value)->info_hash;
+        needed--;
+    }
+
+    return count;
+error:
+    return -1;
+}
+
+Peers *PeerStore_GetSetPeers(PeerStore *store, Hash *info_hash)
+{
+    Peers *peers = Hashmap_get(store->hashmap, info_hash);
+
+    if (peers != NULL)
     {
-        peers = new_peers = Peers_Create(info_hash);
-        check(peers != NULL, "Peers_Create failed");
+        /* Most recently announced last */
+        List_remove(store->order, peers->entry);
+        List_push(store->order, peers);
+        peers->entry = store->order->last;
 
-        int rc = Hashmap_set(hashmap, &peers->info_hash, peers);
-        check(rc == 0, "Hashmap_set failed");
+        return peers;
     }
 
+    peers = Peers_Create(info_hash);
+    check(peers != NULL, "Peers_Create failed");
+
+    peers->clock = store->clock;
+
+    int rc = Hashmap_set(store->hashmap, &peers->info_hash, peers);
+    check(rc == 0, "Hashmap_set failed");
+
+    List_push(store->order, peers);
+    peers->entry = store->order->last;
+    store->size += Peers_Size(peers);
+
     return peers;
 error:
-    Peers_Destroy(new_peers);
+    Peers_Destroy(peers);
     return NULL;
 }
 
-int PeersHashmap_GetPeers(Hashmap *hashmap, Hash *info_hash, DArray *result)
+/* Puts the peers in the wheel slot of the minute of their oldest
+ * peer, or of the next minute to expire if that one is past. */
+void PeerStore_Wheel(PeerStore *store, Peers *peers)
 {
-    assert(hashmap != NULL && "NULL Hashmap pointer");
-    assert(info_hash != NULL && "NULL Hash pointer");
-    assert(result != NULL && "NULL DArray pointer");
+    time_t minute = peers->times[peers->oldest] / 60;
 
-    Peers *peers = PeersHashmap_GetSetPeers(hashmap, info_hash);
+    if (minute < store->wheel_minute)
+        minute = store->wheel_minute;
 
-    int rc = Peers_GetPeers(peers, result);
-    check(rc == 0, "Peers_GetPeers failed");
+    peers->wheel_slot = minute % PEERSTORE_WHEEL_SLOTS;
 
-    return 0;
-error:
-    return -1;
+    List *slot = store->wheel[peers->wheel_slot];
+    List_push(slot, peers);
+    peers->wheel_entry = slot->last;
 }
 
-int PeersHashmap_AddPeer(Hashmap *hashmap, Hash *info_hash, Peer *peer)
+int PeerStore_AddPeer(PeerStore *store, Hash *info_hash, Peer *peer, int seed)
 {
-    assert(hashmap != NULL && "NULL Hashmap pointer");
+    assert(store != NULL && "NULL PeerStore pointer");
     assert(info_hash != NULL && "NULL Hash pointer");
     assert(peer != NULL && "NULL Peer pointer");
 
-    Peers *peers = PeersHashmap_GetSetPeers(hashmap, info_hash);
+    Peers *peers = PeerStore_GetSetPeers(store, info_hash);
+    check(peers != NULL, "PeerStore_GetSetPeers failed");
+
+    size_t size = Peers_Size(peers);
+    int count = peers->count;
+
+    int rc = Peers_AnnouncePeer(peers, peer, seed);
+
+    store->size += Peers_Size(peers) - size;
+    store->count += peers->count - count;
 
-    int rc = Peers_AddPeer(peers, peer);
     check(rc == 0, "Peers_AddPeer failed");
 
+    /* Announces only make the oldest peer newer, so the Peers stay
+     * in their slot until it expires, and are moved on then */
+    if (peers->wheel_entry == NULL)
+        PeerStore_Wheel(store, peers);
+
+    /* The least recently announced go first, the one just added
+     * last of all */
+    while (store->size > store->max_size && List_count(store->order) > 0)
+    {
+        PeerStore_Remove(store, List_first(store->order));
+        store->evictions++;
+    }
+
     return 0;
 error:
     return -1;
 }
 
-int Peers_Clean(Peers *peers, time_t cutoff)
+int PeerStore_Clean(PeerStore *store, time_t now)
 {
-    assert(peers != NULL && "NULL Peers pointer");
-    assert(0 <= peers->count && peers->count <= MAXPEERS && "Bad Peers count");
+    assert(store != NULL && "NULL PeerStore pointer");
 
-    DArray *tmp = DArray_create(sizeof(struct PeerEntry *), 128);
-    int rc = Peers_GetPeers(peers, tmp);
-    check(rc == 0, "Peers_GetPeers failed");
+    time_t cutoff = now - PEERSTORE_TTL;
+    time_t minute = cutoff / 60;
 
-    int i = 0;
-    for (i = 0; i < DArray_count(tmp); i++)
+    /* A whole turn of the wheel visits every slot */
+    if (store->wheel_minute + PEERSTORE_WHEEL_SLOTS < minute)
+        store->wheel_minute = minute - PEERSTORE_WHEEL_SLOTS;
+
+    for (; store->wheel_minute < minute; store->wheel_minute++)
     {
-        struct PeerEntry *entry = DArray_get(tmp, i);
-        check(entry != NULL, "NULL PeerEntry");
+        List *slot = store->wheel[store->wheel_minute % PEERSTORE_WHEEL_SLOTS];
+        int count = List_count(slot);
 
-        if (entry->time < cutoff)
+        /* Moved peers may come back to this slot, after count */
+        while (count-- > 0)
         {
-            Hashmap_delete(peers->hashmap, &entry->peer);
-            peers->count--;
-            free(entry);
+            Peers *peers = List_unshift(slot);
+            peers->wheel_entry = NULL;
+
+            size_t size = Peers_Size(peers);
+            int peers_count = peers->count;
+
+            int rc = Peers_Clean(peers, cutoff);
+            check(rc == 0, "Peers_Clean failed");
+
+            store->size += Peers_Size(peers) - size;
+            store->count += peers->count - peers_count;
+
+            if (peers->count == 0)
+                PeerStore_Remove(store, peers);
+            else
+                PeerStore_Wheel(store, peers);
         }
     }
 
+    return 0;
+error:
+    return -1;
+}
+
+int Peers_Clean(Peers *peers, time_t cutoff)
+{
+    assert(peers != NULL && "NULL Peers pointer");
     assert(0 <= peers->count && peers->count <= MAXPEERS && "Bad Peers count");
 
-    DArray_destroy(tmp);
+    while (peers->count > 0 && peers->times[peers->oldest] < cutoff)
+        Peers_RemoveOldest(peers);
+
     return 0;
+}
+
+PeerFilter *PeerFilter_Create(size_t size)
+{
+    PeerFilter *filter = calloc(1, sizeof(PeerFilter));
+    check_mem(filter);
+
+    filter->size = 16;
+
+    while (filter->size < size)
+        filter->size <<= 1;
+
+    filter->slots = calloc(filter->size, sizeof(uint64_t));
+    check_mem(filter->slots);
+
+    return filter;
+error:
+    PeerFilter_Destroy(filter);
+    return NULL;
+}
+
+void PeerFilter_Destroy(PeerFilter *filter)
+{
+    if (filter == NULL)
+        return;
+
+    free(filter->slots);
+    free(filter);
+}
+
+uint64_t *PeerFilter_Find(uint64_t *slots, size_t size, uint64_t key)
+{
+    size_t mask = size - 1;
+    size_t i = PEERS_SLOT(key, size);
+
+    while (slots[i] != 0 && slots[i] != key)
+        i = (i + 1) & mask;
+
+    return &slots[i];
+}
+
+int PeerFilter_Grow(PeerFilter *filter)
+{
+    size_t size = filter->size << 1;
+    uint64_t *slots = calloc(size, sizeof(uint64_t));
+    check_mem(slots);
+
+    size_t i = 0;
+    for (i = 0; i < filter->size; i++)
+    {
+        if (filter->slots[i] != 0)
+            *PeerFilter_Find(slots, size, filter->slots[i]) = filter->slots[i];
+    }
+
+    free(filter->slots);
+    filter->slots = slots;
+    filter->size = size;
+
+    return 0;
+error:
+    return -1;
+}
+
+int PeerFilter_Add(PeerFilter *filter, Peer *peer)
+{
+    assert(filter != NULL && "NULL PeerFilter pointer");
+    assert(peer != NULL && "NULL Peer pointer");
+
+    uint64_t key = PEERS_KEY(peer);
+    uint64_t *slot = PeerFilter_Find(filter->slots, filter->size, key);
+
+    if (*slot == key)
+        return 0;
+
+    *slot = key;
+    filter->count++;
+
+    /* Keep the load under a half for short probes */
+    if (filter->count * 2 > filter->size)
+    {
+        int rc = PeerFilter_Grow(filter);
+        check(rc == 0, "PeerFilter_Grow failed");
+    }
+
+    return 1;
 error:
-    DArray_destroy(tmp);
     return -1;
 }
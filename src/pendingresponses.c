@@ -101,3 +101,60 @@ error:
     *rc = -1;
     return (PendingResponse) { 0 };
 }
+
+struct ExpireContext {
+    int64_t cutoff;
+    DArray *expired;
+};
+
+int GatherExpired(struct ExpireContext *context, HashmapNode *node)
+{
+    PendingResponse *entry = node->data;
+
+    if (entry->sent_ms >= context->cutoff)
+        return 0;
+
+    return DArray_push(context->expired, entry);
+}
+
+int HashmapPendingResponses_Expire(HashmapPendingResponses *pending,
+                                   int64_t cutoff,
+                                   void *context,
+                                   PendingResponseOp op)
+{
+    assert(pending != NULL && "NULL HashmapPendingResponses pointer");
+    assert(op != NULL && "NULL PendingResponseOp");
+
+    PendingResponse *entry = NULL;
+    struct ExpireContext expire = { .cutoff = cutoff };
+
+    expire.expired = DArray_create(sizeof(PendingResponse *), 32);
+    check(expire.expired != NULL, "DArray_create failed");
+
+    /* The hashmap can't be changed while traversed. */
+    int rc = Hashmap_traverse(pending->hashmap,
+                              &expire,
+                              (Hashmap_traverse_cb)GatherExpired);
+    check(rc == 0, "GatherExpired failed");
+
+    while (DArray_count(expire.expired) > 0)
+    {
+        entry = DArray_pop(expire.expired);
+        Hashmap_delete(pending->hashmap, &entry->tid);
+
+        rc = op(context, entry);
+        check(rc == 0, "PendingResponseOp failed");
+
+        free(entry);
+    }
+
+    DArray_destroy(expire.expired);
+
+    return 0;
+error:
+    /* The rest are still in the hashmap. */
+    free(entry);
+    DArray_destroy(expire.expired);
+
+    return -1;
+}
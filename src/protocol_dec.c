@@ -142,6 +142,12 @@ void SetQueryType(Message *message, BNode *dict)
 	return;
     }
 
+    if (BNode_StringEquals("sample_infohashes", qVal))
+    {
+	message->type = QSampleInfohashes;
+	return;
+    }
+
 invalid:
     message->type = MUnknown;
     message->errors |= MERROR_INVALID_QUERY_TYPE;
@@ -204,6 +210,7 @@ void SetQueryId(Message *message, BNode *dict)
 int SetQueryFindNodeData(Message *message, BNode *arguments);
 int SetQueryGetPeersData(Message *message, BNode *arguments);
 int SetQueryAnnouncePeerData(Message *message, BNode *arguments);
+int SetQuerySampleInfohashesData(Message *message, BNode *arguments);
 
 int SetQueryData(Message *message, BNode *dict)
 {
@@ -241,6 +248,9 @@ int SetQueryData(Message *message, BNode *dict)
     case QAnnouncePeer:
 	return SetQueryAnnouncePeerData(message, arguments);
         break;
+    case QSampleInfohashes:
+	return SetQuerySampleInfohashesData(message, arguments);
+        break;
     default:
         break;
     }
@@ -275,6 +285,32 @@ error:
     return -1;
 }
 
+int SetQuerySampleInfohashesData(Message *message, BNode *arguments)
+{
+    assert(message != NULL && "NULL Message pointer");
+    assert(message->type == QSampleInfohashes && "Wrong Message type");
+    assert(arguments != NULL && "NULL BNode dictionary pointer");
+    assert(arguments->type == BDictionary && "Not a dictionary");
+
+    BNode *target = BNode_GetValue(arguments, "target", 6);
+
+    if (target == NULL || target->type != BString || target->count != HASH_BYTES)
+    {
+        message->errors |= MERROR_INVALID_DATA;
+        return 0;
+    }
+
+    QSampleInfohashesData *data = &message->data.qsampleinfohashes;
+    data->target = malloc(HASH_BYTES);
+    check_mem(data->target);
+
+    memcpy(data->target->value, target->value.string, HASH_BYTES);
+
+    return 0;
+error:
+    return -1;
+}
+
 int IsInfoHashNode(BNode *node)
 {
     return node != NULL
@@ -304,6 +340,12 @@ int SetQueryGetPeersData(Message *message, BNode *arguments)
 
     memcpy(data->info_hash->value, info_hash->value.string, HASH_BYTES);
 
+    BNode *scrape = BNode_GetValue(arguments, "scrape", 6);
+
+    data->scrape = scrape != NULL
+        && scrape->type == BInteger
+        && scrape->value.integer != 0;
+
     return 0;
 error:
     return -1;
@@ -352,6 +394,18 @@ int SetQueryAnnouncePeerData(Message *message, BNode *arguments)
 
     data->port = port->value.integer;
 
+    BNode *implied_port = BNode_GetValue(arguments, "implied_port", 12);
+
+    data->implied_port = implied_port != NULL
+        && implied_port->type == BInteger
+        && implied_port->value.integer != 0;
+
+    BNode *seed = BNode_GetValue(arguments, "seed", 4);
+
+    data->seed = seed != NULL
+        && seed->type == BInteger
+        && seed->value.integer != 0;
+
     data->token.data = BNode_CopyString(token);
     check(data->token.data != NULL, "Failed to copy token");
 
@@ -395,6 +449,8 @@ int DecodeResponse(Message *message, BNode *dict, struct PendingResponses *pendi
 
         message->type = entry.type;
         message->context = entry.context;
+        message->search = entry.search;
+        message->sent_ms = entry.sent_ms;
     }
     else
     {
@@ -438,6 +494,7 @@ void SetResponseId(Message *message, BNode *dict)
 
 int SetResponseFindNodeData(Message *message, BNode *arguments);
 int SetResponseGetPeersData(Message *message, BNode *arguments);
+int SetResponseSampleInfohashesData(Message *message, BNode *arguments);
 
 int SetResponseData(Message *message, BNode *dict)
 {
@@ -465,6 +522,8 @@ int SetResponseData(Message *message, BNode *dict)
 	return SetResponseFindNodeData(message, arguments);
     case RGetPeers:
 	return SetResponseGetPeersData(message, arguments);
+    case RSampleInfohashes:
+	return SetResponseSampleInfohashesData(message, arguments);
     default:
         log_err("Unhandled response message type %d", message->type);
         return -1;
@@ -496,7 +555,9 @@ int SetResponseFindNodeData(Message *message, BNode *arguments)
 int SetCompactNodeInfo(Message *message, BNode *string)
 {
     assert(message != NULL && "NULL Message pointer");
-    assert((message->type == RFindNode || message->type == RGetPeers)
+    assert((message->type == RFindNode
+            || message->type == RGetPeers
+            || message->type == RSampleInfohashes)
            && "Wrong message type");
     assert(string != NULL && "NULL BNode string pointer");
     assert(string->type == BString && "Not a BString");
@@ -540,7 +601,52 @@ error:
     return -1;
 }
 
+int SetResponseSampleInfohashesData(Message *message, BNode *arguments)
+{
+    assert(message != NULL && "NULL Message pointer");
+    assert(message->type == RSampleInfohashes && "Wrong message type");
+    assert(arguments != NULL && "NULL BNode dictionary pointer");
+    assert(arguments->type == BDictionary && "Not a dictionary");
+
+    BNode *interval = BNode_GetValue(arguments, "interval", 8);
+    BNode *num = BNode_GetValue(arguments, "num", 3);
+    BNode *samples = BNode_GetValue(arguments, "samples", 7);
+    BNode *nodes = BNode_GetValue(arguments, "nodes", 5);
+
+    if (interval == NULL || interval->type != BInteger || interval->value.integer < 0
+        || num == NULL || num->type != BInteger || num->value.integer < 0
+        || samples == NULL || samples->type != BString
+        || samples->count % HASH_BYTES != 0
+        || (nodes != NULL && nodes->type != BString))
+    {
+        message->errors |= MERROR_INVALID_DATA;
+        return 0;
+    }
+
+    RSampleInfohashesData *data = &message->data.rsampleinfohashes;
+
+    data->interval = interval->value.integer;
+    data->num = num->value.integer;
+
+    if (samples->count > 0)
+    {
+        data->samples = malloc(samples->count);
+        check_mem(data->samples);
+
+        memcpy(data->samples, samples->value.string, samples->count);
+        data->samples_count = samples->count / HASH_BYTES;
+    }
+
+    if (nodes != NULL)
+        return SetCompactNodeInfo(message, nodes);
+
+    return 0;
+error:
+    return -1;
+}
+
 int SetCompactPeerInfo(Message *message, BNode *list);
+int SetBlooms(Message *message, BNode *seeds, BNode *peers);
 
 int SetResponseGetPeersData(Message *message, BNode *arguments)
 {
@@ -568,6 +674,15 @@ int SetResponseGetPeersData(Message *message, BNode *arguments)
     data->values = NULL;
     data->count = 0;
 
+    BNode *seeds = BNode_GetValue(arguments, "BFsd", 4);
+    BNode *peers = BNode_GetValue(arguments, "BFpe", 4);
+
+    if (seeds != NULL && peers != NULL)
+    {
+        int rc = SetBlooms(message, seeds, peers);
+        check(rc == 0, "SetBlooms failed");
+    }
+
     /* TODO: BNode_TryGetValue */
     BNode *values = BNode_GetValue(arguments, "values", 6);
     BNode *nodes = BNode_GetValue(arguments, "nodes", 5);
@@ -585,8 +700,9 @@ int SetResponseGetPeersData(Message *message, BNode *arguments)
         int rc = SetCompactNodeInfo(message, nodes);
 	check(rc == 0, "Failed to get compact node info");
     }
-    else
+    else if (data->seeds == NULL)
     {
+        /* Only a scrape reply may hold the bloom filters alone */
 	message->errors |= MERROR_INVALID_DATA;
     }
 
@@ -598,6 +714,35 @@ error:
     return -1;
 }
 
+int SetBlooms(Message *message, BNode *seeds, BNode *peers)
+{
+    assert(message != NULL && "NULL Message pointer");
+    assert(message->type == RGetPeers && "Wrong Message type");
+    assert(seeds != NULL && peers != NULL && "NULL BNode pointer");
+
+    if (seeds->type != BString || seeds->count != BLOOM_BYTES
+        || peers->type != BString || peers->count != BLOOM_BYTES)
+    {
+        message->errors |= MERROR_INVALID_DATA;
+        return 0;
+    }
+
+    RGetPeersData *data = &message->data.rgetpeers;
+
+    /* One block, freed with seeds */
+    data->seeds = malloc(2 * sizeof(Bloom));
+    check_mem(data->seeds);
+
+    data->peers = &data->seeds[1];
+
+    memcpy(data->seeds->bits, seeds->value.string, BLOOM_BYTES);
+    memcpy(data->peers->bits, peers->value.string, BLOOM_BYTES);
+
+    return 0;
+error:
+    return -1;
+}
+
 #define COMPACTPEER_BYTES (sizeof(uint32_t) + sizeof(uint16_t))
 
 int SetCompactPeerInfo(Message *message, BNode *list)
@@ -9,11 +9,13 @@ int EncodeQueryPing(Message *message, char *dest, size_t len);
 int EncodeQueryFindNode(Message *message, char *dest, size_t len);
 int EncodeQueryGetPeers(Message *message, char *dest, size_t len);
 int EncodeQueryAnnouncePeer(Message *message, char *dest, size_t len);
+int EncodeQuerySampleInfohashes(Message *message, char *dest, size_t len);
 
 int EncodeResponsePing(Message *message, char *dest, size_t len);
 int EncodeResponseFindNode(Message *message, char *dest, size_t len);
 int EncodeResponseGetPeers(Message *message, char *dest, size_t len);
 int EncodeResponseAnnouncePeer(Message *message, char *dest, size_t len);
+int EncodeResponseSampleInfohashes(Message *message, char *dest, size_t len);
 int EncodeResponseError(Message *message, char *dest, size_t len);
 
 int Message_Encode(Message *message, char *dest, size_t len)
@@ -27,10 +29,12 @@ int Message_Encode(Message *message, char *dest, size_t len)
     case QFindNode: return EncodeQueryFindNode(message, dest, len);
     case QGetPeers: return EncodeQueryGetPeers(message, dest, len);
     case QAnnouncePeer: return EncodeQueryAnnouncePeer(message, dest, len);
+    case QSampleInfohashes: return EncodeQuerySampleInfohashes(message, dest, len);
     case RPing: return EncodeResponsePing(message, dest, len);
     case RFindNode: return EncodeResponseFindNode(message, dest, len);
     case RGetPeers: return EncodeResponseGetPeers(message, dest, len);
     case RAnnouncePeer: return EncodeResponseAnnouncePeer(message, dest, len);
+    case RSampleInfohashes: return EncodeResponseSampleInfohashes(message, dest, len);
     case RError: return EncodeResponseError(message, dest, len);
     default: log_err("Can't encode unknown message type");
 	return -1;
@@ -39,8 +43,6 @@ int Message_Encode(Message *message, char *dest, size_t len)
 
 int digits(size_t l)
 {
-    assert(l < 100000 && "Too many digits");
-    
     if (l < 10)
 	return 1;
     if (l < 100)
@@ -52,7 +54,13 @@ int digits(size_t l)
     if (l < 100000)
 	return 5;
 
-    return 20;
+    /* Only counts, like the num of sample_infohashes, get here */
+    int count = 5;
+
+    for (l /= 100000; l > 0; l /= 10)
+        count++;
+
+    return count;
 }
 
 int StringHeaderLen(size_t string_len)
@@ -173,6 +181,7 @@ error:
 
 #define QGETPEERSA "d1:ad2:id"
 #define QGETPEERSB "9:info_hash"
+#define QGETPEERSS "6:scrapei1e"
 #define QGETPEERSC "e1:q9:get_peers"
 #define QGETPEERSD "1:y1:qe"
 
@@ -189,6 +198,7 @@ int EncodeQueryGetPeers(Message *message, char *dest, size_t len)
 	  + HASHLEN
 	  + SLen(QGETPEERSB)
 	  + HASHLEN
+	  + (message->data.qgetpeers.scrape ? SLen(QGETPEERSS) : 0)
 	  + SLen(QGETPEERSC)
 	  + TLen(message)
 	  + SLen(QGETPEERSD)
@@ -199,6 +209,10 @@ int EncodeQueryGetPeers(Message *message, char *dest, size_t len)
     HCpy(dest, message->id.value);
     SCpy(dest, QGETPEERSB);
     HCpy(dest, message->data.qgetpeers.info_hash->value);
+    if (message->data.qgetpeers.scrape)
+    {
+        SCpy(dest, QGETPEERSS);
+    }
     SCpy(dest, QGETPEERSC);
     TCpy(&dest, message);
     SCpy(dest, QGETPEERSD);
@@ -224,8 +238,10 @@ void ICpy(char **dest, int i)
 }
 
 #define QANNOUNCEPEERA "d1:ad2:id"
+#define QANNOUNCEPEERI "12:implied_porti1e"
 #define QANNOUNCEPEERB "9:info_hash"
 #define QANNOUNCEPEERC "4:port"
+#define QANNOUNCEPEERS "4:seedi1e"
 #define QANNOUNCEPEERD "5:token"
 #define QANNOUNCEPEERE "e1:q13:announce_peer"
 #define QANNOUNCEPEERF "1:y1:qe"
@@ -242,10 +258,12 @@ int EncodeQueryAnnouncePeer(Message *message, char *dest, size_t len)
 
     check(SLen(QANNOUNCEPEERA)
 	  + HASHLEN
+	  + (data->implied_port ? SLen(QANNOUNCEPEERI) : 0)
 	  + SLen(QANNOUNCEPEERB)
 	  + HASHLEN
 	  + SLen(QANNOUNCEPEERC)
 	  + ILen(data->port)
+	  + (data->seed ? SLen(QANNOUNCEPEERS) : 0)
 	  + SLen(QANNOUNCEPEERD)
 	  + BStringLen(data->token.len)
 	  + SLen(QANNOUNCEPEERE)
@@ -256,10 +274,18 @@ int EncodeQueryAnnouncePeer(Message *message, char *dest, size_t len)
 
     SCpy(dest, QANNOUNCEPEERA);
     HCpy(dest, message->id.value);
+    if (data->implied_port)
+    {
+        SCpy(dest, QANNOUNCEPEERI);
+    }
     SCpy(dest, QANNOUNCEPEERB);
     HCpy(dest, data->info_hash->value);
     SCpy(dest, QANNOUNCEPEERC);
     ICpy(&dest, data->port);
+    if (data->seed)
+    {
+        SCpy(dest, QANNOUNCEPEERS);
+    }
     SCpy(dest, QANNOUNCEPEERD);
     BStringCpy(&dest, data->token.data, data->token.len);
     SCpy(dest, QANNOUNCEPEERE);
@@ -273,6 +299,45 @@ error:
     return -1;
 }
 
+#define QSAMPLEINFOHASHESA "d1:ad2:id"
+#define QSAMPLEINFOHASHESB "6:target"
+#define QSAMPLEINFOHASHESC "e1:q17:sample_infohashes"
+#define QSAMPLEINFOHASHESD "1:y1:qe"
+
+int EncodeQuerySampleInfohashes(Message *message, char *dest, size_t len)
+{
+    assert(message != NULL && "NULL Message pointer");
+    assert(dest != NULL && "NULL char dest pointer");
+
+    check(message->type == QSampleInfohashes, "Not a sample_infohashes query");
+
+    char *orig_dest = dest;
+
+    check(SLen(QSAMPLEINFOHASHESA)
+	  + HASHLEN
+	  + SLen(QSAMPLEINFOHASHESB)
+	  + HASHLEN
+	  + SLen(QSAMPLEINFOHASHESC)
+	  + TLen(message)
+	  + SLen(QSAMPLEINFOHASHESD)
+	  <= len,
+	  "sample_infohashes query would overflow dest");
+
+    SCpy(dest, QSAMPLEINFOHASHESA);
+    HCpy(dest, message->id.value);
+    SCpy(dest, QSAMPLEINFOHASHESB);
+    HCpy(dest, message->data.qsampleinfohashes.target->value);
+    SCpy(dest, QSAMPLEINFOHASHESC);
+    TCpy(&dest, message);
+    SCpy(dest, QSAMPLEINFOHASHESD);
+
+    assert(dest - orig_dest <= (ssize_t)len && "Overflow");
+
+    return dest - orig_dest;
+error:
+    return -1;
+}
+
 #define RPINGA "d1:rd2:id"
 #define RPINGB "e"
 #define RPINGC "1:y1:re"
@@ -409,7 +474,28 @@ void ValuesCpy(char **dest, Peer *values, int count)
     *(*dest)++ = 'e';
 }
 
-#define RGETPEERSA "d1:rd2:id"
+/* The BFpe and BFsd of a scrape, sorted before the id */
+int BloomsLen(RGetPeersData *data)
+{
+    if (data->seeds == NULL || data->peers == NULL)
+        return 0;
+
+    return 2 * (SLen("4:BFpe") + BStringLen(BLOOM_BYTES));
+}
+
+void BloomsCpy(char **dest, RGetPeersData *data)
+{
+    if (data->seeds == NULL || data->peers == NULL)
+        return;
+
+    SCpy(*dest, "4:BFpe");
+    BStringCpy(dest, (char *)data->peers->bits, BLOOM_BYTES);
+    SCpy(*dest, "4:BFsd");
+    BStringCpy(dest, (char *)data->seeds->bits, BLOOM_BYTES);
+}
+
+#define RGETPEERSA "d1:rd"
+#define RGETPEERSI "2:id"
 #define RGETPEERSB "5:token"
 #define RGETPEERSC "1:y1:re"
 
@@ -426,6 +512,8 @@ int EncodeResponseGetPeers_values(Message *message, char *dest, size_t len)
     assert(data->values != NULL && "NULL Peer values pointer");
 
     check(SLen(RGETPEERSA)
+	  + BloomsLen(data)
+	  + SLen(RGETPEERSI)
 	  + HASHLEN
 	  + SLen(RGETPEERSB)
 	  + BStringLen(data->token.len)
@@ -438,6 +526,8 @@ int EncodeResponseGetPeers_values(Message *message, char *dest, size_t len)
 	  "get_peers response would overflow dest");
 
     SCpy(dest, RGETPEERSA);
+    BloomsCpy(&dest, data);
+    SCpy(dest, RGETPEERSI);
     HCpy(dest, message->id.value);
     SCpy(dest, RGETPEERSB);
     BStringCpy(&dest, data->token.data, data->token.len);
@@ -467,6 +557,8 @@ int EncodeResponseGetPeers_nodes(Message *message, char *dest, size_t len)
     assert(data->nodes != NULL && "NULL Peer values pointer");
 
     check(SLen(RGETPEERSA)
+	  + BloomsLen(data)
+	  + SLen(RGETPEERSI)
 	  + HASHLEN
 	  + NodesLen(data->count)
 	  + SLen(RGETPEERSB)
@@ -478,6 +570,8 @@ int EncodeResponseGetPeers_nodes(Message *message, char *dest, size_t len)
 	  "get_peers response would overflow dest");
 
     SCpy(dest, RGETPEERSA);
+    BloomsCpy(&dest, data);
+    SCpy(dest, RGETPEERSI);
     HCpy(dest, message->id.value);
     NodesCpy(&dest, data->nodes, data->count);
     SCpy(dest, RGETPEERSB);
@@ -542,6 +636,67 @@ error:
     return -1;
 }
 
+#define RSAMPLEINFOHASHESA "d1:rd2:id"
+#define RSAMPLEINFOHASHESB "8:interval"
+#define RSAMPLEINFOHASHESC "3:num"
+#define RSAMPLEINFOHASHESD "7:samples"
+#define RSAMPLEINFOHASHESE "e"
+#define RSAMPLEINFOHASHESF "1:y1:re"
+
+int EncodeResponseSampleInfohashes(Message *message, char *dest, size_t len)
+{
+    assert(message != NULL && "NULL Message pointer");
+    assert(dest != NULL && "NULL char dest pointer");
+
+    check(message->type == RSampleInfohashes, "Not a sample_infohashes response");
+
+    char *orig_dest = dest;
+    RSampleInfohashesData *data = &message->data.rsampleinfohashes;
+    size_t samples_len = data->samples_count * HASH_BYTES;
+
+    check(SLen(RSAMPLEINFOHASHESA)
+	  + HASHLEN
+	  + SLen(RSAMPLEINFOHASHESB)
+	  + ILen(data->interval)
+	  + (data->nodes != NULL ? NodesLen(data->count) : 0)
+	  + SLen(RSAMPLEINFOHASHESC)
+	  + ILen(data->num)
+	  + SLen(RSAMPLEINFOHASHESD)
+	  + BStringLen(samples_len)
+	  + SLen(RSAMPLEINFOHASHESE)
+	  + TLen(message)
+	  + SLen(RSAMPLEINFOHASHESF)
+	  <= len,
+	  "sample_infohashes response would overflow dest");
+
+    SCpy(dest, RSAMPLEINFOHASHESA);
+    HCpy(dest, message->id.value);
+    SCpy(dest, RSAMPLEINFOHASHESB);
+    ICpy(&dest, data->interval);
+    if (data->nodes != NULL)
+    {
+        NodesCpy(&dest, data->nodes, data->count);
+    }
+    SCpy(dest, RSAMPLEINFOHASHESC);
+    ICpy(&dest, data->num);
+    SCpy(dest, RSAMPLEINFOHASHESD);
+    StringHeaderCpy(&dest, samples_len);
+    if (samples_len > 0)
+    {
+        memcpy(dest, data->samples, samples_len);
+        dest += samples_len;
+    }
+    SCpy(dest, RSAMPLEINFOHASHESE);
+    TCpy(&dest, message);
+    SCpy(dest, RSAMPLEINFOHASHESF);
+
+    assert(dest - orig_dest <= (ssize_t)len && "Overflow");
+
+    return dest - orig_dest;
+error:
+    return -1;
+}
+
 int EncodeResponseError(Message *message, char *dest, size_t len)
 {
     assert(message != NULL && "NULL Message pointer");
@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dht/rtt.h>
+
+void RttStats_Init(RttStats *stats)
+{
+    assert(stats != NULL && "NULL RttStats pointer");
+
+    memset(stats, 0, sizeof(RttStats));
+    stats->timeout = RTT_TIMEOUT_DEFAULT;
+}
+
+int Rtt_Compare(const void *a, const void *b)
+{
+    int64_t ra = *(int64_t *)a, rb = *(int64_t *)b;
+
+    return (ra > rb) - (ra < rb);
+}
+
+int64_t RttStats_Percentile(RttStats *stats, int percent)
+{
+    assert(stats != NULL && "NULL RttStats pointer");
+    assert(0 <= percent && percent <= 100 && "Bad percentile");
+
+    if (stats->count == 0)
+        return -1;
+
+    int64_t sorted[RTT_SAMPLES];
+
+    memcpy(sorted, stats->samples, stats->count * sizeof(int64_t));
+    qsort(sorted, stats->count, sizeof(int64_t), Rtt_Compare);
+
+    return sorted[(stats->count - 1) * percent / 100];
+}
+
+void RttStats_Add(RttStats *stats, int64_t rtt)
+{
+    assert(stats != NULL && "NULL RttStats pointer");
+
+    if (rtt < 0)
+        return;
+
+    stats->samples[stats->next] = rtt;
+    stats->next = (stats->next + 1) % RTT_SAMPLES;
+
+    if (stats->count < RTT_SAMPLES)
+        stats->count++;
+
+    if (stats->count < RTT_MIN_SAMPLES)
+        return;
+
+    int64_t timeout = RTT_FACTOR * RttStats_Percentile(stats, RTT_PERCENTILE);
+
+    if (timeout < RTT_TIMEOUT_MIN)
+        timeout = RTT_TIMEOUT_MIN;
+    else if (timeout > RTT_TIMEOUT_MAX)
+        timeout = RTT_TIMEOUT_MAX;
+
+    stats->timeout = timeout;
+}
@@ -1,7 +1,9 @@
 #include <assert.h>
 
 #include <dht/search.h>
+#include <dht/bloom.h>
 #include <dht/client.h>
+#include <dht/clock.h>
 #include <dht/close.h>
 #include <dht/message_create.h>
 #include <dht/table.h>
@@ -20,6 +22,9 @@ Search *Search_Create(Hash *id)
     search->peers = Peers_Create(id);
     check(search->peers != NULL, "Peers_Create failed");
 
+    search->seen = PeerFilter_Create(0);
+    check(search->seen != NULL, "PeerFilter_Create failed");
+
     search->tokens = Hashmap_create(
         (Hashmap_compare)Distance_Compare,
         (Hashmap_hash)Hash_Hash);
@@ -48,6 +53,8 @@ void Search_Destroy(Search *search)
     Table_DestroyNodes(search->table);
     Table_Destroy(search->table);
     Peers_Destroy(search->peers);
+    PeerFilter_Destroy(search->seen);
+    free(search->fresh);
 
     Hashmap_traverse(search->tokens, NULL, FreeFTokenEntry_cb);
     Hashmap_destroy(search->tokens);
@@ -55,16 +62,131 @@ void Search_Destroy(Search *search)
     free(search);
 }
 
-int Search_IsDone(Search *search, time_t now)
+void Search_MarkSent(Search *search, Hash *id, int64_t now)
+{
+    assert(search != NULL && "NULL Search pointer");
+    assert(id != NULL && "NULL Hash pointer");
+
+    Node *node = Table_FindNode(search->table, id);
+
+    if (node != NULL)
+        node->sent_ms = now;
+}
+
+struct LiveCloseContext {
+    CloseNodes *close;
+    int64_t now;
+    int64_t timeout;
+};
+
+int AddLiveCloseNode(struct LiveCloseContext *context, Node *node)
+{
+    if (Search_IsTimedOut(node, context->now, context->timeout))
+        return 0;
+
+    return CloseNodes_Add(context->close, node);
+}
+
+/* Like Table_ForEachCloseNode, passing over the nodes that timed out
+ * so that the next closest are asked instead. */
+int ForEachLiveCloseNode(Search *search,
+                         int64_t now,
+                         int64_t timeout,
+                         void *context,
+                         NodeOp op)
 {
-    const int search_respite = 3;
+    DArray *nodes = NULL;
+    struct LiveCloseContext live = { .now = now, .timeout = timeout };
+
+    live.close = CloseNodes_Create(&search->table->id);
+    check(live.close != NULL, "CloseNodes_Create failed");
+
+    int rc = Table_ForEachNode(search->table, &live, (NodeOp)AddLiveCloseNode);
+    check(rc == 0, "AddLiveCloseNode failed");
+
+    nodes = CloseNodes_GetNodes(live.close);
+    check(nodes != NULL, "CloseNodes_GetNodes failed");
 
-    if (search->send_time == 0)
+    int i = 0;
+    for (i = 0; i < DArray_count(nodes); i++)
+    {
+        rc = op(context, DArray_get(nodes, i));
+        check(rc == 0, "NodeOp on close node failed");
+    }
+
+    DArray_destroy(nodes);
+    CloseNodes_Destroy(live.close);
+
+    return 0;
+error:
+    DArray_destroy(nodes);
+    CloseNodes_Destroy(live.close);
+    return -1;
+}
+
+struct SettledContext {
+    Search *search;
+    int64_t now;
+    int64_t timeout;
+    int unsettled;
+};
+
+/* A close node is settled when we have nothing more to ask it. */
+int CountUnsettled(struct SettledContext *context, Node *node)
+{
+    if (node->pending_queries > 0)
+    {
+        context->unsettled++;
         return 0;
+    }
+
+    if (context->search->flags & SearchRefresh)
+    {
+        if (node->rfindnode_count == 0)
+            context->unsettled++;
 
-    if (search->send_time + search_respite < now)
+        return 0;
+    }
+
+    if (node->rgetpeers_count == 0)
+    {
+        context->unsettled++;
+        return 0;
+    }
+
+    if ((context->search->flags & SearchAnnounce)
+        && node->rannounce_count == 0
+        && Search_GetToken(context->search, &node->id) != NULL)
+    {
+        context->unsettled++;
+    }
+
+    return 0;
+}
+
+int Search_IsDone(Search *search, int64_t now, int64_t timeout)
+{
+    assert(search != NULL && "NULL Search pointer");
+
+    if (search->is_done)
         return 1;
 
+    if (search->stats.queries == 0)
+        return 0;
+
+    struct SettledContext context = { .search = search,
+                                      .now = now,
+                                      .timeout = timeout };
+
+    int rc = ForEachLiveCloseNode(search,
+                                  now,
+                                  timeout,
+                                  &context,
+                                  (NodeOp)CountUnsettled);
+    check(rc == 0, "CountUnsettled failed");
+
+    return context.unsettled == 0;
+error:
     return 0;
 }
 
@@ -77,25 +199,80 @@ int Search_CopyTable(Search *search, Table *source)
     return Table_ForEachNode(source, search->table, (NodeOp)Table_CopyAndAddNode);
 }
 
-int Search_AddPeers(Search *search, Peer *peers, int count)
+int Search_CopyNodes(Search *search, DArray *nodes)
+{
+    assert(search != NULL && "NULL Search pointer");
+    assert(nodes != NULL && "NULL DArray pointer");
+
+    int i = 0;
+    for (i = 0; i < DArray_count(nodes); i++)
+    {
+        int rc = Table_CopyAndAddNode(search->table, DArray_get(nodes, i));
+        check(rc == 0, "Table_CopyAndAddNode failed");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+int Search_AddPeers(Search *search, Peer *peers, int count, Peer *fresh)
 {
     assert(search != NULL && "NULL Search pointer");
     assert(peers != NULL && "NULL Peer pointer");
+    assert(fresh != NULL && "NULL Peer pointer");
 
     Peer *end = peers + count;
+    int added = 0;
 
-    while (peers < end)
+    while (peers < end && !search->is_done)
     {
-        int rc = Peers_AddPeer(search->peers, peers);
-        check(rc == 0, "Peers_AddPeer failed");
+        int rc = PeerFilter_Add(search->seen, peers);
+        check(rc != -1, "PeerFilter_Add failed");
+
+        if (rc == 1)
+        {
+            if (search->peers->count < MAXPEERS)
+            {
+                rc = Peers_AddPeer(search->peers, peers);
+                check(rc == 0, "Peers_AddPeer failed");
+            }
+
+            fresh[added++] = *peers;
+
+            if (search->max_peers > 0
+                && search->seen->count >= search->max_peers)
+            {
+                search->is_done = 1;
+            }
+        }
+
         peers++;
     }
 
-    return 0;
+    return added;
 error:
     return -1;
 }
 
+Peer *Search_FreshPeers(Search *search, size_t count)
+{
+    assert(search != NULL && "NULL Search pointer");
+
+    if (count > search->fresh_max)
+    {
+        Peer *fresh = realloc(search->fresh, count * sizeof(Peer));
+        check_mem(fresh);
+
+        search->fresh = fresh;
+        search->fresh_max = count;
+    }
+
+    return search->fresh;
+error:
+    return NULL;
+}
+
 void FTokenEntry_Delete(struct FTokenEntry *entry)
 {
     if (entry != NULL)
@@ -153,6 +330,26 @@ error:
     return -1;
 }
 
+void Search_AddScrape(Search *search, Bloom *seeds, Bloom *peers)
+{
+    assert(search != NULL && "NULL Search pointer");
+    assert(seeds != NULL && peers != NULL && "NULL Bloom pointer");
+
+    Bloom_Merge(&search->scrape_seeds, seeds);
+    Bloom_Merge(&search->scrape_peers, peers);
+    search->scrapes++;
+}
+
+void Search_GetScrapeStats(Search *search, ScrapeStats *stats)
+{
+    assert(search != NULL && "NULL Search pointer");
+    assert(stats != NULL && "NULL ScrapeStats pointer");
+
+    stats->replies = search->scrapes;
+    stats->seeds = Bloom_Estimate(&search->scrape_seeds);
+    stats->peers = Bloom_Estimate(&search->scrape_peers);
+}
+
 struct FToken *Search_GetToken(Search *search, Hash *id)
 {
     assert(search != NULL && "NULL Search pointer");
@@ -171,12 +368,44 @@ struct FToken *Search_GetToken(Search *search, Hash *id)
 struct ClientSearch {
     Client *client;
     Search *search;
-    int count;
+    int64_t now;
+    int64_t timeout;
 };
 
+/* A full search lane holds back new queries until sent. */
+int SearchIsBlocked(struct ClientSearch *context)
+{
+    return MessageQueue_IsFull(context->client->queries, LaneSearch);
+}
+
+/* Every query in a search is sent through here. */
+int SearchQuery(struct ClientSearch *context, Node *node, Message *query)
+{
+    query->search = context->search->serial;
+
+    int rc = MessageQueue_Push(context->client->queries, query);
+    check(rc == 0, "MessageQueue_Push failed");
+
+    node->pending_queries++;
+    node->sent_ms = SEARCH_QUEUED_MS;
+
+    if (context->search->stats.queries++ == 0)
+        context->search->stats.start_ms = context->now;
+
+    return 0;
+error:
+    return -1;
+}
+
+/* Nodes are asked one thing at a time. A node that does not reply
+ * in time is not asked again. */
 int SendFindNodes(struct ClientSearch *context, Node *node)
 {
-    if (node->rfindnode_count > 0)
+    if (node->pending_queries > 0 || SearchIsBlocked(context))
+        return 0;
+
+    /* A get_peers reply carries the same nodes */
+    if (node->rfindnode_count > 0 || node->rgetpeers_count > 0)
         return 0;
 
     Message *query = Message_CreateQFindNode(context->client,
@@ -184,12 +413,8 @@ int SendFindNodes(struct ClientSearch *context, Node *node)
                                              &context->search->table->id);
     check(query != NULL, "Message_CreateQFindNode failed");
 
-    query->context = context->search;
-
-    int rc = MessageQueue_Push(context->client->queries, query);
-    check(rc == 0, "MessageQueue_Push failed");
-
-    node->pending_queries++;
+    int rc = SearchQuery(context, node, query);
+    check(rc == 0, "SearchQuery failed");
 
     return 0;
 error:
@@ -199,7 +424,13 @@ error:
 
 int SendGetPeers(struct ClientSearch *context, Node *node)
 {
-    if (node->rgetpeers_count > 0)
+    if (context->search->flags & SearchRefresh)
+        return 0;
+
+    if (node->pending_queries > 0 || node->rgetpeers_count > 0)
+        return 0;
+
+    if (SearchIsBlocked(context))
         return 0;
 
     Message *query = Message_CreateQGetPeers(context->client,
@@ -207,13 +438,11 @@ int SendGetPeers(struct ClientSearch *context, Node *node)
                                              &context->search->table->id);
     check(query != NULL, "Message_CreateQGetPeers failed");
 
-    query->context = context->search;
+    query->data.qgetpeers.scrape
+        = (context->search->flags & SearchScrape) != 0;
 
-    int rc = MessageQueue_Push(context->client->queries, query);
-    check(rc == 0, "MessageQueue_Push failed");
-
-    node->pending_queries++;
-    context->count++;
+    int rc = SearchQuery(context, node, query);
+    check(rc == 0, "SearchQuery failed");
 
     return 0;
 error:
@@ -223,7 +452,13 @@ error:
 
 int SendAnnouncePeer(struct ClientSearch *context, Node *node)
 {
-    if (node->rannounce_count > 0)
+    if (!(context->search->flags & SearchAnnounce))
+        return 0;
+
+    if (node->pending_queries > 0 || node->rannounce_count > 0)
+        return 0;
+
+    if (SearchIsBlocked(context))
         return 0;
 
     struct FToken *token = Search_GetToken(context->search,
@@ -241,15 +476,13 @@ int SendAnnouncePeer(struct ClientSearch *context, Node *node)
                                                  token->len);
     check(query != NULL, "Message_CreateQAnnouncePeer failed");
 
-    query->context = context->search;
+    query->data.qannouncepeer.implied_port
+        = (context->search->flags & SearchImpliedPort) != 0;
+    query->data.qannouncepeer.seed
+        = (context->search->flags & SearchSeed) != 0;
 
-    int rc = MessageQueue_Push(context->client->queries, query);
-    check(rc == 0, "MessageQueue_Push failed");
-    query->context = context->search;
-
-
-    node->pending_queries++;
-    context->count++;
+    int rc = SearchQuery(context, node, query);
+    check(rc == 0, "SearchQuery failed");
 
     return 0;
 error:
@@ -262,23 +495,43 @@ int Search_DoWork(Client *client, Search *search)
     assert(client != NULL && "NULL Client pointer");
     assert(search != NULL && "NULL Search pointer");
 
-    struct ClientSearch context = { .client = client, .search = search };
-
-    int rc = Table_ForEachNode(search->table, &context, (NodeOp)SendFindNodes);
-    check(rc == 0, "SendFindNodes failed");
+    struct ClientSearch context = { .client = client,
+                                    .search = search,
+                                    .now = Clock_Now(&client->clock),
+                                    .timeout = RttStats_Timeout(&client->rtt) };
 
-    rc = Table_ForEachCloseNode(search->table,
-                                &context,
-                                (NodeOp)SendGetPeers);
-    check(rc == 0, "SendGetPeers failed");
+    if (search->is_done || SearchIsBlocked(&context))
+        return 0;
 
-    rc = Table_ForEachCloseNode(search->table,
-                                &context,
-                                (NodeOp)SendAnnouncePeer);
+    int rc = ForEachLiveCloseNode(search,
+                                  context.now,
+                                  context.timeout,
+                                  &context,
+                                  (NodeOp)SendAnnouncePeer);
     check(rc == 0, "SendAnnouncePeer failed");
 
-    if (context.count > 0)
-        search->send_time = time(NULL);
+    rc = ForEachLiveCloseNode(search,
+                              context.now,
+                              context.timeout,
+                              &context,
+                              (NodeOp)SendGetPeers);
+    check(rc == 0, "SendGetPeers failed");
+
+    /* A refresh walks towards its target instead of asking every
+     * node of the copied routing table. */
+    if (search->flags & SearchRefresh)
+    {
+        rc = ForEachLiveCloseNode(search,
+                                  context.now,
+                                  context.timeout,
+                                  &context,
+                                  (NodeOp)SendFindNodes);
+    }
+    else
+    {
+        rc = Table_ForEachNode(search->table, &context, (NodeOp)SendFindNodes);
+    }
+    check(rc == 0, "SendFindNodes failed");
 
     return 0;
 error:
@@ -0,0 +1,267 @@
+#include <assert.h>
+
+#include <dht/searchcache.h>
+#include <dht/table.h>
+#include <lcthw/dbg.h>
+
+SearchCache *SearchCache_Create(time_t ttl, size_t max_size)
+{
+    SearchCache *cache = calloc(1, sizeof(SearchCache));
+    check_mem(cache);
+
+    cache->results = Hashmap_create(
+        (Hashmap_compare)Distance_Compare,
+        (Hashmap_hash)Hash_Hash);
+    check_mem(cache->results);
+
+    cache->order = List_create();
+    check_mem(cache->order);
+
+    cache->ttl = ttl;
+    cache->max_size = max_size;
+
+    return cache;
+error:
+    SearchCache_Destroy(cache);
+    return NULL;
+}
+
+void SearchResult_Destroy(SearchResult *result)
+{
+    if (result == NULL)
+        return;
+
+    size_t i = 0;
+    for (i = 0; i < result->nodes_count; i++)
+        free(result->nodes[i].token.data);
+
+    free(result->nodes);
+    free(result->peers);
+    free(result);
+}
+
+void SearchCache_Destroy(SearchCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    if (cache->order != NULL)
+    {
+        while (List_count(cache->order) > 0)
+            SearchResult_Destroy(List_unshift(cache->order));
+
+        List_destroy(cache->order);
+    }
+
+    Hashmap_destroy(cache->results);
+    free(cache);
+}
+
+void SearchCache_Remove(SearchCache *cache, SearchResult *result)
+{
+    assert(cache != NULL && "NULL SearchCache pointer");
+    assert(result != NULL && "NULL SearchResult pointer");
+
+    Hashmap_delete(cache->results, &result->info_hash);
+    List_remove(cache->order, result->entry);
+
+    cache->size -= result->size;
+
+    SearchResult_Destroy(result);
+}
+
+struct CollectContext {
+    Search *search;
+    SearchResult *result;
+};
+
+int CollectNode(struct CollectContext *context, Node *node)
+{
+    if (node->rgetpeers_count == 0)
+        return 0;
+
+    struct FToken *token = Search_GetToken(context->search, &node->id);
+
+    if (token == NULL)
+        return 0;
+
+    SearchResultNode *entry = &context->result->nodes[context->result->nodes_count];
+
+    entry->token.data = malloc(token->len);
+    check_mem(entry->token.data);
+
+    memcpy(entry->token.data, token->data, token->len);
+    entry->token.len = token->len;
+
+    entry->node = (Node){ .id = node->id, .addr = node->addr, .port = node->port };
+
+    context->result->nodes_count++;
+    context->result->size += sizeof(SearchResultNode) + token->len;
+
+    return 0;
+error:
+    return -1;
+}
+
+SearchResult *SearchResult_Create(Search *search, time_t now)
+{
+    assert(search != NULL && "NULL Search pointer");
+
+    SearchResult *result = calloc(1, sizeof(SearchResult));
+    check_mem(result);
+
+    result->info_hash = search->table->id;
+    result->time = now;
+    result->size = sizeof(SearchResult);
+
+    if (search->max_peers > 0 && search->seen->count >= search->max_peers)
+        result->max_peers = search->max_peers;
+
+    if (search->peers->count > 0)
+    {
+        result->peers = malloc(search->peers->count * sizeof(Peer));
+        check_mem(result->peers);
+
+        result->peers_count = Peers_GetPeers(search->peers,
+                                             result->peers,
+                                             search->peers->count);
+        result->size += result->peers_count * sizeof(Peer);
+    }
+
+    result->nodes = calloc(BUCKET_K, sizeof(SearchResultNode));
+    check_mem(result->nodes);
+
+    struct CollectContext context = { .search = search, .result = result };
+
+    int rc = Table_ForEachCloseNode(search->table, &context, (NodeOp)CollectNode);
+    check(rc == 0, "CollectNode failed");
+
+    return result;
+error:
+    SearchResult_Destroy(result);
+    return NULL;
+}
+
+int SearchCache_Put(SearchCache *cache, Search *search, time_t now)
+{
+    assert(cache != NULL && "NULL SearchCache pointer");
+    assert(search != NULL && "NULL Search pointer");
+
+    SearchResult *result = SearchResult_Create(search, now);
+    check(result != NULL, "SearchResult_Create failed");
+
+    if (result->peers_count == 0 && result->nodes_count == 0)
+    {
+        SearchResult_Destroy(result);
+        return 0;
+    }
+
+    SearchResult *old = Hashmap_get(cache->results, &result->info_hash);
+
+    if (old != NULL)
+        SearchCache_Remove(cache, old);
+
+    int rc = Hashmap_set(cache->results, &result->info_hash, result);
+    check(rc == 0, "Hashmap_set failed");
+
+    List_push(cache->order, result);
+    result->entry = cache->order->last;
+    cache->size += result->size;
+
+    while (cache->size > cache->max_size && List_count(cache->order) > 0)
+        SearchCache_Remove(cache, List_first(cache->order));
+
+    return 0;
+error:
+    SearchResult_Destroy(result);
+    return -1;
+}
+
+SearchResult *SearchCache_Get(SearchCache *cache,
+                              Hash *info_hash,
+                              size_t max_peers,
+                              time_t now)
+{
+    assert(cache != NULL && "NULL SearchCache pointer");
+    assert(info_hash != NULL && "NULL Hash pointer");
+
+    SearchResult *result = Hashmap_get(cache->results, info_hash);
+
+    if (result != NULL && result->time + cache->ttl < now)
+    {
+        SearchCache_Remove(cache, result);
+        result = NULL;
+    }
+
+    /* Fewer peers than the search wants, kept for those wanting less */
+    if (result != NULL
+        && result->max_peers > 0
+        && (max_peers == 0 || max_peers > result->max_peers))
+    {
+        result = NULL;
+    }
+
+    if (result == NULL)
+    {
+        cache->misses++;
+        return NULL;
+    }
+
+    cache->hits++;
+    return result;
+}
+
+void SearchCache_Clean(SearchCache *cache, time_t now)
+{
+    assert(cache != NULL && "NULL SearchCache pointer");
+
+    while (List_count(cache->order) > 0)
+    {
+        SearchResult *result = List_first(cache->order);
+
+        if (result->time + cache->ttl >= now)
+            break;
+
+        SearchCache_Remove(cache, result);
+    }
+}
+
+int Search_UseResult(Search *search, SearchResult *result)
+{
+    assert(search != NULL && "NULL Search pointer");
+    assert(result != NULL && "NULL SearchResult pointer");
+
+    Node *copy = NULL;
+
+    size_t i = 0;
+    for (i = 0; i < result->nodes_count; i++)
+    {
+        SearchResultNode *entry = &result->nodes[i];
+
+        copy = Node_Copy(&entry->node);
+        check_mem(copy);
+
+        copy->reply_time = result->time;
+        copy->rfindnode_count = 1;
+        copy->rgetpeers_count = 1;
+
+        Table_InsertNodeResult insert = Table_InsertNode(search->table, copy);
+        check(insert.rc != ERROR, "Table_InsertNode failed");
+
+        if (insert.rc == OKReplaced)
+            Node_Destroy(insert.replaced);
+
+        if (insert.rc != OKAdded && insert.rc != OKReplaced)
+            Node_Destroy(copy);
+
+        copy = NULL;
+
+        int rc = Search_SetToken(search, &entry->node.id, entry->token);
+        check(rc == 0, "Search_SetToken failed");
+    }
+
+    return 0;
+error:
+    Node_Destroy(copy);
+    return -1;
+}
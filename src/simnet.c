@@ -0,0 +1,430 @@
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dht/clock.h>
+#include <dht/simnet.h>
+#include <lcthw/dbg.h>
+
+int64_t SimNet_Now(void *net)
+{
+    return ((SimNet *)net)->now_ms;
+}
+
+/* Returns a random number in [0, 1). */
+double SimNet_Uniform(SimNet *net)
+{
+    uint32_t value = 0;
+
+    int rc = Random_Fill(net->random, (char *)&value, sizeof(value));
+    check(rc == 0, "Random_Fill failed");
+
+    return (value & 0x7FFFFFFF) / 2147483648.0;
+error:
+    return 0;
+}
+
+int SimNet_Chance(SimNet *net, double p)
+{
+    /* Draws nothing, so that runs without loss stay the same */
+    return p > 0 && SimNet_Uniform(net) < p;
+}
+
+SimNet *SimNet_Create(SimNetConfig *config)
+{
+    assert(config != NULL && "NULL SimNetConfig pointer");
+
+    SimNet *net = calloc(1, sizeof(SimNet));
+    check_mem(net);
+
+    net->config = *config;
+    net->now_ms = SIMNET_START_MS;
+
+    net->endpoints = DArray_create(sizeof(SimEndpoint *), 1024);
+    check(net->endpoints != NULL, "DArray_create failed");
+
+    net->random = RandomState_Create(config->seed);
+    check(net->random != NULL, "RandomState_Create failed");
+
+    return net;
+error:
+    SimNet_Destroy(net);
+    return NULL;
+}
+
+void SimEndpoint_Destroy(SimEndpoint *endpoint)
+{
+    if (endpoint == NULL)
+        return;
+
+    while (endpoint->inbox != NULL)
+    {
+        SimDatagram *datagram = endpoint->inbox;
+        endpoint->inbox = datagram->next;
+        free(datagram);
+    }
+
+    Client_Destroy(endpoint->client);
+    free(endpoint->mappings);
+    free(endpoint);
+}
+
+void SimNet_Destroy(SimNet *net)
+{
+    if (net == NULL)
+        return;
+
+    size_t i = 0;
+    for (i = 0; i < net->events_count; i++)
+        free(net->events[i].datagram);
+
+    free(net->events);
+
+    if (net->endpoints != NULL)
+    {
+        for (i = 0; i < (size_t)DArray_count(net->endpoints); i++)
+            SimEndpoint_Destroy(DArray_get(net->endpoints, i));
+
+        DArray_destroy(net->endpoints);
+    }
+
+    RandomState_Destroy(net->random);
+    free(net);
+}
+
+int SimEvent_Before(SimEvent *a, SimEvent *b)
+{
+    return a->ms < b->ms || (a->ms == b->ms && a->seq < b->seq);
+}
+
+int SimNet_PushEvent(SimNet *net, int64_t ms, uint32_t to, SimDatagram *datagram)
+{
+    if (net->events_count == net->events_max)
+    {
+        size_t max = net->events_max > 0 ? net->events_max * 2 : 1024;
+
+        SimEvent *events = realloc(net->events, max * sizeof(SimEvent));
+        check_mem(events);
+
+        net->events = events;
+        net->events_max = max;
+    }
+
+    SimEvent event = { .ms = ms, .seq = net->seq++, .to = to, .datagram = datagram };
+
+    size_t i = net->events_count++;
+
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+
+        if (!SimEvent_Before(&event, &net->events[parent]))
+            break;
+
+        net->events[i] = net->events[parent];
+        i = parent;
+    }
+
+    net->events[i] = event;
+
+    return 0;
+error:
+    return -1;
+}
+
+SimEvent SimNet_PopEvent(SimNet *net)
+{
+    assert(net->events_count > 0 && "Pop from no events");
+
+    SimEvent first = net->events[0];
+    SimEvent last = net->events[--net->events_count];
+
+    size_t i = 0;
+
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+
+        if (child >= net->events_count)
+            break;
+
+        if (child + 1 < net->events_count
+            && SimEvent_Before(&net->events[child + 1], &net->events[child]))
+            child++;
+
+        if (!SimEvent_Before(&net->events[child], &last))
+            break;
+
+        net->events[i] = net->events[child];
+        i = child;
+    }
+
+    net->events[i] = last;
+
+    return first;
+}
+
+/* Has the endpoint processed at ms, unless it already will be sooner. */
+int SimNet_Schedule(SimNet *net, SimEndpoint *endpoint, int64_t ms)
+{
+    if (ms >= endpoint->wake_ms)
+        return 0;
+
+    endpoint->wake_ms = ms;
+
+    return SimNet_PushEvent(net, ms, endpoint->index, NULL);
+}
+
+SimEndpoint *SimNet_GetEndpoint(SimNet *net, uint32_t addr, uint16_t port)
+{
+    assert(net != NULL && "NULL SimNet pointer");
+
+    uint32_t index = ntohl(addr) - SIMNET_BASE_ADDR;
+
+    if (ntohs(port) != SIMNET_PORT
+        || index >= (uint32_t)DArray_count(net->endpoints))
+        return NULL;
+
+    return DArray_get(net->endpoints, index);
+}
+
+Seed SimNet_Seed(SimNet *net, size_t index)
+{
+    assert(net != NULL && "NULL SimNet pointer");
+    (void)net;
+
+    return (Seed){ .addr = htonl(SIMNET_BASE_ADDR + index),
+                   .port = htons(SIMNET_PORT) };
+}
+
+SimMapping *SimEndpoint_Mapping(SimEndpoint *endpoint, uint32_t peer)
+{
+    return &endpoint->mappings[(peer * 2654435761U) % SIMNET_NAT_MAPPINGS];
+}
+
+int SimEndpoint_Send(Transport *transport, Node *to, char *buf, size_t len)
+{
+    SimEndpoint *endpoint = (SimEndpoint *)transport;
+    SimNet *net = endpoint->net;
+
+    net->stats.sent++;
+    net->stats.bytes += len;
+
+    SimEndpoint *dest = SimNet_GetEndpoint(net, to->addr.s_addr, to->port);
+
+    if (dest == NULL)
+    {
+        net->stats.lost++;
+        return 0;
+    }
+
+    if (endpoint->mappings != NULL)
+    {
+        SimMapping *mapping = SimEndpoint_Mapping(endpoint, dest->index);
+        *mapping = (SimMapping){ .peer = dest->index, .sent_ms = net->now_ms };
+    }
+
+    if (SimNet_Chance(net, net->config.loss))
+    {
+        net->stats.lost++;
+        return 0;
+    }
+
+    int64_t delay = net->config.latency_ms;
+
+    if (net->config.jitter_ms > 0)
+        delay += SimNet_Uniform(net) * (net->config.jitter_ms + 1);
+
+    SimDatagram *datagram = malloc(sizeof(SimDatagram) + len);
+    check_mem(datagram);
+
+    datagram->next = NULL;
+    datagram->from = endpoint->index;
+    datagram->len = len;
+    memcpy(datagram->data, buf, len);
+
+    int rc = SimNet_PushEvent(net, net->now_ms + delay, dest->index, datagram);
+    check(rc == 0, "SimNet_PushEvent failed");
+
+    return 0;
+error:
+    free(datagram);
+    return -1;
+}
+
+int SimEndpoint_Receive(Transport *transport, Node *from, char *buf, size_t len)
+{
+    SimEndpoint *endpoint = (SimEndpoint *)transport;
+    SimDatagram *datagram = endpoint->inbox;
+
+    if (datagram == NULL)
+        return 0;
+
+    assert(datagram->len <= len && "buf too small for datagram");
+
+    endpoint->inbox = datagram->next;
+
+    from->addr.s_addr = htonl(SIMNET_BASE_ADDR + datagram->from);
+    from->port = htons(SIMNET_PORT);
+
+    int rc = datagram->len;
+    memcpy(buf, datagram->data, datagram->len);
+    free(datagram);
+
+    return rc;
+}
+
+/* Puts the datagram in the inbox of the endpoint, unless a NAT in
+ * front of it has no mapping for the sender. */
+int SimNet_Deliver(SimNet *net, SimEndpoint *endpoint, SimDatagram *datagram)
+{
+    if (endpoint->mappings != NULL)
+    {
+        SimMapping *mapping = SimEndpoint_Mapping(endpoint, datagram->from);
+
+        if (mapping->sent_ms == 0
+            || mapping->peer != datagram->from
+            || net->now_ms - mapping->sent_ms > net->config.nat_timeout_ms)
+        {
+            net->stats.nat_dropped++;
+            free(datagram);
+            return 0;
+        }
+    }
+
+    if (endpoint->inbox == NULL)
+        endpoint->inbox = datagram;
+    else
+        endpoint->inbox_last->next = datagram;
+
+    endpoint->inbox_last = datagram;
+    net->stats.delivered++;
+
+    return SimNet_Schedule(net, endpoint, net->now_ms);
+}
+
+Client *SimNet_AddClient(SimNet *net, Hash *id)
+{
+    assert(net != NULL && "NULL SimNet pointer");
+    assert(id != NULL && "NULL Hash pointer");
+
+    uint32_t index = DArray_count(net->endpoints);
+    Client *client = NULL;
+
+    SimEndpoint *endpoint = calloc(1, sizeof(SimEndpoint));
+    check_mem(endpoint);
+
+    endpoint->transport.send = SimEndpoint_Send;
+    endpoint->transport.receive = SimEndpoint_Receive;
+    endpoint->net = net;
+    endpoint->index = index;
+    endpoint->wake_ms = INT64_MAX;
+
+    if (SimNet_Chance(net, net->config.nat))
+    {
+        endpoint->mappings = calloc(SIMNET_NAT_MAPPINGS, sizeof(SimMapping));
+        check_mem(endpoint->mappings);
+    }
+
+    Seed seed = SimNet_Seed(net, index);
+    client = Client_Create(*id, seed.addr, seed.port, seed.port);
+    check(client != NULL, "Client_Create failed");
+
+    int rc = Dht_SetTransport(client, &endpoint->transport);
+    check(rc == 0, "Dht_SetTransport failed");
+
+    rc = Dht_SetClock(client, SimNet_Now, net);
+    check(rc == 0, "Dht_SetClock failed");
+
+    /* Client_Create seeded from the system time */
+    RandomState_Destroy(client->random);
+    client->random = RandomState_Create(net->config.seed + index + 1);
+    check(client->random != NULL, "RandomState_Create failed");
+
+    rc = Dht_Start(client);
+    check(rc == 0, "Dht_Start failed");
+
+    rc = DArray_push(net->endpoints, endpoint);
+    check(rc == 0, "DArray_push failed");
+
+    endpoint->client = client;
+
+    rc = SimNet_Schedule(net, endpoint, net->now_ms);
+    check(rc == 0, "SimNet_Schedule failed");
+
+    return client;
+error:
+    if (endpoint != NULL && endpoint->client == NULL)
+    {
+        Client_Destroy(client);
+        free(endpoint->mappings);
+        free(endpoint);
+    }
+
+    return NULL;
+}
+
+int SimNet_Wake(SimNet *net, size_t index)
+{
+    assert(net != NULL && "NULL SimNet pointer");
+    check(index < (size_t)DArray_count(net->endpoints), "No such client");
+
+    return SimNet_Schedule(net, DArray_get(net->endpoints, index), net->now_ms);
+error:
+    return -1;
+}
+
+int SimNet_Process(SimNet *net, SimEndpoint *endpoint)
+{
+    endpoint->wake_ms = INT64_MAX;
+
+    int rc = Dht_Process(endpoint->client);
+    check(rc == 0, "Dht_Process failed");
+
+    net->stats.processed++;
+
+    int64_t wait = Dht_NextDeadline(endpoint->client);
+    check(wait >= 0, "Dht_NextDeadline failed");
+
+    /* Held back when the incoming queue was full */
+    if (endpoint->inbox != NULL)
+        wait = 0;
+
+    return SimNet_Schedule(net, endpoint, net->now_ms + (wait > 0 ? wait : 1));
+error:
+    return -1;
+}
+
+int SimNet_Run(SimNet *net, int64_t until_ms)
+{
+    assert(net != NULL && "NULL SimNet pointer");
+
+    while (net->events_count > 0 && net->events[0].ms <= until_ms)
+    {
+        SimEvent event = SimNet_PopEvent(net);
+        SimEndpoint *endpoint = DArray_get(net->endpoints, event.to);
+
+        net->now_ms = event.ms;
+
+        int rc = 0;
+
+        if (event.datagram != NULL)
+        {
+            rc = SimNet_Deliver(net, endpoint, event.datagram);
+            check(rc == 0, "SimNet_Deliver failed");
+        }
+        else if (event.ms == endpoint->wake_ms)
+        {
+            rc = SimNet_Process(net, endpoint);
+            check(rc == 0, "SimNet_Process failed");
+        }
+    }
+
+    if (net->now_ms < until_ms)
+        net->now_ms = until_ms;
+
+    return 0;
+error:
+    return -1;
+}
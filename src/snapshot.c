@@ -0,0 +1,202 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <dht/snapshot.h>
+#include <lcthw/bstrlib.h>
+#include <lcthw/dbg.h>
+
+uint32_t Snapshot_Checksum(uint32_t sum, const void *data, size_t len)
+{
+    assert(data != NULL && "NULL data pointer");
+
+    const unsigned char *byte = data;
+
+    size_t i = 0;
+    for (i = 0; i < len; i++)
+    {
+        sum ^= byte[i];
+        sum *= 16777619u;
+    }
+
+    return sum;
+}
+
+struct WriteContext {
+    FILE *file;
+    SnapshotHeader *header;
+};
+
+int WriteRecord(struct WriteContext *context, Node *node)
+{
+    SnapshotRecord record = { .reply_time = node->reply_time,
+                              .query_time = node->query_time,
+                              .id = node->id,
+                              .addr = node->addr.s_addr,
+                              .port = node->port,
+                              .rtt_ms = node->rtt_ms,
+                              .replies = node->replies,
+                              .timeouts = node->timeouts };
+
+    size_t rc = fwrite(&record, sizeof(record), 1, context->file);
+    check(rc == 1, "fwrite failed");
+
+    context->header->count++;
+    context->header->checksum = Snapshot_Checksum(context->header->checksum,
+                                                  &record,
+                                                  sizeof(record));
+
+    return 0;
+error:
+    return -1;
+}
+
+int Snapshot_Write(Table *table, const char *path)
+{
+    assert(table != NULL && "NULL Table pointer");
+    assert(path != NULL && "NULL path pointer");
+
+    FILE *file = NULL;
+    bstring tmp = bformat("%s.tmp", path);
+    check_mem(tmp);
+
+    file = fopen(bdata(tmp), "wb");
+    check(file != NULL, "fopen %s failed", bdata(tmp));
+
+    SnapshotHeader header = { .version = SNAPSHOT_VERSION,
+                              .id = table->id,
+                              .checksum = SNAPSHOT_CHECKSUM_INIT };
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+
+    /* Rewritten with the count and checksum at the end */
+    size_t written = fwrite(&header, sizeof(header), 1, file);
+    check(written == 1, "fwrite failed");
+
+    struct WriteContext context = { .file = file, .header = &header };
+
+    int rc = Table_ForEachNode(table, &context, (NodeOp)WriteRecord);
+    check(rc == 0, "WriteRecord failed");
+
+    rc = fseek(file, 0, SEEK_SET);
+    check(rc == 0, "fseek failed");
+
+    written = fwrite(&header, sizeof(header), 1, file);
+    check(written == 1, "fwrite failed");
+
+    rc = fclose(file);
+    file = NULL;
+    check(rc == 0, "fclose failed");
+
+    rc = rename(bdata(tmp), path);
+    check(rc == 0, "rename to %s failed", path);
+
+    bdestroy(tmp);
+
+    return 0;
+error:
+    if (file != NULL)
+        fclose(file);
+
+    if (tmp != NULL)
+        unlink((char *)tmp->data);
+
+    bdestroy(tmp);
+    return -1;
+}
+
+int ReadRecord(Table *table, SnapshotRecord *record)
+{
+    Node *node = Node_Create(&record->id);
+    check_mem(node);
+
+    node->addr.s_addr = record->addr;
+    node->port = record->port;
+    node->reply_time = record->reply_time;
+    node->query_time = record->query_time;
+    node->rtt_ms = record->rtt_ms;
+    node->replies = record->replies;
+    node->timeouts = record->timeouts;
+
+    Table_InsertNodeResult result = Table_InsertNode(table, node);
+    check(result.rc != ERROR, "Table_InsertNode failed");
+
+    Node_Destroy(result.replaced);
+
+    if (result.rc != OKAdded
+        && result.rc != OKReplaced
+        && result.rc != OKCached)
+    {
+        Node_Destroy(node);
+    }
+
+    return 0;
+error:
+    Node_Destroy(node);
+    return -1;
+}
+
+Table *Snapshot_Read(const char *path)
+{
+    assert(path != NULL && "NULL path pointer");
+
+    Table *table = NULL;
+    void *data = MAP_FAILED;
+    struct stat st = { 0 };
+
+    int fd = open(path, O_RDONLY);
+    check(fd != -1, "open %s failed", path);
+
+    int rc = fstat(fd, &st);
+    check(rc == 0, "fstat failed");
+    check((size_t)st.st_size >= sizeof(SnapshotHeader), "Truncated snapshot");
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    check(data != MAP_FAILED, "mmap failed");
+
+    SnapshotHeader *header = data;
+    SnapshotRecord *records = (SnapshotRecord *)(header + 1);
+
+    check(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0,
+          "Not a snapshot");
+    check(header->version == SNAPSHOT_VERSION,
+          "Snapshot version %u", header->version);
+    check((size_t)st.st_size == sizeof(SnapshotHeader)
+          + header->count * sizeof(SnapshotRecord),
+          "Wrong snapshot size");
+
+    uint32_t checksum = Snapshot_Checksum(SNAPSHOT_CHECKSUM_INIT,
+                                          records,
+                                          header->count * sizeof(SnapshotRecord));
+    check(checksum == header->checksum, "Wrong snapshot checksum");
+
+    table = Table_Create(&header->id);
+    check(table != NULL, "Table_Create failed");
+
+    uint32_t i = 0;
+    for (i = 0; i < header->count; i++)
+    {
+        rc = ReadRecord(table, &records[i]);
+        check(rc == 0, "ReadRecord failed");
+    }
+
+    munmap(data, st.st_size);
+    close(fd);
+
+    return table;
+error:
+    if (data != MAP_FAILED)
+        munmap(data, st.st_size);
+
+    if (fd != -1)
+        close(fd);
+
+    if (table != NULL)
+        Table_DestroyNodes(table);
+
+    Table_Destroy(table);
+    return NULL;
+}
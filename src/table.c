@@ -1,7 +1,9 @@
 #include <assert.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <dht/clock.h>
 #include <dht/close.h>
 #include <dht/table.h>
 #include <lcthw/dbg.h>
@@ -38,6 +40,7 @@ void Table_Destroy(Table *table)
 	Bucket_Destroy(table->buckets[i]);
     }
 
+    Hashmap_destroy(table->addrs);
     free(table);
 }
 
@@ -46,6 +49,70 @@ void Table_DestroyNodes(Table *table)
     Table_ForEachNode(table, NULL, Node_DestroyOp);
 }
 
+int Node_AddrCompare(Node *a, Node *b)
+{
+    if (a->addr.s_addr != b->addr.s_addr)
+        return a->addr.s_addr < b->addr.s_addr ? -1 : 1;
+
+    return a->port - b->port;
+}
+
+uint32_t Node_AddrHash(Node *node)
+{
+    uint32_t hash = node->addr.s_addr ^ ((uint32_t)node->port << 16);
+
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/* The index keeps the most recent node at each addr and port. */
+int IndexNode(Table *table, Node *node)
+{
+    if (table->addrs == NULL)
+        return 0;
+
+    Hashmap_delete(table->addrs, node);
+
+    return Hashmap_set(table->addrs, node, node);
+}
+
+void UnindexNode(Table *table, Node *node)
+{
+    if (table->addrs == NULL)
+        return;
+
+    if (Hashmap_get(table->addrs, node) == node)
+        Hashmap_delete(table->addrs, node);
+}
+
+int Table_IndexAddrs(Table *table)
+{
+    assert(table != NULL && "NULL Table pointer");
+
+    if (table->addrs != NULL)
+        return 0;
+
+    table->addrs = Hashmap_create((Hashmap_compare)Node_AddrCompare,
+                                  (Hashmap_hash)Node_AddrHash);
+    check_mem(table->addrs);
+
+    return Table_ForEachNode(table, table, (NodeOp)IndexNode);
+error:
+    return -1;
+}
+
+Node *Table_FindNodeByAddr(Table *table, Node *node)
+{
+    assert(table != NULL && "NULL Table pointer");
+    assert(node != NULL && "NULL Node pointer");
+    assert(table->addrs != NULL && "Table not indexed");
+
+    return Hashmap_get(table->addrs, node);
+}
+
 int Table_HasShiftableNodes(Hash *id, Bucket *bucket, Node *node)
 {
     assert(id != NULL && "NULL Hash pointer");
@@ -89,6 +156,14 @@ int Table_CanAddBucket(Table *table)
     return table->end < MAX_TABLE_BUCKETS;
 }
 
+Bucket *ShiftTarget(Table *table, Bucket *bucket, Node *node)
+{
+    if (Hash_SharedPrefix(&table->id, &node->id) <= bucket->index)
+        return bucket;
+
+    return table->buckets[bucket->index + 1];
+}
+
 int Table_ShiftBucketNodes(Table *table, Bucket *bucket)
 {
     assert(table != NULL && "NULL Table pointer");
@@ -110,7 +185,7 @@ int Table_ShiftBucketNodes(Table *table, Bucket *bucket)
 	if (Hash_SharedPrefix(&table->id, &node->id) <= bucket->index)
             continue;
 
-        int rc = Bucket_AddNode(next, node);
+        int rc = Bucket_AddNode(next, node, Table_Time(table));
         check(rc == 0, "Bucket_AddNode failed");
 
         bucket->nodes[i] = NULL;
@@ -119,6 +194,39 @@ int Table_ShiftBucketNodes(Table *table, Bucket *bucket)
 
     assert(bucket->count >= 0 && "Negative Bucket count");
 
+    /* Replacements move along. The most recent fill the room made,
+     * the rest are replacements again. */
+    Node *moved[BUCKET_REPLACEMENTS];
+    int count = bucket->replacement_count;
+
+    memcpy(moved, bucket->replacements, count * sizeof(Node *));
+    bucket->replacement_count = 0;
+
+    for (i = count - 1; i >= 0; i--)
+    {
+        Bucket *target = ShiftTarget(table, bucket, moved[i]);
+
+        if (Bucket_IsFull(target))
+            continue;
+
+        int rc = Bucket_AddNode(target, moved[i], Table_Time(table));
+        check(rc == 0, "Bucket_AddNode failed");
+
+        rc = IndexNode(table, moved[i]);
+        check(rc == 0, "IndexNode failed");
+
+        moved[i] = NULL;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (moved[i] != NULL)
+        {
+            Bucket *target = ShiftTarget(table, bucket, moved[i]);
+            Node_Destroy(Bucket_AddReplacement(target, moved[i]));
+        }
+    }
+
     return 0;
 error:
     return -1;
@@ -143,12 +251,16 @@ Table_InsertNodeResult Table_InsertNode(Table *table, Node *node)
     {
 	Node *replaced = NULL;
 
-	if ((replaced = Bucket_ReplaceBad(bucket, node))) {
-	    return (Table_InsertNodeResult)
-	    { .rc = OKReplaced, .bucket = bucket, replaced = replaced};
-	}
+	time_t now = Table_Time(table);
+
+	if ((replaced = Bucket_ReplaceBad(bucket, node, now))
+	    || (!table->has_replacements
+                && (replaced = Bucket_ReplaceQuestionable(bucket, node, now)))) {
+            UnindexNode(table, replaced);
+
+            rc = IndexNode(table, node);
+            check(rc == 0, "IndexNode failed");
 
-	if ((replaced = Bucket_ReplaceQuestionable(bucket, node))) {
 	    return (Table_InsertNodeResult)
 	    { .rc = OKReplaced, .bucket = bucket, replaced = replaced};
 	}
@@ -168,15 +280,26 @@ Table_InsertNodeResult Table_InsertNode(Table *table, Node *node)
 	}
     }
 
+    if (Bucket_IsFull(bucket) && table->has_replacements)
+    {
+        Node *dropped = Bucket_AddReplacement(bucket, node);
+
+        return (Table_InsertNodeResult)
+        { .rc = OKCached, .bucket = bucket, .replaced = dropped};
+    }
+
     if (Bucket_IsFull(bucket))
     {
         return (Table_InsertNodeResult)
         { .rc = OKFull, .bucket = NULL, .replaced = NULL};
     }
 
-    rc = Bucket_AddNode(bucket, node);
+    rc = Bucket_AddNode(bucket, node, Table_Time(table));
     check(rc == 0, "Bucket_AddNode failed");
 
+    rc = IndexNode(table, node);
+    check(rc == 0, "IndexNode failed");
+
     return (Table_InsertNodeResult)
     { .rc = OKAdded, .bucket = bucket, .replaced = NULL};
 error:
@@ -184,12 +307,13 @@ error:
     { .rc = ERROR, .bucket = NULL, .replaced = NULL};
 }
 
-int Table_CopyAndAddNode(Table *dest, Node *node)
+/* Sets *added to the copy when it went in a bucket, NULL otherwise. */
+int CopyAndAdd(Table *dest, Node *node, Node **added)
 {
-    assert(dest != NULL && "NULL Table pointer");
-    assert(node != NULL && "NULL Node pointer");
+    *added = NULL;
 
-    if (Node_Status(node, time(NULL)) == Bad)
+    if (Node_Status(node, Table_Time(dest)) == Bad
+        || Node_IsBackedOff(node, Table_Ms(dest)))
     {
         return 0;
     }
@@ -199,6 +323,9 @@ int Table_CopyAndAddNode(Table *dest, Node *node)
 
     Table_InsertNodeResult result = Table_InsertNode(dest, copy);
 
+    if (result.rc == OKAdded || result.rc == OKReplaced)
+        *added = copy;
+
     if (result.rc == ERROR
         || result.rc == OKFull
         || result.rc == OKAlreadyAdded)
@@ -212,16 +339,31 @@ int Table_CopyAndAddNode(Table *dest, Node *node)
         Node_Destroy(result.replaced);
     }
 
+    if (result.rc == OKCached)
+    {
+        Node_Destroy(result.replaced);
+    }
+
     return 0;
 error:
     return -1;
 }
 
+int Table_CopyAndAddNode(Table *dest, Node *node)
+{
+    assert(dest != NULL && "NULL Table pointer");
+    assert(node != NULL && "NULL Node pointer");
+
+    Node *added = NULL;
+
+    return CopyAndAdd(dest, node, &added);
+}
+
 Bucket *Table_AddBucket(Table *table)
 {
     assert(table->end < MAX_TABLE_BUCKETS && "Adding one bucket too many");
 
-    Bucket *bucket = Bucket_Create();
+    Bucket *bucket = Bucket_Create(Table_Time(table));
     check_mem(bucket);
     
     bucket->index = table->end;
@@ -300,6 +442,20 @@ error:
     return -1;
 }
 
+time_t Table_Time(Table *table)
+{
+    assert(table != NULL && "NULL Table pointer");
+
+    return table->clock != NULL ? Clock_Time(table->clock) : Clock_Ms() / 1000;
+}
+
+int64_t Table_Ms(Table *table)
+{
+    assert(table != NULL && "NULL Table pointer");
+
+    return table->clock != NULL ? Clock_Now(table->clock) : Clock_Ms();
+}
+
 Node *Table_FindNode(Table *table, Hash *id)
 {
     assert(table != NULL && "NULL Table pointer");
@@ -321,6 +477,61 @@ Node *Table_FindNode(Table *table, Hash *id)
     return NULL;
 }
 
+int Table_RandomId(Table *table, Bucket *bucket, RandomState *rs, Hash *id)
+{
+    assert(table != NULL && "NULL Table pointer");
+    assert(bucket != NULL && "NULL Bucket pointer");
+    assert(rs != NULL && "NULL RandomState pointer");
+    assert(id != NULL && "NULL Hash pointer");
+
+    int rc = Hash_PrefixedRandom(rs, id, &table->id, bucket->index);
+    check(rc == 0, "Hash_PrefixedRandom failed");
+
+    /* Only the last bucket holds ids sharing more than index bits */
+    if (bucket->index < table->end - 1)
+    {
+        int byte = bucket->index / 8;
+        char bit = 0x80 >> (bucket->index % 8);
+
+        id->value[byte] = (id->value[byte] & ~bit) | (~table->id.value[byte] & bit);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+struct GatherContext {
+    DArray *nodes;
+    time_t now;
+};
+
+int GatherNodeOp(struct GatherContext *context, Node *node)
+{
+    if (Node_Status(node, context->now) == Bad)
+        return 0;
+
+    return DArray_push(context->nodes, node);
+}
+
+DArray *Table_GatherNodes(Table *table, time_t now)
+{
+    assert(table != NULL && "NULL Table pointer");
+
+    struct GatherContext context = { .now = now };
+
+    context.nodes = DArray_create(sizeof(Node *), 128);
+    check(context.nodes != NULL, "DArray_create failed");
+
+    int rc = Table_ForEachNode(table, &context, (NodeOp)GatherNodeOp);
+    check(rc == 0, "Table_ForEachNode failed");
+
+    return context.nodes;
+error:
+    DArray_destroy(context.nodes);
+    return NULL;
+}
+
 int CloseNodes_AddOp(void *close, Node *node)
 {
     return CloseNodes_Add((CloseNodes *)close, node);
@@ -348,25 +559,105 @@ error:
     return NULL;
 }
 
+Node *Table_ReplaceNode(Table *table, Node *node)
+{
+    assert(table != NULL && "NULL Table pointer");
+    assert(node != NULL && "NULL Node pointer");
+
+    Bucket *bucket = Table_FindBucket(table, &node->id);
+    check(bucket != NULL, "Found no bucket for node");
+
+    int i = 0;
+    for (i = 0; i < BUCKET_K; i++)
+    {
+        if (bucket->nodes[i] != node)
+            continue;
+
+        Node *replacement = Bucket_PopReplacement(bucket);
+
+        if (replacement == NULL)
+            return NULL;
+
+        bucket->nodes[i] = replacement;
+        bucket->change_time = Table_Time(table);
+
+        UnindexNode(table, node);
+
+        int rc = IndexNode(table, replacement);
+        check(rc == 0, "IndexNode failed");
+
+        return node;
+    }
+
+error:
+    return NULL;
+}
+
+Node *Table_RemoveNode(Table *table, Node *node)
+{
+    assert(table != NULL && "NULL Table pointer");
+    assert(node != NULL && "NULL Node pointer");
+
+    Bucket *bucket = Table_FindBucket(table, &node->id);
+
+    int i = 0;
+    for (i = 0; i < BUCKET_K; i++)
+    {
+        if (bucket->nodes[i] != node)
+            continue;
+
+        bucket->nodes[i] = NULL;
+        bucket->count--;
+        bucket->change_time = Table_Time(table);
+
+        UnindexNode(table, node);
+
+        return node;
+    }
+
+    return NULL;
+}
+
+/* Looks the sender up by addr and port on an indexed table, by id
+ * otherwise. */
+Node *FindMessageNode(Table *table, Node *node)
+{
+    if (table->addrs == NULL)
+        return Table_FindNode(table, &node->id);
+
+    Node *found = Table_FindNodeByAddr(table, node);
+
+    if (found == NULL)
+        return Table_FindNode(table, &node->id);
+
+    return found;
+}
+
 int Table_MarkReply(Table *table, Message *message)
 {
     assert(table != NULL && "NULL Table pointer");
     assert(message != NULL && "NULL Message pointer");
 
-    Node *found = Table_FindNode(table, &message->node.id);
+    Node *found = FindMessageNode(table, &message->node);
 
-    if (found == NULL)
+    /* A reply to our query proves the endpoint, its old id is gone */
+    if (found != NULL && !Hash_Equals(&found->id, &message->node.id))
     {
-        int rc = Table_CopyAndAddNode(table, &message->node);
-        check(rc == 0, "Table_CopyAndAddNode failed");
-
+        Node_Destroy(Table_RemoveNode(table, found));
         found = Table_FindNode(table, &message->node.id);
+    }
+
+    if (found == NULL)
+    {
+        int rc = CopyAndAdd(table, &message->node, &found);
+        check(rc == 0, "CopyAndAdd failed");
 
         if (found == NULL)
             return 0;
     }
 
-    found->reply_time = time(NULL);
+    found->reply_time = Table_Time(table);
+    Table_FindBucket(table, &found->id)->change_time = found->reply_time;
 
     if (found->pending_queries > 0)
     {
@@ -390,20 +681,28 @@ int Table_MarkQuery(Table *table, Node *node)
     assert(table != NULL && "NULL Table pointer");
     assert(node != NULL && "NULL Node pointer");
 
-    Node *found = Table_FindNode(table, &node->id);
+    Node *found = FindMessageNode(table, node);
 
-    if (found == NULL)
+    /* Queries are easily spoofed, another id at the endpoint stays
+     * until a reply shows it is stale. */
+    if (found != NULL && !Hash_Equals(&found->id, &node->id))
     {
-        int rc = Table_CopyAndAddNode(table, node);
-        check(rc == 0, "Table_CopyAndAddNode failed");
-
         found = Table_FindNode(table, &node->id);
 
         if (found == NULL)
             return 0;
     }
 
-    found->query_time = time(NULL);
+    if (found == NULL)
+    {
+        int rc = CopyAndAdd(table, node, &found);
+        check(rc == 0, "CopyAndAdd failed");
+
+        if (found == NULL)
+            return 0;
+    }
+
+    found->query_time = Table_Time(table);
 
     return 0;
 error:
@@ -554,7 +853,9 @@ Table *Table_Read(bstring dump)
 
         Node_Destroy(result.replaced);
 
-        if (result.rc != OKAdded)
+        if (result.rc != OKAdded
+            && result.rc != OKReplaced
+            && result.rc != OKCached)
         {
             Node_Destroy(node);
             node = NULL;
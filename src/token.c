@@ -0,0 +1,277 @@
+#include <assert.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <openssl/sha.h>
+
+#include <dht/token.h>
+#include <lcthw/dbg.h>
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                \
+    do {                                                        \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;                  \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;                  \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+    } while (0)
+
+static inline uint64_t U8To64(const unsigned char *p)
+{
+    return (uint64_t)p[0]
+        | (uint64_t)p[1] << 8
+        | (uint64_t)p[2] << 16
+        | (uint64_t)p[3] << 24
+        | (uint64_t)p[4] << 32
+        | (uint64_t)p[5] << 40
+        | (uint64_t)p[6] << 48
+        | (uint64_t)p[7] << 56;
+}
+
+static inline void U64To8(unsigned char *p, uint64_t v)
+{
+    int i = 0;
+    for (i = 0; i < 8; i++)
+        p[i] = v >> (8 * i);
+}
+
+/* As the reference implementation by Aumasson and Bernstein */
+void SipHash(const unsigned char *key,
+             const unsigned char *data,
+             size_t len,
+             unsigned char *out,
+             size_t out_len)
+{
+    assert(key != NULL && "NULL key pointer");
+    assert(data != NULL || len == 0);
+    assert((out_len == 8 || out_len == 16) && "Bad SipHash output length");
+
+    uint64_t k0 = U8To64(key);
+    uint64_t k1 = U8To64(key + 8);
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+    if (out_len == 16)
+        v1 ^= 0xee;
+
+    const unsigned char *end = data + len - (len % 8);
+    uint64_t m = 0;
+
+    for (; data != end; data += 8)
+    {
+        m = U8To64(data);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    uint64_t b = (uint64_t)len << 56;
+
+    switch (len & 7)
+    {
+    case 7: b |= (uint64_t)data[6] << 48; /* fall through */
+    case 6: b |= (uint64_t)data[5] << 40; /* fall through */
+    case 5: b |= (uint64_t)data[4] << 32; /* fall through */
+    case 4: b |= (uint64_t)data[3] << 24; /* fall through */
+    case 3: b |= (uint64_t)data[2] << 16; /* fall through */
+    case 2: b |= (uint64_t)data[1] << 8;  /* fall through */
+    case 1: b |= (uint64_t)data[0];       /* fall through */
+    case 0: break;
+    }
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+
+    v2 ^= out_len == 16 ? 0xee : 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    U64To8(out, v0 ^ v1 ^ v2 ^ v3);
+
+    if (out_len == 8)
+        return;
+
+    v1 ^= 0xdd;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    U64To8(out + 8, v0 ^ v1 ^ v2 ^ v3);
+}
+
+int TokenSecrets_Init(TokenSecrets *secrets, RandomState *random, time_t now)
+{
+    assert(secrets != NULL && "NULL TokenSecrets pointer");
+    assert(random != NULL && "NULL RandomState pointer");
+
+    int rc = Random_Fill(random,
+                         (char *)secrets->secrets,
+                         TOKEN_SECRETS * sizeof(Hash));
+    check(rc == 0, "Random_Fill failed");
+
+    rc = Random_Fill(random, (char *)&secrets->generation, sizeof(uint32_t));
+    check(rc == 0, "Random_Fill failed");
+
+    secrets->rotate_time = now;
+
+    return 0;
+error:
+    return -1;
+}
+
+int TokenSecrets_Rotate(TokenSecrets *secrets, RandomState *random, time_t now)
+{
+    assert(secrets != NULL && "NULL TokenSecrets pointer");
+    assert(random != NULL && "NULL RandomState pointer");
+    assert(HASH_BYTES == SHA_DIGEST_LENGTH && "Size confusion");
+
+    /* Fresh random bytes mixed with the past secrets, so the new one
+     * is no weaker than the first */
+    Hash fresh;
+    int rc = Random_Fill(random, fresh.value, HASH_BYTES);
+    check(rc == 0, "Random_Fill failed");
+
+    SHA_CTX ctx;
+
+    rc = SHA1_Init(&ctx);
+    check(rc == 1, "SHA1_Init failed");
+
+    rc = SHA1_Update(&ctx, fresh.value, HASH_BYTES);
+    check(rc == 1, "SHA1_Update failed");
+
+    rc = SHA1_Update(&ctx, secrets->secrets, sizeof(Hash) * TOKEN_SECRETS);
+    check(rc == 1, "SHA1_Update failed");
+
+    int i;
+    for (i = TOKEN_SECRETS - 1; i > 0; i--)
+        secrets->secrets[i] = secrets->secrets[i - 1];
+
+    rc = SHA1_Final((unsigned char *)&secrets->secrets[0].value, &ctx);
+    check(rc == 1, "SHA1_Final failed");
+
+    secrets->generation++;
+    secrets->rotate_time = now;
+
+    return 0;
+error:
+    return -1;
+}
+
+int TokenSecrets_Update(TokenSecrets *secrets, RandomState *random, time_t now)
+{
+    assert(secrets != NULL && "NULL TokenSecrets pointer");
+
+    if (now - secrets->rotate_time < TOKEN_ROTATE_INTERVAL)
+        return 0;
+
+    int rc = TokenSecrets_Rotate(secrets, random, now);
+    check(rc == 0, "TokenSecrets_Rotate failed");
+
+    return 1;
+error:
+    return -1;
+}
+
+#define SHA1_DATA_LEN (sizeof(Hash) + sizeof(in_addr_t))
+
+Token MakeSha1Token(TokenSecrets *secrets, Node *from, int secret)
+{
+    unsigned char data[SHA1_DATA_LEN];
+    memcpy(data, &secrets->secrets[secret], sizeof(Hash));
+    memcpy(data + sizeof(Hash), &from->addr.s_addr, sizeof(in_addr_t));
+
+    Token token;
+
+    SHA1(data, SHA1_DATA_LEN, (unsigned char *)token.value);
+
+    return token;
+}
+
+#define SIPHASH_DATA_LEN (sizeof(uint32_t) + sizeof(in_addr_t))
+
+/* The generation, then 16 bytes of MAC */
+Token MakeSipHashToken(TokenSecrets *secrets, Node *from, int secret)
+{
+    uint32_t generation = secrets->generation - secret;
+    unsigned char data[SIPHASH_DATA_LEN];
+
+    memcpy(data, &generation, sizeof(uint32_t));
+    memcpy(data + sizeof(uint32_t), &from->addr.s_addr, sizeof(in_addr_t));
+
+    Token token;
+    memcpy(token.value, &generation, sizeof(uint32_t));
+
+    SipHash((unsigned char *)secrets->secrets[secret].value,
+            data,
+            SIPHASH_DATA_LEN,
+            (unsigned char *)token.value + sizeof(uint32_t),
+            HASH_BYTES - sizeof(uint32_t));
+
+    return token;
+}
+
+Token Token_Make(TokenSecrets *secrets, Node *from)
+{
+    assert(secrets != NULL && "NULL TokenSecrets pointer");
+    assert(from != NULL && "NULL Node pointer");
+
+    if (secrets->scheme == TokenSha1)
+        return MakeSha1Token(secrets, from, 0);
+
+    return MakeSipHashToken(secrets, from, 0);
+}
+
+/* Without an early exit, so the time taken tells nothing of how much
+ * of a forged token was right */
+int SameToken(Token *a, char *b)
+{
+    unsigned char diff = 0;
+
+    int i = 0;
+    for (i = 0; i < HASH_BYTES; i++)
+        diff |= a->value[i] ^ b[i];
+
+    return diff == 0;
+}
+
+int Token_IsValid(TokenSecrets *secrets, Node *from, char *token, size_t len)
+{
+    assert(secrets != NULL && "NULL TokenSecrets pointer");
+    assert(from != NULL && "NULL Node pointer");
+    assert(token != NULL && "NULL token data pointer");
+
+    if (len != HASH_BYTES)
+        return 0;
+
+    if (secrets->scheme == TokenSha1)
+    {
+        int i = 0;
+        for (i = 0; i < TOKEN_SECRETS; i++)
+        {
+            Token valid = MakeSha1Token(secrets, from, i);
+
+            if (SameToken(&valid, token))
+                return 1;
+        }
+
+        return 0;
+    }
+
+    uint32_t generation = 0;
+    memcpy(&generation, token, sizeof(uint32_t));
+
+    uint32_t age = secrets->generation - generation;
+
+    if (age >= TOKEN_SECRETS)
+        return 0;
+
+    Token valid = MakeSipHashToken(secrets, from, age);
+
+    return SameToken(&valid, token);
+}
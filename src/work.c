@@ -1,19 +1,529 @@
 #include <dht/client.h>
+#include <dht/clock.h>
 #include <dht/handle.h>
 #include <dht/hooks.h>
+#include <dht/message_create.h>
 #include <dht/network.h>
+#include <dht/peers.h>
+#include <dht/pendingresponses.h>
 #include <dht/search.h>
+#include <dht/searchcache.h>
 #include <dht/work.h>
 
+int Node_CompareIds(const void *a, const void *b)
+{
+    Node *na = *(Node **)a;
+    Node *nb = *(Node **)b;
+
+    return memcmp(na->id.value, nb->id.value, HASH_BYTES);
+}
+
+/* Returns the index of the first node of the sorted snapshot whose id
+ * is not before id. */
+int Snapshot_Find(DArray *snapshot, Hash *id)
+{
+    int low = 0, high = DArray_count(snapshot);
+
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        Node *node = DArray_get(snapshot, middle);
+
+        if (memcmp(node->id.value, id->value, HASH_BYTES) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/* Copies to search the CLIENT_SEARCH_SEEDS nodes around its target in
+ * the sorted snapshot. Going away from the target on either side, the
+ * prefix shared with it only gets shorter, so taking the longer of the
+ * two sides each time copies the closest nodes first, before the
+ * buckets of the search table fill up. */
+int SeedFromSnapshot(Search *search, DArray *snapshot)
+{
+    Hash *target = &search->table->id;
+    int after = Snapshot_Find(snapshot, target);
+    int before = after - 1;
+
+    int i = 0;
+    for (i = 0; i < CLIENT_SEARCH_SEEDS; i++)
+    {
+        Node *left = before >= 0 ? DArray_get(snapshot, before) : NULL;
+        Node *right = after < DArray_count(snapshot)
+            ? DArray_get(snapshot, after)
+            : NULL;
+        Node *node = NULL;
+
+        if (left == NULL && right == NULL)
+            break;
+
+        if (left == NULL
+            || (right != NULL
+                && Hash_SharedPrefix(&right->id, target)
+                >= Hash_SharedPrefix(&left->id, target)))
+        {
+            node = right;
+            after++;
+        }
+        else
+        {
+            node = left;
+            before--;
+        }
+
+        int rc = Table_CopyAndAddNode(search->table, node);
+        check(rc == 0, "Table_CopyAndAddNode failed");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+/* Copies to search the nodes found by previous closest to its target. */
+int SeedFromPrevious(Search *search, Search *previous)
+{
+    DArray *found = Table_GatherClosest(previous->table, &search->table->id);
+    check(found != NULL, "Table_GatherClosest failed");
+
+    int rc = Search_CopyNodes(search, found);
+    check(rc == 0, "Search_CopyNodes failed");
+
+    DArray_destroy(found);
+
+    return 0;
+error:
+    DArray_destroy(found);
+    return -1;
+}
+
+int Client_StartSearches(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    DArray *snapshot = NULL;
+    Search *search = NULL;
+    Search *previous = NULL;
+
+    while (List_count(client->queued_searches) > 0
+           && DArray_count(client->searches) < client->max_searches)
+    {
+        /* One snapshot of the routing table, in keyspace order, is
+         * shared by all the searches started in this round. Each only
+         * copies the few nodes next to its target. */
+        if (snapshot == NULL)
+        {
+            snapshot = Table_GatherNodes(client->table,
+                                         Clock_Time(&client->clock));
+            check(snapshot != NULL, "Table_GatherNodes failed");
+
+            qsort(snapshot->contents,
+                  DArray_count(snapshot),
+                  sizeof(Node *),
+                  Node_CompareIds);
+        }
+
+        search = List_unshift(client->queued_searches);
+
+        int rc = Client_SeedSearch(client, search);
+        check(rc != -1, "Client_SeedSearch failed");
+
+        if (rc == 0)
+        {
+            rc = SeedFromSnapshot(search, snapshot);
+            check(rc == 0, "SeedFromSnapshot failed");
+        }
+
+        /* The search started before it in this round is usually for
+         * a neighbouring hash, as each batch is queued in keyspace
+         * order, so the nodes it found are likely close to this target. */
+        if (rc == 0 && previous != NULL)
+        {
+            rc = SeedFromPrevious(search, previous);
+            check(rc == 0, "SeedFromPrevious failed");
+        }
+
+        rc = Client_RunSearch(client, search);
+        check(rc == 0, "Client_RunSearch failed");
+
+        previous = search;
+        search = NULL;
+    }
+
+    DArray_destroy(snapshot);
+
+    return 0;
+error:
+    Search_Destroy(search);
+    DArray_destroy(snapshot);
+    return -1;
+}
+
+int ExpireQuery(Client *client, PendingResponse *entry)
+{
+    Node *node = NULL;
+
+    if (!entry->is_new)
+    {
+        node = Table_FindNode(client->table, &entry->id);
+
+        if (node != NULL)
+        {
+            /* Counts towards the node going Bad */
+            node->pending_queries++;
+            Node_MarkTimeout(node);
+
+            /* Search queries go to copies of the node. Its backoff
+             * starts from the timeout. */
+            node->sent_ms = Clock_Now(&client->clock);
+
+            /* Replaced once Bad, after repeated timeouts, as one
+             * lost datagram is no reason to drop a node. */
+            if (Node_Status(node, Clock_Time(&client->clock)) == Bad)
+            {
+                Node_Destroy(Table_ReplaceNode(client->table, node));
+            }
+        }
+    }
+
+    Search *search = Client_GetSearch(client, entry->search);
+
+    if (search != NULL)
+    {
+        node = Table_FindNode(search->table, &entry->id);
+
+        if (node != NULL)
+        {
+            if (node->pending_queries > 0)
+                node->pending_queries--;
+
+            Node_MarkTimeout(node);
+        }
+    }
+
+    return 0;
+}
+
+int Client_ExpireQueries(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    int64_t cutoff = Clock_Now(&client->clock)
+        - RttStats_Timeout(&client->rtt);
+
+    int rc = HashmapPendingResponses_Expire(
+        (HashmapPendingResponses *)client->pending,
+        cutoff,
+        client,
+        (PendingResponseOp)ExpireQuery);
+    check(rc == 0, "HashmapPendingResponses_Expire failed");
+
+    return 0;
+error:
+    return -1;
+}
+
+struct PingLoadedContext {
+    Client *client;
+    int64_t now_ms;
+    int sent;
+    int left;
+};
+
+int PingLoaded(struct PingLoadedContext *context, Node *node)
+{
+    Message *ping = NULL;
+
+    if (node->sent_ms != 0 || node->reply_time >= context->client->load_time)
+        return 0;
+
+    if (context->sent == CLIENT_LOAD_PINGS
+        || MessageQueue_IsFull(context->client->queries, LaneMaintenance))
+    {
+        context->left++;
+        return 0;
+    }
+
+    ping = Message_CreateQPing(context->client, node);
+    check(ping != NULL, "Message_CreateQPing failed");
+
+    int rc = MessageQueue_Push(context->client->queries, ping);
+    check(rc == 0, "MessageQueue_Push failed");
+
+    node->sent_ms = context->now_ms;
+    context->sent++;
+
+    return 0;
+error:
+    Message_Destroy(ping);
+    return -1;
+}
+
+int Client_PingLoaded(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    time_t now = Clock_Time(&client->clock);
+
+    if (client->load_time == 0 || client->load_ping_time == now)
+        return 0;
+
+    struct PingLoadedContext context = { .client = client,
+                                         .now_ms = Clock_Now(&client->clock) };
+
+    int rc = Table_ForEachNode(client->table, &context, (NodeOp)PingLoaded);
+    check(rc == 0, "PingLoaded failed");
+
+    client->load_ping_time = now;
+
+    if (context.left == 0)
+        client->load_time = 0;
+
+    return 0;
+error:
+    return -1;
+}
+
+/* Starts a find_node only search for target from the routing table. */
+int StartNodeLookup(Client *client, Hash *target, int flags)
+{
+    Search *search = Search_Create(target);
+    check(search != NULL, "Search_Create failed");
+
+    search->table->clock = &client->clock;
+    search->flags = flags | SearchRefresh;
+
+    int rc = Search_CopyTable(search, client->table);
+    check(rc == 0, "Search_CopyTable failed");
+
+    /* No node worth asking, it would never send a query */
+    if (search->table->end == 1 && search->table->buckets[0]->count == 0)
+        search->is_done = 1;
+
+    rc = Client_RunSearch(client, search);
+    check(rc == 0, "Client_RunSearch failed");
+
+    return 0;
+error:
+    Search_Destroy(search);
+    return -1;
+}
+
+int PingSeeds(Client *client, int64_t now_ms)
+{
+    Bootstrap *bootstrap = &client->bootstrap;
+    Message *ping = NULL;
+
+    if (now_ms - bootstrap->wave_ms < BOOTSTRAP_WAVE_MS)
+        return 0;
+
+    int i = 0;
+    for (i = 0;
+         i < BOOTSTRAP_WAVE && bootstrap->next < bootstrap->stats.seeds
+             && !MessageQueue_IsFull(client->queries, LaneMaintenance);
+         i++)
+    {
+        Seed *seed = &bootstrap->seeds[bootstrap->next++];
+        Node node = { .addr.s_addr = seed->addr, .port = seed->port, .is_new = 1 };
+
+        ping = Message_CreateQPing(client, &node);
+        check(ping != NULL, "Message_CreateQPing failed");
+
+        int rc = MessageQueue_Push(client->queries, ping);
+        check(rc == 0, "MessageQueue_Push failed");
+
+        bootstrap->stats.pinged++;
+    }
+
+    bootstrap->wave_ms = now_ms;
+
+    return 0;
+error:
+    Message_Destroy(ping);
+    return -1;
+}
+
+int StartBootstrapRound(Client *client)
+{
+    Bootstrap *bootstrap = &client->bootstrap;
+    Table *table = client->table;
+
+    int rc = StartNodeLookup(client, &table->id, SearchBootstrap);
+    check(rc == 0, "StartNodeLookup failed");
+
+    bootstrap->lookups++;
+
+    /* The lookup of our id covers the last bucket */
+    int i = 0;
+    for (i = 0; i < table->end - 1; i++)
+    {
+        if (table->buckets[i]->count == BUCKET_K)
+            continue;
+
+        Hash target;
+        rc = Table_RandomId(table, table->buckets[i], client->random, &target);
+        check(rc == 0, "Table_RandomId failed");
+
+        rc = StartNodeLookup(client, &target, SearchBootstrap);
+        check(rc == 0, "StartNodeLookup failed");
+
+        bootstrap->lookups++;
+    }
+
+    bootstrap->stats.rounds++;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Client_Bootstrap(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    Bootstrap *bootstrap = &client->bootstrap;
+
+    if (bootstrap->stats.start_ms < 0 || bootstrap->stats.ready_ms >= 0)
+        return 0;
+
+    int64_t now_ms = Clock_Now(&client->clock);
+
+    int rc = PingSeeds(client, now_ms);
+    check(rc == 0, "PingSeeds failed");
+
+    if (bootstrap->lookups > 0)
+        return 0;
+
+    if (bootstrap->stats.rounds > 0
+        && (Bootstrap_IsTableReady(client->table)
+            || bootstrap->stats.rounds == BOOTSTRAP_MAX_ROUNDS))
+    {
+        bootstrap->stats.ready_ms = now_ms - bootstrap->stats.start_ms;
+        Client_RunHook(client, HookTableReady, &bootstrap->stats);
+
+        return 0;
+    }
+
+    /* Waiting for the seeds */
+    if (client->table->end == 1 && client->table->buckets[0]->count == 0)
+        return 0;
+
+    return StartBootstrapRound(client);
+error:
+    return -1;
+}
+
+int Client_RefreshBuckets(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    time_t now = Clock_Time(&client->clock);
+
+    if (client->refreshing > 0
+        || now - client->refresh_time < CLIENT_REFRESH_GAP)
+    {
+        return 0;
+    }
+
+    Bucket *stalest = NULL;
+
+    int i = 0;
+    for (i = 0; i < client->table->end; i++)
+    {
+        Bucket *bucket = client->table->buckets[i];
+
+        if (now - bucket->change_time < CLIENT_REFRESH_AGE)
+            continue;
+
+        if (stalest == NULL || bucket->change_time < stalest->change_time)
+            stalest = bucket;
+    }
+
+    if (stalest == NULL)
+        return 0;
+
+    Hash target;
+    int rc = Table_RandomId(client->table, stalest, client->random, &target);
+    check(rc == 0, "Table_RandomId failed");
+
+    rc = StartNodeLookup(client, &target, SearchRefresh);
+    check(rc == 0, "StartNodeLookup failed");
+
+    stalest->change_time = now;
+    client->refresh_time = now;
+    client->refreshing++;
+    client->refresh.refreshes++;
+
+    return 0;
+error:
+    return -1;
+}
+
+int Client_PingQuestionable(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    Message *ping = NULL;
+    time_t now = Clock_Time(&client->clock);
+    int64_t now_ms = Clock_Now(&client->clock);
+    int64_t timeout = RttStats_Timeout(&client->rtt);
+
+    int i = 0;
+    for (i = 0; i < client->table->end; i++)
+    {
+        Bucket *bucket = client->table->buckets[i];
+
+        if (bucket->replacement_count == 0)
+            continue;
+
+        int j = 0;
+        for (j = 0; j < BUCKET_K; j++)
+        {
+            Node *node = bucket->nodes[j];
+
+            if (node == NULL || Node_Status(node, now) != Questionable)
+                continue;
+
+            /* Still waiting for the last ping */
+            if (now_ms - node->sent_ms < timeout)
+                continue;
+
+            /* Asked again on a later call */
+            if (MessageQueue_IsFull(client->queries, LaneMaintenance))
+                return 0;
+
+            ping = Message_CreateQPing(client, node);
+            check(ping != NULL, "Message_CreateQPing failed");
+
+            int rc = MessageQueue_Push(client->queries, ping);
+            check(rc == 0, "MessageQueue_Push failed");
+
+            node->sent_ms = now_ms;
+        }
+    }
+
+    return 0;
+error:
+    Message_Destroy(ping);
+    return -1;
+}
+
 int Client_HandleSearches(Client *client)
 {
     assert(client != NULL && "NULL Client pointer");
 
+    int rc = Client_StartSearches(client);
+    check(rc == 0, "Client_StartSearches failed");
+
     int i;
     for (i = 0; i < DArray_end(client->searches); i++)
     {
         Search *search = (Search *)DArray_get(client->searches, i);
-        int rc = Search_DoWork(client, search);
+        rc = Search_DoWork(client, search);
         check (rc == 0, "Search_DoWork failed");
     }
 
@@ -26,16 +536,49 @@ void Client_CleanSearches(Client *client)
 {
     assert(client != NULL && "NULL Client pointer");
 
+    SearchCache_Clean(client->cache, Clock_Time(&client->clock));
+
+    int64_t now = Clock_Now(&client->clock);
+    int64_t timeout = RttStats_Timeout(&client->rtt);
+
     int i;
     for (i = 0; i < DArray_end(client->searches); i++)
     {
         Search *search = (Search *)DArray_get(client->searches, i);
 
-        if (!Search_IsDone(search, time(NULL)))
+        if (!Search_IsDone(search, now, timeout))
             continue;
 
-        Client_RunHook(client, HookSearchDone, search);
+        if (search->stats.queries > 0)
+            search->stats.duration_ms = now - search->stats.start_ms;
 
+        if (search->flags & SearchBootstrap)
+        {
+            client->bootstrap.lookups--;
+            client->bootstrap.stats.queries += search->stats.queries;
+            client->bootstrap.stats.replies += search->stats.replies;
+        }
+        else if (search->flags & SearchRefresh)
+        {
+            client->refreshing--;
+            client->refresh.queries += search->stats.queries;
+            client->refresh.replies += search->stats.replies;
+        }
+        else
+        {
+            Client_RunHook(client, HookSearchDone, search);
+        }
+
+        if (!search->is_cached
+            && !(search->flags & SearchRefresh)
+            && SearchCache_Put(client->cache,
+                               search,
+                               Clock_Time(&client->clock)) != 0)
+        {
+            log_err("SearchCache_Put failed");
+        }
+
+        Hashmap_delete(client->serials, &search->serial);
         Search_Destroy(search);
 
         DArray_remove(client->searches, i);
@@ -44,6 +587,32 @@ void Client_CleanSearches(Client *client)
     DArray_compact(client->searches);
 }
 
+int Client_CleanPeers(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    int rc = PeerStore_Clean(client->peers, Clock_Time(&client->clock));
+    check(rc == 0, "PeerStore_Clean failed");
+
+    return 0;
+error:
+    return -1;
+}
+
+int Client_RotateSecrets(Client *client)
+{
+    assert(client != NULL && "NULL Client pointer");
+
+    int rc = TokenSecrets_Update(&client->tokens,
+                                 client->random,
+                                 Clock_Time(&client->clock));
+    check(rc >= 0, "TokenSecrets_Update failed");
+
+    return 0;
+error:
+    return -1;
+}
+
 int Client_HandleMessages(Client *client)
 {
     assert(client != NULL && "NULL Client pointer");
@@ -55,13 +624,19 @@ int Client_HandleMessages(Client *client)
         message = MessageQueue_Pop(client->incoming);
         check(message != NULL, "MessageQueue_Pop failed");
 
+        /* The search of a reply may have ended since the query */
+        message->context = Client_GetSearch(client, message->search);
+
         if (message->errors && MessageType_IsQuery(message->type))
         {
-            Message *reply = HandleInvalidQuery(client, message);
+            reply = HandleInvalidQuery(client, message);
             check(reply != NULL, "HandleInvalidQuery failed");
 
-            int rc = MessageQueue_Push(client->replies, reply);
-            check(rc == 0, "MessageQueue_Push failed");
+            /* A full lane drops the reply, as the network would */
+            if (MessageQueue_Push(client->replies, reply) != 0)
+                Message_Destroy(reply);
+
+            reply = NULL;
         }
         else if (message->errors)
         {
@@ -73,11 +648,20 @@ int Client_HandleMessages(Client *client)
             QueryHandler handler = GetQueryHandler(message->type);
             check(handler != NULL, "GetQueryHandler failed");
 
-            Message *reply = handler(client, message);
+            reply = handler(client, message);
             check(reply != NULL, "QueryHandler failed");
 
-            int rc = MessageQueue_Push(client->replies, reply);
-            check(rc == 0, "MessageQueue_Push failed");
+            if (MessageQueue_Push(client->replies, reply) != 0)
+                Message_Destroy(reply);
+
+            reply = NULL;
+        }
+        else if (MessageType_IsReply(message->type)
+                 && message->search != 0
+                 && message->context == NULL)
+        {
+            int rc = HandleOrphanReply(client, message);
+            check(rc == 0, "HandleOrphanReply failed");
         }
         else if (MessageType_IsReply(message->type))
         {
@@ -95,10 +679,6 @@ int Client_HandleMessages(Client *client)
 
         Client_RunHook(client, HookHandleMessage, message);
 
-        /* We must send any RGetPeers before its Nodes might be
-         * destroyed by some other action. */
-        Client_Send(client, client->replies);
-
         Message_Destroy(message);
     }
 
@@ -116,9 +696,16 @@ int Client_Send(Client *client, MessageQueue *queue)
     assert(queue != NULL && "NULL MessageQueue pointer");
 
     Message *message = NULL;
+    int64_t now = Clock_Now(&client->clock);
 
     while (MessageQueue_Count(queue) > 0)
     {
+        if (!Pacer_IsReady(&client->pacer, now))
+        {
+            client->pacer.stats.deferred++;
+            break;
+        }
+
         message = MessageQueue_Pop(queue);
         check(message != NULL, "MessageQueue_Pop failed");
 
@@ -142,6 +729,12 @@ int Client_Receive(Client *client)
 
     for (;;)
     {
+        /* The rest waits in the socket until handled */
+        if (MessageQueue_IsFull(client->incoming, LaneReply)
+            || MessageQueue_IsFull(client->incoming, LaneSearch)
+            || MessageQueue_IsFull(client->incoming, LaneMaintenance))
+            break;
+
         message = NULL;
         int rc = ReceiveMessage(client, &message);
 
@@ -0,0 +1,67 @@
+#include "minunit.h"
+#include <math.h>
+#include <dht/bloom.h>
+
+char *test_Bloom_Estimate()
+{
+    Bloom bloom = {{ 0 }};
+
+    mu_assert(Bloom_Estimate(&bloom) == 0, "Empty filter not estimated as 0");
+
+    /* The test vector of BEP 33: 192.0.2.0 to 192.0.2.255 and
+     * 2001:DB8:: to 2001:DB8::3E7 */
+    int i = 0;
+    for (i = 0; i < 256; i++)
+    {
+        Bloom_AddAddr(&bloom, 0xC0000200 | i);
+    }
+
+    for (i = 0; i < 1000; i++)
+    {
+        unsigned char addr[16] = { 0x20, 0x01, 0x0D, 0xB8 };
+        addr[14] = i >> 8;
+        addr[15] = i;
+
+        Bloom_Add(&bloom, addr, sizeof(addr));
+    }
+
+    double estimate = Bloom_Estimate(&bloom);
+    mu_assert(fabs(estimate - 1224.9308) < 0.001, "Wrong estimate");
+
+    return NULL;
+}
+
+char *test_Bloom_Merge()
+{
+    Bloom a = {{ 0 }}, b = {{ 0 }}, both = {{ 0 }};
+
+    int i = 0;
+    for (i = 0; i < 100; i++)
+    {
+        Bloom_AddAddr(i < 60 ? &a : &b, i);
+        Bloom_AddAddr(&both, i);
+    }
+
+    /* The same address at both */
+    Bloom_AddAddr(&b, 0);
+
+    Bloom_Merge(&a, &b);
+    mu_assert(memcmp(&a, &both, sizeof(Bloom)) == 0, "Wrong merge");
+
+    double estimate = Bloom_Estimate(&a);
+    mu_assert(90 < estimate && estimate < 110, "Estimate off");
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_Bloom_Estimate);
+    mu_run_test(test_Bloom_Merge);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,214 @@
+#include "minunit.h"
+#include <dht/bootstrap.h>
+#include <dht/client.h>
+#include <dht/clock.h>
+#include <dht/hooks.h>
+#include <dht/search.h>
+#include <dht/work.h>
+
+int AddNodes(Table *table, int count)
+{
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        Hash id = {{ 0x80, i + 1 }};
+        Node node = { .id = id, .reply_time = time(NULL) };
+
+        int rc = Table_CopyAndAddNode(table, &node);
+        check(rc == 0, "Table_CopyAndAddNode failed");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+char *test_Bootstrap_IsTableReady()
+{
+    Hash id = {{ 0 }};
+    Table *table = Table_Create(&id);
+
+    mu_assert(!Bootstrap_IsTableReady(table), "Empty table ready");
+
+    AddNodes(table, BUCKET_K - 1);
+    mu_assert(!Bootstrap_IsTableReady(table), "Table ready too soon");
+
+    AddNodes(table, BUCKET_K);
+    mu_assert(Bootstrap_IsTableReady(table), "Full bucket not ready");
+
+    Table_AddBucket(table);
+    mu_assert(!Bootstrap_IsTableReady(table), "Empty bucket ready");
+
+    Table_DestroyNodes(table);
+    Table_Destroy(table);
+
+    return NULL;
+}
+
+int64_t zero_ms = 0;
+
+int64_t ZeroMs(void *context)
+{
+    return *(int64_t *)context;
+}
+
+char *test_Client_Bootstrap_AtZero()
+{
+    Hash id = {{ 0 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+    Seed seeds[BOOTSTRAP_WAVE + 4];
+
+    int i = 0;
+    for (i = 0; i < BOOTSTRAP_WAVE + 4; i++)
+        seeds[i] = (Seed){ .addr = 0x0100007f, .port = htons(6881 + i) };
+
+    int rc = Dht_AddSeeds(client, seeds, BOOTSTRAP_WAVE + 4);
+    mu_assert(rc == 0, "Dht_AddSeeds failed");
+
+    /* A clock that starts at 0, as a simulation's may */
+    rc = Dht_SetClock(client, ZeroMs, &zero_ms);
+    mu_assert(rc == 0, "Dht_SetClock failed");
+
+    rc = Dht_Start(client);
+    mu_assert(rc == 0, "Dht_Start failed");
+    mu_assert(client->bootstrap.stats.start_ms == 0, "Wrong start");
+
+    rc = Client_Bootstrap(client);
+    mu_assert(rc == 0, "Client_Bootstrap failed");
+    mu_assert(MessageQueue_Count(client->queries) == BOOTSTRAP_WAVE,
+              "Not started at time 0");
+
+    /* The next wave is waited for */
+    MessageQueue_Clear(client->queries);
+    mu_assert(Dht_NextDeadline(client) == BOOTSTRAP_WAVE_MS,
+              "Wave not waited for");
+
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_Client_Bootstrap_Waves()
+{
+    Hash id = {{ 0 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+    Seed seeds[BOOTSTRAP_WAVE + 4];
+
+    int i = 0;
+    for (i = 0; i < BOOTSTRAP_WAVE + 4; i++)
+        seeds[i] = (Seed){ .addr = 0x0100007f, .port = htons(6881 + i) };
+
+    int rc = Dht_AddSeeds(client, seeds, BOOTSTRAP_WAVE + 4);
+    mu_assert(rc == 0, "Dht_AddSeeds failed");
+
+    rc = Client_Bootstrap(client);
+    mu_assert(MessageQueue_Count(client->queries) == 0, "Pinged before start");
+
+    client->bootstrap.stats.start_ms = Clock_Now(&client->clock);
+
+    rc = Client_Bootstrap(client);
+    mu_assert(rc == 0, "Client_Bootstrap failed");
+    mu_assert(MessageQueue_Count(client->queries) == BOOTSTRAP_WAVE, "Wrong first wave");
+
+    rc = Client_Bootstrap(client);
+    mu_assert(MessageQueue_Count(client->queries) == BOOTSTRAP_WAVE, "Waves not paced");
+
+    client->bootstrap.wave_ms -= BOOTSTRAP_WAVE_MS;
+    rc = Client_Bootstrap(client);
+    mu_assert(MessageQueue_Count(client->queries) == BOOTSTRAP_WAVE + 4,
+              "Wrong second wave");
+    mu_assert(client->bootstrap.stats.pinged == BOOTSTRAP_WAVE + 4, "Wrong pinged");
+    mu_assert(client->bootstrap.stats.rounds == 0, "Lookups without nodes");
+
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+BootstrapStats ready_stats = { .ready_ms = -1 };
+int ready_count = 0;
+
+void TableReady(void *client, void *args)
+{
+    (void)client;
+    ready_stats = *(BootstrapStats *)args;
+    ready_count++;
+}
+
+int FinishSearches(Client *client)
+{
+    int i = 0;
+    for (i = 0; i < DArray_count(client->searches); i++)
+    {
+        Search *search = DArray_get(client->searches, i);
+        check(search->flags & SearchBootstrap, "Not a bootstrap lookup");
+
+        search->is_done = 1;
+    }
+
+    Client_CleanSearches(client);
+
+    return 0;
+error:
+    return -1;
+}
+
+char *test_Client_Bootstrap_Ready()
+{
+    Hash id = {{ 0 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+    Hook *hook = Hook_Create(HookTableReady, TableReady);
+    Client_AddHook(client, hook);
+
+    client->bootstrap.stats.start_ms = Clock_Now(&client->clock);
+
+    int rc = AddNodes(client->table, 2);
+    mu_assert(rc == 0, "AddNodes failed");
+
+    /* A small network never fills the table */
+    unsigned int round = 0;
+    for (round = 1; round <= BOOTSTRAP_MAX_ROUNDS; round++)
+    {
+        rc = Client_Bootstrap(client);
+        mu_assert(rc == 0, "Client_Bootstrap failed");
+        mu_assert(client->bootstrap.stats.rounds == round, "Round not started");
+        mu_assert(client->bootstrap.lookups == 1, "Expected a self lookup");
+
+        rc = Client_Bootstrap(client);
+        mu_assert(client->bootstrap.stats.rounds == round, "Rounds overlap");
+
+        rc = FinishSearches(client);
+        mu_assert(rc == 0, "FinishSearches failed");
+        mu_assert(client->bootstrap.lookups == 0, "Lookups not finished");
+    }
+
+    mu_assert(ready_count == 0, "Ready too soon");
+
+    rc = Client_Bootstrap(client);
+    mu_assert(ready_count == 1, "Ready not run");
+    mu_assert(ready_stats.ready_ms >= 0, "No time to ready");
+    mu_assert(ready_stats.rounds == BOOTSTRAP_MAX_ROUNDS, "Wrong rounds");
+
+    rc = Client_Bootstrap(client);
+    mu_assert(ready_count == 1, "Ready run twice");
+    mu_assert(DArray_count(client->searches) == 0, "Lookups after ready");
+
+    Client_Destroy(client);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_Bootstrap_IsTableReady);
+    mu_run_test(test_Client_Bootstrap_Waves);
+    mu_run_test(test_Client_Bootstrap_AtZero);
+    mu_run_test(test_Client_Bootstrap_Ready);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
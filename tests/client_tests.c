@@ -1,5 +1,11 @@
+#include <time.h>
+
 #include "minunit.h"
+#include "fixtures.h"
 #include <dht/client.h>
+#include <dht/peers.h>
+#include <dht/search.h>
+#include <dht/work.h>
 
 char *test_Client_CreateDestroy()
 {
@@ -41,7 +47,7 @@ char *test_Token()
     Token token_b = Client_MakeToken(client, &node_b);
 
     int i = 0;
-    while (i++ < SECRETS_LEN)
+    while (i++ < TOKEN_SECRETS)
     {
         mu_assert(Client_IsValidToken(client, &node_a,
                                       token_a.value, HASH_BYTES),
@@ -72,12 +78,192 @@ char *test_Token()
     return NULL;
 }
 
+char *test_Client_AddSearches()
+{
+    Hash id = { "bulk client" };
+    Client *client = Client_Create(id, 0, 0, 0);
+    RandomState *rs = RandomState_Create(17);
+
+    int rc = FillTable(client->table, rs);
+    mu_assert(rc == 0, "FillTable failed");
+
+    const int count = CLIENT_ACTIVE_SEARCHES * 3;
+    SearchRequest requests[count];
+
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        Hash_Random(rs, &requests[i].info_hash);
+        requests[i].flags = i % 2 ? SearchAnnounce : SearchLookup;
+        requests[i].search = NULL;
+    }
+
+    rc = Dht_AddSearches(client, NULL, 0);
+    mu_assert(rc == 0, "Dht_AddSearches failed with no requests");
+
+    rc = Client_AddSearches(client, requests, count);
+    mu_assert(rc == 0, "Client_AddSearches failed");
+    mu_assert(List_count(client->queued_searches) == count, "Wrong queue count");
+    mu_assert(DArray_count(client->searches) == 0, "Started too early");
+
+    for (i = 0; i < count; i++)
+    {
+        Search *search = requests[i].search;
+        mu_assert(search != NULL, "No search set");
+        mu_assert(Hash_Equals(&search->table->id, &requests[i].info_hash),
+                  "Wrong search target");
+        mu_assert(search->flags == requests[i].flags, "Wrong flags");
+    }
+
+    rc = Client_StartSearches(client);
+    mu_assert(rc == 0, "Client_StartSearches failed");
+    mu_assert(DArray_count(client->searches) == CLIENT_ACTIVE_SEARCHES,
+              "Wrong number of started searches");
+
+    DArray *known = Table_GatherNodes(client->table, time(NULL));
+    mu_assert(DArray_count(known) > BUCKET_K, "Too few nodes added");
+    Search *previous = NULL;
+
+    for (i = 0; i < DArray_count(client->searches); i++)
+    {
+        Search *search = DArray_get(client->searches, i);
+
+        /* Seeded with the nodes of the longest shared prefix, and not
+         * the whole routing table */
+        Node *closest = NULL;
+        int j = 0;
+        for (j = 0; j < DArray_count(known); j++)
+        {
+            Node *node = DArray_get(known, j);
+
+            if (closest == NULL
+                || Hash_SharedPrefix(&node->id, &search->table->id)
+                > Hash_SharedPrefix(&closest->id, &search->table->id))
+            {
+                closest = node;
+            }
+        }
+
+        mu_assert(Table_FindNode(search->table, &closest->id) != NULL,
+                  "Closest node not seeded");
+
+        DArray *seeded = Table_GatherNodes(search->table, time(NULL));
+        mu_assert(DArray_count(seeded) <= CLIENT_SEARCH_SEEDS + BUCKET_K,
+                  "Too many nodes seeded");
+        DArray_destroy(seeded);
+
+        if (previous != NULL)
+        {
+            mu_assert(memcmp(previous->table->id.value,
+                             search->table->id.value,
+                             HASH_BYTES) < 0,
+                      "Not started in keyspace order");
+        }
+
+        previous = search;
+    }
+
+    DArray_destroy(known);
+    RandomState_Destroy(rs);
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_Client_StartSearches_Previous()
+{
+    Hash id = {{ 0 }};
+    Hash single_target = {{ 0x40 }};
+    Hash bulk_target = {{ 0xc0 }};
+    Hash found_id = {{ 0x41 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+
+    /* Running before the batch, and far from it */
+    Search *single = Client_AddSearch(client, &single_target);
+    mu_assert(single != NULL, "Client_AddSearch failed");
+
+    Node found = { .id = found_id,
+                   .addr.s_addr = 1,
+                   .port = 1,
+                   .reply_time = Clock_Time(&client->clock) };
+    int rc = Table_CopyAndAddNode(single->table, &found);
+    mu_assert(rc == 0, "Table_CopyAndAddNode failed");
+
+    SearchRequest request = { .info_hash = bulk_target, .flags = SearchLookup };
+    rc = Client_AddSearches(client, &request, 1);
+    mu_assert(rc == 0, "Client_AddSearches failed");
+
+    rc = Client_StartSearches(client);
+    mu_assert(rc == 0, "Client_StartSearches failed");
+    mu_assert(Table_FindNode(((Search *)request.search)->table, &found_id) == NULL,
+              "Seeded from a search of an earlier round");
+
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+int64_t virtual_ms = 0;
+
+int64_t VirtualMs(void *context)
+{
+    return *(int64_t *)context;
+}
+
+char *test_Client_VirtualClock()
+{
+    Hash id = { "virtual" };
+    Client *client = Client_Create(id, 0, 0, 0);
+
+    virtual_ms = 1000 * 1000;
+    int rc = Dht_SetClock(client, VirtualMs, &virtual_ms);
+    mu_assert(rc == 0, "Dht_SetClock failed");
+    mu_assert(Clock_Time(&client->clock) == 1000, "Clock not read");
+
+    /* Stamped by Client_Create with the system time */
+    mu_assert(client->tokens.rotate_time == 1000, "Token rotation not restamped");
+    mu_assert(client->pacer.update_ms == virtual_ms, "Pacer not restamped");
+    mu_assert(client->table->buckets[0]->change_time == 1000,
+              "Bucket change not restamped");
+
+    Hash node_id = { "node" };
+    Node node = { .id = node_id, .addr.s_addr = 1, .port = 1 };
+
+    rc = Table_MarkQuery(client->table, &node);
+    mu_assert(rc == 0, "Table_MarkQuery failed");
+
+    Node *found = Table_FindNode(client->table, &node_id);
+    mu_assert(found != NULL && found->query_time == 1000, "Wrong query_time");
+
+    Hash info_hash = { "info_hash" };
+    Peer peer = { .addr = 1, .port = 1 };
+    rc = PeerStore_AddPeer(client->peers, &info_hash, &peer, 0);
+    mu_assert(rc == 0, "PeerStore_AddPeer failed");
+
+    /* Cached until the next update */
+    virtual_ms += (PEERSTORE_TTL + 120) * 1000;
+    rc = Client_CleanPeers(client);
+    mu_assert(client->peers->count == 1, "Clock read between ticks");
+
+    Clock_Update(&client->clock);
+    rc = Client_CleanPeers(client);
+    mu_assert(rc == 0, "Client_CleanPeers failed");
+    mu_assert(client->peers->count == 0, "Peer not expired in virtual time");
+
+    Client_Destroy(client);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
 
     mu_run_test(test_Client_CreateDestroy);
     mu_run_test(test_Token);
+    mu_run_test(test_Client_AddSearches);
+    mu_run_test(test_Client_StartSearches_Previous);
+    mu_run_test(test_Client_VirtualClock);
 
     return NULL;
 }
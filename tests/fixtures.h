@@ -0,0 +1,38 @@
+#ifndef _fixtures_h
+#define _fixtures_h
+
+#include <time.h>
+
+#include <dht/hash.h>
+#include <dht/random.h>
+#include <dht/table.h>
+#include <lcthw/dbg.h>
+
+/* Shared by the tests and the benchmarks. */
+
+/* Offers table BUCKET_K good nodes for each length of the prefix they
+ * share with its id, up to 32 bits, as a well-populated routing table.
+ * Returns 0 on success, -1 on failure. */
+int FillTable(Table *table, RandomState *random)
+{
+    int prefix = 0, i = 0;
+    for (prefix = 0; prefix < 32; prefix++)
+    {
+        for (i = 0; i < BUCKET_K; i++)
+        {
+            Node node = { .reply_time = time(NULL) };
+
+            int rc = Hash_PrefixedRandom(random, &node.id, &table->id, prefix);
+            check(rc == 0, "Hash_PrefixedRandom failed");
+
+            rc = Table_CopyAndAddNode(table, &node);
+            check(rc == 0, "Table_CopyAndAddNode failed");
+        }
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include "minunit.h"
 #include <dht/client.h>
+#include <dht/crawl.h>
 #include <dht/handle.h>
+#include <dht/hooks.h>
 #include <dht/message.h>
 #include <dht/message_create.h>
 #include <dht/search.h>
@@ -103,7 +105,7 @@ char *test_HandleQGetPeers_peers()
     Peer peer = { .addr = 23, .port = 32 };
 
     Table_CopyAndAddNode(client->table, &from->node);
-    Client_AddPeer(client, &target_id, &peer);
+    Client_AddPeer(client, &target_id, &peer, 0);
 
     Message *qgetpeers = Message_CreateQGetPeers(from, &from->node, &target_id);
 
@@ -154,15 +156,12 @@ char *test_HandleQAnnouncePeer()
     mu_assert(SameT(query, reply), "Wrong t");
     mu_assert(HasRecentQuery(client->table, from_id), "Node query_time not set");
 
-    DArray *peers = NULL;
+    Peer peers[2];
 
-    int rc = Client_GetPeers(client, &target_id, &peers);
-    mu_assert(rc == 0, "Client_GetPeers failed");
-    mu_assert(peers != NULL, "NULL DArray");
-    mu_assert(DArray_count(peers) == 1, "Wrong peers count");
+    int rc = Client_GetPeers(client, &target_id, peers, 2);
+    mu_assert(rc == 1, "Wrong peers count");
 
-    Peer *peer = DArray_get(peers, 0);
-    mu_assert(peer != NULL, "NULL Peer");
+    Peer *peer = &peers[0];
     mu_assert(peer->addr == from->node.addr.s_addr, "Wrong peer addr");
     mu_assert(peer->port == from->peer_port, "Wrong peer port");
 
@@ -170,7 +169,41 @@ char *test_HandleQAnnouncePeer()
     Client_Destroy(from);
     Message_Destroy(query);
     Message_Destroy(reply);
-    DArray_destroy(peers);
+
+    return NULL;
+}
+
+char *test_HandleQAnnouncePeer_implied_port()
+{
+    Hash id = { "client id" };
+    Hash from_id = { "from id" };
+    Hash target_id = { "target id" };
+    Client *client = Client_Create(id, 2, 4, 8);
+    Client *from = Client_Create(from_id, 1, htons(6881), 3);
+
+    Token token = Client_MakeToken(client, &from->node);
+
+    Message *query = Message_CreateQAnnouncePeer(from,
+                                                 &from->node,
+                                                 &target_id,
+                                                 token.value,
+                                                 HASH_BYTES);
+    query->data.qannouncepeer.implied_port = 1;
+
+    Message *reply = (GetQueryHandler(query->type))(client, query);
+    mu_assert(reply != NULL, "HandleQAnnouncePeer failed");
+    mu_assert(reply->type == RAnnouncePeer, "Wrong type");
+
+    Peer peers[2];
+
+    int rc = Client_GetPeers(client, &target_id, peers, 2);
+    mu_assert(rc == 1, "Wrong peers count");
+    mu_assert(peers[0].port == 6881, "Implied port not used");
+
+    Client_Destroy(client);
+    Client_Destroy(from);
+    Message_Destroy(query);
+    Message_Destroy(reply);
 
     return NULL;
 }
@@ -257,14 +290,25 @@ char *test_HandleRFindNode()
 
     Search *search = Search_Create(&target_id);
 
+    /* Queued well before it was sent */
+    int64_t now = Clock_Now(&client->clock);
+    Table_CopyAndAddNode(search->table, &from->node);
+    Node *node = Table_FindNode(search->table, &from_id);
+    node->pending_queries = 1;
+    node->sent_ms = now - 500;
+
     Message *query = Message_CreateQFindNode(client, &from->node, &target_id);
 
     Message *rfindnode = Message_CreateRFindNode(from, query, found);
     rfindnode->context = search; /* Would be set when decoding */
+    rfindnode->sent_ms = now - 40;
 
     int rc = (GetReplyHandler(rfindnode->type))(client, rfindnode);
     mu_assert(rc == 0, "HandleRFindNode failed");
 
+    mu_assert(node->rtt_ms == 40, "Not timed from the send");
+    mu_assert(client->rtt.count == 1, "Rtt not sampled");
+
     mu_assert(search->peers->count == 0, "Wrong peers count on search");
 
     mu_assert(HasRecentReply(client->table, from->node.id),
@@ -272,6 +316,7 @@ char *test_HandleRFindNode()
     mu_assert(HasRecentReply(search->table, from->node.id),
               "Reply not marked in search->table");
     DArray_destroy(found);
+    Node_Destroy(found_node);
     Search_Destroy(search);
     Client_Destroy(client);
     Client_Destroy(from);
@@ -291,11 +336,14 @@ char *test_HandleRPing()
     Message *query = Message_CreateQPing(client, &from->node);
 
     Message *reply = Message_CreateRPing(from, query);
+    reply->sent_ms = Clock_Now(&client->clock) - 30;
 
     int rc = (GetReplyHandler(reply->type))(client, reply);
 
     mu_assert(rc == 0, "HandleReply failed");
     mu_assert(HasRecentReply(client->table, from->node.id), "Reply not marked");
+    mu_assert(Table_FindNode(client->table, &from_id)->rtt_ms == 30,
+              "Ping not timed from the send");
     mu_assert(reply->type == RPing, "Wrong type");
     mu_assert(SameT(query, reply), "Wrong t");
 
@@ -386,11 +434,6 @@ char *test_HandleRGetPeers_nodes()
     mu_assert(search->peers->count == 0, "No peers expected");
 
     Client_Destroy(client);
-
-    /* Nodes already destroyed by reply handler: just destroy table
-     * and replace it with a dummy for Client_Destroy. */
-    Table_Destroy(from->table);
-    from->table = Table_Create(&from_id);
     Client_Destroy(from);
 
     Message_Destroy(qgetpeers);
@@ -416,7 +459,7 @@ char *test_HandleRGetPeers_peers()
     for (i = 0; i < peers_count; i++)
     {
         Peer peer = { .addr = 100 + i, .port = 100 + i };
-        Client_AddPeer(from, &target_id, &peer);
+        Client_AddPeer(from, &target_id, &peer, 0);
     }
 
     Message *qgetpeers = Message_CreateQGetPeers(client,
@@ -447,6 +490,214 @@ char *test_HandleRGetPeers_peers()
     return NULL;
 }
 
+size_t new_peers_count = 0;
+
+void CountNewPeers(void *client, void *args)
+{
+    (void)client;
+    new_peers_count += ((struct HookPeerData *)args)->count;
+}
+
+char *test_HandleRGetPeers_NewPeer()
+{
+    Hash id = { "client id" };
+    Hash from_id = { "from id" };
+    Hash target_id = { "target id" };
+    Client *client = Client_Create(id, 2, 4, 8);
+    Client *from = Client_Create(from_id, 1, 1, 1);
+    const int peers_count = 3;
+
+    int i = 0;
+    for (i = 0; i < peers_count; i++)
+    {
+        Peer peer = { .addr = 100 + i, .port = 100 + i };
+        Client_AddPeer(from, &target_id, &peer, 0);
+    }
+
+    Hook *hook = Hook_Create(HookNewPeer, CountNewPeers);
+    Client_AddHook(client, hook);
+
+    Search *search = Search_Create(&target_id);
+
+    for (i = 0; i < 2; i++)
+    {
+        Message *qgetpeers = Message_CreateQGetPeers(client,
+                                                     &from->node,
+                                                     &target_id);
+        qgetpeers->node = client->node;
+
+        Message *rgetpeers = HandleQGetPeers(from, qgetpeers);
+        rgetpeers->context = search;
+        rgetpeers->node = from->node;
+
+        RGetPeersData *data = &rgetpeers->data.rgetpeers;
+        size_t count = data->count;
+        Peer values[peers_count + 1];
+        memcpy(values, data->values, count * sizeof(Peer));
+
+        int rc = (GetReplyHandler(rgetpeers->type))(client, rgetpeers);
+        mu_assert(rc == 0, "HandleRGetPeers failed");
+
+        /* Later handlers and hooks see the reply as received */
+        mu_assert(data->count == count, "Values count changed");
+        mu_assert(memcmp(values, data->values, count * sizeof(Peer)) == 0,
+                  "Values changed");
+
+        Message_Destroy(qgetpeers);
+        Message_Destroy(rgetpeers);
+
+        /* The next reply has both seen and new peers */
+        Peer peer = { .addr = 200, .port = 200 };
+        Client_AddPeer(from, &target_id, &peer, 0);
+    }
+
+    mu_assert(new_peers_count == (size_t)peers_count + 1,
+              "Peers delivered twice or not at all");
+
+    Client_Destroy(client);
+    Client_Destroy(from);
+    Search_Destroy(search);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
+char *test_HandleScrape()
+{
+    Hash id = { "client id" };
+    Hash from_id = { "from id" };
+    Hash target_id = { "target id" };
+    Client *client = Client_Create(id, 2, 4, 8);
+    Client *from = Client_Create(from_id, 1, 1, 1);
+
+    int i = 0;
+    for (i = 0; i < 5; i++)
+    {
+        Peer peer = { .addr = 100 + i, .port = 6881 };
+        Client_AddPeer(from, &target_id, &peer, i < 2);
+    }
+
+    Message *query = Message_CreateQGetPeers(client, &client->node, &target_id);
+    query->data.qgetpeers.scrape = 1;
+
+    Message *reply = HandleQGetPeers(from, query);
+    mu_assert(reply != NULL, "HandleQGetPeers failed");
+
+    RGetPeersData *data = &reply->data.rgetpeers;
+    mu_assert(data->seeds != NULL && data->peers != NULL, "No bloom filters");
+    mu_assert(data->values == NULL, "Peers sent to a scrape");
+    mu_assert(data->nodes != NULL, "No nodes");
+
+    Search *search = Search_Create(&target_id);
+    search->flags = SearchScrape;
+    reply->context = search;
+    reply->node = from->node;
+    reply->node.reply_time = time(NULL);
+
+    int rc = (GetReplyHandler(reply->type))(client, reply);
+    mu_assert(rc == 0, "HandleRGetPeers failed");
+
+    ScrapeStats stats = { 0 };
+    rc = Dht_GetScrapeStats(search, &stats);
+    mu_assert(rc == 0, "Dht_GetScrapeStats failed");
+    mu_assert(stats.replies == 1, "Wrong replies");
+    mu_assert(stats.seeds > 1.5 && stats.seeds < 2.5, "Wrong seeds estimate");
+    mu_assert(stats.peers > 2.5 && stats.peers < 3.5, "Wrong peers estimate");
+
+    Client_Destroy(client);
+
+    Client_Destroy(from);
+    Message_Destroy(query);
+    Message_Destroy(reply);
+    Search_Destroy(search);
+
+    return NULL;
+}
+
+size_t new_info_hashes = 0;
+
+void CountNewInfoHashes(void *client, void *args)
+{
+    (void)client;
+    new_info_hashes += ((struct HookInfoHashData *)args)->count;
+}
+
+char *test_HandleSampleInfohashes()
+{
+    Hash id = { "client id" };
+    Hash from_id = { "from id" };
+    Hash target = { "target" };
+    Client *client = Client_Create(id, 2, 4, 8);
+    Client *from = Client_Create(from_id, 1, 1, 1);
+
+    int i = 0;
+    for (i = 0; i < 3; i++)
+    {
+        Hash info_hash = { "info_hash" };
+        info_hash.value[HASH_BYTES - 1] = i;
+
+        Peer peer = { .addr = 100 + i, .port = 6881 };
+        Client_AddPeer(from, &info_hash, &peer, 0);
+    }
+
+    Message *query = Message_CreateQSampleInfohashes(client, &client->node, &target);
+    Message *reply = HandleQSampleInfohashes(from, query);
+    mu_assert(reply != NULL, "HandleQSampleInfohashes failed");
+
+    RSampleInfohashesData *data = &reply->data.rsampleinfohashes;
+    mu_assert(data->samples_count == 3, "Wrong samples count");
+    mu_assert(data->num == 3, "Wrong num");
+    mu_assert(data->interval == CLIENT_SAMPLES_INTERVAL, "Wrong interval");
+    mu_assert(data->count == 1, "Wrong nodes count");
+    mu_assert(Hash_Equals(&data->nodes[0]->id, &id), "Querier not replied");
+
+    Hook *hook = Hook_Create(HookNewInfoHash, CountNewInfoHashes);
+    Client_AddHook(client, hook);
+
+    int rc = Dht_StartCrawl(client, 1);
+    mu_assert(rc == 0, "Dht_StartCrawl failed");
+
+    reply->node = from->node;
+    reply->node.reply_time = time(NULL);
+
+    rc = (GetReplyHandler(reply->type))(client, reply);
+    mu_assert(rc == 0, "HandleRSampleInfohashes failed");
+    mu_assert(new_info_hashes == 3, "New info_hashes not delivered");
+    mu_assert(List_count(client->crawl->queue) == 0, "Queued ourselves");
+
+    /* Nothing new the second time */
+    data->samples_count = 3;
+    rc = (GetReplyHandler(reply->type))(client, reply);
+    mu_assert(rc == 0, "HandleRSampleInfohashes failed");
+    mu_assert(new_info_hashes == 3, "Known info_hashes delivered");
+
+    CrawlStats stats = { 0 };
+    rc = Dht_GetCrawlStats(client, &stats);
+    mu_assert(rc == 0, "Dht_GetCrawlStats failed");
+    mu_assert(stats.replies == 2, "Wrong replies");
+    mu_assert(stats.samples == 6, "Wrong samples");
+    mu_assert(stats.new_samples == 3, "Wrong new samples");
+
+    rc = Crawl_DoWork(client, client->crawl);
+    mu_assert(rc == 0, "Crawl_DoWork failed");
+    mu_assert(MessageQueue_Count(client->queries) == 1, "No query sent");
+
+    Message *sent = MessageQueue_Pop(client->queries);
+    mu_assert(sent->type == QSampleInfohashes, "Wrong query type");
+    mu_assert(Hash_Equals(&sent->node.id, &from_id), "Wrong node queried");
+    Message_Destroy(sent);
+
+    Dht_StopCrawl(client);
+    Client_Destroy(client);
+
+    Client_Destroy(from);
+    Message_Destroy(query);
+    Message_Destroy(reply);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
@@ -455,6 +706,7 @@ char *all_tests()
     mu_run_test(test_HandleQGetPeers_nodes);
     mu_run_test(test_HandleQGetPeers_peers);
     mu_run_test(test_HandleQAnnouncePeer);
+    mu_run_test(test_HandleQAnnouncePeer_implied_port);
     mu_run_test(test_HandleQAnnouncePeer_badtoken);
     mu_run_test(test_HandleQFindNode);
 
@@ -463,6 +715,9 @@ char *all_tests()
     mu_run_test(test_HandleRAnnouncePeer);
     mu_run_test(test_HandleRGetPeers_nodes);
     mu_run_test(test_HandleRGetPeers_peers);
+    mu_run_test(test_HandleRGetPeers_NewPeer);
+    mu_run_test(test_HandleScrape);
+    mu_run_test(test_HandleSampleInfohashes);
 
     return NULL;
 }
@@ -0,0 +1,76 @@
+#include "minunit.h"
+#include <dht/hash.h>
+#include <dht/hashfilter.h>
+#include <dht/random.h>
+
+char *test_HashFilter_Add()
+{
+    RandomState *random = RandomState_Create(0);
+    HashFilter *filter = HashFilter_Create(64);
+    mu_assert(filter != NULL, "HashFilter_Create failed");
+    mu_assert(filter->capacity == 51, "Wrong capacity");
+
+    Hash hashes[40];
+
+    int i = 0;
+    for (i = 0; i < 40; i++)
+    {
+        Hash_Random(random, &hashes[i]);
+        mu_assert(!HashFilter_Contains(filter, &hashes[i]), "Contained before added");
+        mu_assert(HashFilter_Add(filter, &hashes[i]) == 1, "Not new");
+    }
+
+    for (i = 0; i < 40; i++)
+    {
+        mu_assert(HashFilter_Contains(filter, &hashes[i]), "Not contained");
+        mu_assert(HashFilter_Add(filter, &hashes[i]) == 0, "Added twice");
+    }
+
+    mu_assert(filter->count == 40, "Wrong count");
+
+    HashFilter_Destroy(filter);
+    RandomState_Destroy(random);
+
+    return NULL;
+}
+
+char *test_HashFilter_Rotate()
+{
+    RandomState *random = RandomState_Create(0);
+    HashFilter *filter = HashFilter_Create(64);
+
+    Hash first;
+    Hash_Random(random, &first);
+    HashFilter_Add(filter, &first);
+
+    Hash hash;
+
+    /* Fills the current generation, then the next one */
+    size_t i = 0;
+    for (i = 0; filter->rotations < 2; i++)
+    {
+        Hash_Random(random, &hash);
+        HashFilter_Add(filter, &hash);
+    }
+
+    mu_assert(i >= 2 * filter->capacity - 1, "Rotated too soon");
+    mu_assert(!HashFilter_Contains(filter, &first), "Oldest hash not forgotten");
+    mu_assert(HashFilter_Contains(filter, &hash), "Newest hash forgotten");
+
+    HashFilter_Destroy(filter);
+    RandomState_Destroy(random);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_HashFilter_Add);
+    mu_run_test(test_HashFilter_Rotate);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -1,6 +1,9 @@
 #include "minunit.h"
+#include <pthread.h>
 #include <dht/client.h>
 #include <dht/hooks.h>
+#include <dht/message.h>
+#include <dht/message_create.h>
 
 Client *test_client = NULL;
 
@@ -40,11 +43,380 @@ char *test_hooks()
     return NULL;
 }
 
+size_t peers_seen = 0;
+uint32_t last_addr = 0;
+int out_of_order = 0;
+
+void CountPeers(void *hook_client, void *args)
+{
+    (void)hook_client;
+    struct HookPeerData *data = args;
+
+    size_t i = 0;
+    for (i = 0; i < data->count; i++)
+    {
+        if (data->peers[i].addr != last_addr + 1)
+            out_of_order = 1;
+
+        last_addr = data->peers[i].addr;
+    }
+
+    peers_seen += data->count;
+}
+
+Client *AsyncClient(size_t size, HookOverflow overflow, Hook *hook)
+{
+    Client *client = calloc(1, sizeof(Client));
+    check_mem(client);
+
+    client->hooks = Hooks_Create();
+    check(client->hooks != NULL, "Hooks_Create failed");
+
+    client->async_hooks = AsyncHooks_Create(size, overflow);
+    check(client->async_hooks != NULL, "AsyncHooks_Create failed");
+
+    Client_AddHook(client, hook);
+
+    return client;
+error:
+    return NULL;
+}
+
+void AsyncClient_Destroy(Client *client)
+{
+    Hooks_Destroy(client->hooks);
+    AsyncHooks_Destroy(client->async_hooks);
+    free(client);
+}
+
+/* Runs HookAddPeer for count peers, addresses from first on */
+void AddPeers(Client *client, uint32_t first, size_t count)
+{
+    Hash info_hash = { "info_hash" };
+    Peer peers[8];
+
+    size_t i = 0;
+    for (i = 0; i < count; i++)
+        peers[i] = (Peer){ .addr = first + i, .port = 6881 };
+
+    struct HookPeerData data = { .info_hash = &info_hash,
+                                 .peers = peers,
+                                 .count = count };
+    Client_RunHook(client, HookAddPeer, &data);
+}
+
+char *test_AsyncHooks_Overflow()
+{
+    Hook *hook = Hook_Create(HookAddPeer, CountPeers);
+    Client *client = AsyncClient(4096, HookOverflowDrop, hook);
+    mu_assert(client != NULL, "AsyncClient failed");
+
+    peers_seen = last_addr = out_of_order = 0;
+
+    /* Each event takes 8 + 32 + 8 * 8 bytes */
+    uint32_t addr = 1;
+    int i = 0;
+    for (i = 0; i < 40; i++, addr += 8)
+        AddPeers(client, addr, 8);
+
+    AsyncHooks *async = client->async_hooks;
+    mu_assert(peers_seen == 0, "Hooks run at once");
+    mu_assert(async->queued == 39, "Wrong queued");
+    mu_assert(async->dropped == 1, "Wrong dropped");
+
+    mu_assert(Client_DrainHooks(client, 10) == 10, "Drained past max");
+    mu_assert(Client_DrainHooks(client, 100) == 29, "Not all drained");
+    mu_assert(peers_seen == 39 * 8 && !out_of_order, "Wrong peers delivered");
+
+    /* Records wrap around the end of the ring */
+    last_addr = addr - 1;
+    for (i = 0; i < 100; i++, addr += 8)
+    {
+        AddPeers(client, addr, 8);
+        mu_assert(Client_DrainHooks(client, 1) == 1, "Not drained");
+    }
+
+    mu_assert(peers_seen == 139 * 8 && !out_of_order, "Wrong peers after wrap");
+    mu_assert(async->delivered == 139, "Wrong delivered");
+
+    /* A full ring runs the hooks at once under HookOverflowSync */
+    async->overflow = HookOverflowSync;
+    for (i = 0; i < 40; i++, addr += 8)
+        AddPeers(client, addr, 8);
+
+    mu_assert(async->synced == 1, "Wrong synced");
+    mu_assert(peers_seen == 140 * 8, "Overflow not run");
+
+    AsyncClient_Destroy(client);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
+struct Drainer {
+    Client *client;
+    size_t events;
+    atomic_int stop;
+};
+
+void *DrainHooks(void *arg)
+{
+    struct Drainer *drainer = arg;
+
+    while (1)
+    {
+        /* Once stopped, queued no longer changes */
+        int stopped = atomic_load(&drainer->stop);
+
+        drainer->events += Client_DrainHooks(drainer->client, 64);
+
+        if (stopped && drainer->events >= drainer->client->async_hooks->queued)
+            break;
+    }
+
+    return NULL;
+}
+
+char *test_AsyncHooks_Thread()
+{
+    Hook *hook = Hook_Create(HookAddPeer, CountPeers);
+    Client *client = AsyncClient(4096, HookOverflowDrop, hook);
+
+    peers_seen = last_addr = out_of_order = 0;
+
+    struct Drainer drainer = { .client = client };
+    pthread_t thread;
+    int rc = pthread_create(&thread, NULL, DrainHooks, &drainer);
+    mu_assert(rc == 0, "pthread_create failed");
+
+    uint32_t addr = 1;
+    int i = 0;
+    for (i = 0; i < 100000; i++)
+    {
+        AddPeers(client, addr, 1);
+
+        if (client->async_hooks->dropped == 0)
+            addr++;
+        else
+            client->async_hooks->dropped = 0;
+    }
+
+    atomic_store(&drainer.stop, 1);
+    pthread_join(thread, NULL);
+
+    mu_assert(drainer.events == client->async_hooks->queued, "Events lost");
+    mu_assert(peers_seen == addr - 1, "Wrong peers delivered");
+    mu_assert(!out_of_order, "Peers out of order");
+
+    AsyncClient_Destroy(client);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
+int set_rc = 0;
+
+void SetAsyncHooks(void *hook_client, void *args)
+{
+    (void)args;
+    set_rc = Dht_SetAsyncHooks(hook_client, 0, HookOverflowDrop);
+}
+
+char *test_AsyncHooks_SetWhileDraining()
+{
+    Hook *hook = Hook_Create(HookAddPeer, SetAsyncHooks);
+    Client *client = AsyncClient(4096, HookOverflowDrop, hook);
+    mu_assert(client != NULL, "AsyncClient failed");
+
+    AsyncHooks *async = client->async_hooks;
+    AddPeers(client, 1, 1);
+
+    mu_assert(Client_DrainHooks(client, 1) == 1, "Not drained");
+    mu_assert(set_rc == -1, "Ring replaced while draining");
+    mu_assert(client->async_hooks == async, "Ring freed while draining");
+
+    int rc = Dht_SetAsyncHooks(client, 0, HookOverflowDrop);
+    mu_assert(rc == 0, "Dht_SetAsyncHooks failed after draining");
+    mu_assert(client->async_hooks == NULL, "Hooks still asynchronous");
+
+    AsyncClient_Destroy(client);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
+void *DrainUntilStopped(void *arg)
+{
+    struct Drainer *drainer = arg;
+
+    while (!atomic_load(&drainer->stop))
+        drainer->events += Client_DrainHooks(drainer->client, 64);
+
+    return NULL;
+}
+
+char *test_AsyncHooks_SetWhileThreadDrains()
+{
+    Hook *hook = Hook_Create(HookAddPeer, CountPeers);
+    Client *client = AsyncClient(4096, HookOverflowDrop, hook);
+    mu_assert(client != NULL, "AsyncClient failed");
+
+    struct Drainer drainer = { .client = client };
+    pthread_t thread;
+    int rc = pthread_create(&thread, NULL, DrainUntilStopped, &drainer);
+    mu_assert(rc == 0, "pthread_create failed");
+
+    /* Each ring is replaced while the other thread may be draining */
+    int replaced = 0;
+    while (replaced < 1000)
+    {
+        AddPeers(client, 1, 1);
+
+        if (Dht_SetAsyncHooks(client, 4096, HookOverflowDrop) == 0)
+            replaced++;
+    }
+
+    atomic_store(&drainer.stop, 1);
+    pthread_join(thread, NULL);
+
+    mu_assert(client->async_state == AsyncIdle, "Left busy");
+
+    AsyncClient_Destroy(client);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
+int messages_seen = 0;
+
+void CountMessages(void *hook_client, void *args)
+{
+    (void)hook_client;
+    (void)args;
+    messages_seen++;
+}
+
+size_t batches_seen = 0;
+size_t events_seen = 0;
+
+void CountBatch(void *hook_client, void *args)
+{
+    (void)hook_client;
+    struct HookBatchData *data = args;
+
+    batches_seen++;
+    events_seen += data->count;
+}
+
+char *test_Hook_Filters()
+{
+    Hash id = { "client id" };
+    Hash wanted = { "wanted" };
+    Hash other = { "other" };
+    Client *client = Client_Create(id, 0, 0, 0);
+    Node to = {{ "node id" }};
+
+    Hook *pings = Hook_Create(HookHandleMessage, CountMessages);
+    Hook_SetMessageTypes(pings, HOOK_MESSAGE_BIT(QPing) | HOOK_MESSAGE_BIT(RPing));
+    Client_AddHook(client, pings);
+
+    Hook *swarm = Hook_Create(HookHandleMessage, CountMessages);
+    int rc = Hook_AddInfoHash(swarm, &wanted);
+    mu_assert(rc == 0, "Hook_AddInfoHash failed");
+    Client_AddHook(client, swarm);
+
+    Message *ping = Message_CreateQPing(client, &to);
+    Message *get_wanted = Message_CreateQGetPeers(client, &to, &wanted);
+    Message *get_other = Message_CreateQGetPeers(client, &to, &other);
+
+    messages_seen = 0;
+    mu_assert(Client_RunHook(client, HookHandleMessage, ping) == 1, "Ping not filtered");
+    mu_assert(Client_RunHook(client, HookHandleMessage, get_wanted) == 1,
+              "Wanted info_hash not run");
+    mu_assert(Client_RunHook(client, HookHandleMessage, get_other) == 0,
+              "Other info_hash run");
+    mu_assert(messages_seen == 2, "Wrong messages seen");
+
+    /* Peer hooks are filtered by info_hash as well */
+    Hook *peers = Hook_Create(HookAddPeer, CountMessages);
+    Hook_AddInfoHash(peers, &wanted);
+    Client_AddHook(client, peers);
+
+    Peer peer = { .addr = 1, .port = 1 };
+    Client_AddPeer(client, &other, &peer, 0);
+    Client_AddPeer(client, &wanted, &peer, 0);
+    mu_assert(messages_seen == 3, "Wrong peer hooks run");
+
+    Message_Destroy(ping);
+    Message_Destroy(get_wanted);
+    Message_Destroy(get_other);
+    Client_Destroy(client);
+    Hook_Destroy(pings);
+    Hook_Destroy(swarm);
+    Hook_Destroy(peers);
+
+    return NULL;
+}
+
+char *test_Hook_Batched()
+{
+    Hash id = { "client id" };
+    Client *client = Client_Create(id, 0, 0, 0);
+    Node to = {{ "node id" }};
+
+    mu_assert(Hook_CreateBatched(HookAddPeer, CountBatch) == NULL,
+              "Batched a hook without Messages");
+
+    Hook *hook = Hook_CreateBatched(HookSendMessage, CountBatch);
+    Hook_SetMessageTypes(hook, HOOK_MESSAGE_BIT(QFindNode));
+    Client_AddHook(client, hook);
+
+    Message *ping = Message_CreateQPing(client, &to);
+    Message *find = Message_CreateQFindNode(client, &to, &id);
+
+    int i = 0;
+    for (i = 0; i < 100; i++)
+    {
+        Client_RunHook(client, HookSendMessage, ping);
+        Client_RunHook(client, HookSendMessage, find);
+    }
+
+    mu_assert(batches_seen == 0, "Delivered before the tick");
+
+    Client_FlushHooks(client);
+    mu_assert(batches_seen == 1, "Not delivered once");
+    mu_assert(events_seen == 100, "Wrong events");
+    mu_assert(hook->events[0].message_type == QFindNode, "Wrong event");
+
+    Client_FlushHooks(client);
+    mu_assert(batches_seen == 1, "Empty batch delivered");
+
+    /* A full batch is delivered before the tick */
+    for (i = 0; i < HOOK_BATCH_MAX + 1; i++)
+        Client_RunHook(client, HookSendMessage, find);
+
+    mu_assert(batches_seen == 2, "Full batch not delivered");
+    mu_assert(hook->events_count == 1, "Wrong events left");
+
+    Message_Destroy(ping);
+    Message_Destroy(find);
+    Client_Destroy(client);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
 
     mu_run_test(test_hooks);
+    mu_run_test(test_AsyncHooks_Overflow);
+    mu_run_test(test_AsyncHooks_Thread);
+    mu_run_test(test_AsyncHooks_SetWhileDraining);
+    mu_run_test(test_AsyncHooks_SetWhileThreadDrains);
+    mu_run_test(test_Hook_Filters);
+    mu_run_test(test_Hook_Batched);
 
     return NULL;
 }
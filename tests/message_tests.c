@@ -223,8 +223,14 @@ char *test_CreateDestroy_RFindNode()
             mu_assert(Node_Same(DArray_get(found, j),
                                 message->data.rfindnode.nodes[j]),
                       "Wrong node in message");
+            mu_assert(DArray_get(found, j) != message->data.rfindnode.nodes[j],
+                      "Node not copied");
         }
 
+        /* The reply outlives the found nodes */
+        while (DArray_count(found) > 0)
+            Node_Destroy(DArray_pop(found));
+
         mu_assert(message != NULL, "Message_CreateRFindNode failed");
         mu_assert(message->type == RFindNode, "Wrong message type");
         mu_assert(Hash_Equals(&id, &message->id), "Wrong message id");
@@ -237,10 +243,6 @@ char *test_CreateDestroy_RFindNode()
         mu_assert(rc == 0, "Dht_MessageStr failed");
 
         Message_Destroy(message);
-
-        while (DArray_count(found) > 0)
-            Node_Destroy(DArray_pop(found));
-
         DArray_destroy(found);
     }
 
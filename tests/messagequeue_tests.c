@@ -0,0 +1,174 @@
+#include "minunit.h"
+#include <unistd.h>
+
+#include <dht/client.h>
+#include <dht/message_create.h>
+#include <dht/messagequeue.h>
+#include <dht/search.h>
+#include <dht/table.h>
+
+Hash id = { "client id" };
+
+char *test_MessageQueue_Lanes()
+{
+    Client *client = Client_Create(id, 0, 0, 0);
+    MessageQueue *queue = MessageQueue_Create();
+    mu_assert(queue != NULL, "MessageQueue_Create failed");
+
+    Node node = { .addr.s_addr = 1, .port = 1 };
+
+    Message *ping = Message_CreateQPing(client, &node);
+    Message *query = Message_CreateQPing(client, &node);
+    query->search = 1;          /* Serial of a running search */
+    Message *first = Message_CreateRPing(client, ping);
+    Message *second = Message_CreateRPing(client, ping);
+
+    mu_assert(MessageQueue_Lane(ping) == LaneMaintenance, "Wrong ping lane");
+    mu_assert(MessageQueue_Lane(query) == LaneSearch, "Wrong search lane");
+    mu_assert(MessageQueue_Lane(first) == LaneReply, "Wrong reply lane");
+
+    MessageQueue_Push(queue, ping);
+    MessageQueue_Push(queue, query);
+    MessageQueue_Push(queue, first);
+    MessageQueue_Push(queue, second);
+    mu_assert(MessageQueue_Count(queue) == 4, "Wrong count");
+
+    mu_assert(MessageQueue_Pop(queue) == first, "Replies not first");
+    mu_assert(MessageQueue_Pop(queue) == second, "Replies not in order");
+    mu_assert(MessageQueue_Pop(queue) == query, "Search not before pings");
+    mu_assert(MessageQueue_Pop(queue) == ping, "Ping not last");
+    mu_assert(MessageQueue_Pop(queue) == NULL, "Pop from empty");
+
+    /* Left for MessageQueue_Destroy */
+    MessageQueue_Push(queue, query);
+
+    Message_Destroy(ping);
+    Message_Destroy(first);
+    Message_Destroy(second);
+    MessageQueue_Destroy(queue);
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_MessageQueue_Full()
+{
+    Client *client = Client_Create(id, 0, 0, 0);
+    MessageQueue *queue = MessageQueue_CreateSized(3);
+    mu_assert(queue->lanes[LaneMaintenance].capacity == 4, "Not a power of 2");
+
+    Node node = { .addr.s_addr = 1, .port = 1 };
+    Message *pings[5];
+
+    int i = 0;
+    for (i = 0; i < 5; i++)
+        pings[i] = Message_CreateQPing(client, &node);
+
+    for (i = 0; i < 4; i++)
+    {
+        int rc = MessageQueue_Push(queue, pings[i]);
+        mu_assert(rc == 0, "MessageQueue_Push failed");
+    }
+
+    mu_assert(MessageQueue_IsFull(queue, LaneMaintenance), "Not full");
+    mu_assert(!MessageQueue_IsFull(queue, LaneSearch), "Wrong lane full");
+    mu_assert(MessageQueue_Push(queue, pings[4]) == -1, "Pushed when full");
+
+    /* Wraps around */
+    mu_assert(MessageQueue_Pop(queue) == pings[0], "Not FIFO");
+    mu_assert(MessageQueue_Push(queue, pings[4]) == 0, "Push after pop");
+
+    QueueLaneStats *stats = &queue->lanes[LaneMaintenance].stats;
+    mu_assert(stats->pushed == 5 && stats->rejected == 1, "Wrong stats");
+
+    for (i = 1; i < 5; i++)
+        mu_assert(MessageQueue_Pop(queue) == pings[i], "Not FIFO");
+
+    for (i = 0; i < 5; i++)
+        Message_Destroy(pings[i]);
+
+    MessageQueue_Destroy(queue);
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_MessageQueue_Delay()
+{
+    Client *client = Client_Create(id, 0, 0, 0);
+    MessageQueue *queue = MessageQueue_Create();
+
+    Node node = { .addr.s_addr = 1, .port = 1 };
+    MessageQueue_Push(queue, Message_CreateQPing(client, &node));
+
+    usleep(20 * 1000);
+    Message_Destroy(MessageQueue_Pop(queue));
+
+    QueueLaneStats *stats = &queue->lanes[LaneMaintenance].stats;
+    mu_assert(stats->max_delay_ms >= 10, "Delay not measured");
+    mu_assert(stats->delay_ms == stats->max_delay_ms, "Wrong total delay");
+    mu_assert(queue->lanes[LaneReply].stats.delay_ms == 0, "Wrong lane delay");
+
+    MessageQueue_Destroy(queue);
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_Search_Backpressure()
+{
+    Client *client = Client_Create(id, 0, 0, 0);
+    MessageQueue_Destroy(client->queries);
+    client->queries = MessageQueue_CreateSized(2);
+
+    Hash target = { "target" };
+    Search *search = Search_Create(&target);
+
+    int i = 0;
+    for (i = 0; i < 4; i++)
+    {
+        Hash node_id = target;
+        node_id.value[HASH_BYTES - 1] ^= i + 1;
+
+        Table_InsertNodeResult result = Table_InsertNode(search->table,
+                                                         Node_Create(&node_id));
+        mu_assert(result.rc == OKAdded, "Table_InsertNode failed");
+    }
+
+    /* Its queries go in the search lane by its serial */
+    int rc = Client_RunSearch(client, search);
+    mu_assert(rc == 0, "Client_RunSearch failed");
+
+    rc = Search_DoWork(client, search);
+    mu_assert(rc == 0, "Search_DoWork failed");
+    mu_assert(search->stats.queries == 2, "Queued past capacity");
+    mu_assert(MessageQueue_IsFull(client->queries, LaneSearch), "Not full");
+
+    rc = Search_DoWork(client, search);
+    mu_assert(rc == 0, "Search_DoWork failed");
+    mu_assert(search->stats.queries == 2, "Queued when full");
+
+    MessageQueue_Clear(client->queries);
+
+    rc = Search_DoWork(client, search);
+    mu_assert(search->stats.queries == 4, "Not resumed");
+
+    MessageQueue_Clear(client->queries);
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_MessageQueue_Lanes);
+    mu_run_test(test_MessageQueue_Full);
+    mu_run_test(test_MessageQueue_Delay);
+    mu_run_test(test_Search_Backpressure);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
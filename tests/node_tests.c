@@ -42,11 +42,53 @@ char *test_Node_Status()
     return NULL;
 }
 
+char *test_Node_Quality()
+{
+    Hash id = {{ 0 }};
+
+    Node *fast = Node_Create(&id);
+    Node *slow = Node_Create(&id);
+    Node *silent = Node_Create(&id);
+
+    mu_assert(Node_Score(fast) == Node_Score(silent), "Unequal new nodes");
+
+    Node_MarkReply(fast, 40);
+    Node_MarkReply(fast, 80);
+    mu_assert(fast->rtt_ms == 45, "Wrong smoothed rtt");
+
+    Node_MarkReply(slow, 900);
+    Node_MarkTimeout(silent);
+
+    mu_assert(Node_Score(fast) > Node_Score(slow), "Slow node scored higher");
+    mu_assert(Node_Score(slow) > Node_Score(silent), "Silent node scored higher");
+
+    silent->sent_ms = 1000;
+    mu_assert(Node_IsBackedOff(silent, 1000 + NODE_BACKOFF_MS - 1),
+              "Not backed off");
+    mu_assert(!Node_IsBackedOff(silent, 1000 + NODE_BACKOFF_MS),
+              "Backed off too long");
+
+    Node_MarkTimeout(silent);
+    mu_assert(Node_IsBackedOff(silent, 1000 + NODE_BACKOFF_MS),
+              "Backoff not doubled");
+
+    Node_MarkReply(silent, -1);
+    mu_assert(!Node_IsBackedOff(silent, 1000), "Backed off after reply");
+    mu_assert(silent->rtt_ms == 0, "Rtt from an untimed reply");
+
+    free(fast);
+    free(slow);
+    free(silent);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
 
     mu_run_test(test_Node_Status);
+    mu_run_test(test_Node_Quality);
 
     return NULL;
 }
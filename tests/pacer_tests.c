@@ -0,0 +1,122 @@
+#include "minunit.h"
+#include <dht/client.h>
+#include <dht/message_create.h>
+#include <dht/network.h>
+#include <dht/pacer.h>
+#include <dht/work.h>
+
+#define TESTPORT 21725
+
+char *test_Pacer_Packets()
+{
+    Pacer pacer = { 0 };
+    Pacer_Init(&pacer, 100, 0, 1000);
+
+    /* A burst of 100 ms */
+    int sent = 0;
+    while (Pacer_IsReady(&pacer, 1000))
+    {
+        Pacer_Charge(&pacer, 100);
+        sent++;
+    }
+
+    mu_assert(sent == 10, "Wrong burst");
+    mu_assert(Pacer_Wait(&pacer, 1000) == 10, "Wrong wait");
+    mu_assert(!Pacer_IsReady(&pacer, 1009), "Ready early");
+    mu_assert(Pacer_IsReady(&pacer, 1010), "Not refilled");
+
+    /* Idle time saves up no more than a burst */
+    sent = 0;
+    while (Pacer_IsReady(&pacer, 60000))
+    {
+        Pacer_Charge(&pacer, 100);
+        sent++;
+    }
+
+    mu_assert(sent == 10, "Burst exceeded");
+    mu_assert(pacer.stats.packets == 20, "Wrong packets");
+    mu_assert(pacer.stats.bytes == 2000, "Wrong bytes");
+
+    return NULL;
+}
+
+char *test_Pacer_Bytes()
+{
+    Pacer pacer = { 0 };
+    Pacer_Init(&pacer, 0, 10000, 0);
+
+    /* The budget of 1000 bytes is overspent by one datagram */
+    mu_assert(Pacer_IsReady(&pacer, 0), "Not ready");
+    Pacer_Charge(&pacer, 1500);
+    mu_assert(!Pacer_IsReady(&pacer, 0), "Ready in debt");
+
+    int64_t wait = Pacer_Wait(&pacer, 0);
+    mu_assert(wait == 51, "Wrong wait");
+    mu_assert(!Pacer_IsReady(&pacer, 50), "Debt not paid");
+    mu_assert(Pacer_IsReady(&pacer, 51), "Not ready after wait");
+
+    Pacer_Init(&pacer, 0, 0, 0);
+    Pacer_Charge(&pacer, 1 << 20);
+    mu_assert(Pacer_IsReady(&pacer, 0), "Unlimited pacer held back");
+    mu_assert(pacer.stats.packets == 2, "Stats not kept");
+
+    return NULL;
+}
+
+char *test_Client_SendPaced()
+{
+    Hash sender_id = { "sender id" };
+    Hash receiver_id = { "receiver id" };
+    Client *sender = Client_Create(sender_id, htonl(INADDR_LOOPBACK), TESTPORT, 0);
+    Client *receiver = Client_Create(receiver_id, htonl(INADDR_LOOPBACK), TESTPORT + 1, 0);
+
+    NetworkUp(sender);
+    NetworkUp(receiver);
+
+    int rc = Dht_SetSendRate(sender, 10, 0);
+    mu_assert(rc == 0, "Dht_SetSendRate failed");
+
+    int i = 0;
+    for (i = 0; i < 4; i++)
+        MessageQueue_Push(sender->queries,
+                          Message_CreateQPing(sender, &receiver->node));
+
+    rc = Client_Send(sender, sender->queries);
+    mu_assert(rc == 0, "Client_Send failed");
+    mu_assert(MessageQueue_Count(sender->queries) == 3, "Not paced");
+
+    PacerStats stats;
+    Dht_GetPacerStats(sender, &stats);
+    mu_assert(stats.packets == 1 && stats.deferred == 1, "Wrong stats");
+
+    int64_t wait = Dht_NextDeadline(sender);
+    mu_assert(wait > 0 && wait <= 100, "Wrong deadline");
+
+    rc = Dht_SetSendRate(sender, 0, 0);
+    rc = Client_Send(sender, sender->queries);
+    mu_assert(MessageQueue_Count(sender->queries) == 0, "Still paced");
+
+    Client_Receive(receiver);
+    MessageQueue_Clear(receiver->incoming);
+
+    NetworkDown(sender);
+    NetworkDown(receiver);
+
+    Client_Destroy(sender);
+    Client_Destroy(receiver);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_Pacer_Packets);
+    mu_run_test(test_Pacer_Bytes);
+    mu_run_test(test_Client_SendPaced);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -1,5 +1,8 @@
 #include "minunit.h"
+#include <math.h>
+#include <dht/bloom.h>
 #include <dht/client.h>
+#include <dht/handle.h>
 #include <dht/message_create.h>
 #include <dht/network.h>
 #include <dht/peers.h>
@@ -106,36 +109,41 @@ char *test_Peers_GetPeers()
         Peers_AddPeer(peers, &peer);
     }
 
-    DArray *result = DArray_create(sizeof(Peer *), MAXPEERS + 1);
+    Peer *result = calloc(MAXPEERS + 1, sizeof(Peer));
 
-    int rc = Peers_GetPeers(peers, result);
-    mu_assert(rc == 0, "Peers_GetPeers failed");
-    mu_assert(DArray_count(result) == MAXPEERS, "Wrong result count");
+    size_t count = Peers_GetPeers(peers, result, MAXPEERS + 1);
+    mu_assert(count == MAXPEERS, "Wrong result count");
 
     char *seen = calloc(1, MAXPEERS);
 
-    while (DArray_count(result) > 0)
+    size_t i = 0;
+    for (i = 0; i < count; i++)
     {
-        Peer *peer = DArray_pop(result);
+        Peer *peer = &result[i];
         mu_assert(seen[peer->addr] == 0, "Already seen peer");
         seen[peer->addr] = 1;
     }
 
-    DArray_destroy(result);
+    free(result);
     Peers_Destroy(peers);
     free(seen);
 
     return NULL;
 }
 
-time_t GetOldTime()
+time_t peers_time = 0;
+
+int64_t GetPeersMs(void *context)
 {
-    return 0;
+    return *(time_t *)context * 1000;
 }
 
-time_t GetNewTime()
+Clock peers_clock = { .source = GetPeersMs, .context = &peers_time };
+
+void SetPeersTime(time_t now)
 {
-    return 1;
+    peers_time = now;
+    Clock_Update(&peers_clock);
 }
 
 char *test_Peers_Clean()
@@ -147,7 +155,8 @@ char *test_Peers_Clean()
 
     int i = 0;
 
-    peers->GetTime = GetOldTime;
+    peers->clock = &peers_clock;
+    SetPeersTime(0);
 
     for (i = 0; i < old; i++)
     {
@@ -155,7 +164,7 @@ char *test_Peers_Clean()
         Peers_AddPeer(peers, &peer);
     }
 
-    peers->GetTime = GetNewTime;
+    SetPeersTime(1);
 
     const int new_bit = 0x100;
 
@@ -167,32 +176,378 @@ char *test_Peers_Clean()
 
     mu_assert(peers->count == old + new, "Wrong count");
 
-    int rc = Peers_Clean(peers, GetNewTime());
+    int rc = Peers_Clean(peers, 1);
     mu_assert(rc == 0, "Peers_Clean failed");
 
     mu_assert(peers->count == new, "Wrong count");
 
-    DArray *new_only = DArray_create(sizeof(Peer *), new);
-    rc = Peers_GetPeers(peers, new_only);
-    mu_assert(rc == 0, "Peers_GetPeers failed");
+    Peer new_only[new];
+    size_t count = Peers_GetPeers(peers, new_only, new);
+    mu_assert(count == (size_t)new, "Wrong peers count");
 
-    for (i = 0; i < DArray_count(new_only); i++)
+    for (i = 0; i < new; i++)
     {
-        Peer *peer = DArray_get(new_only, i);
+        Peer *peer = &new_only[i];
         mu_assert(peer->addr & new_bit, "Not a new peer");
+
+        mu_assert(Peers_AddPeer(peers, peer) == 0, "Peers_AddPeer failed");
+        mu_assert(peers->count == new, "Kept peer not found after clean");
     }
 
-    rc = Peers_Clean(peers, GetNewTime() + 1);
+    rc = Peers_Clean(peers, 2);
     mu_assert(rc == 0, "Peers_Clean failed");
 
     mu_assert(peers->count == 0, "Wrong count");
 
-    DArray_destroy(new_only);
     Peers_Destroy(peers);
 
     return NULL;
 }
 
+char *test_Peers_CleanOldest()
+{
+    Hash info_hash = { "info_hash" };
+    Peers *peers = Peers_Create(&info_hash);
+    peers->clock = &peers_clock;
+
+    const int count = 100;
+
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        SetPeersTime(i);
+        Peer peer = { .addr = i, .port = i };
+        Peers_AddPeer(peers, &peer);
+    }
+
+    /* Announced again, so no longer among the oldest */
+    SetPeersTime(200);
+    Peer again = { .addr = 10, .port = 10 };
+    Peers_AddPeer(peers, &again);
+
+    int rc = Peers_Clean(peers, 50);
+    mu_assert(rc == 0, "Peers_Clean failed");
+    mu_assert(peers->count == 51, "Wrong count");
+
+    Peer kept[count];
+    size_t kept_count = Peers_GetPeers(peers, kept, count);
+    mu_assert(kept_count == 51, "Wrong peers count");
+
+    for (i = 0; i < 51; i++)
+    {
+        mu_assert(kept[i].addr >= 50 || kept[i].addr == 10, "Expired peer kept");
+    }
+
+    SetPeersTime(300);
+
+    for (i = 0; i < count; i++)
+    {
+        Peer peer = { .addr = i, .port = i };
+        int before = peers->count;
+        int was_kept = i >= 50 || i == 10;
+
+        Peers_AddPeer(peers, &peer);
+        mu_assert(peers->count == before + !was_kept, "Index wrong after clean");
+    }
+
+    mu_assert(peers->count == count, "Removed peers not added again");
+
+    rc = Peers_Clean(peers, 300);
+    mu_assert(rc == 0, "Peers_Clean failed");
+    mu_assert(peers->count == count, "Updated peers removed");
+
+    rc = Peers_Clean(peers, 301);
+    mu_assert(peers->count == 0, "Wrong count");
+    mu_assert(peers->oldest == PEERS_NIL && peers->newest == PEERS_NIL, "Links left");
+
+    Peers_Destroy(peers);
+
+    return NULL;
+}
+
+char *test_Peers_Sample()
+{
+    Hash info_hash = { "info_hash" };
+    Peers *peers = Peers_Create(&info_hash);
+    RandomState *rs = RandomState_Create(42);
+
+    const int count = 100, max = 10, rounds = 1000;
+
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        Peer peer = { .addr = i, .port = i };
+        Peers_AddPeer(peers, &peer);
+    }
+
+    int picked[count];
+    memset(picked, 0, sizeof(picked));
+
+    Peer sample[max];
+
+    int round = 0;
+    for (round = 0; round < rounds; round++)
+    {
+        int rc = Peers_Sample(peers, sample, max, rs);
+        mu_assert(rc == max, "Wrong sample count");
+
+        for (i = 0; i < max; i++)
+        {
+            mu_assert(sample[i].addr < (uint32_t)count, "Unknown peer");
+            mu_assert(i == 0 || sample[i].addr != sample[i - 1].addr,
+                      "Peer sampled twice");
+            picked[sample[i].addr]++;
+        }
+    }
+
+    /* Each is expected rounds * max / count = 100 times */
+    for (i = 0; i < count; i++)
+        mu_assert(50 < picked[i] && picked[i] < 150, "Skewed sample");
+
+    Peer all[count + 1];
+    int rc = Peers_Sample(peers, all, count + 1, rs);
+    mu_assert(rc == count, "Small sets not returned whole");
+
+    RandomState_Destroy(rs);
+    Peers_Destroy(peers);
+
+    return NULL;
+}
+
+char *test_HandleQGetPeers_Budget()
+{
+    Hash id = { "id" };
+    Hash info_hash = { "info_hash" };
+    Client *client = Client_Create(id, 0, 0, 0);
+    Node from = {{ "from id" }, { 1234 }};
+
+    int i = 0;
+    for (i = 0; i < MAXPEERS; i++)
+    {
+        Peer peer = { .addr = i, .port = i };
+        Client_AddPeer(client, &info_hash, &peer, 0);
+    }
+
+    Message *query = Message_CreateQGetPeers(client, &from, &info_hash);
+    query->node = from;
+
+    Message *reply = HandleQGetPeers(client, query);
+    mu_assert(reply != NULL, "HandleQGetPeers failed");
+    mu_assert(reply->data.rgetpeers.count == CLIENT_VALUES_BUDGET / PEER_VALUE_LEN,
+              "Reply over budget");
+
+    char buffer[UDPBUFLEN];
+    int len = Message_Encode(reply, buffer, UDPBUFLEN);
+    mu_assert(0 < len && len < 1500, "Reply over a datagram");
+
+    Message_Destroy(reply);
+    Message_Destroy(query);
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_PeerStore_GetPeers()
+{
+    Hash info_hash = { "info_hash" };
+    PeerStore *store = PeerStore_Create(PEERSTORE_MAX_SIZE);
+    RandomState *rs = RandomState_Create(42);
+    Peer peer = { .addr = 1, .port = 2 }, found;
+
+    int rc = PeerStore_GetPeers(store, &info_hash, &found, 1, rs);
+    mu_assert(rc == 0, "Found peers of unknown info_hash");
+    mu_assert(List_count(store->order) == 0, "Lookup added an info_hash");
+    mu_assert(store->size == 0, "Lookup allocated");
+
+    rc = PeerStore_AddPeer(store, &info_hash, &peer, 0);
+    mu_assert(rc == 0, "PeerStore_AddPeer failed");
+    mu_assert(store->count == 1, "Wrong count");
+
+    rc = PeerStore_GetPeers(store, &info_hash, &found, 1, rs);
+    mu_assert(rc == 1, "Peer not found");
+    mu_assert(found.addr == peer.addr && found.port == peer.port, "Wrong peer");
+
+    RandomState_Destroy(rs);
+    PeerStore_Destroy(store);
+
+    return NULL;
+}
+
+size_t SumSizes(PeerStore *store)
+{
+    size_t size = 0;
+
+    LIST_FOREACH(store->order, first, next, cur)
+    {
+        size += Peers_Size(cur->value);
+    }
+
+    return size;
+}
+
+char *test_PeerStore_Evict()
+{
+    Hash hashes[] = { { "a" }, { "b" }, { "c" }, { "d" } };
+    PeerStore *store = PeerStore_Create(PEERSTORE_MAX_SIZE);
+
+    int i = 0, j = 0;
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 10; j++)
+        {
+            Peer peer = { .addr = j, .port = i };
+            int rc = PeerStore_AddPeer(store, &hashes[i], &peer, 0);
+            mu_assert(rc == 0, "PeerStore_AddPeer failed");
+        }
+    }
+
+    mu_assert(store->size == SumSizes(store), "Wrong size");
+    mu_assert(store->count == 30, "Wrong count");
+
+    /* "a" is announced again, "b" is now the least recent */
+    Peer again = { .addr = 0, .port = 0 };
+    PeerStore_AddPeer(store, &hashes[0], &again, 0);
+
+    store->max_size = store->size;
+
+    Peer peer = { .addr = 1, .port = 3 };
+    int rc = PeerStore_AddPeer(store, &hashes[3], &peer, 0);
+    mu_assert(rc == 0, "PeerStore_AddPeer failed");
+
+    mu_assert(store->evictions == 1, "Wrong evictions");
+    mu_assert(Hashmap_get(store->hashmap, &hashes[1]) == NULL, "Least recent kept");
+    mu_assert(Hashmap_get(store->hashmap, &hashes[0]) != NULL, "Recent evicted");
+    mu_assert(store->size <= store->max_size, "Over max_size");
+    mu_assert(store->size == SumSizes(store), "Wrong size after eviction");
+    mu_assert(store->count == 21, "Wrong count after eviction");
+
+    rc = PeerStore_Clean(store, time(NULL) + PEERSTORE_TTL + 120);
+    mu_assert(rc == 0, "PeerStore_Clean failed");
+    mu_assert(List_count(store->order) == 0, "Empty info_hashes kept");
+    mu_assert(store->size == 0 && store->count == 0, "Wrong usage after clean");
+
+    PeerStore_Destroy(store);
+
+    return NULL;
+}
+
+char *test_PeerStore_Wheel()
+{
+    Hash info_hash = { "a" };
+    PeerStore *store = PeerStore_Create(PEERSTORE_MAX_SIZE);
+    time_t now = time(NULL);
+
+    Peer first = { .addr = 1, .port = 1 };
+    int rc = PeerStore_AddPeer(store, &info_hash, &first, 0);
+    mu_assert(rc == 0, "PeerStore_AddPeer failed");
+
+    Peers *peers = Hashmap_get(store->hashmap, &info_hash);
+    peers->clock = &peers_clock;
+    SetPeersTime(now + 600);
+
+    Peer second = { .addr = 2, .port = 2 };
+    rc = PeerStore_AddPeer(store, &info_hash, &second, 0);
+    mu_assert(rc == 0, "PeerStore_AddPeer failed");
+
+    rc = PeerStore_Clean(store, now + PEERSTORE_TTL - 60);
+    mu_assert(rc == 0, "PeerStore_Clean failed");
+    mu_assert(store->count == 2, "Peers expired early");
+
+    rc = PeerStore_Clean(store, now + PEERSTORE_TTL + 120);
+    mu_assert(rc == 0, "PeerStore_Clean failed");
+    mu_assert(store->count == 1, "Oldest peer not expired");
+    mu_assert(peers->wheel_entry != NULL, "Peers not moved on");
+    mu_assert(peers->wheel_slot
+              == (peers_time / 60) % PEERSTORE_WHEEL_SLOTS, "Wrong slot");
+
+    rc = PeerStore_Clean(store, peers_time + PEERSTORE_TTL + 120);
+    mu_assert(rc == 0, "PeerStore_Clean failed");
+    mu_assert(store->count == 0 && store->size == 0, "Peers not expired");
+    mu_assert(List_count(store->order) == 0, "Empty info_hash kept");
+
+    int i = 0;
+    for (i = 0; i < PEERSTORE_WHEEL_SLOTS; i++)
+    {
+        mu_assert(List_count(store->wheel[i]) == 0, "Wheel not empty");
+    }
+
+    PeerStore_Destroy(store);
+
+    return NULL;
+}
+
+char *test_Peers_Scrape()
+{
+    Hash info_hash = { "info_hash" };
+    Peers *peers = Peers_Create(&info_hash);
+    Bloom seeds, others;
+
+    int i = 0;
+    for (i = 0; i < 30; i++)
+    {
+        Peer peer = { .addr = i, .port = i };
+        Peers_AnnouncePeer(peers, &peer, i < 10);
+    }
+
+    int rc = Peers_Scrape(peers, &seeds, &others);
+    mu_assert(rc == 0, "Peers_Scrape failed");
+    mu_assert(!peers->blooms_stale, "Stale after scrape");
+    mu_assert(fabs(Bloom_Estimate(&seeds) - 10) < 1, "Wrong seeds");
+    mu_assert(fabs(Bloom_Estimate(&others) - 20) < 2, "Wrong peers");
+
+    /* Added to the filters as they come */
+    Peer peer = { .addr = 30, .port = 30 };
+    Peers_AnnouncePeer(peers, &peer, 1);
+    mu_assert(!peers->blooms_stale, "Stale after add");
+
+    /* A peer turned seed makes them stale */
+    peer = (Peer){ .addr = 29, .port = 29 };
+    Peers_AnnouncePeer(peers, &peer, 1);
+    mu_assert(peers->blooms_stale, "Not stale after seeding");
+
+    Peers_Clean(peers, time(NULL) + 1);
+
+    rc = Peers_Scrape(peers, &seeds, &others);
+    mu_assert(rc == 0, "Peers_Scrape failed");
+    mu_assert(Bloom_Estimate(&seeds) == 0 && Bloom_Estimate(&others) == 0,
+              "Removed peers in filters");
+
+    Peers_Destroy(peers);
+
+    return NULL;
+}
+
+char *test_PeerFilter_Add()
+{
+    PeerFilter *filter = PeerFilter_Create(0);
+    mu_assert(filter != NULL, "PeerFilter_Create failed");
+
+    const int count = 1000;
+
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        Peer peer = { .addr = i, .port = i % 7 };
+        mu_assert(PeerFilter_Add(filter, &peer) == 1, "New peer not added");
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        Peer peer = { .addr = i, .port = i % 7 };
+        mu_assert(PeerFilter_Add(filter, &peer) == 0, "Seen peer added");
+    }
+
+    Peer zero = { 0 };
+    mu_assert(PeerFilter_Add(filter, &zero) == 0, "Zero peer not seen");
+
+    mu_assert(filter->count == (size_t)count, "Wrong count");
+    mu_assert(filter->count * 2 <= filter->size, "Filter too full");
+
+    PeerFilter_Destroy(filter);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
@@ -202,6 +557,14 @@ char *all_tests()
     mu_run_test(test_Peers_RepeatAdd);
     mu_run_test(test_Peers_GetPeers);
     mu_run_test(test_Peers_Clean);
+    mu_run_test(test_Peers_CleanOldest);
+    mu_run_test(test_Peers_Sample);
+    mu_run_test(test_PeerStore_GetPeers);
+    mu_run_test(test_PeerStore_Evict);
+    mu_run_test(test_PeerStore_Wheel);
+    mu_run_test(test_HandleQGetPeers_Budget);
+    mu_run_test(test_Peers_Scrape);
+    mu_run_test(test_PeerFilter_Add);
 
     return NULL;
 }
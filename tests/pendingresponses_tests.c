@@ -84,6 +84,48 @@ char *test_addremove()
     return NULL;
 }    
 
+int CountExpired(int *count, PendingResponse *entry)
+{
+    (void)entry;
+    (*count)++;
+
+    return 0;
+}
+
+char *test_expire()
+{
+    HashmapPendingResponses *responses = HashmapPendingResponses_Create();
+    mu_assert(responses != NULL, "Hashmappendingresponses_Create failed");
+
+    tid_t tid = 0;
+    for (tid = 1; tid <= 4; tid++)
+    {
+        PendingResponse entry = { .type = RPing, .tid = tid, .sent_ms = tid * 100 };
+        int rc = responses->addPendingResponse(responses, entry);
+        mu_assert(rc == 0, "HashmapPendingResponses_Add failed");
+    }
+
+    int count = 0;
+    int rc = HashmapPendingResponses_Expire(responses,
+                                            300,
+                                            &count,
+                                            (PendingResponseOp)CountExpired);
+    mu_assert(rc == 0, "HashmapPendingResponses_Expire failed");
+    mu_assert(count == 2, "Wrong expired count");
+
+    tid = 1;
+    responses->getPendingResponse(responses, (char *)&tid, &rc);
+    mu_assert(rc == -1, "Expired entry still pending");
+
+    tid = 3;
+    responses->getPendingResponse(responses, (char *)&tid, &rc);
+    mu_assert(rc == 0, "Unexpired entry missing");
+
+    HashmapPendingResponses_Destroy(responses);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
@@ -92,6 +134,7 @@ char *all_tests()
     mu_run_test(test_destroy_with_entries);
     mu_run_test(test_compare);
     mu_run_test(test_addremove);
+    mu_run_test(test_expire);
 
     return NULL;
 }
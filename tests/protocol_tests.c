@@ -36,12 +36,14 @@ char *check_Message(Message *message, MessageType type)
     case QFindNode:
     case QGetPeers:
     case QAnnouncePeer:
+    case QSampleInfohashes:
 	mu_assert(same_bytes(qid, message->id.value), "Wrong query id");
 	break;
     case RPing:
     case RFindNode:
     case RGetPeers:
     case RAnnouncePeer:
+    case RSampleInfohashes:
 	mu_assert(same_bytes(rid, message->id.value), "Wrong reply id");
 	break;
     case RError:
@@ -605,6 +607,12 @@ PendingResponse GetRoundtripResponseMessageType(void *responses, char *t, int *r
         return (PendingResponse) { RAnnouncePeer, *(tid_t *)t, id, NULL };
     }
 
+    if (same_bytes_len("si", t, sizeof(tid_t)))
+    {
+        *rc = 0;
+        return (PendingResponse) { RSampleInfohashes, *(tid_t *)t, id, NULL };
+    }
+
     *rc = -1;
     return (PendingResponse) { 0 };
 }
@@ -616,11 +624,17 @@ char *test_Roundtrip()
 	"d1:ad2:id20:abcdefghij01234567896:target20:mnopqrstuvwxyz123456e1:q9:find_node1:t2:aa1:y1:qe",
 	"d1:ad2:id20:abcdefghij01234567899:info_hash20:mnopqrstuvwxyz123456e1:q9:get_peers1:t2:aa1:y1:qe",
 	"d1:ad2:id20:abcdefghij01234567899:info_hash20:mnopqrstuvwxyz1234564:porti6881e5:token8:aoeusnthe1:q13:announce_peer1:t2:aa1:y1:qe",
+	"d1:ad2:id20:abcdefghij012345678912:implied_porti1e9:info_hash20:mnopqrstuvwxyz1234564:porti6881e5:token8:aoeusnthe1:q13:announce_peer1:t2:aa1:y1:qe",
+	"d1:ad2:id20:abcdefghij01234567899:info_hash20:mnopqrstuvwxyz1234566:scrapei1ee1:q9:get_peers1:t2:aa1:y1:qe",
+	"d1:ad2:id20:abcdefghij01234567899:info_hash20:mnopqrstuvwxyz1234564:porti6881e4:seedi1e5:token8:aoeusnthe1:q13:announce_peer1:t2:aa1:y1:qe",
+	"d1:ad2:id20:abcdefghij01234567896:target20:mnopqrstuvwxyz123456e1:q17:sample_infohashes1:t2:aa1:y1:qe",
 	"d1:rd2:id20:abcdefghij0123456789e1:t2:pi1:y1:re",
 	"d1:rd2:id20:abcdefghij01234567895:nodes52:01234567890123456789ABCDEF????????????????????xxxxyye1:t2:fn1:y1:re",
 	"d1:rd2:id20:abcdefghij01234567895:nodes208:012345678901234567890xxxy0112345678901234567891xxxy1212345678901234567892xxxy2312345678901234567893xxxy3412345678901234567894xxxy4512345678901234567895xxxy5612345678901234567896xxxy6712345678901234567897xxxy75:token8:aoeusnthe1:t2:gp1:y1:re",
 	"d1:rd2:id20:abcdefghij01234567895:token8:aoeusnth6:valuesl6:0xxxy06:1xxxy16:2xxxy2ee1:t2:gp1:y1:re",
 	"d1:rd2:id20:abcdefghij0123456789e1:t2:ap1:y1:re",
+	"d1:rd2:id20:abcdefghij01234567898:intervali300e5:nodes26:01234567890123456789xxxxyy3:numi2e7:samples40:mnopqrstuvwxyz123456abcdefghij0123456789e1:t2:si1:y1:re",
+	"d1:rd2:id20:abcdefghij01234567898:intervali0e3:numi1234567e7:samples0:e1:t2:si1:y1:re",
 	"d1:eli201e23:A Generic Error Ocurrede1:t2:ee1:y1:ee",
 	NULL
     };
@@ -658,6 +672,58 @@ char *test_Roundtrip()
     return NULL;
 }
 
+char *test_Roundtrip_Scrape()
+{
+    char bfpe[BLOOM_BYTES + 1], bfsd[BLOOM_BYTES + 1];
+
+    memset(bfpe, 'p', BLOOM_BYTES);
+    memset(bfsd, 's', BLOOM_BYTES);
+    bfpe[BLOOM_BYTES] = bfsd[BLOOM_BYTES] = '\0';
+
+    bstring nodes = bformat("d1:rd4:BFpe256:%s4:BFsd256:%s2:id20:abcdefghij0123456789"
+                            "5:nodes26:01234567890123456789xxxxyy"
+                            "5:token8:aoeusnthe1:t2:gp1:y1:re", bfpe, bfsd);
+    bstring alone = bformat("d1:rd4:BFpe256:%s4:BFsd256:%s2:id20:abcdefghij0123456789"
+                            "5:token8:aoeusnthe1:t2:gp1:y1:re", bfpe, bfsd);
+    bstring input[] = { nodes, alone };
+
+    struct PendingResponses responses = { .getPendingResponse = GetRoundtripResponseMessageType };
+
+    int i = 0;
+    for (i = 0; i < 2; i++)
+    {
+        int len = blength(input[i]);
+
+        Message *message = Message_Decode(bdata(input[i]), len, &responses);
+        mu_assert(message != NULL, "Decode failed");
+        mu_assert(message->errors == 0, "Decode errors");
+
+        RGetPeersData *data = &message->data.rgetpeers;
+        mu_assert(data->seeds != NULL && data->peers != NULL, "Missing blooms");
+        mu_assert(data->seeds->bits[0] == 's' && data->peers->bits[0] == 'p',
+                  "Wrong blooms");
+
+        /* We always send the closest nodes along */
+        if (data->nodes != NULL)
+        {
+            char *dest = calloc(1, len);
+            mu_assert(dest != NULL, "calloc failed");
+
+            int rc = Message_Encode(message, dest, len);
+            mu_assert(rc == len, "Encoded wrong length");
+            mu_assert(same_bytes_len(bdata(input[i]), dest, len), "Roundtrip failed");
+
+            free(dest);
+        }
+
+        Message_DestroyNodes(message);
+        Message_Destroy(message);
+        bdestroy(input[i]);
+    }
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
@@ -678,6 +744,7 @@ char *all_tests()
     mu_run_test(test_Decode_JunkResponse_find_node);
     mu_run_test(test_Decode_JunkResponse_get_peers);
     mu_run_test(test_Roundtrip);
+    mu_run_test(test_Roundtrip_Scrape);
 
     return NULL;
 }
@@ -0,0 +1,46 @@
+#include "minunit.h"
+#include <dht/rtt.h>
+
+char *test_RttStats_Timeout()
+{
+    RttStats stats;
+    RttStats_Init(&stats);
+
+    mu_assert(RttStats_Timeout(&stats) == RTT_TIMEOUT_DEFAULT, "Wrong default");
+    mu_assert(RttStats_Percentile(&stats, 50) == -1, "Percentile of nothing");
+
+    int i = 0;
+    for (i = 1; i < RTT_MIN_SAMPLES; i++)
+        RttStats_Add(&stats, 10 * i);
+
+    mu_assert(RttStats_Timeout(&stats) == RTT_TIMEOUT_DEFAULT,
+              "Timeout from too few samples");
+
+    for (i = 0; i < RTT_SAMPLES; i++)
+        RttStats_Add(&stats, 1000 + i % 10);
+
+    mu_assert(stats.count == RTT_SAMPLES, "Wrong count");
+    mu_assert(RttStats_Percentile(&stats, 0) == 1000, "Wrong minimum");
+    mu_assert(RttStats_Percentile(&stats, 100) == 1009, "Wrong maximum");
+    mu_assert(RttStats_Timeout(&stats)
+              == RTT_FACTOR * RttStats_Percentile(&stats, RTT_PERCENTILE),
+              "Wrong timeout");
+
+    for (i = 0; i < RTT_SAMPLES; i++)
+        RttStats_Add(&stats, 1);
+
+    mu_assert(RttStats_Timeout(&stats) == RTT_TIMEOUT_MIN, "Timeout below min");
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_RttStats_Timeout);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -1,4 +1,5 @@
 #include "minunit.h"
+#include <dht/clock.h>
 #include <dht/table.h>
 #include <dht/search.h>
 
@@ -108,6 +109,99 @@ char *test_Search_SetGetToken()
     return NULL;
 }
 
+char *test_Search_AddPeers()
+{
+    Hash id = { "search peers" };
+    Search *search = Search_Create(&id);
+
+    Peer peers[] = { { 1, 1 }, { 2, 2 }, { 1, 1 }, { 3, 3 }, { 2, 2 } };
+    Peer fresh[5];
+
+    int rc = Search_AddPeers(search, peers, 5, fresh);
+    mu_assert(rc == 3, "Wrong fresh count");
+    mu_assert(fresh[0].addr == 1 && fresh[1].addr == 2 && fresh[2].addr == 3,
+              "Wrong fresh peers");
+    mu_assert(search->peers->count == 3, "Wrong peers count");
+
+    rc = Search_AddPeers(search, peers, 5, peers);
+    mu_assert(rc == 0, "Peers delivered twice");
+    mu_assert(!Search_IsDone(search, 0, 0), "Done without max_peers");
+
+    Search_Destroy(search);
+
+    return NULL;
+}
+
+char *test_Search_MaxPeers()
+{
+    Hash id = { "search max peers" };
+    Search *search = Search_Create(&id);
+    search->max_peers = 2;
+
+    Peer peers[] = { { 1, 1 }, { 2, 2 }, { 3, 3 } };
+
+    int rc = Search_AddPeers(search, peers, 3, peers);
+    mu_assert(rc == 2, "Wrong fresh count");
+    mu_assert(search->is_done, "Search not done");
+    mu_assert(Search_IsDone(search, 0, 0), "Search_IsDone not done");
+
+    Search_Destroy(search);
+
+    return NULL;
+}
+
+char *test_Search_IsDone()
+{
+    Hash id = { "client id" };
+    Hash target = { "converging search" };
+    Client *client = Client_Create(id, 0, 0, 0);
+    Search *search = Search_Create(&target);
+
+    Node *nodes[2];
+    int i = 0;
+    for (i = 0; i < 2; i++)
+    {
+        Hash node_id = target;
+        node_id.value[HASH_BYTES - 1] ^= i + 1;
+
+        nodes[i] = Node_Create(&node_id);
+        Table_InsertNodeResult result = Table_InsertNode(search->table, nodes[i]);
+        mu_assert(result.rc == OKAdded, "Table_InsertNode failed");
+    }
+
+    int rc = Search_DoWork(client, search);
+    mu_assert(rc == 0, "Search_DoWork failed");
+    mu_assert(search->stats.queries == 2, "Expected one query per node");
+    mu_assert(MessageQueue_Count(client->queries) == 2, "Wrong queued count");
+
+    rc = Search_DoWork(client, search);
+    mu_assert(search->stats.queries == 2, "Pending queries sent again");
+
+    int64_t now = Clock_Ms();
+    const int64_t timeout = 1000;
+
+    mu_assert(!Search_IsDone(search, now, timeout), "Done while waiting");
+
+    nodes[0]->pending_queries = 0;
+    nodes[0]->rgetpeers_count = 1;
+
+    mu_assert(!Search_IsDone(search, now, timeout), "Done with one pending");
+    mu_assert(!Search_IsDone(search, now + timeout, timeout),
+              "Timed out while still queued");
+
+    Search_MarkSent(search, &nodes[1]->id, now);
+
+    mu_assert(!Search_IsDone(search, now + timeout - 1, timeout),
+              "Timed out before the timeout");
+    mu_assert(Search_IsDone(search, now + timeout, timeout),
+              "Not done after timeout");
+
+    Search_Destroy(search);
+    Client_Destroy(client);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
@@ -115,6 +209,9 @@ char *all_tests()
     mu_run_test(test_Search_CreateDestroy);
     mu_run_test(test_Search_CopyTable);
     mu_run_test(test_Search_SetGetToken);
+    mu_run_test(test_Search_AddPeers);
+    mu_run_test(test_Search_MaxPeers);
+    mu_run_test(test_Search_IsDone);
 
     return NULL;
 }
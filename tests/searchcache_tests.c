@@ -0,0 +1,226 @@
+#include "minunit.h"
+#include <dht/client.h>
+#include <dht/hooks.h>
+#include <dht/message.h>
+#include <dht/searchcache.h>
+#include <dht/table.h>
+#include <dht/work.h>
+
+Search *FinishedSearch(Hash *id, int peers_count)
+{
+    Search *search = Search_Create(id);
+    check(search != NULL, "Search_Create failed");
+
+    int i = 0;
+    for (i = 0; i < peers_count; i++)
+    {
+        Peer peer = { .addr = 100 + i, .port = 100 + i };
+        int rc = Search_AddPeers(search, &peer, 1, &peer);
+        check(rc == 1, "Search_AddPeers failed");
+    }
+
+    Hash node_id = *id;
+    node_id.value[HASH_BYTES - 1] ^= 1;
+
+    Node *node = Node_Create(&node_id);
+    check(node != NULL, "Node_Create failed");
+
+    node->reply_time = time(NULL);
+    node->rgetpeers_count = 1;
+
+    Table_InsertNodeResult result = Table_InsertNode(search->table, node);
+    check(result.rc == OKAdded, "Table_InsertNode failed");
+
+    char data[] = "token";
+    struct FToken token = { .data = data, .len = sizeof(data) };
+    int rc = Search_SetToken(search, &node_id, token);
+    check(rc == 0, "Search_SetToken failed");
+
+    return search;
+error:
+    return NULL;
+}
+
+char *test_SearchCache_PutGet()
+{
+    Hash id = { "cached info_hash" };
+    Hash other = { "not cached" };
+    SearchCache *cache = SearchCache_Create(60, 1 << 16);
+    mu_assert(cache != NULL, "SearchCache_Create failed");
+
+    Search *search = FinishedSearch(&id, 3);
+    mu_assert(search != NULL, "FinishedSearch failed");
+
+    int rc = SearchCache_Put(cache, search, 1000);
+    mu_assert(rc == 0, "SearchCache_Put failed");
+    mu_assert(cache->size > 0, "Size not accounted");
+
+    SearchResult *result = SearchCache_Get(cache, &id, 0, 1060);
+    mu_assert(result != NULL, "Missing result");
+    mu_assert(result->peers_count == 3, "Wrong peers count");
+    mu_assert(result->nodes_count == 1, "Wrong nodes count");
+    mu_assert(result->nodes[0].token.len == sizeof("token"), "Wrong token");
+
+    mu_assert(SearchCache_Get(cache, &other, 0, 1060) == NULL, "Unexpected result");
+    mu_assert(SearchCache_Get(cache, &id, 0, 1061) == NULL, "Result not expired");
+
+    mu_assert(cache->hits == 1, "Wrong hits");
+    mu_assert(cache->misses == 2, "Wrong misses");
+    mu_assert(cache->size == 0, "Size not released");
+
+    Search_Destroy(search);
+    SearchCache_Destroy(cache);
+
+    return NULL;
+}
+
+char *test_SearchCache_MaxPeers()
+{
+    Hash id = { "stopped early" };
+    Hash other = { "found fewer" };
+    SearchCache *cache = SearchCache_Create(60, 1 << 16);
+    mu_assert(cache != NULL, "SearchCache_Create failed");
+
+    /* Stopped at its limit, with more peers left to find */
+    Search *search = FinishedSearch(&id, 2);
+    mu_assert(search != NULL, "FinishedSearch failed");
+    search->max_peers = 2;
+
+    int rc = SearchCache_Put(cache, search, 1000);
+    mu_assert(rc == 0, "SearchCache_Put failed");
+
+    mu_assert(SearchCache_Get(cache, &id, 0, 1000) == NULL,
+              "Partial result served without a limit");
+    mu_assert(SearchCache_Get(cache, &id, 3, 1000) == NULL,
+              "Partial result served to a higher limit");
+    mu_assert(SearchCache_Get(cache, &id, 2, 1000) != NULL,
+              "Partial result not served to the same limit");
+    mu_assert(SearchCache_Get(cache, &id, 1, 1000) != NULL,
+              "Partial result not served to a lower limit");
+
+    Search_Destroy(search);
+
+    /* Ended below its limit, so it found all there were */
+    search = FinishedSearch(&other, 2);
+    mu_assert(search != NULL, "FinishedSearch failed");
+    search->max_peers = 3;
+
+    rc = SearchCache_Put(cache, search, 1000);
+    mu_assert(rc == 0, "SearchCache_Put failed");
+    mu_assert(SearchCache_Get(cache, &other, 0, 1000) != NULL,
+              "Complete result not served");
+
+    mu_assert(cache->hits == 3, "Wrong hits");
+    mu_assert(cache->misses == 2, "Wrong misses");
+
+    Search_Destroy(search);
+    SearchCache_Destroy(cache);
+
+    return NULL;
+}
+
+char *test_SearchCache_MaxSize()
+{
+    Hash first = { "first" };
+    Hash second = { "second" };
+
+    Search *search = FinishedSearch(&first, 8);
+    mu_assert(search != NULL, "FinishedSearch failed");
+
+    SearchCache *cache = SearchCache_Create(60, 0);
+    int rc = SearchCache_Put(cache, search, 1000);
+    mu_assert(rc == 0, "SearchCache_Put failed");
+
+    size_t size = cache->size;
+    mu_assert(size == 0, "Zero max_size kept a result");
+
+    SearchCache_Destroy(cache);
+
+    cache = SearchCache_Create(60, 1 << 16);
+    rc = SearchCache_Put(cache, search, 1000);
+    size = cache->size;
+    cache->max_size = size + size / 2;
+    Search_Destroy(search);
+
+    search = FinishedSearch(&second, 8);
+    rc = SearchCache_Put(cache, search, 1001);
+    mu_assert(rc == 0, "SearchCache_Put failed");
+
+    mu_assert(cache->size == size, "Oldest not evicted");
+    mu_assert(SearchCache_Get(cache, &first, 0, 1001) == NULL, "Oldest kept");
+    mu_assert(SearchCache_Get(cache, &second, 0, 1001) != NULL, "Newest evicted");
+
+    Search_Destroy(search);
+    SearchCache_Destroy(cache);
+
+    return NULL;
+}
+
+size_t new_peers = 0;
+
+void CountNewPeers(void *client, void *args)
+{
+    (void)client;
+    new_peers += ((struct HookPeerData *)args)->count;
+}
+
+char *test_Client_SeedSearch()
+{
+    Hash id = { "client id" };
+    Hash target = { "target" };
+    Client *client = Client_Create(id, 0, 0, 0);
+    mu_assert(client != NULL, "Client_Create failed");
+
+    Hook *hook = Hook_Create(HookNewPeer, CountNewPeers);
+    Client_AddHook(client, hook);
+
+    Search *finished = FinishedSearch(&target, 4);
+    int rc = SearchCache_Put(client->cache, finished, time(NULL));
+    mu_assert(rc == 0, "SearchCache_Put failed");
+    Search_Destroy(finished);
+
+    SearchRequest requests[] = { { .info_hash = target, .flags = SearchLookup },
+                                 { .info_hash = target, .flags = SearchAnnounce } };
+    rc = Client_AddSearches(client, requests, 2);
+    mu_assert(rc == 0, "Client_AddSearches failed");
+
+    rc = Client_StartSearches(client);
+    mu_assert(rc == 0, "Client_StartSearches failed");
+
+    mu_assert(client->cache->hits == 2, "Wrong hits");
+    mu_assert(new_peers == 8, "Cached peers not delivered");
+
+    Search *lookup = requests[0].search;
+    Search *announce = requests[1].search;
+
+    mu_assert(lookup->is_cached && announce->is_cached, "Not seeded");
+    mu_assert(Search_IsDone(lookup, 0, 0), "Lookup not answered");
+    mu_assert(!Search_IsDone(announce, 0, 0), "Announce done");
+
+    rc = Search_DoWork(client, announce);
+    mu_assert(rc == 0, "Search_DoWork failed");
+    mu_assert(MessageQueue_Count(client->queries) == 1, "Expected one query");
+
+    Message *query = MessageQueue_Pop(client->queries);
+    mu_assert(query->type == QAnnouncePeer, "Expected an announce only");
+    Message_Destroy(query);
+
+    Client_Destroy(client);
+    Hook_Destroy(hook);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_SearchCache_PutGet);
+    mu_run_test(test_SearchCache_MaxPeers);
+    mu_run_test(test_SearchCache_MaxSize);
+    mu_run_test(test_Client_SeedSearch);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,177 @@
+#include "minunit.h"
+#include <dht/client.h>
+#include <dht/hooks.h>
+#include <dht/search.h>
+#include <dht/simnet.h>
+
+#define CLIENTS 64
+
+Hash RandomId(RandomState *random)
+{
+    Hash id = {{ 0 }};
+    Random_Fill(random, id.value, HASH_BYTES);
+
+    return id;
+}
+
+/* Each client bootstraps from the first one. */
+SimNet *CreateNet(SimNetConfig *config, size_t count)
+{
+    RandomState *random = RandomState_Create(config->seed);
+    check(random != NULL, "RandomState_Create failed");
+
+    SimNet *net = SimNet_Create(config);
+    check(net != NULL, "SimNet_Create failed");
+
+    Seed first = SimNet_Seed(net, 0);
+
+    size_t i = 0;
+    for (i = 0; i < count; i++)
+    {
+        Hash id = RandomId(random);
+        Client *client = SimNet_AddClient(net, &id);
+        check(client != NULL, "SimNet_AddClient failed");
+
+        if (i > 0)
+        {
+            int rc = Dht_AddSeeds(client, &first, 1);
+            check(rc == 0, "Dht_AddSeeds failed");
+        }
+    }
+
+    RandomState_Destroy(random);
+
+    return net;
+error:
+    return NULL;
+}
+
+Client *GetClient(SimNet *net, size_t index)
+{
+    return ((SimEndpoint *)DArray_get(net->endpoints, index))->client;
+}
+
+SearchStats done_stats;
+int done = 0;
+
+void SearchDone(void *client, void *search)
+{
+    (void)client;
+    Dht_GetSearchStats(search, &done_stats);
+    done++;
+}
+
+char *test_SimNet_Lookup()
+{
+    SimNetConfig config = { .latency_ms = 20, .jitter_ms = 10, .seed = 1 };
+    SimNet *net = CreateNet(&config, CLIENTS);
+    mu_assert(net != NULL, "CreateNet failed");
+
+    int rc = SimNet_Run(net, net->now_ms + 60 * 1000);
+    mu_assert(rc == 0, "SimNet_Run failed");
+
+    size_t i = 0;
+    for (i = 1; i < CLIENTS; i++)
+    {
+        BootstrapStats stats;
+        Dht_GetBootstrapStats(GetClient(net, i), &stats);
+        mu_assert(stats.ready_ms >= 0, "Table not ready");
+        mu_assert(stats.replies > 0, "No replies");
+    }
+
+    Client *client = GetClient(net, 7);
+    Client *target = GetClient(net, 40);
+
+    Hook *hook = Hook_Create(HookSearchDone, SearchDone);
+    Dht_AddHook(client, hook);
+
+    mu_assert(Dht_AddSearch(client, target->node.id) != NULL, "Dht_AddSearch failed");
+    SimNet_Wake(net, 7);
+
+    rc = SimNet_Run(net, net->now_ms + 30 * 1000);
+    mu_assert(rc == 0, "SimNet_Run failed");
+
+    mu_assert(done == 1, "Search not done");
+    mu_assert(done_stats.replies > 0, "No replies");
+    mu_assert(done_stats.hops > 0, "No hops");
+    mu_assert(done_stats.duration_ms >= 40, "Faster than the latency");
+
+    mu_assert(net->stats.delivered == net->stats.sent, "Datagrams lost");
+    mu_assert(net->stats.processed > 0, "Nothing processed");
+
+    Dht_RemoveHook(client, hook);
+    Hook_Destroy(hook);
+    SimNet_Destroy(net);
+
+    return NULL;
+}
+
+char *test_SimNet_Deterministic()
+{
+    SimNetConfig config = { .latency_ms = 10, .jitter_ms = 50, .loss = 0.1, .seed = 2 };
+    SimNetStats stats[2];
+
+    int i = 0;
+    for (i = 0; i < 2; i++)
+    {
+        SimNet *net = CreateNet(&config, 16);
+        mu_assert(net != NULL, "CreateNet failed");
+
+        int rc = SimNet_Run(net, net->now_ms + 20 * 1000);
+        mu_assert(rc == 0, "SimNet_Run failed");
+
+        stats[i] = net->stats;
+        SimNet_Destroy(net);
+    }
+
+    mu_assert(stats[0].lost > 0, "Nothing lost");
+    mu_assert(memcmp(&stats[0], &stats[1], sizeof(SimNetStats)) == 0,
+              "Runs differ");
+
+    return NULL;
+}
+
+char *test_SimNet_Nat()
+{
+    SimNetConfig config = { .latency_ms = 10, .nat = 1, .nat_timeout_ms = 30000 };
+    SimNet *net = CreateNet(&config, 3);
+    mu_assert(net != NULL, "CreateNet failed");
+
+    Client *first = GetClient(net, 0);
+    Client *second = GetClient(net, 1);
+
+    /* Seeds behind a NAT drop the unsolicited pings */
+    int rc = SimNet_Run(net, net->now_ms + 1000);
+    mu_assert(rc == 0, "SimNet_Run failed");
+    mu_assert(net->stats.nat_dropped == 2, "Pings not dropped");
+    mu_assert(net->stats.delivered == 0, "Delivered through the NAT");
+
+    /* Pinging each other opens both */
+    Dht_AddNode(first, second->node.addr.s_addr, second->node.port);
+    Dht_AddNode(second, first->node.addr.s_addr, first->node.port);
+    SimNet_Wake(net, 0);
+    SimNet_Wake(net, 1);
+
+    rc = SimNet_Run(net, net->now_ms + 1000);
+    mu_assert(rc == 0, "SimNet_Run failed");
+    mu_assert(net->stats.delivered >= 4, "Pings and replies not delivered");
+    mu_assert(net->stats.nat_dropped == 2, "Dropped with a mapping");
+    mu_assert(first->table->buckets[0]->count == 1, "Node not added");
+
+    SimNet_Destroy(net);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_SimNet_Lookup);
+    mu_run_test(test_SimNet_Deterministic);
+    mu_run_test(test_SimNet_Nat);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,167 @@
+#include <stdio.h>
+
+#include "minunit.h"
+#include <dht/client.h>
+#include <dht/snapshot.h>
+#include <dht/work.h>
+
+#define SNAPSHOT_PATH "tests/snapshot.tmp"
+
+Table *SavedTable(Hash *id, int count)
+{
+    Table *table = Table_Create(id);
+    check(table != NULL, "Table_Create failed");
+
+    int i = 0;
+    for (i = 0; i < count; i++)
+    {
+        Hash node_id = *id;
+        node_id.value[i / 8] ^= 0x80 >> (i % 8);
+
+        Node node = { .id = node_id,
+                      .addr.s_addr = 0x0100007f,
+                      .port = htons(6881 + i),
+                      .reply_time = time(NULL) - 60 - i,
+                      .rtt_ms = 100 + i,
+                      .replies = i };
+
+        int rc = Table_CopyAndAddNode(table, &node);
+        check(rc == 0, "Table_CopyAndAddNode failed");
+    }
+
+    return table;
+error:
+    return NULL;
+}
+
+int CompareNode(Table *other, Node *node)
+{
+    Node *found = Table_FindNode(other, &node->id);
+
+    if (found == NULL
+        || !Node_Same(found, node)
+        || found->reply_time != node->reply_time
+        || found->rtt_ms != node->rtt_ms
+        || found->replies != node->replies)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+char *test_Snapshot_WriteRead()
+{
+    Hash id = { "snapshot id" };
+    Table *table = SavedTable(&id, 40);
+    mu_assert(table != NULL, "SavedTable failed");
+
+    int rc = Snapshot_Write(table, SNAPSHOT_PATH);
+    mu_assert(rc == 0, "Snapshot_Write failed");
+
+    Table *read = Snapshot_Read(SNAPSHOT_PATH);
+    mu_assert(read != NULL, "Snapshot_Read failed");
+    mu_assert(Hash_Equals(&read->id, &id), "Wrong id");
+
+    rc = Table_ForEachNode(table, read, (NodeOp)CompareNode);
+    mu_assert(rc == 0, "Node not read back");
+    rc = Table_ForEachNode(read, table, (NodeOp)CompareNode);
+    mu_assert(rc == 0, "Extra node read");
+
+    Table_DestroyNodes(read);
+    Table_Destroy(read);
+    Table_DestroyNodes(table);
+    Table_Destroy(table);
+
+    return NULL;
+}
+
+char *test_Snapshot_Corrupt()
+{
+    Hash id = { "snapshot id" };
+    Table *table = SavedTable(&id, 4);
+
+    int rc = Snapshot_Write(table, SNAPSHOT_PATH);
+    mu_assert(rc == 0, "Snapshot_Write failed");
+
+    FILE *file = fopen(SNAPSHOT_PATH, "r+b");
+    mu_assert(file != NULL, "fopen failed");
+    fseek(file, -1, SEEK_END);
+    fputc(0xff, file);
+    fclose(file);
+
+    mu_assert(Snapshot_Read(SNAPSHOT_PATH) == NULL, "Read a corrupt snapshot");
+
+    rc = Snapshot_Write(table, SNAPSHOT_PATH);
+    mu_assert(rc == 0, "Snapshot_Write failed");
+
+    file = fopen(SNAPSHOT_PATH, "r+b");
+    uint32_t version = SNAPSHOT_VERSION + 1;
+    fseek(file, offsetof(SnapshotHeader, version), SEEK_SET);
+    fwrite(&version, sizeof(version), 1, file);
+    fclose(file);
+
+    mu_assert(Snapshot_Read(SNAPSHOT_PATH) == NULL, "Read another version");
+    mu_assert(Snapshot_Read("tests/missing.tmp") == NULL, "Read a missing file");
+
+    Table_DestroyNodes(table);
+    Table_Destroy(table);
+
+    return NULL;
+}
+
+char *test_Dht_LoadTable()
+{
+    Hash id = { "snapshot id" };
+    Table *table = SavedTable(&id, CLIENT_LOAD_PINGS + 8);
+
+    int rc = Snapshot_Write(table, SNAPSHOT_PATH);
+    mu_assert(rc == 0, "Snapshot_Write failed");
+
+    Client *client = Client_Create(id, 0, 0, 0);
+
+    rc = Dht_LoadTable(client, SNAPSHOT_PATH);
+    mu_assert(rc == 0, "Dht_LoadTable failed");
+    mu_assert(client->table->has_replacements, "Lost has_replacements");
+
+    rc = Client_PingLoaded(client);
+    mu_assert(rc == 0, "Client_PingLoaded failed");
+    mu_assert(MessageQueue_Count(client->queries) == CLIENT_LOAD_PINGS,
+              "Wrong first batch");
+
+    rc = Client_PingLoaded(client);
+    mu_assert(MessageQueue_Count(client->queries) == CLIENT_LOAD_PINGS,
+              "Batches not paced");
+
+    client->load_ping_time--;
+    rc = Client_PingLoaded(client);
+    mu_assert(MessageQueue_Count(client->queries) == CLIENT_LOAD_PINGS + 8,
+              "Wrong second batch");
+    mu_assert(client->load_time == 0, "Loaded nodes left");
+
+    Hash other = { "other id" };
+    Client *stranger = Client_Create(other, 0, 0, 0);
+    mu_assert(Dht_LoadTable(stranger, SNAPSHOT_PATH) != 0, "Loaded another id");
+
+    remove(SNAPSHOT_PATH);
+
+    Client_Destroy(stranger);
+    Client_Destroy(client);
+    Table_DestroyNodes(table);
+    Table_Destroy(table);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_Snapshot_WriteRead);
+    mu_run_test(test_Snapshot_Corrupt);
+    mu_run_test(test_Dht_LoadTable);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
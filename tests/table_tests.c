@@ -1,6 +1,7 @@
 #include <time.h>
 
 #include "minunit.h"
+#include <dht/close.h>
 #include <dht/table.h>
 #include <lcthw/darray.h>
 
@@ -332,6 +333,106 @@ char *test_Table_GatherClosest()
     return NULL;
 }
 
+char *test_CloseNodes_Score()
+{
+    Hash target = {{ 0 }};
+    CloseNodes *close = CloseNodes_Create(&target);
+    mu_assert(close != NULL, "CloseNodes_Create failed");
+
+    Node **closer = MakeNodes(1, 0x10);
+    Node **nodes = MakeNodes(2 * BUCKET_K, 0x20);
+
+    /* A slow and unreliable node, but with a longer shared prefix */
+    Node_MarkTimeout(closer[0]);
+    int rc = CloseNodes_Add(close, closer[0]);
+    mu_assert(rc == 0, "CloseNodes_Add failed");
+
+    int j = 0;
+    for (j = 0; j < 2 * BUCKET_K; j++)
+    {
+        /* Every other node has replied quickly */
+        if (j % 2 == 0)
+            Node_MarkReply(nodes[j], 20);
+
+        rc = CloseNodes_Add(close, nodes[j]);
+        mu_assert(rc == 0, "CloseNodes_Add failed");
+    }
+
+    DArray *found = CloseNodes_GetNodes(close);
+    mu_assert(DArray_count(found) == BUCKET_K, "Wrong found count");
+    mu_assert(DArray_first(found) == closer[0], "Closest node not first");
+
+    for (j = 0; j < 2 * (BUCKET_K - 1); j += 2)
+        mu_assert(HasNode(found, nodes[j]), "Fast node missing");
+
+    mu_assert(!HasNode(found, nodes[1]), "Closer but slower node found");
+
+    for (j = 0; j < 2 * BUCKET_K; j++)
+        Node_Destroy(nodes[j]);
+
+    Node_Destroy(closer[0]);
+    CloseNodes_Destroy(close);
+    DArray_destroy(found);
+
+    free(closer);
+    free(nodes);
+
+    return NULL;
+}
+
+char *test_Table_InsertNode_Replacements()
+{
+    Hash id = {{ 0 }};
+    Table *table = Table_Create(&id);
+    table->has_replacements = 1;
+
+    Node **nodes = MakeNodes(BUCKET_K, 0x80);
+    Node **candidates = MakeNodes(BUCKET_REPLACEMENTS + 1, 0x90);
+
+    int i = 0;
+    for (i = 0; i < BUCKET_K; i++)
+    {
+        /* Questionable */
+        nodes[i]->reply_time -= NODE_RESPITE;
+
+        Table_InsertNodeResult result = Table_InsertNode(table, nodes[i]);
+        mu_assert(result.rc == OKAdded, "add");
+    }
+
+    Bucket *bucket = table->buckets[0];
+
+    for (i = 0; i <= BUCKET_REPLACEMENTS; i++)
+    {
+        Table_InsertNodeResult result = Table_InsertNode(table, candidates[i]);
+        mu_assert(result.rc == OKCached, "Candidate not cached");
+        mu_assert(result.bucket == bucket, "Wrong bucket");
+
+        Node *dropped = i < BUCKET_REPLACEMENTS ? NULL : candidates[0];
+        mu_assert(result.replaced == dropped, "Wrong candidate dropped");
+    }
+
+    Node_Destroy(candidates[0]);
+
+    for (i = 0; i < BUCKET_K; i++)
+        mu_assert(Bucket_ContainsNode(bucket, nodes[i]), "Incumbent replaced");
+
+    Node *replaced = Table_ReplaceNode(table, nodes[0]);
+    mu_assert(replaced == nodes[0], "Table_ReplaceNode failed");
+    mu_assert(Bucket_ContainsNode(bucket, candidates[BUCKET_REPLACEMENTS]),
+              "Not replaced by the most recent candidate");
+    mu_assert(bucket->replacement_count == BUCKET_REPLACEMENTS - 1,
+              "Wrong replacement count");
+
+    Node_Destroy(replaced);
+    Table_DestroyNodes(table);
+    Table_Destroy(table);
+
+    free(nodes);
+    free(candidates);
+
+    return NULL;
+}
+
 char *test_Table_FindNode_EmptyBucket()
 {
     Hash id = { "id" };
@@ -467,6 +568,88 @@ char *test_TableDump()
 }
 
 
+char *test_Table_RandomId()
+{
+    Hash id = { "table id" };
+    Table *table = Table_Create(&id);
+    RandomState *rs = RandomState_Create(42);
+
+    int i = 0;
+    for (i = 0; i < 4; i++)
+        mu_assert(Table_AddBucket(table) != NULL, "Table_AddBucket failed");
+
+    int j = 0;
+    for (i = 0; i < table->end; i++)
+    {
+        for (j = 0; j < 16; j++)
+        {
+            Hash random;
+            int rc = Table_RandomId(table, table->buckets[i], rs, &random);
+            mu_assert(rc == 0, "Table_RandomId failed");
+            mu_assert(Table_FindBucket(table, &random) == table->buckets[i],
+                      "Random id out of bucket");
+        }
+    }
+
+    RandomState_Destroy(rs);
+    Table_Destroy(table);
+
+    return NULL;
+}
+
+char *test_Table_IndexAddrs()
+{
+    Hash id = {{ 0 }};
+    Table *table = Table_Create(&id);
+
+    Hash first_id = {{ 0x80, 1 }};
+    Node first = { .id = first_id, .addr.s_addr = 1, .port = 1 };
+    int rc = Table_CopyAndAddNode(table, &first);
+    mu_assert(rc == 0, "Table_CopyAndAddNode failed");
+
+    rc = Table_IndexAddrs(table);
+    mu_assert(rc == 0, "Table_IndexAddrs failed");
+
+    Node *found = Table_FindNodeByAddr(table, &first);
+    mu_assert(found != NULL && Node_Same(found, &first), "Existing node not indexed");
+
+    Hash second_id = {{ 0x80, 2 }};
+    Node second = { .id = second_id, .addr.s_addr = 2, .port = 2 };
+    rc = Table_CopyAndAddNode(table, &second);
+    found = Table_FindNodeByAddr(table, &second);
+    mu_assert(found != NULL && Node_Same(found, &second), "Added node not indexed");
+
+    Node other_port = { .addr.s_addr = 2, .port = 3 };
+    mu_assert(Table_FindNodeByAddr(table, &other_port) == NULL, "Found by addr only");
+
+    /* A query with another id does not displace the node */
+    Hash new_id = {{ 0x80, 3 }};
+    Node renamed = { .id = new_id, .addr.s_addr = 2, .port = 2 };
+    rc = Table_MarkQuery(table, &renamed);
+    mu_assert(rc == 0, "Table_MarkQuery failed");
+    mu_assert(Table_FindNode(table, &second_id) != NULL, "Query replaced a node");
+
+    /* A reply does */
+    Message reply = { .type = RPing, .node = renamed };
+    rc = Table_MarkReply(table, &reply);
+    mu_assert(rc == 0, "Table_MarkReply failed");
+    mu_assert(Table_FindNode(table, &second_id) == NULL, "Stale id kept");
+
+    found = Table_FindNodeByAddr(table, &renamed);
+    mu_assert(found != NULL && Hash_Equals(&found->id, &new_id), "New id not indexed");
+    mu_assert(found->reply_time != 0, "Reply not marked");
+
+    found = Table_RemoveNode(table, found);
+    mu_assert(found != NULL, "Table_RemoveNode failed");
+    mu_assert(Table_FindNodeByAddr(table, &renamed) == NULL, "Removed node indexed");
+    Node_Destroy(found);
+
+    Table_DestroyNodes(table);
+    Table_Destroy(table);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
@@ -476,7 +659,11 @@ char *all_tests()
     mu_run_test(test_Table_InsertNode_FullTable);
     mu_run_test(test_Table_InsertNode_AddBucket);
     mu_run_test(test_Table_GatherClosest);
+    mu_run_test(test_CloseNodes_Score);
+    mu_run_test(test_Table_InsertNode_Replacements);
     mu_run_test(test_Table_FindNode_EmptyBucket);
+    mu_run_test(test_Table_RandomId);
+    mu_run_test(test_Table_IndexAddrs);
     mu_run_test(test_TableDump);
     mu_run_test(test_Table_ForEachCloseNode);
 
@@ -0,0 +1,122 @@
+#include "minunit.h"
+#include <dht/token.h>
+
+char *test_SipHash()
+{
+    unsigned char key[SIPHASH_KEY_BYTES];
+    unsigned char data[15];
+    unsigned char out[16];
+
+    int i = 0;
+    for (i = 0; i < SIPHASH_KEY_BYTES; i++)
+        key[i] = i;
+
+    for (i = 0; i < 15; i++)
+        data[i] = i;
+
+    /* The test vectors of the reference implementation */
+    unsigned char empty64[] = { 0x31, 0x0e, 0x0e, 0xdd, 0x47, 0xdb, 0x6f, 0x72 };
+    unsigned char full64[] = { 0xe5, 0x45, 0xbe, 0x49, 0x61, 0xca, 0x29, 0xa1 };
+    unsigned char empty128[] = { 0xa3, 0x81, 0x7f, 0x04, 0xba, 0x25, 0xa8, 0xe6,
+                                 0x6d, 0xf6, 0x72, 0x14, 0xc7, 0x55, 0x02, 0x93 };
+
+    SipHash(key, data, 0, out, 8);
+    mu_assert(memcmp(out, empty64, 8) == 0, "Wrong SipHash of no data");
+
+    SipHash(key, data, 15, out, 8);
+    mu_assert(memcmp(out, full64, 8) == 0, "Wrong SipHash of 15 bytes");
+
+    SipHash(key, data, 0, out, 16);
+    mu_assert(memcmp(out, empty128, 16) == 0, "Wrong 128 bit SipHash");
+
+    return NULL;
+}
+
+char *test_Token_Schemes()
+{
+    RandomState *random = RandomState_Create(0);
+    TokenSecrets secrets = { 0 };
+    Node node_a = {{{ 0 }}};
+    Node node_b = {{{ 0 }}};
+    node_a.addr.s_addr = 1;
+    node_b.addr.s_addr = 2;
+
+    int rc = TokenSecrets_Init(&secrets, random, 1000);
+    mu_assert(rc == 0, "TokenSecrets_Init failed");
+
+    TokenScheme schemes[] = { TokenSipHash, TokenSha1 };
+
+    int i = 0;
+    for (i = 0; i < 2; i++)
+    {
+        secrets.scheme = schemes[i];
+
+        Token token = Token_Make(&secrets, &node_a);
+
+        mu_assert(Token_IsValid(&secrets, &node_a, token.value, HASH_BYTES),
+                  "Token should be valid");
+        mu_assert(!Token_IsValid(&secrets, &node_b, token.value, HASH_BYTES),
+                  "Token valid for another node");
+        mu_assert(!Token_IsValid(&secrets, &node_a, token.value, HASH_BYTES - 1),
+                  "Short token valid");
+
+        token.value[HASH_BYTES - 1] ^= 1;
+        mu_assert(!Token_IsValid(&secrets, &node_a, token.value, HASH_BYTES),
+                  "Altered token valid");
+    }
+
+    /* A SipHash token of a future generation */
+    secrets.scheme = TokenSipHash;
+    Token token = Token_Make(&secrets, &node_a);
+    secrets.generation--;
+    mu_assert(!Token_IsValid(&secrets, &node_a, token.value, HASH_BYTES),
+              "Token of an unknown secret valid");
+
+    RandomState_Destroy(random);
+
+    return NULL;
+}
+
+char *test_TokenSecrets_Update()
+{
+    RandomState *random = RandomState_Create(0);
+    TokenSecrets secrets = { 0 };
+    Node node = {{{ 0 }}};
+
+    TokenSecrets_Init(&secrets, random, 1000);
+    Token token = Token_Make(&secrets, &node);
+
+    int rc = TokenSecrets_Update(&secrets, random, 1000 + TOKEN_ROTATE_INTERVAL - 1);
+    mu_assert(rc == 0, "Rotated too soon");
+
+    int i = 0;
+    for (i = 1; i < TOKEN_SECRETS; i++)
+    {
+        rc = TokenSecrets_Update(&secrets, random, 1000 + i * TOKEN_ROTATE_INTERVAL);
+        mu_assert(rc == 1, "Not rotated");
+        mu_assert(Token_IsValid(&secrets, &node, token.value, HASH_BYTES),
+                  "Token should still be valid");
+    }
+
+    rc = TokenSecrets_Update(&secrets, random, 1000 + i * TOKEN_ROTATE_INTERVAL);
+    mu_assert(rc == 1, "Not rotated");
+    mu_assert(!Token_IsValid(&secrets, &node, token.value, HASH_BYTES),
+              "Token should now be invalid");
+
+    RandomState_Destroy(random);
+
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_SipHash);
+    mu_run_test(test_Token_Schemes);
+    mu_run_test(test_TokenSecrets_Update);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -1,6 +1,8 @@
 #include "minunit.h"
 #include <dht/client.h>
+#include <dht/handle.h>
 #include <dht/network.h>
+#include <dht/search.h>
 #include <dht/work.h>
 #include <dht/message_create.h>
 
@@ -57,11 +59,277 @@ char *test_Client_SendReceive()
     return NULL;
 }
 
+char *test_Client_PingQuestionable()
+{
+    Hash id = {{ 0 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+    Node *nodes[BUCKET_K];
+
+    int i = 0;
+    for (i = 0; i < BUCKET_K; i++)
+    {
+        Hash node_id = {{ 0x80, i }};
+        nodes[i] = Node_Create(&node_id);
+        nodes[i]->reply_time = Clock_Time(&client->clock) - NODE_RESPITE;
+
+        Table_InsertNodeResult result = Table_InsertNode(client->table, nodes[i]);
+        mu_assert(result.rc == OKAdded, "Table_InsertNode failed");
+    }
+
+    int rc = Client_PingQuestionable(client);
+    mu_assert(rc == 0, "Client_PingQuestionable failed");
+    mu_assert(MessageQueue_Count(client->queries) == 0, "Pinged without candidates");
+
+    Hash candidate_id = {{ 0x90 }};
+    Node candidate = { .id = candidate_id,
+                       .reply_time = Clock_Time(&client->clock) };
+
+    rc = Table_CopyAndAddNode(client->table, &candidate);
+    mu_assert(rc == 0, "Table_CopyAndAddNode failed");
+    mu_assert(Table_FindNode(client->table, &candidate_id) == NULL,
+              "Questionable node replaced");
+
+    rc = Client_PingQuestionable(client);
+    mu_assert(rc == 0, "Client_PingQuestionable failed");
+    mu_assert(MessageQueue_Count(client->queries) == BUCKET_K, "Wrong ping count");
+
+    rc = Client_PingQuestionable(client);
+    mu_assert(MessageQueue_Count(client->queries) == BUCKET_K, "Pinged twice");
+
+    /* The first ping times out */
+    Message *ping = MessageQueue_Pop(client->queries);
+    PendingResponse entry = { .type = RPing,
+                              .tid = *(tid_t *)ping->t,
+                              .id = ping->node.id };
+    rc = client->pending->addPendingResponse(client->pending, entry);
+    mu_assert(rc == 0, "addPendingResponse failed");
+    Message_Destroy(ping);
+
+    rc = Client_ExpireQueries(client);
+    mu_assert(rc == 0, "Client_ExpireQueries failed");
+    mu_assert(Table_FindNode(client->table, &candidate_id) == NULL,
+              "Replaced after a single timeout");
+
+    /* Pinged again after a timeout, and that ping times out too */
+    MessageQueue_Clear(client->queries);
+    client->clock.now_ms += RttStats_Timeout(&client->rtt);
+
+    rc = Client_PingQuestionable(client);
+    mu_assert(rc == 0, "Client_PingQuestionable failed");
+    mu_assert(MessageQueue_Count(client->queries) == BUCKET_K, "Not pinged again");
+
+    entry.tid++;
+    entry.sent_ms = Clock_Now(&client->clock) - RttStats_Timeout(&client->rtt) - 1;
+    rc = client->pending->addPendingResponse(client->pending, entry);
+    mu_assert(rc == 0, "addPendingResponse failed");
+
+    rc = Client_ExpireQueries(client);
+    mu_assert(rc == 0, "Client_ExpireQueries failed");
+    mu_assert(Table_FindNode(client->table, &candidate_id) != NULL,
+              "Timed out node not replaced");
+    mu_assert(Table_FindNode(client->table, &entry.id) == NULL,
+              "Timed out node still in table");
+
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_Client_RefreshBuckets()
+{
+    Hash id = {{ 0 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+
+    int i = 0;
+    for (i = 0; i < 4; i++)
+    {
+        Hash node_id = {{ 0x80, i }};
+        Node node = { .id = node_id,
+                      .reply_time = Clock_Time(&client->clock) };
+
+        int rc = Table_CopyAndAddNode(client->table, &node);
+        mu_assert(rc == 0, "Table_CopyAndAddNode failed");
+    }
+
+    int rc = Client_RefreshBuckets(client);
+    mu_assert(rc == 0, "Client_RefreshBuckets failed");
+    mu_assert(DArray_count(client->searches) == 0, "Refreshed a fresh bucket");
+
+    Bucket *bucket = client->table->buckets[0];
+    bucket->change_time = Clock_Time(&client->clock) - CLIENT_REFRESH_AGE;
+
+    rc = Client_RefreshBuckets(client);
+    mu_assert(rc == 0, "Client_RefreshBuckets failed");
+    mu_assert(DArray_count(client->searches) == 1, "Stale bucket not refreshed");
+    mu_assert(bucket->change_time == client->refresh_time, "Bucket not touched");
+
+    Search *search = DArray_first(client->searches);
+    mu_assert(search->flags == SearchRefresh, "Not a refresh");
+    mu_assert(Table_FindBucket(client->table, &search->table->id) == bucket,
+              "Target out of bucket");
+
+    bucket->change_time = Clock_Time(&client->clock) - CLIENT_REFRESH_AGE;
+    client->refresh_time = 0;
+
+    rc = Client_RefreshBuckets(client);
+    mu_assert(DArray_count(client->searches) == 1, "Refreshes overlap");
+
+    rc = Search_DoWork(client, search);
+    mu_assert(rc == 0, "Search_DoWork failed");
+    mu_assert(MessageQueue_Count(client->queries) == 4, "Wrong query count");
+
+    while (MessageQueue_Count(client->queries) > 0)
+    {
+        Message *query = MessageQueue_Pop(client->queries);
+        mu_assert(query->type == QFindNode, "Expected find_node only");
+        Message_Destroy(query);
+    }
+
+    search->is_done = 1;
+    Client_CleanSearches(client);
+
+    mu_assert(client->refreshing == 0, "Refresh still running");
+    mu_assert(client->refresh.refreshes == 1, "Wrong refreshes");
+    mu_assert(client->refresh.queries == 4, "Refresh queries not accounted");
+
+    Client_Destroy(client);
+
+    return NULL;
+}
+
+char *test_Client_EndedSearch()
+{
+    Hash id = {{ 0 }};
+    Hash from_id = {{ 0x80 }};
+    Hash target = {{ 0x81 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+    Client *from = Client_Create(from_id, 1, 1, 1);
+
+    Node node = { .id = from_id,
+                  .addr = from->node.addr,
+                  .port = from->node.port,
+                  .reply_time = Clock_Time(&client->clock) };
+
+    int rc = Table_CopyAndAddNode(client->table, &node);
+    mu_assert(rc == 0, "Table_CopyAndAddNode failed");
+
+    Search *ended = Client_AddSearch(client, &target);
+    mu_assert(ended != NULL, "Client_AddSearch failed");
+
+    uint32_t serial = ended->serial;
+    mu_assert(Client_GetSearch(client, serial) == ended, "Search not found");
+
+    ended->is_done = 1;
+    Client_CleanSearches(client);
+    mu_assert(Client_GetSearch(client, serial) == NULL, "Ended search found");
+
+    /* Likely at the address of the ended one */
+    Search *search = Client_AddSearch(client, &target);
+    mu_assert(search != NULL, "Client_AddSearch failed");
+    mu_assert(search->serial != serial, "Serial reused");
+
+    Node *copy = Table_FindNode(search->table, &from_id);
+    mu_assert(copy != NULL, "Node not copied");
+
+    rc = Search_DoWork(client, search);
+    mu_assert(rc == 0, "Search_DoWork failed");
+    mu_assert(copy->pending_queries == 1, "Node not queried");
+    MessageQueue_Clear(client->queries);
+
+    /* A reply to the ended search is an orphan */
+    Message *query = Message_CreateQFindNode(client, &node, &target);
+    Message *reply = HandleQFindNode(from, query);
+    mu_assert(reply != NULL, "HandleQFindNode failed");
+
+    reply->node = node;
+    reply->search = serial;
+
+    rc = MessageQueue_Push(client->incoming, reply);
+    mu_assert(rc == 0, "MessageQueue_Push failed");
+
+    rc = Client_HandleMessages(client);
+    mu_assert(rc == 0, "Client_HandleMessages failed");
+    mu_assert(search->stats.replies == 0, "Reply taken by a new search");
+
+    /* And so is its timeout */
+    PendingResponse entry = { .type = RFindNode,
+                              .tid = 1,
+                              .id = from_id,
+                              .search = serial,
+                              .sent_ms = Clock_Now(&client->clock)
+                                         - RttStats_Timeout(&client->rtt) - 1 };
+    rc = client->pending->addPendingResponse(client->pending, entry);
+    mu_assert(rc == 0, "addPendingResponse failed");
+
+    rc = Client_ExpireQueries(client);
+    mu_assert(rc == 0, "Client_ExpireQueries failed");
+    mu_assert(copy->failures == 0, "Timeout taken by a new search");
+
+    Message_Destroy(query);
+    Client_Destroy(client);
+    Client_Destroy(from);
+
+    return NULL;
+}
+
+char *test_Client_SearchTimeoutBackoff()
+{
+    Hash id = {{ 0 }};
+    Hash node_id = {{ 0x80 }};
+    Hash target = {{ 0x81 }};
+    Client *client = Client_Create(id, 0, 0, 0);
+
+    Node node = { .id = node_id,
+                  .addr.s_addr = 1,
+                  .port = 1,
+                  .reply_time = Clock_Time(&client->clock) };
+
+    int rc = Table_CopyAndAddNode(client->table, &node);
+    mu_assert(rc == 0, "Table_CopyAndAddNode failed");
+
+    Search *search = Client_AddSearch(client, &target);
+    mu_assert(search != NULL, "Client_AddSearch failed");
+
+    rc = Search_DoWork(client, search);
+    mu_assert(rc == 0, "Search_DoWork failed");
+    MessageQueue_Clear(client->queries);
+
+    PendingResponse entry = { .type = RFindNode,
+                              .tid = 1,
+                              .id = node_id,
+                              .search = search->serial,
+                              .sent_ms = Clock_Now(&client->clock)
+                                         - RttStats_Timeout(&client->rtt) - 1 };
+    rc = client->pending->addPendingResponse(client->pending, entry);
+    mu_assert(rc == 0, "addPendingResponse failed");
+
+    rc = Client_ExpireQueries(client);
+    mu_assert(rc == 0, "Client_ExpireQueries failed");
+
+    Node *known = Table_FindNode(client->table, &node_id);
+    mu_assert(known != NULL, "Node dropped after one timeout");
+    mu_assert(known->sent_ms == Clock_Now(&client->clock), "Timeout not noted");
+
+    /* Left out of the next search while backed off */
+    Search *next = Client_AddSearch(client, &target);
+    mu_assert(next != NULL, "Client_AddSearch failed");
+    mu_assert(Table_FindNode(next->table, &node_id) == NULL,
+              "Backed off node copied");
+
+    Client_Destroy(client);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
 
     mu_run_test(test_Client_SendReceive);
+    mu_run_test(test_Client_PingQuestionable);
+    mu_run_test(test_Client_RefreshBuckets);
+    mu_run_test(test_Client_EndedSearch);
+    mu_run_test(test_Client_SearchTimeoutBackoff);
 
     return NULL;
 }